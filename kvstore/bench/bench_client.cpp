@@ -0,0 +1,80 @@
+#include "bench_client.hpp"
+
+bool BenchClient::Get(const std::string& key) {
+    auto server = this->server_for(key);
+    return server && this->call(*server, GetRequest{key});
+}
+
+bool BenchClient::Put(const std::string& key, const std::string& value) {
+    auto server = this->server_for(key);
+    return server && this->call(*server, PutRequest{key, value});
+}
+
+bool BenchClient::MultiGet(const std::vector<std::string>& keys) {
+    auto groups = this->group(keys);
+    if (!groups) return false;
+    for (auto&& [server, indices] : *groups) {
+        MultiGetRequest req;
+        for (size_t i : indices) req.keys.push_back(keys[i]);
+        if (!this->call(server, req)) return false;
+    }
+    return true;
+}
+
+bool BenchClient::MultiPut(const std::vector<std::string>& keys,
+                           const std::vector<std::string>& values) {
+    auto groups = this->group(keys);
+    if (!groups) return false;
+    for (auto&& [server, indices] : *groups) {
+        MultiPutRequest req;
+        for (size_t i : indices) {
+            req.keys.push_back(keys[i]);
+            req.values.push_back(values[i]);
+        }
+        if (!this->call(server, req)) return false;
+    }
+    return true;
+}
+
+std::optional<std::string> BenchClient::server_for(
+    const std::string& key) const {
+    if (!this->config) return this->server;
+    return this->config->get_server(key);
+}
+
+std::optional<std::map<std::string, std::vector<size_t>>> BenchClient::group(
+    const std::vector<std::string>& keys) const {
+    std::map<std::string, std::vector<size_t>> groups;
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto server = this->server_for(keys[i]);
+        if (!server) return std::nullopt;
+        groups[*server].push_back(i);
+    }
+    return groups;
+}
+
+std::optional<Response> BenchClient::call(const std::string& server,
+                                          const Request& req) {
+    // Reads that don't fit in a datagram fall back to the connection, rather
+    // than one of their own that would need another of the server's workers
+    std::optional<Response> res;
+    if (this->udp && (std::holds_alternative<GetRequest>(req) ||
+                      std::holds_alternative<MultiGetRequest>(req))) {
+        auto& client = this->udp_clients[server];
+        if (!client) client = std::make_unique<UdpClient>(server);
+        res = client->call_udp(req);
+    }
+    if (!res) {
+        auto& conn = this->conns[server];
+        if (!conn) conn = connect_to_server(server);
+        if (!conn) return std::nullopt;
+
+        if (conn->send_request(req)) res = conn->recv_response();
+        if (!res) {
+            conn.reset();
+            return std::nullopt;
+        }
+    }
+    if (std::holds_alternative<ErrorResponse>(*res)) return std::nullopt;
+    return res;
+}
@@ -0,0 +1,60 @@
+#ifndef BENCH_CLIENT_HPP
+#define BENCH_CLIENT_HPP
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "client/udp_client.hpp"
+#include "common/config.hpp"
+#include "net/network_conn.hpp"
+
+// A benchmark thread's view of the cluster. Unlike SimpleClient, which opens a
+// connection for every request, it keeps one connection per server open, so
+// that latencies measure the server rather than connection setup. Keys are
+// routed with a config fetched once up front; the cluster is assumed not to
+// change during a run, and failed requests aren't retried.
+class BenchClient {
+ public:
+  // Sends everything to `server`
+  explicit BenchClient(std::string server) : server(std::move(server)) {
+  }
+  // Routes keys by `config`
+  explicit BenchClient(ShardControllerConfig config)
+      : config(std::move(config)) {
+  }
+
+  bool Get(const std::string& key);
+  bool Put(const std::string& key, const std::string& value);
+  // Reads all of `keys` (one MultiGet per server)
+  bool MultiGet(const std::vector<std::string>& keys);
+  // Writes all of `keys` (one MultiPut per server)
+  bool MultiPut(const std::vector<std::string>& keys,
+                const std::vector<std::string>& values);
+
+  // Sends Gets and MultiGets over UDP from now on (see UdpClient), for
+  // servers that serve them that way
+  void read_over_udp() {
+    this->udp = true;
+  }
+
+ private:
+  std::string server;
+  std::optional<ShardControllerConfig> config;
+  std::map<std::string, std::shared_ptr<ServerConn>> conns;
+  bool udp = false;
+  std::map<std::string, std::unique_ptr<UdpClient>> udp_clients;
+
+  std::optional<std::string> server_for(const std::string& key) const;
+  // Groups the indices of `keys` by the server they go to
+  std::optional<std::map<std::string, std::vector<size_t>>> group(
+      const std::vector<std::string>& keys) const;
+  // Sends `req` to `server` and waits for its response, reconnecting first if
+  // the last request on the connection failed (or over UDP, for reads if
+  // read_over_udp). Error responses count as failures.
+  std::optional<Response> call(const std::string& server, const Request& req);
+};
+
+#endif /* end of include guard */
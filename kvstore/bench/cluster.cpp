@@ -0,0 +1,63 @@
+#include "cluster.hpp"
+
+#include <thread>
+
+#include "bench/workload.hpp"
+#include "client/shardkv_client.hpp"
+#include "common/shard.hpp"
+#include "common/utils.hpp"
+#include "shardcontroller/static_shardcontroller.hpp"
+
+bool LocalCluster::start(size_t n_servers, uint64_t port, size_t n_workers,
+                         std::string& server,
+                         std::string& shardcontroller_addr, bool udp) {
+    if (n_servers == 1) {
+        server = get_host_address(std::to_string(port).c_str());
+        this->servers.push_back(
+            std::make_shared<KvServer>(server, n_workers, udp));
+        return this->servers.back()->start() >= 0;
+    }
+
+    shardcontroller_addr = get_host_address(std::to_string(port).c_str());
+    this->shardcontroller = std::make_shared<StaticShardController>(
+        shardcontroller_addr, RebalancePolicy{}, ShardingMode::HASH);
+    if (this->shardcontroller->start() < 0) return false;
+
+    std::vector<std::string> addresses;
+    for (size_t i = 0; i < n_servers; i++) {
+        addresses.push_back(
+            get_host_address(std::to_string(port + 1 + i).c_str()));
+        this->servers.push_back(std::make_shared<KvServer>(
+            addresses.back(), shardcontroller_addr, n_workers, udp));
+        if (this->servers.back()->start() < 0) return false;
+    }
+    ShardKvClient client(shardcontroller_addr);
+    std::vector<Shard> shards = split_into(n_servers);
+    for (size_t i = 0; i < n_servers; i++) {
+        if (!client.Move(addresses[i], {shards[i]})) return false;
+    }
+    // Let the servers pick up the config
+    std::this_thread::sleep_for(500ms);
+    return true;
+}
+
+bool LocalCluster::start_per_core(uint64_t port, size_t n_cores,
+                                  std::string& server) {
+    server = get_host_address(std::to_string(port).c_str());
+    this->core_server = std::make_shared<CoreServer>(server, n_cores);
+    return this->core_server->start() >= 0;
+}
+
+bool load_records(BenchClient& loader, uint64_t n_records, size_t value_size) {
+    std::vector<std::string> keys, values;
+    for (uint64_t r = 0; r < n_records; r++) {
+        keys.push_back(record_key(r));
+        values.emplace_back(value_size, 'x');
+        if (keys.size() == LOAD_BATCH_SIZE || r + 1 == n_records) {
+            if (!loader.MultiPut(keys, values)) return false;
+            keys.clear();
+            values.clear();
+        }
+    }
+    return true;
+}
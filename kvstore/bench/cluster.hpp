@@ -0,0 +1,41 @@
+#ifndef BENCH_CLUSTER_HPP
+#define BENCH_CLUSTER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench/bench_client.hpp"
+#include "server/core_server.hpp"
+#include "server/server.hpp"
+#include "shardcontroller/shardcontroller.hpp"
+
+// Records are loaded this many at a time
+constexpr size_t LOAD_BATCH_SIZE = 500;
+
+// The servers (and, for more than one, a shardcontroller hashing keys over
+// them, each owning an equal part of the key space) that a benchmark runs
+// against, when no running cluster was given. Each connection occupies one of
+// a server's workers, so they need a worker per connection a benchmark keeps
+// to them.
+struct LocalCluster {
+  std::shared_ptr<Shardcontroller> shardcontroller;
+  std::vector<std::shared_ptr<KvServer>> servers;
+  std::shared_ptr<CoreServer> core_server;
+
+  // Starts `n_servers` servers, listening from `port` up (after the
+  // shardcontroller, if there is one), and sets the address to send requests
+  // to: `server` for a single server, otherwise `shardcontroller_addr`. With
+  // `udp`, the servers also serve reads over UDP.
+  bool start(size_t n_servers, uint64_t port, size_t n_workers,
+             std::string& server, std::string& shardcontroller_addr,
+             bool udp = false);
+  // Starts a single CoreServer with `n_cores` cores instead, which keeps
+  // nothing per connection, on `port`
+  bool start_per_core(uint64_t port, size_t n_cores, std::string& server);
+};
+
+// Writes records 0 to `n_records` - 1, each with a value of `value_size` bytes
+bool load_records(BenchClient& loader, uint64_t n_records, size_t value_size);
+
+#endif /* end of include guard */
@@ -0,0 +1,58 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram()
+    : counts((64 - SUB_BITS + 1) * SUB_BUCKETS) {
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    this->counts[index_of(ns)]++;
+    this->total++;
+    this->largest = std::max(this->largest, ns);
+    this->sum += static_cast<double>(ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < this->counts.size(); i++) {
+        this->counts[i] += other.counts[i];
+    }
+    this->total += other.total;
+    this->largest = std::max(this->largest, other.largest);
+    this->sum += other.sum;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    if (this->total == 0) return 0;
+    auto rank = static_cast<uint64_t>(
+        std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(this->total)));
+    rank = std::max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < this->counts.size(); i++) {
+        seen += this->counts[i];
+        if (seen >= rank) return std::min(highest_in(i), this->largest);
+    }
+    return this->largest;
+}
+
+double LatencyHistogram::mean() const {
+    return this->total ? this->sum / static_cast<double>(this->total) : 0;
+}
+
+size_t LatencyHistogram::index_of(uint64_t ns) {
+    // Values below 2 * SUB_BUCKETS are counted exactly; above that, each
+    // power of two gets SUB_BUCKETS buckets, indexed by the value's top bits
+    if (ns < 2 * SUB_BUCKETS) return ns;
+    size_t shift = std::bit_width(ns) - 1 - SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + ((ns >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::highest_in(size_t index) {
+    if (index < 2 * SUB_BUCKETS) return index;
+    size_t shift = index / SUB_BUCKETS - 1;
+    uint64_t lowest = (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t(1) << shift) - 1);
+}
@@ -0,0 +1,47 @@
+#ifndef BENCH_HISTOGRAM_HPP
+#define BENCH_HISTOGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Latencies (in nanoseconds) counted in log-linear buckets, as in an HDR
+// histogram: each power of two is split into 2^SUB_BITS equal sub-buckets, so
+// every value is known to within 1/2^SUB_BITS (under 1%), and the whole 64-bit
+// range fits in a few thousand counters. Recording is a couple of shifts and
+// an increment; histograms of the same layout merge by adding counters.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void record(uint64_t ns);
+  void merge(const LatencyHistogram& other);
+
+  // The smallest recorded value (rounded up to its bucket) that at least a
+  // fraction `q` of the values don't exceed, or 0 if there are none.
+  uint64_t percentile(double q) const;
+
+  uint64_t count() const {
+    return this->total;
+  }
+  uint64_t max() const {
+    return this->largest;
+  }
+  double mean() const;
+
+ private:
+  static constexpr size_t SUB_BITS = 7;
+  static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BITS;
+
+  std::vector<uint64_t> counts;
+  uint64_t total = 0;
+  uint64_t largest = 0;
+  // Summed as a double, which can't overflow
+  double sum = 0;
+
+  static size_t index_of(uint64_t ns);
+  // The largest value that lands in bucket `index`
+  static uint64_t highest_in(size_t index);
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,228 @@
+#include "open_loop.hpp"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <thread>
+
+OpenLoopGenerator::OpenLoopGenerator(std::string server, size_t n_lanes)
+    : server(std::move(server)), n_lanes(n_lanes), lanes(n_lanes) {
+}
+
+OpenLoopGenerator::OpenLoopGenerator(ShardControllerConfig config,
+                                     size_t n_lanes)
+    : config(std::move(config)), n_lanes(n_lanes), lanes(n_lanes) {
+}
+
+bool OpenLoopGenerator::supports(const Workload& workload) {
+    return workload.scan == 0 && workload.read_modify_write == 0;
+}
+
+bool OpenLoopGenerator::connect() {
+    for (auto&& lane : this->lanes) {
+        for (auto&& server : this->servers()) {
+            auto& pipeline = lane[server];
+            if (!pipeline) pipeline = std::make_unique<Pipeline>();
+            if (pipeline->conn) continue;
+            pipeline->conn = connect_to_server(server);
+            if (!pipeline->conn) return false;
+            // With requests pipelined, Nagle's algorithm would hold each one
+            // back until the last is acknowledged
+            int yes = 1;
+            if (setsockopt(pipeline->conn->fd, IPPROTO_TCP, TCP_NODELAY, &yes,
+                           sizeof(yes)) < 0) {
+                perror_color(YELLOW, "setsockopt");
+            }
+        }
+    }
+    return true;
+}
+
+OpenLoopResult OpenLoopGenerator::run(const Workload& workload, double rate,
+                                      std::chrono::milliseconds duration,
+                                      size_t value_size,
+                                      std::atomic<uint64_t>& n_records,
+                                      std::chrono::milliseconds drain_timeout) {
+    // Each thread tallies its own part, merged at the end
+    std::vector<OpenLoopResult> sent(this->n_lanes);
+    std::vector<OpenLoopResult> received;
+    std::vector<Pipeline*> pipelines;
+    for (auto&& lane : this->lanes) {
+        for (auto&& [_, pipeline] : lane) {
+            std::unique_lock lock(pipeline->mtx);
+            pipeline->done = false;
+            pipeline->failed = !pipeline->conn;
+            pipelines.push_back(pipeline.get());
+        }
+    }
+    received.resize(pipelines.size());
+
+    // Leave the threads a moment to start before the first send is due
+    auto start = Clock::now() + std::chrono::milliseconds(10);
+    auto end = start + duration;
+    std::vector<std::thread> receivers;
+    for (size_t i = 0; i < pipelines.size(); i++) {
+        receivers.emplace_back(
+            [&, i] { receive(*pipelines[i], received[i]); });
+    }
+    std::vector<std::thread> senders;
+    for (size_t lane = 0; lane < this->n_lanes; lane++) {
+        senders.emplace_back([&, lane] {
+            this->send(lane, workload, rate, start, end, value_size, n_records,
+                       sent[lane]);
+        });
+    }
+    for (auto&& thread : senders) thread.join();
+
+    // Let the receivers finish once the responses are in, and cut off the
+    // connections whose responses don't come in time
+    for (auto* pipeline : pipelines) {
+        std::unique_lock lock(pipeline->mtx);
+        pipeline->done = true;
+        pipeline->cv.notify_all();
+    }
+    auto deadline = Clock::now() + drain_timeout;
+    for (auto* pipeline : pipelines) {
+        std::unique_lock lock(pipeline->mtx);
+        if (!pipeline->cv.wait_until(lock, deadline, [&] {
+                return pipeline->in_flight.empty();
+            }) &&
+            pipeline->conn) {
+            pipeline->conn->shutdown();
+        }
+    }
+    for (auto&& thread : receivers) thread.join();
+    auto finished = Clock::now();
+
+    OpenLoopResult total;
+    total.offered = rate;
+    total.elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(finished - start);
+    for (auto&& part : sent) {
+        total.n_ops += part.n_ops;
+        total.n_errors += part.n_errors;
+        total.send_lag.merge(part.send_lag);
+    }
+    for (auto&& part : received) {
+        total.n_errors += part.n_errors;
+        total.latencies.merge(part.latencies);
+    }
+    double seconds = std::max<double>(total.elapsed.count(), 1) / 1000.0;
+    total.achieved = (total.n_ops - total.n_errors) / seconds;
+
+    for (auto* pipeline : pipelines) {
+        if (pipeline->failed && pipeline->conn) {
+            pipeline->conn->close();
+            pipeline->conn.reset();
+        }
+    }
+    return total;
+}
+
+std::vector<std::string> OpenLoopGenerator::servers() const {
+    if (!this->config) return {this->server};
+    std::vector<std::string> servers;
+    for (auto&& [server, _] : this->config->server_to_shards) {
+        servers.push_back(server);
+    }
+    return servers;
+}
+
+std::optional<std::string> OpenLoopGenerator::server_for(
+    const std::string& key) const {
+    if (!this->config) return this->server;
+    return this->config->get_server(key);
+}
+
+void OpenLoopGenerator::send(size_t lane, const Workload& workload,
+                             double rate, Clock::time_point start,
+                             Clock::time_point end, size_t value_size,
+                             std::atomic<uint64_t>& n_records,
+                             OpenLoopResult& result) {
+    KeyChooser chooser(workload.distribution, n_records.load(),
+                       (uint64_t(workload.name) << 32) + lane);
+    std::string value(value_size, 'x');
+    for (auto& c : value) c = 'a' + chooser.rng()() % 26;
+
+    for (uint64_t slot = lane;; slot += this->n_lanes) {
+        // Computed from the slot rather than accumulated, so that rounding
+        // doesn't drift the schedule
+        auto intended = start + std::chrono::nanoseconds(static_cast<int64_t>(
+                                    static_cast<double>(slot) * 1e9 / rate));
+        if (intended >= end) break;
+        std::this_thread::sleep_until(intended);
+
+        Request req;
+        std::string key;
+        switch (workload.pick(chooser.uniform())) {
+            case OpType::READ:
+                key = record_key(chooser.next(n_records.load()));
+                req = GetRequest{key};
+                break;
+            case OpType::INSERT:
+                key = record_key(n_records.fetch_add(1));
+                req = PutRequest{key, value};
+                break;
+            default:
+                key = record_key(chooser.next(n_records.load()));
+                req = PutRequest{key, value};
+                break;
+        }
+        result.n_ops++;
+        auto server = this->server_for(key);
+        if (!server || !this->lanes[lane].contains(*server)) {
+            result.n_errors++;
+            continue;
+        }
+        Pipeline* pipeline = this->lanes[lane][*server].get();
+        {
+            std::unique_lock lock(pipeline->mtx);
+            if (pipeline->failed) {
+                result.n_errors++;
+                continue;
+            }
+            pipeline->in_flight.push_back(intended);
+        }
+        pipeline->cv.notify_all();
+
+        result.send_lag.record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                                 intended)
+                .count());
+        // The receiver sees the failure too, and counts what's outstanding
+        if (!pipeline->conn->send_request(req)) pipeline->conn->shutdown();
+    }
+}
+
+void OpenLoopGenerator::receive(Pipeline& pipeline, OpenLoopResult& result) {
+    while (true) {
+        Clock::time_point intended;
+        {
+            std::unique_lock lock(pipeline.mtx);
+            pipeline.cv.wait(lock, [&] {
+                return !pipeline.in_flight.empty() || pipeline.done;
+            });
+            if (pipeline.in_flight.empty()) return;
+            intended = pipeline.in_flight.front();
+        }
+
+        // Only this thread pops, so the front stays put meanwhile
+        std::optional<Response> res = pipeline.conn->recv_response();
+        auto now = Clock::now();
+
+        std::unique_lock lock(pipeline.mtx);
+        if (!res) {
+            result.n_errors += pipeline.in_flight.size();
+            pipeline.in_flight.clear();
+            pipeline.failed = true;
+            pipeline.cv.notify_all();
+            return;
+        }
+        pipeline.in_flight.pop_front();
+        pipeline.cv.notify_all();
+        result.latencies.record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - intended)
+                .count());
+        result.n_errors += std::holds_alternative<ErrorResponse>(*res);
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef BENCH_OPEN_LOOP_HPP
+#define BENCH_OPEN_LOOP_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "bench/histogram.hpp"
+#include "bench/workload.hpp"
+#include "common/config.hpp"
+#include "net/network_conn.hpp"
+
+struct OpenLoopResult {
+  // Requests per second scheduled, and completed successfully
+  double offered = 0;
+  double achieved = 0;
+  // From the first intended send until the last response
+  std::chrono::milliseconds elapsed{0};
+  // Operations scheduled, and those that failed or got no response
+  uint64_t n_ops = 0;
+  uint64_t n_errors = 0;
+  // From when each request was meant to be sent until its response arrived
+  LatencyHistogram latencies;
+  // How far behind schedule requests were actually sent. If this grows, the
+  // generator itself couldn't keep up, and the offered rate wasn't reached.
+  LatencyHistogram send_lag;
+};
+
+// Offers load at a fixed rate, whatever the servers' response times are.
+//
+// A closed-loop client only sends its next request once the last one
+// returns, so while a server stalls, the requests that would have queued up
+// behind the stall are never sent, and their delay is never measured
+// ("coordinated omission"). Here, every request has an intended send time on
+// a fixed schedule, requests are pipelined over a pool of persistent
+// connections without waiting for responses, and latency is measured from
+// the intended send time, so queueing delay (in the server, the network, or
+// the generator) is counted in full.
+//
+// Each of the `n_lanes` lanes has a connection to every server and a thread
+// sending its share of the schedule; each connection has a thread receiving
+// its responses, which the server sends in request order.
+class OpenLoopGenerator {
+ public:
+  // Sends everything to `server`
+  OpenLoopGenerator(std::string server, size_t n_lanes);
+  // Routes keys by `config`
+  OpenLoopGenerator(ShardControllerConfig config, size_t n_lanes);
+
+  OpenLoopGenerator(const OpenLoopGenerator&) = delete;
+  OpenLoopGenerator& operator=(const OpenLoopGenerator&) = delete;
+
+  // Whether every operation of `workload` is a single request (a read, an
+  // update or an insert), which is all that can be pipelined
+  static bool supports(const Workload& workload);
+
+  // Connects every lane to every server it isn't connected to, returning
+  // false if any connection fails
+  bool connect();
+
+  // Offers `rate` operations per second of `workload` (which must be
+  // supported) for `duration`, then waits up to `drain_timeout` for the
+  // outstanding responses. Connections that fail or time out are dropped, and
+  // their outstanding requests count as errors; connect again before the next
+  // run.
+  OpenLoopResult run(const Workload& workload, double rate,
+                     std::chrono::milliseconds duration, size_t value_size,
+                     std::atomic<uint64_t>& n_records,
+                     std::chrono::milliseconds drain_timeout);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Pipeline {
+    std::shared_ptr<ServerConn> conn;
+    std::mutex mtx;
+    std::condition_variable cv;
+    // Intended send times of the requests awaiting responses, oldest first
+    std::deque<Clock::time_point> in_flight;
+    // Set once the run's last request has been sent
+    bool done = false;
+    // Set once the connection has failed; nothing more is sent on it
+    bool failed = false;
+  };
+
+  std::string server;
+  std::optional<ShardControllerConfig> config;
+  size_t n_lanes;
+  // Per lane, a pipeline to each server
+  std::vector<std::map<std::string, std::unique_ptr<Pipeline>>> lanes;
+
+  std::vector<std::string> servers() const;
+  std::optional<std::string> server_for(const std::string& key) const;
+
+  // Sends lane `lane`'s requests: the `lane`th of every `n_lanes` slots of
+  // the schedule starting at `start`
+  void send(size_t lane, const Workload& workload, double rate,
+            Clock::time_point start, Clock::time_point end,
+            size_t value_size, std::atomic<uint64_t>& n_records,
+            OpenLoopResult& result);
+  // Receives `pipeline`'s responses until the run is done and none are left
+  static void receive(Pipeline& pipeline, OpenLoopResult& result);
+};
+
+#endif /* end of include guard */
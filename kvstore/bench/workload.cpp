@@ -0,0 +1,115 @@
+#include "workload.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+#include "common/utils.hpp"
+
+std::optional<KeyDistribution> parse_distribution(const std::string& name) {
+    if (name == "uniform") return KeyDistribution::UNIFORM;
+    if (name == "zipfian") return KeyDistribution::ZIPFIAN;
+    if (name == "latest") return KeyDistribution::LATEST;
+    return std::nullopt;
+}
+
+std::string distribution_name(KeyDistribution distribution) {
+    switch (distribution) {
+        case KeyDistribution::UNIFORM:
+            return "uniform";
+        case KeyDistribution::ZIPFIAN:
+            return "zipfian";
+        case KeyDistribution::LATEST:
+            return "latest";
+    }
+    return "";
+}
+
+std::optional<Workload> Workload::ycsb(char name) {
+    switch (std::toupper(static_cast<unsigned char>(name))) {
+        // Update heavy
+        case 'A':
+            return Workload{'A', 0.5, 0.5, 0, 0, 0, KeyDistribution::ZIPFIAN};
+        // Read mostly
+        case 'B':
+            return Workload{'B', 0.95, 0.05, 0, 0, 0, KeyDistribution::ZIPFIAN};
+        // Read only
+        case 'C':
+            return Workload{'C', 1, 0, 0, 0, 0, KeyDistribution::ZIPFIAN};
+        // Read latest
+        case 'D':
+            return Workload{'D', 0.95, 0, 0.05, 0, 0, KeyDistribution::LATEST};
+        // Short ranges
+        case 'E':
+            return Workload{'E', 0, 0, 0.05, 0.95, 0, KeyDistribution::ZIPFIAN};
+        // Read-modify-write
+        case 'F':
+            return Workload{'F', 0.5, 0, 0, 0, 0.5, KeyDistribution::ZIPFIAN};
+    }
+    return std::nullopt;
+}
+
+OpType Workload::pick(double draw) const {
+    if ((draw -= this->read) < 0) return OpType::READ;
+    if ((draw -= this->update) < 0) return OpType::UPDATE;
+    if ((draw -= this->insert) < 0) return OpType::INSERT;
+    if ((draw -= this->scan) < 0) return OpType::SCAN;
+    return OpType::READ_MODIFY_WRITE;
+}
+
+ZipfianGenerator::ZipfianGenerator(uint64_t n, double theta)
+    : theta(theta),
+      alpha(1 / (1 - theta)),
+      zeta2(1 + std::pow(0.5, theta)) {
+    this->grow(std::max<uint64_t>(n, 1));
+}
+
+uint64_t ZipfianGenerator::next(std::mt19937_64& rng, uint64_t n) {
+    this->grow(std::max<uint64_t>(n, 1));
+    double eta = (1 - std::pow(2.0 / this->n, 1 - this->theta)) /
+                 (1 - this->zeta2 / this->zetan);
+
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    double uz = u * this->zetan;
+    if (uz < 1) return 0;
+    if (uz < this->zeta2) return 1;
+    auto i = static_cast<uint64_t>(this->n *
+                                   std::pow(eta * u - eta + 1, this->alpha));
+    return std::min(i, this->n - 1);
+}
+
+void ZipfianGenerator::grow(uint64_t new_n) {
+    for (; this->n < new_n; this->n++) {
+        this->zetan += 1 / std::pow(static_cast<double>(this->n + 1), this->theta);
+    }
+}
+
+KeyChooser::KeyChooser(KeyDistribution distribution, uint64_t n_records,
+                       uint64_t seed)
+    : distribution(distribution), gen(seed), zipf(n_records) {
+}
+
+uint64_t KeyChooser::next(uint64_t n_records) {
+    n_records = std::max<uint64_t>(n_records, 1);
+    switch (this->distribution) {
+        case KeyDistribution::UNIFORM:
+            return std::uniform_int_distribution<uint64_t>(0, n_records - 1)(
+                this->gen);
+        case KeyDistribution::ZIPFIAN:
+            // Scatter the popular ranks over the records
+            return stable_hash(std::to_string(
+                       this->zipf.next(this->gen, n_records))) %
+                   n_records;
+        case KeyDistribution::LATEST:
+            return n_records - 1 - this->zipf.next(this->gen, n_records);
+    }
+    return 0;
+}
+
+double KeyChooser::uniform() {
+    return std::uniform_real_distribution<double>(0, 1)(this->gen);
+}
+
+std::string record_key(uint64_t n) {
+    return "user" + std::to_string(stable_hash(std::to_string(n)));
+}
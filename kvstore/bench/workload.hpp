@@ -0,0 +1,82 @@
+#ifndef BENCH_WORKLOAD_HPP
+#define BENCH_WORKLOAD_HPP
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+
+enum class OpType { READ, UPDATE, INSERT, SCAN, READ_MODIFY_WRITE };
+
+// Which records operations go to. ZIPFIAN favors a fixed set of popular
+// records, scattered over the key space; LATEST favors the most recently
+// inserted ones.
+enum class KeyDistribution { UNIFORM, ZIPFIAN, LATEST };
+
+std::optional<KeyDistribution> parse_distribution(const std::string& name);
+std::string distribution_name(KeyDistribution distribution);
+
+// One of the YCSB core workloads (A-F): the fraction of each operation, and
+// the distribution records are picked from.
+struct Workload {
+  char name;
+  double read;
+  double update;
+  double insert;
+  double scan;
+  double read_modify_write;
+  KeyDistribution distribution;
+
+  // Scans cover a uniformly chosen number of consecutive records, up to this
+  static constexpr uint64_t MAX_SCAN_LENGTH = 100;
+
+  static std::optional<Workload> ycsb(char name);
+
+  // Picks an operation according to the mix, given a uniform draw in [0, 1)
+  OpType pick(double draw) const;
+};
+
+// Draws integers in [0, n) with P(i) proportional to 1 / (i + 1)^theta, in
+// constant time per draw (Gray et al., "Quickly Generating Billion-Record
+// Synthetic Databases"). Growing n only sums the new terms of the
+// normalization constant.
+class ZipfianGenerator {
+ public:
+  explicit ZipfianGenerator(uint64_t n, double theta = 0.99);
+
+  uint64_t next(std::mt19937_64& rng, uint64_t n);
+
+ private:
+  double theta;
+  double alpha;
+  double zeta2;
+  uint64_t n = 0;
+  double zetan = 0;
+
+  void grow(uint64_t new_n);
+};
+
+// Picks the record numbers a benchmark thread's operations go to, out of the
+// `n_records` inserted so far.
+class KeyChooser {
+ public:
+  KeyChooser(KeyDistribution distribution, uint64_t n_records, uint64_t seed);
+
+  uint64_t next(uint64_t n_records);
+  // A uniform draw in [0, 1), from the same generator
+  double uniform();
+  std::mt19937_64& rng() {
+    return this->gen;
+  }
+
+ private:
+  KeyDistribution distribution;
+  std::mt19937_64 gen;
+  ZipfianGenerator zipf;
+};
+
+// The key of record `n`. Record numbers are hashed, like in YCSB, so that
+// consecutive inserts don't all go to the same place.
+std::string record_key(uint64_t n);
+
+#endif /* end of include guard */
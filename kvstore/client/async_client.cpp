@@ -0,0 +1,208 @@
+#include "async_client.hpp"
+
+// Prints the server's error, if `res` is one
+static void report_error(const std::optional<Response>& res,
+                         const std::string& failure) {
+  if (!res) return;
+  if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    cerr_color(YELLOW, "Failed to ", failure, " server: ", error_res->msg);
+  }
+}
+
+AsyncClient::AsyncClient(std::string server, size_t n_connections)
+    : server(std::move(server)), loop(n_connections) {
+}
+
+AsyncClient::AsyncClient(ShardControllerConfig config, size_t n_connections)
+    : config(std::make_shared<const ShardControllerConfig>(std::move(config))),
+      loop(n_connections) {
+}
+
+std::optional<std::string> AsyncClient::server_for(
+    const std::string& key) const {
+  std::shared_ptr<const ShardControllerConfig> config = this->config.load();
+  if (!config) return this->server;
+  return config->get_server(key);
+}
+
+std::optional<std::map<std::string, std::vector<size_t>>>
+AsyncClient::servers_for(const std::vector<std::string>& keys) const {
+  std::map<std::string, std::vector<size_t>> servers;
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::optional<std::string> server = this->server_for(keys[i]);
+    if (!server) return std::nullopt;
+    servers[*server].push_back(i);
+  }
+  return servers;
+}
+
+Task<std::optional<Response>> AsyncClient::call(std::string key,
+                                                Request req) {
+  std::optional<std::string> server = this->server_for(key);
+  if (!server) co_return std::nullopt;
+  std::vector<std::pair<std::string, Request>> requests;
+  requests.emplace_back(std::move(*server), std::move(req));
+  EventLoop::Exchange exchange(this->loop, std::move(requests));
+  std::vector<std::optional<Response>> responses = co_await exchange;
+  co_return std::move(responses[0]);
+}
+
+Task<std::optional<std::string>> AsyncClient::Get(std::string key) {
+  Task<std::optional<Response>> call = this->call(key, GetRequest{key});
+  std::optional<Response> res = co_await call;
+  if (res) {
+    if (auto* get_res = std::get_if<GetResponse>(&*res)) {
+      co_return std::move(get_res->value);
+    }
+  }
+  report_error(res, "Get value from");
+  co_return std::nullopt;
+}
+
+Task<bool> AsyncClient::Put(std::string key, std::string value,
+                            std::chrono::milliseconds ttl) {
+  Task<std::optional<Response>> call = this->call(
+      key, PutRequest{key, std::move(value),
+                      static_cast<uint64_t>(ttl.count())});
+  std::optional<Response> res = co_await call;
+  if (res && std::holds_alternative<PutResponse>(*res)) co_return true;
+  report_error(res, "Put value to");
+  co_return false;
+}
+
+Task<bool> AsyncClient::Append(std::string key, std::string value,
+                               std::chrono::milliseconds ttl) {
+  Task<std::optional<Response>> call = this->call(
+      key, AppendRequest{key, std::move(value),
+                         static_cast<uint64_t>(ttl.count())});
+  std::optional<Response> res = co_await call;
+  if (res && std::holds_alternative<AppendResponse>(*res)) co_return true;
+  report_error(res, "Append value to");
+  co_return false;
+}
+
+Task<std::optional<std::string>> AsyncClient::Delete(std::string key) {
+  Task<std::optional<Response>> call = this->call(key, DeleteRequest{key});
+  std::optional<Response> res = co_await call;
+  if (res) {
+    if (auto* delete_res = std::get_if<DeleteResponse>(&*res)) {
+      co_return std::move(delete_res->value);
+    }
+  }
+  report_error(res, "Delete value on");
+  co_return std::nullopt;
+}
+
+Task<std::optional<std::vector<std::string>>> AsyncClient::MultiGet(
+    std::vector<std::string> keys) {
+  auto servers = this->servers_for(keys);
+  if (!servers) co_return std::nullopt;
+  std::vector<std::pair<std::string, Request>> requests;
+  for (auto&& [server, indices] : *servers) {
+    MultiGetRequest req;
+    for (size_t i : indices) req.keys.push_back(keys[i]);
+    requests.emplace_back(server, std::move(req));
+  }
+  EventLoop::Exchange exchange(this->loop, std::move(requests));
+  std::vector<std::optional<Response>> responses = co_await exchange;
+
+  std::vector<std::string> values(keys.size());
+  size_t n = 0;
+  for (auto&& [server, indices] : *servers) {
+    std::optional<Response>& res = responses[n++];
+    auto* multiget_res = res ? std::get_if<MultiGetResponse>(&*res) : nullptr;
+    if (!multiget_res || multiget_res->values.size() != indices.size()) {
+      report_error(res, "MultiGet values on");
+      co_return std::nullopt;
+    }
+    for (size_t j = 0; j < indices.size(); j++) {
+      values[indices[j]] = std::move(multiget_res->values[j]);
+    }
+  }
+  co_return std::move(values);
+}
+
+Task<bool> AsyncClient::MultiPut(std::vector<std::string> keys,
+                                 std::vector<std::string> values,
+                                 std::chrono::milliseconds ttl) {
+  if (keys.size() != values.size()) co_return false;
+  auto servers = this->servers_for(keys);
+  if (!servers) co_return false;
+  std::vector<std::pair<std::string, Request>> requests;
+  for (auto&& [server, indices] : *servers) {
+    MultiPutRequest req{{}, {}, static_cast<uint64_t>(ttl.count())};
+    for (size_t i : indices) {
+      req.keys.push_back(keys[i]);
+      req.values.push_back(std::move(values[i]));
+    }
+    requests.emplace_back(server, std::move(req));
+  }
+  EventLoop::Exchange exchange(this->loop, std::move(requests));
+  std::vector<std::optional<Response>> responses = co_await exchange;
+
+  bool ok = true;
+  for (auto&& res : responses) {
+    if (res && std::holds_alternative<MultiPutResponse>(*res)) continue;
+    report_error(res, "MultiPut values on");
+    ok = false;
+  }
+  co_return ok;
+}
+
+Task<std::optional<bool>> AsyncClient::CompareAndSwap(std::string key,
+                                                      std::string expected,
+                                                      std::string desired) {
+  Task<std::optional<Response>> call = this->call(
+      key, CompareAndSwapRequest{key, std::move(expected), std::move(desired)});
+  std::optional<Response> res = co_await call;
+  if (res) {
+    if (auto* cas_res = std::get_if<CompareAndSwapResponse>(&*res)) {
+      co_return cas_res->swapped;
+    }
+  }
+  report_error(res, "CompareAndSwap value on");
+  co_return std::nullopt;
+}
+
+Task<std::optional<bool>> AsyncClient::PutIfAbsent(
+    std::string key, std::string value, std::chrono::milliseconds ttl) {
+  Task<std::optional<Response>> call = this->call(
+      key, PutIfAbsentRequest{key, std::move(value),
+                              static_cast<uint64_t>(ttl.count())});
+  std::optional<Response> res = co_await call;
+  if (res) {
+    if (auto* pia_res = std::get_if<PutIfAbsentResponse>(&*res)) {
+      co_return pia_res->inserted;
+    }
+  }
+  report_error(res, "PutIfAbsent value to");
+  co_return std::nullopt;
+}
+
+Task<std::optional<bool>> AsyncClient::DeleteIfEquals(std::string key,
+                                                      std::string expected) {
+  Task<std::optional<Response>> call =
+      this->call(key, DeleteIfEqualsRequest{key, std::move(expected)});
+  std::optional<Response> res = co_await call;
+  if (res) {
+    if (auto* die_res = std::get_if<DeleteIfEqualsResponse>(&*res)) {
+      co_return die_res->deleted;
+    }
+  }
+  report_error(res, "DeleteIfEquals value on");
+  co_return std::nullopt;
+}
+
+Task<std::optional<int64_t>> AsyncClient::Increment(std::string key,
+                                                    int64_t delta) {
+  Task<std::optional<Response>> call =
+      this->call(key, IncrementRequest{key, delta});
+  std::optional<Response> res = co_await call;
+  if (res) {
+    if (auto* incr_res = std::get_if<IncrementResponse>(&*res)) {
+      co_return incr_res->value;
+    }
+  }
+  report_error(res, "Increment value on");
+  co_return std::nullopt;
+}
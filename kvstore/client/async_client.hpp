@@ -0,0 +1,93 @@
+#ifndef ASYNC_CLIENT_HPP
+#define ASYNC_CLIENT_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/config.hpp"
+#include "event_loop.hpp"
+#include "task.hpp"
+
+// A client whose operations are coroutines, so that one thread can have many
+// requests in flight: `co_await client.Get(key)` from a coroutine, or
+// `sync_wait(client.Get(key))` to block for the result. Concurrent operations
+// (e.g. started together with when_all) share a few pipelined connections per
+// server, through one event loop, instead of a connection each.
+//
+// Operations take their arguments by value, since they outlive the call that
+// starts them, and fail the same way as the synchronous clients'. Code after
+// a `co_await` runs on the event loop's thread, so it mustn't block on other
+// operations (with sync_wait) itself.
+class AsyncClient {
+ public:
+  // Sends every request to `server`
+  explicit AsyncClient(
+      std::string server,
+      size_t n_connections = EVENT_LOOP_CONNECTIONS_PER_SERVER);
+  // Sends each request to the server that `config` gives its key(s) to
+  explicit AsyncClient(
+      ShardControllerConfig config,
+      size_t n_connections = EVENT_LOOP_CONNECTIONS_PER_SERVER);
+
+  Task<std::optional<std::string>> Get(std::string key);
+
+  Task<bool> Put(std::string key, std::string value,
+                 std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  Task<bool> Append(
+      std::string key, std::string value,
+      std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  Task<std::optional<std::string>> Delete(std::string key);
+
+  // Keys on different servers are fetched (or written) from all of them at
+  // once
+  Task<std::optional<std::vector<std::string>>> MultiGet(
+      std::vector<std::string> keys);
+
+  Task<bool> MultiPut(
+      std::vector<std::string> keys, std::vector<std::string> values,
+      std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  Task<std::optional<bool>> CompareAndSwap(std::string key,
+                                           std::string expected,
+                                           std::string desired);
+
+  Task<std::optional<bool>> PutIfAbsent(
+      std::string key, std::string value,
+      std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  Task<std::optional<bool>> DeleteIfEquals(std::string key,
+                                           std::string expected);
+
+  Task<std::optional<int64_t>> Increment(std::string key, int64_t delta = 1);
+
+  // Routes keys by `config` from now on (e.g. after shards moved)
+  void set_config(ShardControllerConfig config) {
+    this->config.store(
+        std::make_shared<const ShardControllerConfig>(std::move(config)));
+  }
+
+ private:
+  std::string server;
+  std::atomic<std::shared_ptr<const ShardControllerConfig>> config;
+  // Last, so that it's stopped before the rest goes
+  EventLoop loop;
+
+  std::optional<std::string> server_for(const std::string& key) const;
+  // The servers holding `keys`, and which of `keys` each holds
+  std::optional<std::map<std::string, std::vector<size_t>>> servers_for(
+      const std::vector<std::string>& keys) const;
+
+  // Sends `req` to the server holding `key`, for its response. (Like an
+  // Exchange, the task is kept in a variable before it's awaited.)
+  Task<std::optional<Response>> call(std::string key, Request req);
+};
+
+#endif /* end of include guard */
@@ -1,12 +1,17 @@
 #ifndef CLIENT_HPP
 #define CLIENT_HPP
 
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <map>
 #include <optional>
 #include <string>
 #include <vector>
 
 #include "common/color.hpp"
+#include "common/utils.hpp"
+#include "net/server_commands.hpp"
 
 class Client {
  public:
@@ -14,9 +19,24 @@ class Client {
 
   virtual std::optional<std::string> Get(const std::string& key) = 0;
 
-  virtual bool Put(const std::string& key, const std::string& value) = 0;
+  // Writes take an optional time to live, after which the key expires. A Put
+  // without one makes the key persistent; an Append without one keeps the
+  // key's current expiry.
+  virtual bool Put(const std::string& key, const std::string& value,
+                   std::chrono::milliseconds ttl = std::chrono::milliseconds(0)) = 0;
 
-  virtual bool Append(const std::string& key, const std::string& value) = 0;
+  virtual bool Append(const std::string& key, const std::string& value,
+                      std::chrono::milliseconds ttl = std::chrono::milliseconds(0)) = 0;
+
+  // Put and Get for values too large to hold in one message (or in memory):
+  // the value is read from `in` or written to `out` a chunk at a time (see
+  // STREAM_CHUNK_SIZE), so a transfer never holds more than a chunk of it.
+  // GetStream fails if the key is written while its value is being read,
+  // leaving what was written to `out` so far.
+  virtual bool PutStream(
+      const std::string& key, std::istream& in,
+      std::chrono::milliseconds ttl = std::chrono::milliseconds(0)) = 0;
+  virtual bool GetStream(const std::string& key, std::ostream& out) = 0;
 
   virtual std::optional<std::string> Delete(const std::string& key) = 0;
 
@@ -24,9 +44,52 @@ class Client {
       const std::vector<std::string>& keys) = 0;
 
   virtual bool MultiPut(const std::vector<std::string>& keys,
-                        const std::vector<std::string>& values) = 0;
+                        const std::vector<std::string>& values,
+                        std::chrono::milliseconds ttl = std::chrono::milliseconds(0)) = 0;
+
+  // Conditional writes, applied atomically by the server. Each returns whether
+  // the condition held (and the write happened), or std::nullopt on error.
+  virtual std::optional<bool> CompareAndSwap(const std::string& key,
+                                             const std::string& expected,
+                                             const std::string& desired) = 0;
+
+  virtual std::optional<bool> PutIfAbsent(
+      const std::string& key, const std::string& value,
+      std::chrono::milliseconds ttl = std::chrono::milliseconds(0)) = 0;
+
+  virtual std::optional<bool> DeleteIfEquals(const std::string& key,
+                                             const std::string& expected) = 0;
 
+  // Adds `delta` to an integer-valued key (a missing key counts as 0) and
+  // returns the new value.
+  virtual std::optional<int64_t> Increment(const std::string& key,
+                                           int64_t delta = 1) = 0;
+
+  std::optional<int64_t> Decrement(const std::string& key, int64_t delta = 1) {
+    return this->Increment(key, -delta);
+  }
+
+  // Erases a user (given by ID, like "user_1"): deletes their records and
+  // redacts every mention of them elsewhere.
   virtual bool GDPRDelete(const std::string& user) = 0;
+
+  // Each server's access statistics, by server address. Servers that don't
+  // answer are left out.
+  virtual std::optional<std::map<std::string, StatsResponse>> Stats() = 0;
+
+ protected:
+  // The keys holding `user`'s own data: their record, their list of posts
+  // ("user_1_posts"), and each of those posts with its list of replies.
+  std::vector<std::string> gdpr_records(const std::string& user) {
+    std::vector<std::string> keys{user, user + "_posts"};
+    if (auto posts = this->Get(user + "_posts")) {
+      for (auto&& post : split(*posts, ',')) {
+        keys.push_back(post);
+        keys.push_back(post + "_replies");
+      }
+    }
+    return keys;
+  }
 };
 
 #endif /* end of include guard */
@@ -0,0 +1,31 @@
+#include "cascommand.hpp"
+
+void CasCommand::handle(const std::string& s) {
+  std::vector<std::string> tokens = split(s);
+  if (tokens.size() < 3) {
+    cerr_color(RED, "Missing key, expected and/or desired value. ", usage());
+    return;
+  } else if (tokens.size() > 3) {
+    cerr_color(RED, "Too many parameters. ", usage());
+    return;
+  }
+
+  auto res = this->client->CompareAndSwap(tokens[0], tokens[1], tokens[2]);
+  if (!res) {
+    return;
+  }
+
+  std::cout << (*res ? "Swapped" : "Not swapped") << '\n';
+}
+
+std::string CasCommand::name() const {
+  return "cas";
+}
+
+std::string CasCommand::params() const {
+  return "<key> <expected> <desired>";
+}
+
+std::string CasCommand::description() const {
+  return "Sets <key> to <desired> if its value is <expected>";
+}
@@ -0,0 +1,31 @@
+#include "deleteifequalscommand.hpp"
+
+void DeleteIfEqualsCommand::handle(const std::string& s) {
+  std::vector<std::string> tokens = split(s);
+  if (tokens.size() < 2) {
+    cerr_color(RED, "Missing key and/or expected value. ", usage());
+    return;
+  } else if (tokens.size() > 2) {
+    cerr_color(RED, "Too many parameters. ", usage());
+    return;
+  }
+
+  auto res = this->client->DeleteIfEquals(tokens[0], tokens[1]);
+  if (!res) {
+    return;
+  }
+
+  std::cout << (*res ? "Deleted" : "Not deleted") << '\n';
+}
+
+std::string DeleteIfEqualsCommand::name() const {
+  return "deleteifequals";
+}
+
+std::string DeleteIfEqualsCommand::params() const {
+  return "<key> <expected>";
+}
+
+std::string DeleteIfEqualsCommand::description() const {
+  return "Deletes <key> if its value is <expected>";
+}
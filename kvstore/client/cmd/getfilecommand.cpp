@@ -0,0 +1,35 @@
+#include "getfilecommand.hpp"
+
+void GetFileCommand::handle(const std::string& s) {
+  std::vector<std::string> tokens = split(s);
+  if (tokens.size() < 2) {
+    cerr_color(RED, "Missing key and/or file. ", usage());
+    return;
+  } else if (tokens.size() > 2) {
+    cerr_color(RED, "Too many parameters. ", usage());
+    return;
+  }
+
+  std::ofstream file(tokens[1], std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    cerr_color(RED, "Failed to open ", tokens[1]);
+    return;
+  }
+  if (!this->client->GetStream(tokens[0], file)) {
+    return;
+  }
+
+  std::cout << "Wrote value to " << tokens[1] << '\n';
+}
+
+std::string GetFileCommand::name() const {
+  return "getfile";
+}
+
+std::string GetFileCommand::params() const {
+  return "<key> <file>";
+}
+
+std::string GetFileCommand::description() const {
+  return "Writes <key>'s value to <file>, streamed in chunks";
+}
@@ -0,0 +1,35 @@
+#include "incrementcommand.hpp"
+
+void IncrementCommand::handle(const std::string& s) {
+  std::vector<std::string> tokens = split(s);
+  if (tokens.size() == 0) {
+    cerr_color(RED, "Missing key. ", usage());
+    return;
+  } else if (tokens.size() > 2) {
+    cerr_color(RED, "Too many parameters. ", usage());
+    return;
+  } else if (tokens.size() == 2 && !is_number(tokens[1])) {
+    cerr_color(RED, "Amount must be a positive number. ", usage());
+    return;
+  }
+
+  int64_t delta = tokens.size() == 2 ? std::stoll(tokens[1]) : 1;
+  auto res = this->client->Increment(tokens[0], delta);
+  if (!res) {
+    return;
+  }
+
+  std::cout << "New value: " << *res << '\n';
+}
+
+std::string IncrementCommand::name() const {
+  return "incr";
+}
+
+std::string IncrementCommand::params() const {
+  return "<key> [amount]";
+}
+
+std::string IncrementCommand::description() const {
+  return "Adds [amount] (default 1) to <key>'s integer value, starting from 0";
+}
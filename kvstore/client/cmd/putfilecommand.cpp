@@ -0,0 +1,31 @@
+#include "putfilecommand.hpp"
+
+void PutFileCommand::handle(const std::string& s) {
+  std::vector<std::string> tokens = split(s);
+  if (tokens.size() < 2) {
+    cerr_color(RED, "Missing key and/or file. ", usage());
+    return;
+  } else if (tokens.size() > 2) {
+    cerr_color(RED, "Too many parameters. ", usage());
+    return;
+  }
+
+  std::ifstream file(tokens[1], std::ios::binary);
+  if (!file.is_open()) {
+    cerr_color(RED, "Failed to open ", tokens[1]);
+    return;
+  }
+  this->client->PutStream(tokens[0], file);
+}
+
+std::string PutFileCommand::name() const {
+  return "putfile";
+}
+
+std::string PutFileCommand::params() const {
+  return "<key> <file>";
+}
+
+std::string PutFileCommand::description() const {
+  return "Sets <key> to the contents of <file>, streamed in chunks";
+}
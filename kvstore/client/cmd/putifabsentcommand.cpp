@@ -0,0 +1,35 @@
+#include "putifabsentcommand.hpp"
+
+void PutIfAbsentCommand::handle(const std::string& s) {
+  std::vector<std::string> tokens = split(s);
+  if (tokens.size() < 2) {
+    cerr_color(RED, "Missing key and/or value. ", usage());
+    return;
+  }
+
+  std::string val;
+  for (size_t i = 1; i < tokens.size(); i++) {
+    val.append(tokens[i] + " ");
+  }
+  // remove trailing whitespace
+  val.pop_back();
+
+  auto res = this->client->PutIfAbsent(tokens[0], val);
+  if (!res) {
+    return;
+  }
+
+  std::cout << (*res ? "Inserted" : "Key already exists") << '\n';
+}
+
+std::string PutIfAbsentCommand::name() const {
+  return "putifabsent";
+}
+
+std::string PutIfAbsentCommand::params() const {
+  return "<key> <value>";
+}
+
+std::string PutIfAbsentCommand::description() const {
+  return "Sets <key> to <value> if <key> doesn't exist yet";
+}
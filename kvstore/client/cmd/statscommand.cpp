@@ -0,0 +1,38 @@
+#include "statscommand.hpp"
+
+void StatsCommand::handle(const std::string& s) {
+  if (!split(s).empty()) {
+    cerr_color(RED, "Too many parameters. ", usage());
+    return;
+  }
+
+  auto stats = this->client->Stats();
+  if (!stats) {
+    cerr_color(RED, "Failed to get stats.");
+    return;
+  }
+
+  for (auto&& [server, server_stats] : *stats) {
+    double seconds = std::max<uint64_t>(server_stats.window_ms, 1) / 1000.0;
+    std::cout << server << ": " << server_stats.n_accesses
+              << " key accesses in the last " << server_stats.window_ms
+              << "ms (" << uint64_t(server_stats.n_accesses / seconds)
+              << "/s)\n";
+    for (auto&& hot_key : server_stats.hot_keys) {
+      std::cout << "  " << hot_key.key << ": ~" << hot_key.count << " ("
+                << uint64_t(hot_key.count / seconds) << "/s)\n";
+    }
+  }
+}
+
+std::string StatsCommand::name() const {
+  return "stats";
+}
+
+std::string StatsCommand::params() const {
+  return "";
+}
+
+std::string StatsCommand::description() const {
+  return "Shows each server's key accesses and hottest keys";
+}
@@ -0,0 +1,304 @@
+#include "event_loop.hpp"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+
+// How many events the loop handles per wakeup, and how often it checks for
+// requests that have waited too long
+constexpr int MAX_EVENTS = 64;
+constexpr int TICK_MS = 100;
+// How much the loop reads from a socket at a time
+constexpr size_t READ_SIZE = 64 * 1024;
+
+EventLoop::EventLoop(size_t n_connections, std::chrono::milliseconds timeout)
+    : n_connections(std::max<size_t>(n_connections, 1)), timeout(timeout) {
+  this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (this->epoll_fd < 0 || this->wake_fd < 0) {
+    perror_color(RED, "Failed to set up the event loop");
+    this->stopped = true;
+    return;
+  }
+  // The wakeup descriptor is told apart from connections by its null pointer
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->wake_fd, &event);
+  this->thread = std::thread(&EventLoop::run, this);
+}
+
+EventLoop::~EventLoop() {
+  {
+    std::unique_lock lock(this->submit_mtx);
+    this->stopped = true;
+  }
+  uint64_t one = 1;
+  if (this->wake_fd >= 0 && write(this->wake_fd, &one, sizeof(one)) < 0) {
+    perror_color(RED, "write");
+  }
+  if (this->thread.joinable()) this->thread.join();
+  if (this->wake_fd >= 0) ::close(this->wake_fd);
+  if (this->epoll_fd >= 0) ::close(this->epoll_fd);
+}
+
+EventLoop::Exchange::Exchange(
+    EventLoop& loop, std::vector<std::pair<std::string, Request>> requests)
+    : loop(&loop) {
+  this->calls.reserve(requests.size());
+  for (auto&& [server, req] : requests) {
+    this->calls.push_back(Call{server, serialize_request(std::move(req))});
+  }
+}
+
+bool EventLoop::Exchange::await_suspend(std::coroutine_handle<> awaiter) {
+  this->awaiter = awaiter;
+  this->remaining = this->calls.size() + 1;
+  for (auto&& call : this->calls) call.exchange = this;
+  this->loop->submit(this->calls);
+  // If every call failed already, there's nothing to wait for
+  return this->remaining.fetch_sub(1) != 1;
+}
+
+std::vector<std::optional<Response>> EventLoop::Exchange::await_resume() {
+  std::vector<std::optional<Response>> responses;
+  responses.reserve(this->calls.size());
+  for (auto&& call : this->calls) responses.push_back(std::move(call.res));
+  return responses;
+}
+
+void EventLoop::Exchange::finish_one() {
+  if (this->remaining.fetch_sub(1) == 1) this->awaiter.resume();
+}
+
+void EventLoop::complete(Call* call, std::optional<Response> res) {
+  call->res = std::move(res);
+  call->exchange->finish_one();
+}
+
+void EventLoop::submit(std::vector<Call>& calls) {
+  bool stopped;
+  {
+    std::unique_lock lock(this->submit_mtx);
+    stopped = this->stopped;
+    for (auto&& call : calls) {
+      if (call.msg && !stopped) this->submitted.push_back(&call);
+    }
+  }
+  // Calls that can't be sent fail right away
+  for (auto&& call : calls) {
+    if (!call.msg || stopped) complete(&call, std::nullopt);
+  }
+  uint64_t one = 1;
+  if (write(this->wake_fd, &one, sizeof(one)) < 0) perror_color(RED, "write");
+}
+
+void EventLoop::run() {
+  epoll_event events[MAX_EVENTS];
+  while (true) {
+    int n = epoll_wait(this->epoll_fd, events, MAX_EVENTS, TICK_MS);
+    if (n < 0 && errno != EINTR) {
+      perror_color(RED, "epoll_wait");
+      break;
+    }
+
+    std::vector<Connection*> broken;
+    for (int i = 0; i < n; i++) {
+      auto* conn = static_cast<Connection*>(events[i].data.ptr);
+      if (!conn) {
+        uint64_t count;
+        while (read(this->wake_fd, &count, sizeof(count)) > 0) {
+        }
+        continue;
+      }
+      // Already given up on during this round
+      if (std::find(broken.begin(), broken.end(), conn) != broken.end()) {
+        continue;
+      }
+      bool ok = true;
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        ok = this->receive(*conn);
+      }
+      if (ok && (events[i].events & EPOLLOUT)) ok = this->flush(*conn);
+      if (!ok) broken.push_back(conn);
+    }
+    for (auto* conn : broken) this->fail(conn);
+
+    std::vector<Call*> calls;
+    bool stopped;
+    {
+      std::unique_lock lock(this->submit_mtx);
+      calls.swap(this->submitted);
+      stopped = this->stopped;
+    }
+    if (stopped) {
+      for (auto* call : calls) complete(call, std::nullopt);
+      break;
+    }
+    for (auto* call : calls) this->dispatch(call);
+
+    // Responses come back in order, so only each connection's oldest request
+    // can have waited too long. A connection also holds one of its server's
+    // workers while it's open, so idle ones are closed.
+    auto now = Clock::now();
+    auto deadline = now - this->timeout;
+    auto idle_deadline =
+        now - std::chrono::milliseconds(EVENT_LOOP_IDLE_TIMEOUT_MS);
+    std::vector<Connection*> done;
+    for (auto&& [server, pool] : this->pools) {
+      for (auto&& conn : pool) {
+        if (conn->in_flight.empty()) {
+          if (conn->last_active < idle_deadline) done.push_back(conn.get());
+        } else if (conn->in_flight.front()->sent < deadline) {
+          cerr_color(RED, "Request to ", server, " timed out.");
+          done.push_back(conn.get());
+        }
+      }
+    }
+    for (auto* conn : done) this->fail(conn);
+  }
+
+  std::vector<Connection*> open;
+  for (auto&& [_, pool] : this->pools) {
+    for (auto&& conn : pool) open.push_back(conn.get());
+  }
+  for (auto* conn : open) this->fail(conn);
+}
+
+void EventLoop::dispatch(Call* call) {
+  Connection* conn = this->connection_for(call->server);
+  if (!conn) {
+    cerr_color(RED, "Failed to connect to KvServer at ", call->server, '.');
+    complete(call, std::nullopt);
+    return;
+  }
+
+  append_message(conn->out, *call->msg);
+  call->sent = Clock::now();
+  conn->last_active = call->sent;
+  conn->in_flight.push_back(call);
+  if (!conn->writing && !this->flush(*conn)) this->fail(conn);
+}
+
+EventLoop::Connection* EventLoop::connection_for(const std::string& server) {
+  auto& pool = this->pools[server];
+  auto least_busy = std::min_element(
+      pool.begin(), pool.end(), [](auto&& a, auto&& b) {
+        return a->in_flight.size() < b->in_flight.size();
+      });
+  if (least_busy != pool.end() &&
+      ((*least_busy)->in_flight.empty() || pool.size() >= this->n_connections)) {
+    return least_busy->get();
+  }
+
+  // Connecting blocks the loop, but only until the server accepts
+  int fd = connect_to_address(server);
+  if (fd < 0) {
+    return least_busy != pool.end() ? least_busy->get() : nullptr;
+  }
+  int flags = fcntl(fd, F_GETFL, 0);
+  int yes = 1;
+  if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)) < 0) {
+    perror_color(RED, "Failed to set up a connection");
+    ::close(fd);
+    return least_busy != pool.end() ? least_busy->get() : nullptr;
+  }
+
+  auto conn = std::make_unique<Connection>();
+  conn->server = server;
+  conn->fd = fd;
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.ptr = conn.get();
+  if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    perror_color(RED, "epoll_ctl");
+    ::close(fd);
+    return least_busy != pool.end() ? least_busy->get() : nullptr;
+  }
+  pool.push_back(std::move(conn));
+  return pool.back().get();
+}
+
+bool EventLoop::flush(Connection& conn) {
+  while (conn.out_done < conn.out.size()) {
+    ssize_t sent = send(conn.fd, conn.out.data() + conn.out_done,
+                        conn.out.size() - conn.out_done, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror_color(RED, "send");
+        return false;
+      }
+      // Carry on once the socket has room again
+      if (!conn.writing) {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT;
+        event.data.ptr = &conn;
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+        conn.writing = true;
+      }
+      return true;
+    }
+    conn.out_done += sent;
+  }
+
+  conn.out.clear();
+  conn.out_done = 0;
+  if (conn.writing) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = &conn;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+    conn.writing = false;
+  }
+  return true;
+}
+
+bool EventLoop::receive(Connection& conn) {
+  while (true) {
+    size_t start = conn.in.size();
+    conn.in.resize(start + READ_SIZE);
+    ssize_t got = recv(conn.fd, conn.in.data() + start, READ_SIZE, 0);
+    conn.in.resize(start + std::max<ssize_t>(got, 0));
+    if (got > 0) continue;
+    if (got == 0) return false;
+    if (errno == EINTR) continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+    perror_color(RED, "recv");
+    return false;
+  }
+
+  Message msg{};
+  while (take_message(conn.in, conn.in_done, &msg)) {
+    if (conn.in_flight.empty()) {
+      cerr_color(RED, "Unexpected response from ", conn.server, '.');
+      return false;
+    }
+    std::optional<Response> res = deserialize_response(std::move(msg));
+    if (!res) perror_color(RED, "Error deserializing response.");
+    Call* call = conn.in_flight.front();
+    conn.in_flight.pop_front();
+    conn.last_active = Clock::now();
+    complete(call, std::move(res));
+  }
+
+  // Keep only what's left to parse
+  conn.in.erase(conn.in.begin(), conn.in.begin() + conn.in_done);
+  conn.in_done = 0;
+  return true;
+}
+
+void EventLoop::fail(Connection* conn) {
+  ::close(conn->fd);
+  std::deque<Call*> in_flight = std::move(conn->in_flight);
+
+  auto& pool = this->pools[conn->server];
+  pool.erase(std::find_if(pool.begin(), pool.end(),
+                          [&](auto&& other) { return other.get() == conn; }));
+  for (auto* call : in_flight) complete(call, std::nullopt);
+}
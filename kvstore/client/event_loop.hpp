@@ -0,0 +1,146 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "net/network_messages.hpp"
+
+// How many connections an event loop opens to each server, at most. Each one
+// holds one of the server's workers for as long as it's open.
+#define EVENT_LOOP_CONNECTIONS_PER_SERVER 2
+// How long a request may wait for its response before its connection is given
+// up on, failing every request in flight on it
+#define EVENT_LOOP_REQUEST_TIMEOUT_MS 5000
+// How long a connection may sit with nothing in flight before it's closed,
+// giving its worker back to the server
+#define EVENT_LOOP_IDLE_TIMEOUT_MS 200
+
+// Sends requests to servers and collects their responses from a single thread,
+// over a small pool of non-blocking connections to each server. A server
+// answers each connection's requests in order, so many of them can be in
+// flight on a connection at once, each matched to its response by position.
+//
+// Requests are made by `co_await`ing an Exchange, which resumes the awaiting
+// coroutine on the loop's thread once all of its responses are in. (It's kept
+// in a variable rather than awaited as a temporary, which GCC 12 mishandles.)
+class EventLoop {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit EventLoop(
+      size_t n_connections = EVENT_LOOP_CONNECTIONS_PER_SERVER,
+      std::chrono::milliseconds timeout =
+          std::chrono::milliseconds(EVENT_LOOP_REQUEST_TIMEOUT_MS));
+  // Fails the requests still in flight, and closes the connections
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  class Exchange;
+
+  // A request to a server (by address), and its response once it's in: none
+  // if it couldn't be sent, or the connection failed before it was answered
+  struct Call {
+    std::string server;
+    std::optional<Message> msg;
+    std::optional<Response> res = std::nullopt;
+    Exchange* exchange = nullptr;
+    Clock::time_point sent = {};
+  };
+
+  // Sends each request to its server, all at once, when it's awaited
+  class Exchange {
+   public:
+    Exchange(EventLoop& loop,
+             std::vector<std::pair<std::string, Request>> requests);
+    Exchange(const Exchange&) = delete;
+    Exchange& operator=(const Exchange&) = delete;
+
+    bool await_ready() const noexcept {
+      return this->calls.empty();
+    }
+    bool await_suspend(std::coroutine_handle<> awaiter);
+    // The responses, in the order of the requests
+    std::vector<std::optional<Response>> await_resume();
+
+   private:
+    friend EventLoop;
+
+    EventLoop* loop;
+    std::vector<Call> calls;
+    // The calls still waiting for a response, and one more for
+    // await_suspend itself, so that calls finishing before it's done can't
+    // resume the awaiter early
+    std::atomic<size_t> remaining = 0;
+    std::coroutine_handle<> awaiter;
+
+    void finish_one();
+  };
+
+ private:
+  struct Connection {
+    std::string server;
+    int fd;
+    // Serialized requests not yet written to the socket, from `out_done` on
+    std::vector<std::byte> out;
+    size_t out_done = 0;
+    // Bytes read from the socket not yet parsed, from `in_done` on
+    std::vector<std::byte> in;
+    size_t in_done = 0;
+    // Sent requests, in the order their responses will come back
+    std::deque<Call*> in_flight;
+    // Whether the loop is waiting for the socket to take more bytes
+    bool writing = false;
+    // When a request was last sent or answered on it
+    Clock::time_point last_active = {};
+  };
+
+  size_t n_connections;
+  std::chrono::milliseconds timeout;
+
+  int epoll_fd = -1;
+  // Written to wake the loop up when there are calls to send, or it's stopped
+  int wake_fd = -1;
+  std::thread thread;
+
+  // Calls made since the loop last looked, and whether it has been stopped.
+  // Protected by submit_mtx.
+  std::mutex submit_mtx;
+  std::vector<Call*> submitted;
+  bool stopped = false;
+
+  // Each server's connections. Only used by the loop's thread.
+  std::map<std::string, std::vector<std::unique_ptr<Connection>>> pools;
+
+  // Hands `calls` to the loop's thread
+  void submit(std::vector<Call>& calls);
+  void run();
+
+  // Writes `call` to the least busy connection to its server, opening another
+  // if they're all busy and there's room for one
+  void dispatch(Call* call);
+  Connection* connection_for(const std::string& server);
+  // Writes as much of `conn`'s queued requests as the socket takes
+  bool flush(Connection& conn);
+  // Reads what the socket has, and completes the calls it answers
+  bool receive(Connection& conn);
+  // Closes `conn`, failing its calls in flight, and drops it from its pool
+  void fail(Connection* conn);
+
+  static void complete(Call* call, std::optional<Response> res);
+};
+
+#endif /* end of include guard */
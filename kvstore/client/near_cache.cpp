@@ -0,0 +1,92 @@
+#include "near_cache.hpp"
+
+void NearCache::set_capacity(size_t capacity) {
+  std::unique_lock lock(this->mtx);
+  this->capacity = capacity;
+  this->shrink_to(capacity);
+}
+
+std::optional<std::string> NearCache::lookup(const std::string& key) {
+  std::unique_lock lock(this->mtx);
+  auto it = this->entries.find(key);
+  if (it == this->entries.end()) return std::nullopt;
+  if (it->second.expires <= Clock::now()) {
+    this->remove(it);
+    return std::nullopt;
+  }
+  this->lru.splice(this->lru.begin(), this->lru, it->second.lru_pos);
+  return it->second.value;
+}
+
+std::pair<uint64_t, uint64_t> NearCache::position(const std::string& server) {
+  std::unique_lock lock(this->mtx);
+  auto it = this->logs.find(server);
+  if (it == this->logs.end()) return {0, 0};
+  return {it->second.epoch, it->second.seq};
+}
+
+void NearCache::fill(const std::string& server, const std::string& key,
+                     const LeaseGetResponse& res, Clock::time_point sent,
+                     uint64_t generation) {
+  std::unique_lock lock(this->mtx);
+  ServerLog& log = this->logs[server];
+  if (res.flush || res.epoch != log.epoch) {
+    for (auto it = this->entries.begin(); it != this->entries.end();) {
+      auto next = std::next(it);
+      if (it->second.server == server) this->remove(it);
+      it = next;
+    }
+    log = ServerLog{res.epoch, res.seq};
+  } else if (res.seq >= log.seq) {
+    for (auto&& revoked : res.revoked) {
+      auto it = this->entries.find(revoked);
+      if (it != this->entries.end() && it->second.server == server) {
+        this->remove(it);
+      }
+    }
+    log.seq = res.seq;
+  } else {
+    // A response that raced with a newer one: revocations after its lease was
+    // granted may already have been applied, and missed its key
+    return;
+  }
+
+  size_t capacity = this->capacity.load();
+  if (capacity == 0 || res.lease_ms == 0 || generation != this->writes.load()) {
+    return;
+  }
+  auto it = this->entries.find(key);
+  if (it != this->entries.end()) this->remove(it);
+  this->shrink_to(capacity - 1);
+  this->lru.push_front(key);
+  this->entries.emplace(
+      key, Entry{res.value, server,
+                 sent + std::chrono::milliseconds(res.lease_ms),
+                 this->lru.begin()});
+}
+
+void NearCache::erase(const std::string& key) {
+  std::unique_lock lock(this->mtx);
+  this->writes++;
+  auto it = this->entries.find(key);
+  if (it != this->entries.end()) this->remove(it);
+}
+
+void NearCache::clear() {
+  std::unique_lock lock(this->mtx);
+  this->writes++;
+  this->entries.clear();
+  this->lru.clear();
+}
+
+void NearCache::remove(std::unordered_map<std::string, Entry>::iterator it) {
+  this->lru.erase(it->second.lru_pos);
+  this->entries.erase(it);
+}
+
+void NearCache::shrink_to(size_t capacity) {
+  while (this->entries.size() > capacity) {
+    this->entries.erase(this->lru.back());
+    this->lru.pop_back();
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef NEAR_CACHE_HPP
+#define NEAR_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "net/server_commands.hpp"
+
+// A client's bounded cache of values it read with leases (see LeaseTable),
+// evicting the least recently used entry when full.
+//
+// An entry is served until its lease expires, unless it's revoked first: each
+// lease response carries the revocations its server logged since the client
+// last heard from it, and this client's own writes drop their keys right away.
+class NearCache {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // A capacity of 0 disables the cache
+  explicit NearCache(size_t capacity = 0) : capacity(capacity) {
+  }
+
+  NearCache(const NearCache&) = delete;
+  NearCache& operator=(const NearCache&) = delete;
+
+  void set_capacity(size_t capacity);
+  bool enabled() const {
+    return this->capacity.load() > 0;
+  }
+
+  // The key's cached value, if its lease hasn't expired or been revoked
+  std::optional<std::string> lookup(const std::string& key);
+
+  // Where a lease request to `server` should pick up its revocation log: the
+  // server's epoch and the last revocation seen in it.
+  std::pair<uint64_t, uint64_t> position(const std::string& server);
+  // Incremented by every local write, so that a lease read before a write
+  // isn't cached after it
+  uint64_t generation() const {
+    return this->writes.load();
+  }
+
+  // Applies the revocations in `res`, from `server`, then caches the key's
+  // value until its lease expires. `sent` is when the request was sent, which
+  // the lease is counted from, and `generation` the generation() then.
+  void fill(const std::string& server, const std::string& key,
+            const LeaseGetResponse& res, Clock::time_point sent,
+            uint64_t generation);
+
+  // Drops `key`, which this client is writing, or everything
+  void erase(const std::string& key);
+  void clear();
+
+ private:
+  struct Entry {
+    std::string value;
+    std::string server;
+    Clock::time_point expires;
+    // Position in lru
+    std::list<std::string>::iterator lru_pos;
+  };
+  struct ServerLog {
+    uint64_t epoch = 0;
+    uint64_t seq = 0;
+  };
+
+  std::atomic<size_t> capacity;
+  std::atomic<uint64_t> writes = 0;
+
+  // Entries, their keys from most to least recently used, and each server's
+  // revocation log position. Protected by mtx.
+  std::unordered_map<std::string, Entry> entries;
+  std::list<std::string> lru;
+  std::map<std::string, ServerLog> logs;
+  std::mutex mtx;
+
+  void remove(std::unordered_map<std::string, Entry>::iterator it);
+  // Evicts entries until there are at most `capacity`. Requires mtx.
+  void shrink_to(size_t capacity);
+};
+
+#endif /* end of include guard */
@@ -1,136 +1,392 @@
 #include "shardkv_client.hpp"
 
 std::optional<std::string> ShardKvClient::Get(const std::string& key) {
-    // Query shardcontroller for config
-    auto config = this->Query();
-    if (!config) return std::nullopt;
+    if (this->near_cache.enabled()) return this->near_get(key);
+
+    return this->with_config([&](const ShardControllerConfig& config,
+                                 bool& not_applied)
+                                 -> std::optional<std::string> {
+        // find responsible server in config
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return std::nullopt;
 
-    // find responsible server in config
-    std::optional<std::string> server = config->get_server(key);
-    if (!server) return std::nullopt;
+        // If stale reads are allowed, try one of the key's replicas first,
+        // falling back to the primary if that replica is too far behind
+        milliseconds max_staleness(this->max_staleness_ms.load());
+        if (max_staleness > 0ms) {
+            std::vector<std::string> replicas = config.get_replicas(key);
+            const std::string& replica =
+                replicas[this->next_replica++ % replicas.size()];
+            if (replica != *server) {
+                auto value = SimpleClient{replica}.Get(key, max_staleness);
+                if (value) return value;
+            }
+        }
 
-    return SimpleClient{*server}.Get(key);
+        SimpleClient primary{*server};
+        auto value = primary.Get(key);
+        not_applied = primary.not_applied();
+        return value;
+    });
 }
 
-bool ShardKvClient::Put(const std::string& key, const std::string& value) {
-    // Query shardcontroller for config
-    auto config = this->Query();
-    if (!config) return false;
+std::optional<std::string> ShardKvClient::near_get(const std::string& key) {
+    if (auto value = this->near_cache.lookup(key)) return value;
+    return this->with_config([&](const ShardControllerConfig& config,
+                                 bool& not_applied)
+                                 -> std::optional<std::string> {
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return std::nullopt;
 
-    // find responsible server in config, then make Put request
-    std::optional<std::string> server = config->get_server(key);
-    if (!server) return false;
-    return SimpleClient{*server}.Put(key, value);
+        auto [epoch, since] = this->near_cache.position(*server);
+        uint64_t generation = this->near_cache.generation();
+        auto sent = NearCache::Clock::now();
+        SimpleClient client{*server};
+        auto res = client.LeaseGet(key, epoch, since);
+        not_applied = client.not_applied();
+        if (!res) return std::nullopt;
+        this->near_cache.fill(*server, key, *res, sent, generation);
+        return res->value;
+    });
 }
 
-bool ShardKvClient::Append(const std::string& key, const std::string& value) {
-    // Query shardcontroller for config
-    auto config = this->Query();
-    if (!config) return false;
+bool ShardKvClient::Put(const std::string& key, const std::string& value,
+                        std::chrono::milliseconds ttl) {
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied) -> bool {
+        // find responsible server in config, then make Put request
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return false;
+        SimpleClient client{*server};
+        auto done = client.Put(key, value, ttl);
+        not_applied = client.not_applied();
+        return done;
+    });
+    this->near_cache.erase(key);
+    return res;
+}
+
+bool ShardKvClient::Append(const std::string& key, const std::string& value,
+                           std::chrono::milliseconds ttl) {
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied) -> bool {
+        // find responsible server in config, then make Append request
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return false;
+        SimpleClient client{*server};
+        auto done = client.Append(key, value, ttl);
+        not_applied = client.not_applied();
+        return done;
+    });
+    this->near_cache.erase(key);
+    return res;
+}
+
+bool ShardKvClient::PutStream(const std::string& key, std::istream& in,
+                              std::chrono::milliseconds ttl) {
+    std::streampos start = in.tellg();
+    bool first = true;
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied) -> bool {
+        // Another attempt sends the value over from the start, if the stream
+        // can go back there
+        if (!first) {
+            in.clear();
+            if (start == std::streampos(-1) || !in.seekg(start)) {
+                not_applied = false;
+                return false;
+            }
+        }
+        first = false;
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return false;
+        SimpleClient client{*server};
+        auto done = client.PutStream(key, in, ttl);
+        not_applied = client.not_applied();
+        return done;
+    });
+    this->near_cache.erase(key);
+    return res;
+}
 
-    // find responsible server in config, then make Append request
-    std::optional<std::string> server = config->get_server(key);
-    if (!server) return false;
-    return SimpleClient{*server}.Append(key, value);
+bool ShardKvClient::GetStream(const std::string& key, std::ostream& out) {
+    std::streampos start = out.tellp();
+    bool first = true;
+    return this->with_config([&](const ShardControllerConfig& config,
+                                 bool& not_applied) -> bool {
+        // Another attempt is only made if the last one wrote nothing, which
+        // takes a stream that can tell
+        if (!first && (start == std::streampos(-1) || out.tellp() != start)) {
+            not_applied = false;
+            return false;
+        }
+        first = false;
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return false;
+        SimpleClient client{*server};
+        auto done = client.GetStream(key, out);
+        not_applied = client.not_applied();
+        return done;
+    });
 }
 
 std::optional<std::string> ShardKvClient::Delete(const std::string& key) {
-    // Query shardcontroller for config
-    auto config = this->Query();
-    if (!config) return std::nullopt;
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied)
+                                     -> std::optional<std::string> {
+        // find responsible server in config, then make Delete request
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return std::nullopt;
+        SimpleClient client{*server};
+        auto done = client.Delete(key);
+        not_applied = client.not_applied();
+        return done;
+    });
+    this->near_cache.erase(key);
+    return res;
+}
+
+std::optional<bool> ShardKvClient::CompareAndSwap(const std::string& key,
+                                                  const std::string& expected,
+                                                  const std::string& desired) {
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied)
+                                     -> std::optional<bool> {
+        // find responsible server in config, then make CompareAndSwap request
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return std::nullopt;
+        SimpleClient client{*server};
+        auto done = client.CompareAndSwap(key, expected, desired);
+        not_applied = client.not_applied();
+        return done;
+    });
+    this->near_cache.erase(key);
+    return res;
+}
+
+std::optional<bool> ShardKvClient::PutIfAbsent(const std::string& key,
+                                               const std::string& value,
+                                               std::chrono::milliseconds ttl) {
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied)
+                                     -> std::optional<bool> {
+        // find responsible server in config, then make PutIfAbsent request
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return std::nullopt;
+        SimpleClient client{*server};
+        auto done = client.PutIfAbsent(key, value, ttl);
+        not_applied = client.not_applied();
+        return done;
+    });
+    this->near_cache.erase(key);
+    return res;
+}
 
-    // find responsible server in config, then make Delete request
-    std::optional<std::string> server = config->get_server(key);
-    if (!server) return std::nullopt;
-    return SimpleClient{*server}.Delete(key);
+std::optional<bool> ShardKvClient::DeleteIfEquals(const std::string& key,
+                                                  const std::string& expected) {
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied)
+                                     -> std::optional<bool> {
+        // find responsible server in config, then make DeleteIfEquals request
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return std::nullopt;
+        SimpleClient client{*server};
+        auto done = client.DeleteIfEquals(key, expected);
+        not_applied = client.not_applied();
+        return done;
+    });
+    this->near_cache.erase(key);
+    return res;
+}
+
+std::optional<int64_t> ShardKvClient::Increment(const std::string& key,
+                                                int64_t delta) {
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied)
+                                     -> std::optional<int64_t> {
+        // find responsible server in config, then make Increment request
+        std::optional<std::string> server = config.get_server(key);
+        if (!server) return std::nullopt;
+        SimpleClient client{*server};
+        auto done = client.Increment(key, delta);
+        not_applied = client.not_applied();
+        return done;
+    });
+    this->near_cache.erase(key);
+    return res;
 }
 
 std::optional<std::vector<std::string>> ShardKvClient::MultiGet(
     const std::vector<std::string>& keys) {
     // TODO (Part B, Step 3): Implement!
-    auto config = this->Query();
-    if (!config) return std::nullopt;
+    return this->with_config([&](const ShardControllerConfig& config,
+                                 bool& not_applied)
+                                 -> std::optional<std::vector<std::string>> {
+        // Group keys by server
+        std::map<std::string, std::vector<size_t>> server_to_indices;
+        for(size_t i = 0; i < keys.size(); ++i)
+        {
+            auto server = config.get_server(keys[i]);
+            if (!server) return std::nullopt;
+            server_to_indices[*server].push_back(i);
+        }
+        std::vector<std::pair<std::string, std::vector<size_t>>> groups(
+            server_to_indices.begin(), server_to_indices.end());
 
-    // Group keys by server
-    std::map<std::string, std::vector<size_t>> server_to_indices;
-    for(size_t i = 0; i < keys.size(); ++i)
-    {
-        auto server = config->get_server(keys[i]);
-        if (!server) return std::nullopt;
-        server_to_indices[*server].push_back(i);
-    }
+        // Prepare output (same order as input). Each group owns a disjoint set
+        // of indices, so the sub-requests can scatter into it without locking.
+        std::vector<std::string> values(keys.size());
 
-    // // Prepare output (same order as input)
-    std::vector<std::string> values;
-    values.reserve(keys.size());
+        // Issue one MultiGet per server, several at a time. It's only worth
+        // another attempt if every server that failed turned its keys away.
+        std::atomic<bool> all_not_applied = true;
+        bool ok = parallel_for(
+            groups.size(), this->max_parallel_requests, [&](size_t g) {
+                auto& [server, indices] = groups[g];
+                std::vector<std::string> server_keys;
+                server_keys.reserve(indices.size());
+                for (auto idx : indices) {
+                    server_keys.push_back(keys[idx]);
+                }
 
-    // For each server, issue MultiGet
-    for (auto& [server, indices] : server_to_indices) {
-        std::vector<std::string> server_keys;
-        server_keys.reserve(indices.size());
+                SimpleClient client{server};
+                auto res = client.MultiGet(server_keys);
+                if (!res || res->size() != indices.size()) {
+                    if (!client.not_applied()) all_not_applied = false;
+                    return false;
+                }
+                for (size_t i = 0; i < indices.size(); ++i) {
+                    values[indices[i]] = std::move((*res)[i]);
+                }
+                return true;
+            });
+        not_applied = all_not_applied;
+        if (!ok) return std::nullopt;
 
-        for (auto idx : indices) {
-            server_keys.push_back(keys[idx]);
-        }
+        return values;
+    });
+}
 
-        // Send MultiGet to that server
-        auto res = SimpleClient{server}.MultiGet(server_keys);
-        if (!res || res->size() != indices.size())
-            return std::nullopt;
-        for (size_t i = 0; i < indices.size(); ++i) {
-            values[indices[i]] = (*res)[i];
+bool ShardKvClient::MultiPut(const std::vector<std::string>& keys,
+                             const std::vector<std::string>& values,
+                             std::chrono::milliseconds ttl) {
+    // TODO (Part B, Step 3): Implement!
+    if (keys.size() != values.size()) return false;
+
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied) -> bool {
+        // Group keys by server
+        std::map<std::string, std::vector<size_t>> server_to_indices;
+        for(size_t i = 0; i < keys.size(); ++i)
+        {
+            auto server = config.get_server(keys[i]);
+            if (!server) return false;
+            server_to_indices[*server].push_back(i);
         }
-    }
+        std::vector<std::pair<std::string, std::vector<size_t>>> groups(
+            server_to_indices.begin(), server_to_indices.end());
 
-    return values;
+        // Issue one MultiPut per server, several at a time. Putting the keys
+        // of the servers that took them again is harmless, so it's worth
+        // another attempt if every server that failed turned its keys away.
+        std::atomic<bool> all_not_applied = true;
+        bool ok = parallel_for(
+            groups.size(), this->max_parallel_requests, [&](size_t g) {
+                auto& [server, indices] = groups[g];
+                std::vector<std::string> server_keys;
+                std::vector<std::string> server_values;
+                server_keys.reserve(indices.size());
+                server_values.reserve(indices.size());
+                for (auto idx : indices) {
+                    server_keys.push_back(keys[idx]);
+                    server_values.push_back(values[idx]);
+                }
+
+                SimpleClient client{server};
+                if (client.MultiPut(server_keys, server_values, ttl)) {
+                    return true;
+                }
+                if (!client.not_applied()) all_not_applied = false;
+                return false;
+            });
+        not_applied = all_not_applied;
+        return ok;
+    });
+    for (auto&& key : keys) this->near_cache.erase(key);
+    return res;
 }
 
-bool ShardKvClient::MultiPut(const std::vector<std::string>& keys,
-                             const std::vector<std::string>& values) {
-    // TODO (Part B, Step 3): Implement!
+bool ShardKvClient::GDPRDelete(const std::string& user) {
+    std::vector<std::string> keys = this->gdpr_records(user);
+    auto res = this->with_config([&](const ShardControllerConfig& config,
+                                     bool& not_applied) -> bool {
+        std::vector<std::string> servers;
+        for (auto&& [server, _] : config.server_to_shards) {
+            servers.push_back(server);
+        }
+        bool ok = parallel_for(
+            servers.size(), this->max_parallel_requests, [&](size_t i) {
+                return SimpleClient{servers[i]}.GDPRPurge(user, keys)
+                    .has_value();
+            });
 
+        // A shard that moved meanwhile may have been skipped by both its old
+        // and new owner; purging again under the new config catches it, and
+        // is harmless for the keys that were purged already
+        not_applied = true;
+        auto latest = this->Query();
+        return ok && latest && latest->version == config.version;
+    });
+    // Nothing says which cached keys mentioned the user
+    this->near_cache.clear();
+    return res;
+}
+
+std::optional<std::map<std::string, StatsResponse>> ShardKvClient::Stats() {
     auto config = this->Query();
-    if (!config) return false;
+    if (!config) return std::nullopt;
 
-    // Group keys by server
-    std::map<std::string, std::vector<size_t>> server_to_indices;
-    for(size_t i = 0; i < keys.size(); ++i)
-    {
-        auto server = config->get_server(keys[i]);
-        if (!server) return false;
-        server_to_indices[*server].push_back(i);
+    std::vector<std::string> servers;
+    for (auto&& [server, _] : config->server_to_shards) {
+        servers.push_back(server);
     }
-    //
-    // For each server, issue MultiGet
-    for (auto& [server, indices] : server_to_indices) {
-        std::vector<std::string> server_values;
-        std::vector<std::string> server_keys;
-        server_keys.reserve(indices.size());
-        server_values.reserve(indices.size());
-
-        for (auto idx : indices) {
-            server_keys.push_back(keys[idx]);
-            server_values.push_back(values[idx]);
-        }
+    std::vector<std::optional<std::map<std::string, StatsResponse>>> stats(
+        servers.size());
+    parallel_for(servers.size(), this->max_parallel_requests, [&](size_t i) {
+        stats[i] = SimpleClient{servers[i]}.Stats();
+        return true;
+    });
 
-        // Send MultiGet to that server
-        auto res = SimpleClient{server}.MultiPut(server_keys, server_values);
-        if (!res)
-            return false;
+    std::map<std::string, StatsResponse> by_server;
+    for (auto&& server_stats : stats) {
+        if (server_stats) by_server.merge(*server_stats);
     }
-
-    return true;
+    return by_server;
 }
 
 // Shardcontroller functions
 std::optional<ShardControllerConfig> ShardKvClient::Query() {
-    QueryRequest req;
-    if (!this->shardcontroller_conn->send_request(req)) return std::nullopt;
+    std::lock_guard lock(this->config_mtx);
+    // Changes that don't follow on from this client's config (which they
+    // always should) are dropped, and the whole config fetched again
+    for (size_t attempt = 0; attempt < 2; attempt++) {
+        ConfigChangesRequest req{this->compact_config.version};
+        if (!this->shardcontroller_conn->send_request(req)) return std::nullopt;
 
-    std::optional<Response> res = this->shardcontroller_conn->recv_response();
-    if (!res) return std::nullopt;
-    if (auto* query_res = std::get_if<QueryResponse>(&*res)) {
-        return query_res->config;
+        std::optional<Response> res = this->shardcontroller_conn->recv_response();
+        if (!res) return std::nullopt;
+        auto* changes_res = std::get_if<ConfigChangesResponse>(&*res);
+        if (!changes_res) return std::nullopt;
+        if (!this->compact_config.apply(changes_res->changes)) {
+            this->compact_config = {};
+            this->config = std::nullopt;
+            continue;
+        }
+        if (!this->config ||
+            this->config->version != this->compact_config.version) {
+            this->config = this->compact_config.expand();
+        }
+        return this->config;
     }
 
     return std::nullopt;
@@ -2,7 +2,9 @@
 #define SHARDKV_CLIENT_HPP
 
 #include <array>
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <vector>
@@ -11,12 +13,22 @@
 #include "common/config.hpp"
 #include "net/network_conn.hpp"
 #include "net/network_messages.hpp"
+#include "near_cache.hpp"
 #include "simple_client.hpp"
 
+// Default cap on how many servers a single MultiGet/MultiPut contacts at once.
+#define DEFAULT_MAX_PARALLEL_REQUESTS 16
+// How many configs a single operation tries before giving up, when shards move
+// while it's in flight.
+#define MAX_CONFIG_ATTEMPTS 3
+
 class ShardKvClient : public Client {
  public:
-  explicit ShardKvClient(const std::string& sm_addr)
-      : shardcontroller_addr(sm_addr) {
+  explicit ShardKvClient(
+      const std::string& sm_addr,
+      size_t max_parallel_requests = DEFAULT_MAX_PARALLEL_REQUESTS)
+      : shardcontroller_addr(sm_addr),
+        max_parallel_requests(max_parallel_requests) {
     this->shardcontroller_conn = connect_to_server(this->shardcontroller_addr);
     if (!this->shardcontroller_conn) {
       cerr_color(RED, "Failed to connect to shardcontroller at ",
@@ -34,9 +46,16 @@ class ShardKvClient : public Client {
   // ShardKvStore functions
   std::optional<std::string> Get(const std::string& key);
 
-  bool Put(const std::string& key, const std::string& value);
+  bool Put(const std::string& key, const std::string& value,
+           std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  bool Append(const std::string& key, const std::string& value,
+              std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  bool PutStream(const std::string& key, std::istream& in,
+                 std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
 
-  bool Append(const std::string& key, const std::string& value);
+  bool GetStream(const std::string& key, std::ostream& out);
 
   std::optional<std::string> Delete(const std::string& key);
 
@@ -44,19 +63,99 @@ class ShardKvClient : public Client {
       const std::vector<std::string>& keys);
 
   bool MultiPut(const std::vector<std::string>& keys,
-                const std::vector<std::string>& values);
+                const std::vector<std::string>& values,
+                std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
 
-  bool GDPRDelete(const std::string& user) {
-    assert(false);
-  }
+  std::optional<bool> CompareAndSwap(const std::string& key,
+                                     const std::string& expected,
+                                     const std::string& desired);
+
+  std::optional<bool> PutIfAbsent(
+      const std::string& key, const std::string& value,
+      std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  std::optional<bool> DeleteIfEquals(const std::string& key,
+                                     const std::string& expected);
 
-  // Shardcontroller functions
+  std::optional<int64_t> Increment(const std::string& key, int64_t delta = 1);
+
+  // Purges the user on every server at once; each finds what mentions the
+  // user through its own index.
+  bool GDPRDelete(const std::string& user);
+
+  // Asks every server in the current config, all at once
+  std::optional<std::map<std::string, StatsResponse>> Stats();
+
+  // Shardcontroller functions. Query only fetches what changed since the
+  // config it last got.
   std::optional<ShardControllerConfig> Query();
   bool Move(const std::string& dest_server, const std::vector<Shard>& shards);
 
+  // Sets how many per-server sub-requests a single MultiGet/MultiPut may have
+  // in flight at once (1 contacts the servers one after another).
+  void set_max_parallel_requests(size_t n) {
+    this->max_parallel_requests = std::max<size_t>(n, 1);
+  }
+
+  // Sets the read policy: with a nonzero `max_staleness`, Gets are spread
+  // across each shard's replicas, and may return a value that is at most that
+  // far behind the primary. With 0 (the default), Gets only go to primaries.
+  void set_read_policy(std::chrono::milliseconds max_staleness) {
+    this->max_staleness_ms = max_staleness.count();
+  }
+
+  // Enables a near cache of up to `capacity` keys (0, the default, disables
+  // it): Gets are then served from this client's memory while the owning
+  // servers' leases on the keys last, so they may miss other clients' writes
+  // for up to LEASE_MS. This client's own writes are seen right away.
+  void set_near_cache(size_t capacity) {
+    this->near_cache.set_capacity(capacity);
+  }
+
  private:
   std::string shardcontroller_addr;
   std::shared_ptr<ServerConn> shardcontroller_conn;
+
+  // The config as of the last Query, which the changes since are applied to,
+  // and in full. Protected by config_mtx, held for all of a Query so that
+  // concurrent ones don't take each other's responses.
+  CompactConfig compact_config;
+  std::optional<ShardControllerConfig> config;
+  std::mutex config_mtx;
+
+  std::atomic<size_t> max_parallel_requests;
+
+  // Read policy, and a counter to round-robin Gets over replicas
+  std::atomic<uint64_t> max_staleness_ms = 0;
+  std::atomic<size_t> next_replica = 0;
+
+  NearCache near_cache;
+
+  // Get, through the near cache
+  std::optional<std::string> near_get(const std::string& key);
+
+  // Runs `op` against the latest config. If it fails without anything having
+  // been applied (which `op` reports through `not_applied`, e.g. a server
+  // turned it away because a shard moved before it caught up) and the config
+  // changed in the meantime, runs it again against the new config. Other
+  // failures, such as a missing key or a write that may have gone through,
+  // are returned as they are.
+  template <typename Op>
+  auto with_config(Op op)
+      -> decltype(op(std::declval<const ShardControllerConfig&>(),
+                     std::declval<bool&>())) {
+    auto config = this->Query();
+    for (size_t attempt = 1; config; attempt++) {
+      // Until `op` gets a request to a server, nothing was applied
+      bool not_applied = true;
+      auto res = op(*config, not_applied);
+      if (res || !not_applied || attempt >= MAX_CONFIG_ATTEMPTS) return res;
+      auto latest = this->Query();
+      if (!latest || latest->version == config->version) return res;
+      config = std::move(latest);
+    }
+    return {};
+  }
 };
 
 #endif /* end of include guard */
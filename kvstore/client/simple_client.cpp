@@ -1,14 +1,15 @@
 #include "simple_client.hpp"
 
 std::optional<std::string> SimpleClient::Get(const std::string& key) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return std::nullopt;
-  }
+  return this->Get(key, std::chrono::milliseconds(0));
+}
+
+std::optional<std::string> SimpleClient::Get(
+    const std::string& key, std::chrono::milliseconds max_staleness) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
 
-  GetRequest req{key};
+  GetRequest req{key, static_cast<uint64_t>(max_staleness.count())};
   if (!conn->send_request(req)) return std::nullopt;
 
   std::optional<Response> res = conn->recv_response();
@@ -16,21 +17,40 @@ std::optional<std::string> SimpleClient::Get(const std::string& key) {
   if (auto* get_res = std::get_if<GetResponse>(&*res)) {
     return get_res->value;
   } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
     cerr_color(YELLOW, "Failed to Get value from server: ", error_res->msg);
   }
 
   return std::nullopt;
 }
 
-bool SimpleClient::Put(const std::string& key, const std::string& value) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return false;
+std::optional<LeaseGetResponse> SimpleClient::LeaseGet(const std::string& key,
+                                                       uint64_t epoch,
+                                                       uint64_t since) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
+
+  LeaseGetRequest req{key, epoch, since};
+  if (!conn->send_request(req)) return std::nullopt;
+
+  std::optional<Response> res = conn->recv_response();
+  if (!res) return std::nullopt;
+  if (auto* lease_res = std::get_if<LeaseGetResponse>(&*res)) {
+    return *lease_res;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
+    cerr_color(YELLOW, "Failed to Get value from server: ", error_res->msg);
   }
 
-  PutRequest req{key, value};
+  return std::nullopt;
+}
+
+bool SimpleClient::Put(const std::string& key, const std::string& value,
+                       std::chrono::milliseconds ttl) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return false;
+
+  PutRequest req{key, value, static_cast<uint64_t>(ttl.count())};
   if (!conn->send_request(req)) return false;
 
   std::optional<Response> res = conn->recv_response();
@@ -38,21 +58,19 @@ bool SimpleClient::Put(const std::string& key, const std::string& value) {
   if (auto* put_res = std::get_if<PutResponse>(&*res)) {
     return true;
   } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
     cerr_color(YELLOW, "Failed to Put value to server: ", error_res->msg);
   }
 
   return false;
 }
 
-bool SimpleClient::Append(const std::string& key, const std::string& value) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return false;
-  }
+bool SimpleClient::Append(const std::string& key, const std::string& value,
+                          std::chrono::milliseconds ttl) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return false;
 
-  AppendRequest req{key, value};
+  AppendRequest req{key, value, static_cast<uint64_t>(ttl.count())};
   if (!conn->send_request(req)) return false;
 
   std::optional<Response> res = conn->recv_response();
@@ -60,19 +78,96 @@ bool SimpleClient::Append(const std::string& key, const std::string& value) {
   if (auto* append_res = std::get_if<AppendResponse>(&*res)) {
     return true;
   } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
     cerr_color(YELLOW, "Failed to Append value to server: ", error_res->msg);
   }
 
   return false;
 }
 
-std::optional<std::string> SimpleClient::Delete(const std::string& key) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return std::nullopt;
+bool SimpleClient::PutStream(const std::string& key, std::istream& in,
+                             std::chrono::milliseconds ttl) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return false;
+
+  PutStreamRequest req{key};
+  req.ttl_ms = ttl.count();
+  // Tell the server how large the value is, if the stream can say
+  std::streampos start = in.tellg();
+  if (start != std::streampos(-1) && in.seekg(0, std::ios::end)) {
+    req.total_size = in.tellg() - start;
+    in.seekg(start);
   }
+  in.clear();
+
+  while (true) {
+    req.chunk.resize(STREAM_CHUNK_SIZE);
+    in.read(req.chunk.data(), req.chunk.size());
+    req.chunk.resize(in.gcount());
+    if (in.bad()) {
+      cerr_color(RED, "Failed to read the value to stream to the server.");
+      return false;
+    }
+    req.last = in.eof() || in.peek() == std::istream::traits_type::eof();
+    if (!conn->send_request(req)) return false;
+
+    std::optional<Response> res = conn->recv_response();
+    if (!res) return false;
+    if (auto* stream_res = std::get_if<PutStreamResponse>(&*res)) {
+      if (req.last) return true;
+      req.stream_id = stream_res->stream_id;
+      req.offset = stream_res->received;
+    } else {
+      if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+        this->unapplied = is_not_responsible(*error_res);
+        cerr_color(YELLOW, "Failed to stream value to server: ",
+                   error_res->msg);
+      }
+      return false;
+    }
+  }
+}
+
+bool SimpleClient::GetStream(const std::string& key, std::ostream& out) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return false;
+
+  GetStreamRequest req{key};
+  std::optional<uint64_t> version;
+  while (true) {
+    if (!conn->send_request(req)) return false;
+
+    std::optional<Response> res = conn->recv_response();
+    if (!res) return false;
+    auto* stream_res = std::get_if<GetStreamResponse>(&*res);
+    if (!stream_res) {
+      if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+        this->unapplied = is_not_responsible(*error_res);
+        cerr_color(YELLOW, "Failed to stream value from server: ",
+                   error_res->msg);
+      }
+      return false;
+    }
+    if (version && *version != stream_res->version) {
+      cerr_color(YELLOW, "Failed to stream value from server: the key was "
+                         "written during the transfer");
+      return false;
+    }
+    version = stream_res->version;
+
+    if (!out.write(stream_res->chunk.data(), stream_res->chunk.size())) {
+      return false;
+    }
+    req.offset += stream_res->chunk.size();
+    if (req.offset >= stream_res->total_size || stream_res->chunk.empty()) {
+      return true;
+    }
+  }
+}
+
+std::optional<std::string> SimpleClient::Delete(const std::string& key) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
 
   DeleteRequest req{key};
   if (!conn->send_request(req)) return std::nullopt;
@@ -82,6 +177,7 @@ std::optional<std::string> SimpleClient::Delete(const std::string& key) {
   if (auto* delete_res = std::get_if<DeleteResponse>(&*res)) {
     return delete_res->value;
   } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
     cerr_color(YELLOW, "Failed to Delete value on server: ", error_res->msg);
   }
 
@@ -90,12 +186,8 @@ std::optional<std::string> SimpleClient::Delete(const std::string& key) {
 
 std::optional<std::vector<std::string>> SimpleClient::MultiGet(
     const std::vector<std::string>& keys) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return std::nullopt;
-  }
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
 
   MultiGetRequest req{keys};
   if (!conn->send_request(req)) return std::nullopt;
@@ -105,6 +197,7 @@ std::optional<std::vector<std::string>> SimpleClient::MultiGet(
   if (auto* multiget_res = std::get_if<MultiGetResponse>(&*res)) {
     return multiget_res->values;
   } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
     cerr_color(YELLOW, "Failed to MultiGet values on server: ", error_res->msg);
   }
 
@@ -112,15 +205,12 @@ std::optional<std::vector<std::string>> SimpleClient::MultiGet(
 }
 
 bool SimpleClient::MultiPut(const std::vector<std::string>& keys,
-                            const std::vector<std::string>& values) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return false;
-  }
+                            const std::vector<std::string>& values,
+                            std::chrono::milliseconds ttl) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return false;
 
-  MultiPutRequest req{keys, values};
+  MultiPutRequest req{keys, values, static_cast<uint64_t>(ttl.count())};
   if (!conn->send_request(req)) return false;
 
   std::optional<Response> res = conn->recv_response();
@@ -128,22 +218,146 @@ bool SimpleClient::MultiPut(const std::vector<std::string>& keys,
   if (auto* multiput_res = std::get_if<MultiPutResponse>(&*res)) {
     return true;
   } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
     cerr_color(YELLOW, "Failed to MultiPut values on server: ", error_res->msg);
   }
 
   return false;
 }
 
+std::optional<bool> SimpleClient::CompareAndSwap(const std::string& key,
+                                                 const std::string& expected,
+                                                 const std::string& desired) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
+
+  CompareAndSwapRequest req{key, expected, desired};
+  if (!conn->send_request(req)) return std::nullopt;
+
+  std::optional<Response> res = conn->recv_response();
+  if (!res) return std::nullopt;
+  if (auto* cas_res = std::get_if<CompareAndSwapResponse>(&*res)) {
+    return cas_res->swapped;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
+    cerr_color(YELLOW, "Failed to CompareAndSwap value on server: ", error_res->msg);
+  }
+
+  return std::nullopt;
+}
+
+std::optional<bool> SimpleClient::PutIfAbsent(const std::string& key,
+                                              const std::string& value,
+                                              std::chrono::milliseconds ttl) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
+
+  PutIfAbsentRequest req{key, value, static_cast<uint64_t>(ttl.count())};
+  if (!conn->send_request(req)) return std::nullopt;
+
+  std::optional<Response> res = conn->recv_response();
+  if (!res) return std::nullopt;
+  if (auto* pia_res = std::get_if<PutIfAbsentResponse>(&*res)) {
+    return pia_res->inserted;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
+    cerr_color(YELLOW, "Failed to PutIfAbsent value to server: ", error_res->msg);
+  }
+
+  return std::nullopt;
+}
+
+std::optional<bool> SimpleClient::DeleteIfEquals(const std::string& key,
+                                                 const std::string& expected) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
+
+  DeleteIfEqualsRequest req{key, expected};
+  if (!conn->send_request(req)) return std::nullopt;
+
+  std::optional<Response> res = conn->recv_response();
+  if (!res) return std::nullopt;
+  if (auto* die_res = std::get_if<DeleteIfEqualsResponse>(&*res)) {
+    return die_res->deleted;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
+    cerr_color(YELLOW, "Failed to DeleteIfEquals value on server: ", error_res->msg);
+  }
+
+  return std::nullopt;
+}
+
+std::optional<int64_t> SimpleClient::Increment(const std::string& key,
+                                               int64_t delta) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
+
+  IncrementRequest req{key, delta};
+  if (!conn->send_request(req)) return std::nullopt;
+
+  std::optional<Response> res = conn->recv_response();
+  if (!res) return std::nullopt;
+  if (auto* incr_res = std::get_if<IncrementResponse>(&*res)) {
+    return incr_res->value;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
+    cerr_color(YELLOW, "Failed to Increment value on server: ", error_res->msg);
+  }
+
+  return std::nullopt;
+}
+
 bool SimpleClient::GDPRDelete(const std::string& user) {
-  // TODO: Write your GDPR deletion code here!
-  // You can invoke operations directly on the client object, like so:
-  //
-  // std::string key("user_1_posts");
-  // std::optional<std::string> posts = Get(key);
-  // ...
-  //
-  // Assume the `user` arugment is a user ID such as "user_1".
-
-  cerr_color(RED, "GDPR deletion is unimplemented!");
-  return false;
+  return this->GDPRPurge(user, this->gdpr_records(user)).has_value();
+}
+
+std::optional<GDPRPurgeResponse> SimpleClient::GDPRPurge(
+    const std::string& user, const std::vector<std::string>& keys) {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
+
+  GDPRPurgeRequest req{user, keys};
+  if (!conn->send_request(req)) return std::nullopt;
+
+  std::optional<Response> res = conn->recv_response();
+  if (!res) return std::nullopt;
+  if (auto* purge_res = std::get_if<GDPRPurgeResponse>(&*res)) {
+    return *purge_res;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
+    cerr_color(YELLOW, "Failed to GDPRPurge user on server: ", error_res->msg);
+  }
+
+  return std::nullopt;
+}
+
+std::optional<std::map<std::string, StatsResponse>> SimpleClient::Stats() {
+  std::shared_ptr<ServerConn> conn = this->connect();
+  if (!conn) return std::nullopt;
+
+  StatsRequest req;
+  if (!conn->send_request(req)) return std::nullopt;
+
+  std::optional<Response> res = conn->recv_response();
+  if (!res) return std::nullopt;
+  if (auto* stats_res = std::get_if<StatsResponse>(&*res)) {
+    return std::map<std::string, StatsResponse>{
+        {this->server_addr, *stats_res}};
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    this->unapplied = is_not_responsible(*error_res);
+    cerr_color(YELLOW, "Failed to get stats from server: ", error_res->msg);
+  }
+
+  return std::nullopt;
+}
+
+std::shared_ptr<ServerConn> SimpleClient::connect() {
+  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
+  // A request that can't be sent is sure not to have been applied
+  this->unapplied = !conn;
+  if (!conn) {
+    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
+               '.');
+  }
+  return conn;
 }
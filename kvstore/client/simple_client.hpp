@@ -1,6 +1,7 @@
 #ifndef SIMPLE_CLIENT_HPP
 #define SIMPLE_CLIENT_HPP
 
+#include <chrono>
 #include <optional>
 #include <string>
 
@@ -16,10 +17,26 @@ class SimpleClient : public Client {
 
   // ShardKvStore functions.
   std::optional<std::string> Get(const std::string& key);
+  // Same as above, except that if the server is a backup for the key, it may
+  // answer with a copy that is at most `max_staleness` behind the primary.
+  std::optional<std::string> Get(const std::string& key,
+                                 std::chrono::milliseconds max_staleness);
 
-  bool Put(const std::string& key, const std::string& value);
+  // A Get that also leases the key (see LeaseGetRequest), for a near cache
+  // that has seen the server's revocations of `epoch` up to `since`
+  std::optional<LeaseGetResponse> LeaseGet(const std::string& key,
+                                           uint64_t epoch, uint64_t since);
 
-  bool Append(const std::string& key, const std::string& value);
+  bool Put(const std::string& key, const std::string& value,
+           std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  bool Append(const std::string& key, const std::string& value,
+              std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  bool PutStream(const std::string& key, std::istream& in,
+                 std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  bool GetStream(const std::string& key, std::ostream& out);
 
   std::optional<std::string> Delete(const std::string& key);
 
@@ -27,12 +44,44 @@ class SimpleClient : public Client {
       const std::vector<std::string>& keys);
 
   bool MultiPut(const std::vector<std::string>& keys,
-                const std::vector<std::string>& values);
+                const std::vector<std::string>& values,
+                std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  std::optional<bool> CompareAndSwap(const std::string& key,
+                                     const std::string& expected,
+                                     const std::string& desired);
+
+  std::optional<bool> PutIfAbsent(
+      const std::string& key, const std::string& value,
+      std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+  std::optional<bool> DeleteIfEquals(const std::string& key,
+                                     const std::string& expected);
+
+  std::optional<int64_t> Increment(const std::string& key, int64_t delta = 1);
 
   bool GDPRDelete(const std::string& user);
+  // Deletes `keys` (a user's records) from the server's shards and redacts
+  // every mention of them or `user` there.
+  std::optional<GDPRPurgeResponse> GDPRPurge(
+      const std::string& user, const std::vector<std::string>& keys);
+
+  std::optional<std::map<std::string, StatsResponse>> Stats();
+
+  // Whether the last request failed without the server applying any of it:
+  // the server couldn't be reached, or isn't responsible for the request's
+  // key(s). Only such a request is safe to send again after it failed (e.g.
+  // to another server, once the config changed).
+  bool not_applied() const {
+    return this->unapplied;
+  }
 
  private:
   std::string server_addr;
+  bool unapplied = false;
+
+  // Connects to the server, starting a new request
+  std::shared_ptr<ServerConn> connect();
 };
 
 #endif /* end of include guard */
@@ -0,0 +1,228 @@
+#ifndef TASK_HPP
+#define TASK_HPP
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <semaphore>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+// What a Task's promise has in common whatever it returns: it starts
+// suspended, and hands control back to whoever awaited it once it's done
+struct TaskPromiseBase {
+  std::coroutine_handle<> continuation = std::noop_coroutine();
+
+  std::suspend_always initial_suspend() noexcept {
+    return {};
+  }
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept {
+      return false;
+    }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> task) noexcept {
+      return task.promise().continuation;
+    }
+    void await_resume() noexcept {
+    }
+  };
+  FinalAwaiter final_suspend() noexcept {
+    return {};
+  }
+
+  // Errors are returned, not thrown, throughout the clients
+  void unhandled_exception() noexcept {
+    std::terminate();
+  }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+  std::optional<T> value;
+
+  Task<T> get_return_object();
+  template <typename U>
+  void return_value(U&& result) {
+    this->value.emplace(std::forward<U>(result));
+  }
+  T result() {
+    return std::move(*this->value);
+  }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+  Task<void> get_return_object();
+  void return_void() {
+  }
+  void result() {
+  }
+};
+
+// A coroutine that runs as soon as it's called, and frees itself when it ends
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() {
+      return {};
+    }
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+    void return_void() {
+    }
+    void unhandled_exception() noexcept {
+      std::terminate();
+    }
+  };
+};
+
+}  // namespace detail
+
+// A coroutine producing a T, for `co_await`ing from another coroutine (or
+// sync_wait). It's lazy: it only starts once it's awaited, and then runs on
+// the awaiting thread until it has to wait itself. Its awaiter carries on on
+// whichever thread it finishes on (for the async client, its event loop's).
+template <typename T>
+class Task {
+ public:
+  using promise_type = detail::TaskPromise<T>;
+
+  Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {
+  }
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (this->handle) this->handle.destroy();
+      this->handle = std::exchange(other.handle, {});
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task() {
+    if (this->handle) this->handle.destroy();
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<> awaiter) noexcept {
+    this->handle.promise().continuation = awaiter;
+    return this->handle;
+  }
+  T await_resume() {
+    return this->handle.promise().result();
+  }
+
+ private:
+  friend promise_type;
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {
+  }
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() {
+  return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+namespace detail {
+
+template <typename T>
+Detached signal_when_done(Task<T>& task, std::optional<T>& result,
+                          std::binary_semaphore& done) {
+  result.emplace(co_await task);
+  done.release();
+}
+
+inline Detached signal_when_done(Task<void>& task, std::optional<bool>& result,
+                                 std::binary_semaphore& done) {
+  co_await task;
+  result.emplace(true);
+  done.release();
+}
+
+// Runs each of `tasks` at once, and resumes the awaiter once they're all done
+template <typename T>
+struct WhenAll {
+  std::vector<Task<T>> tasks;
+  std::vector<std::optional<T>> results = {};
+  // The tasks still running, and one more for await_suspend itself, so that
+  // tasks finishing before it's done can't resume the awaiter early
+  std::atomic<size_t> remaining = 0;
+  std::coroutine_handle<> awaiter = {};
+
+  bool await_ready() const noexcept {
+    return this->tasks.empty();
+  }
+  bool await_suspend(std::coroutine_handle<> awaiter) {
+    this->awaiter = awaiter;
+    this->results.resize(this->tasks.size());
+    this->remaining = this->tasks.size() + 1;
+    for (size_t i = 0; i < this->tasks.size(); i++) run(this, i);
+    // If they all finished already, there's nothing to wait for
+    return this->remaining.fetch_sub(1) != 1;
+  }
+  std::vector<T> await_resume() {
+    std::vector<T> results;
+    results.reserve(this->results.size());
+    for (auto&& result : this->results) results.push_back(std::move(*result));
+    return results;
+  }
+
+  static Detached run(WhenAll* all, size_t i) {
+    Task<T>& task = all->tasks[i];
+    all->results[i].emplace(co_await task);
+    if (all->remaining.fetch_sub(1) == 1) all->awaiter.resume();
+  }
+};
+
+}  // namespace detail
+
+// Blocks until `task` is done, and returns its result. Not to be called from
+// a coroutine that the task may need to finish first (e.g. on an event loop
+// thread).
+template <typename T>
+T sync_wait(Task<T> task) {
+  std::binary_semaphore done(0);
+  if constexpr (std::is_void_v<T>) {
+    std::optional<bool> result;
+    detail::signal_when_done(task, result, done);
+    done.acquire();
+  } else {
+    std::optional<T> result;
+    detail::signal_when_done(task, result, done);
+    done.acquire();
+    return std::move(*result);
+  }
+}
+
+// Runs all of `tasks` concurrently, and returns their results in order once
+// they're all done
+template <typename T>
+Task<std::vector<T>> when_all(std::vector<Task<T>> tasks) {
+  // Awaited from a variable, as GCC 12 mishandles awaiting temporaries that
+  // own resources
+  detail::WhenAll<T> all{std::move(tasks)};
+  co_return co_await all;
+}
+
+#endif /* end of include guard */
@@ -0,0 +1,103 @@
+#include "udp_client.hpp"
+
+#include <poll.h>
+
+UdpClient::UdpClient(const std::string& server_addr)
+    : server_addr(server_addr),
+      fd(connect_datagram_socket(server_addr)),
+      in(MAX_DATAGRAM_SIZE) {
+}
+
+UdpClient::~UdpClient() {
+  if (this->fd >= 0) this->stop_udp();
+}
+
+std::optional<std::string> UdpClient::Get(const std::string& key) {
+  std::optional<Response> res = this->call(GetRequest{key});
+  if (!res) return std::nullopt;
+  if (auto* get_res = std::get_if<GetResponse>(&*res)) {
+    return get_res->value;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    cerr_color(YELLOW, "Failed to Get value from server: ", error_res->msg);
+  }
+  return std::nullopt;
+}
+
+std::optional<std::vector<std::string>> UdpClient::MultiGet(
+    const std::vector<std::string>& keys) {
+  std::optional<Response> res = this->call(MultiGetRequest{keys});
+  if (!res) return std::nullopt;
+  if (auto* multiget_res = std::get_if<MultiGetResponse>(&*res)) {
+    return multiget_res->values;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    cerr_color(YELLOW, "Failed to MultiGet values from server: ",
+               error_res->msg);
+  }
+  return std::nullopt;
+}
+
+std::optional<Response> UdpClient::call(const Request& req) {
+  if (std::optional<Response> res = this->call_udp(req)) return res;
+
+  this->fallbacks++;
+  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
+  if (!conn) {
+    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
+               '.');
+    return std::nullopt;
+  }
+  if (!conn->send_request(req)) return std::nullopt;
+  return conn->recv_response();
+}
+
+std::optional<Response> UdpClient::call_udp(const Request& req) {
+  std::optional<Message> msg = serialize_request(req);
+  if (!msg) return std::nullopt;
+  std::optional<Message> reply = this->exchange(*msg);
+  if (!reply) return std::nullopt;
+  return deserialize_response(std::move(*reply));
+}
+
+std::optional<Message> UdpClient::exchange(const Message& msg) {
+  if (this->fd < 0) return std::nullopt;
+  uint64_t id = this->next_id++;
+  write_datagram(this->out, id, &msg);
+  if (this->out.size() > MAX_DATAGRAM_SIZE) return std::nullopt;
+
+  milliseconds timeout = UDP_TIMEOUT;
+  for (int attempt = 0; attempt < UDP_ATTEMPTS; attempt++, timeout *= 2) {
+    if (send(this->fd, this->out.data(), this->out.size(), 0) < 0) {
+      this->stop_udp();
+      return std::nullopt;
+    }
+
+    auto deadline = steady_clock::now() + timeout;
+    while (true) {
+      auto left = duration_cast<milliseconds>(deadline - steady_clock::now());
+      struct pollfd pfd {this->fd, POLLIN, 0};
+      if (left <= 0ms || poll(&pfd, 1, left.count()) <= 0) break;
+
+      this->in.resize(MAX_DATAGRAM_SIZE);
+      ssize_t n = recv(this->fd, this->in.data(), this->in.size(), 0);
+      if (n < 0) {
+        this->stop_udp();
+        return std::nullopt;
+      }
+      this->in.resize(n);
+
+      // Replies to requests given up on, or to earlier attempts, are skipped
+      uint64_t reply_id;
+      std::optional<Message> reply;
+      if (!read_datagram(this->in, &reply_id, &reply) || reply_id != id) {
+        continue;
+      }
+      return reply;
+    }
+  }
+  return std::nullopt;
+}
+
+void UdpClient::stop_udp() {
+  ::close(this->fd);
+  this->fd = -1;
+}
@@ -0,0 +1,65 @@
+#ifndef UDP_CLIENT_HPP
+#define UDP_CLIENT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "net/network_conn.hpp"
+
+// How long a read over UDP waits for its reply before sending the request
+// again (twice as long each time), and how many times it's sent before the
+// read goes over TCP instead
+#define UDP_TIMEOUT 20ms
+#define UDP_ATTEMPTS 3
+
+// Reads from a KvServer's UDP listener (see KvServer): a Get or MultiGet is
+// sent as a single datagram, without a connection, and retried if no reply
+// comes in time; replies to earlier attempts are told apart by their ids.
+// Reads whose request or response doesn't fit in a datagram, and ones that
+// never get a reply (e.g. from a server without a UDP listener), go over TCP,
+// with a connection each as SimpleClient's requests do. Fails the way
+// SimpleClient does. Not for use by several threads at once.
+class UdpClient {
+ public:
+  explicit UdpClient(const std::string& server_addr);
+  ~UdpClient();
+
+  std::optional<std::string> Get(const std::string& key);
+
+  std::optional<std::vector<std::string>> MultiGet(
+      const std::vector<std::string>& keys);
+
+  // Sends a GetRequest or MultiGetRequest and returns the response, which may
+  // be an ErrorResponse, or std::nullopt if the server couldn't be reached
+  std::optional<Response> call(const Request& req);
+  // The same, over UDP only: std::nullopt if the read has to go over TCP
+  // instead (e.g. over a connection the caller keeps)
+  std::optional<Response> call_udp(const Request& req);
+
+  // How many reads went over TCP
+  uint64_t n_fallbacks() const {
+    return this->fallbacks;
+  }
+
+  UdpClient(const UdpClient&) = delete;
+  UdpClient& operator=(const UdpClient&) = delete;
+
+ private:
+  std::string server_addr;
+  int fd;
+  uint64_t next_id = 0;
+  std::vector<std::byte> out, in;
+  uint64_t fallbacks = 0;
+
+  // Sends `msg` over UDP until a reply comes. Returns the reply's message, or
+  // std::nullopt if there was none or it didn't fit (to go over TCP).
+  std::optional<Message> exchange(const Message& msg);
+  // Reads go over TCP from now on, after the socket failed (e.g. with
+  // ECONNREFUSED, as nothing listens on the server's port for UDP)
+  void stop_udp();
+};
+
+#endif /* end of include guard */
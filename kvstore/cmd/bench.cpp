@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_client.hpp"
+#include "bench/cluster.hpp"
+#include "bench/histogram.hpp"
+#include "bench/workload.hpp"
+#include "client/shardkv_client.hpp"
+#include "common/utils.hpp"
+
+struct Options {
+  std::string workloads = "A";
+  std::optional<KeyDistribution> distribution;
+  uint64_t n_records = 10'000;
+  uint64_t n_operations = 100'000;
+  size_t value_size = 100;
+  std::vector<size_t> thread_counts = {1, 8};
+  // Where the cluster is; if neither is set, one is started in this process
+  // with `n_servers` servers, listening from `port` up
+  std::string server;
+  std::string shardcontroller;
+  size_t n_servers = 1;
+  // If set, the local server is a CoreServer with this many cores rather than
+  // a KvServer, for comparing how the two scale with --threads
+  size_t per_core = 0;
+  // Whether Gets and MultiGets (reads and scans) go over UDP rather than the
+  // connection the rest of the requests use, for comparing the two
+  bool udp_reads = false;
+  std::string port = "12000";
+  std::string output = "performance-runtime.csv";
+};
+
+static void usage() {
+  cerr_color(
+      RED,
+      "Usage: ./bench [--workload <letters A-F>] "
+      "[--distribution uniform|zipfian|latest]\n"
+      "               [--records <n>] [--operations <n>] "
+      "[--value-size <bytes>] [--threads <n>[,<n>...]]\n"
+      "               [--server <host:port> | --shardcontroller <host:port> | "
+      "--servers <n> [--port <port>]]\n"
+      "               [--per-core <n cores>] [--reads tcp|udp]\n"
+      "               [--output <csv file>]");
+}
+
+static std::optional<Options> parse_args(int argc, char* argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) return std::nullopt;
+    std::string arg = argv[++i];
+
+    if (flag == "--workload") {
+      for (char name : arg) {
+        if (!Workload::ycsb(name)) return std::nullopt;
+      }
+      opts.workloads = arg;
+    } else if (flag == "--distribution") {
+      opts.distribution = parse_distribution(arg);
+      if (!opts.distribution) return std::nullopt;
+    } else if (flag == "--threads") {
+      opts.thread_counts.clear();
+      for (auto&& count : split(arg, ',')) {
+        if (!is_number(count) || std::stoul(count) == 0) return std::nullopt;
+        opts.thread_counts.push_back(std::stoul(count));
+      }
+      if (opts.thread_counts.empty()) return std::nullopt;
+    } else if (flag == "--server") {
+      opts.server = arg;
+    } else if (flag == "--shardcontroller") {
+      opts.shardcontroller = arg;
+    } else if (flag == "--output") {
+      opts.output = arg;
+    } else if (flag == "--reads") {
+      if (arg != "tcp" && arg != "udp") return std::nullopt;
+      opts.udp_reads = arg == "udp";
+    } else if (!is_number(arg)) {
+      return std::nullopt;
+    } else if (flag == "--records") {
+      opts.n_records = std::stoull(arg);
+    } else if (flag == "--operations") {
+      opts.n_operations = std::stoull(arg);
+    } else if (flag == "--value-size") {
+      opts.value_size = std::stoul(arg);
+    } else if (flag == "--servers") {
+      opts.n_servers = std::max<size_t>(std::stoul(arg), 1);
+    } else if (flag == "--per-core") {
+      opts.per_core = std::stoul(arg);
+    } else if (flag == "--port") {
+      opts.port = arg;
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (!opts.server.empty() && !opts.shardcontroller.empty()) return std::nullopt;
+  // Only a local, single server can run per core, and it doesn't serve UDP
+  if (opts.per_core > 0 &&
+      (!opts.server.empty() || !opts.shardcontroller.empty() ||
+       opts.n_servers > 1 || opts.udp_reads)) {
+    return std::nullopt;
+  }
+  return opts;
+}
+
+struct RunResult {
+  std::chrono::milliseconds elapsed;
+  uint64_t n_ops = 0;
+  uint64_t n_errors = 0;
+  LatencyHistogram latencies;
+};
+
+// Runs `n_ops` operations of `workload` from `n_threads` threads, each
+// issuing its next request as soon as the last one completes. Inserts claim
+// record numbers from `n_records`, so a thread may occasionally pick a record
+// whose insert hasn't finished yet; such reads count as errors.
+static RunResult run_workload(const Workload& workload, uint64_t n_ops,
+                              size_t n_threads, size_t value_size,
+                              std::atomic<uint64_t>& n_records,
+                              const std::function<BenchClient()>& make_client) {
+  std::vector<RunResult> results(n_threads);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < n_threads; t++) {
+    threads.emplace_back([&, t] {
+      BenchClient client = make_client();
+      KeyChooser chooser(workload.distribution, n_records.load(),
+                         (uint64_t(workload.name) << 32) + t);
+      std::string value(value_size, 'x');
+      for (auto& c : value) c = 'a' + chooser.rng()() % 26;
+
+      RunResult& result = results[t];
+      uint64_t my_ops = n_ops / n_threads + (t < n_ops % n_threads);
+      for (uint64_t i = 0; i < my_ops; i++) {
+        OpType op = workload.pick(chooser.uniform());
+        auto op_start = std::chrono::steady_clock::now();
+        bool ok = false;
+        switch (op) {
+          case OpType::READ:
+            ok = client.Get(record_key(chooser.next(n_records.load())));
+            break;
+          case OpType::UPDATE:
+            ok = client.Put(record_key(chooser.next(n_records.load())), value);
+            break;
+          case OpType::INSERT:
+            ok = client.Put(record_key(n_records.fetch_add(1)), value);
+            break;
+          case OpType::SCAN: {
+            uint64_t n = n_records.load();
+            uint64_t first = chooser.next(n);
+            uint64_t length = 1 + chooser.rng()() % Workload::MAX_SCAN_LENGTH;
+            std::vector<std::string> keys;
+            for (uint64_t r = first; r < std::min(first + length, n); r++) {
+              keys.push_back(record_key(r));
+            }
+            ok = client.MultiGet(keys);
+            break;
+          }
+          case OpType::READ_MODIFY_WRITE: {
+            std::string key = record_key(chooser.next(n_records.load()));
+            ok = client.Get(key) && client.Put(key, value);
+            break;
+          }
+        }
+        result.latencies.record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - op_start)
+                .count());
+        result.n_ops++;
+        result.n_errors += !ok;
+      }
+    });
+  }
+  for (auto&& thread : threads) thread.join();
+
+  RunResult total;
+  total.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  for (auto&& result : results) {
+    total.n_ops += result.n_ops;
+    total.n_errors += result.n_errors;
+    total.latencies.merge(result.latencies);
+  }
+  return total;
+}
+
+int main(int argc, char* argv[]) {
+  auto parsed = parse_args(argc, argv);
+  if (!parsed) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  const Options& opts = *parsed;
+
+  LocalCluster cluster;
+  std::string server = opts.server;
+  std::string shardcontroller = opts.shardcontroller;
+  if (opts.per_core > 0) {
+    if (!cluster.start_per_core(std::stoull(opts.port), opts.per_core,
+                                server)) {
+      cerr_color(RED, "Failed to start the benchmark server.");
+      return EXIT_FAILURE;
+    }
+  } else if (server.empty() && shardcontroller.empty()) {
+    size_t max_threads =
+        *std::max_element(opts.thread_counts.begin(), opts.thread_counts.end());
+    // Every thread keeps a connection to every server, and the loader one more
+    if (!cluster.start(opts.n_servers, std::stoull(opts.port), max_threads + 1,
+                       server, shardcontroller, opts.udp_reads)) {
+      cerr_color(RED, "Failed to start the benchmark cluster.");
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::function<BenchClient()> make_client = [&] {
+    BenchClient client(server);
+    if (opts.udp_reads) client.read_over_udp();
+    return client;
+  };
+  if (!shardcontroller.empty()) {
+    auto config = ShardKvClient(shardcontroller).Query();
+    if (!config) {
+      cerr_color(RED, "Failed to query the shardcontroller at ",
+                 shardcontroller);
+      return EXIT_FAILURE;
+    }
+    make_client = [&opts, config = *config] {
+      BenchClient client(config);
+      if (opts.udp_reads) client.read_over_udp();
+      return client;
+    };
+  }
+
+  // Load the initial records
+  {
+    BenchClient loader = make_client();
+    if (!load_records(loader, opts.n_records, opts.value_size)) {
+      cerr_color(RED, "Failed to load the initial records.");
+      return EXIT_FAILURE;
+    }
+  }
+  std::atomic<uint64_t> n_records = opts.n_records;
+
+  // Rows follow the order of --threads, so "--threads 1,8" plots each
+  // workload's multithreaded run against its single-threaded one
+  std::ofstream output(opts.output, std::ios::app);
+  if (!output.is_open()) {
+    cerr_color(RED, "Failed to open ", opts.output);
+    return EXIT_FAILURE;
+  }
+  if (output.tellp() == 0) {
+    output << "title,time,tput,p50_us,p99_us,p999_us,errors\n";
+  }
+
+  for (char name : opts.workloads) {
+    Workload workload = *Workload::ycsb(name);
+    if (opts.distribution) workload.distribution = *opts.distribution;
+
+    for (size_t n_threads : opts.thread_counts) {
+      RunResult result =
+          run_workload(workload, opts.n_operations, n_threads,
+                       opts.value_size, n_records, make_client);
+
+      std::ostringstream title;
+      title << "ycsb_" << char(std::tolower(workload.name)) << "_"
+            << distribution_name(workload.distribution) << "_" << n_threads
+            << "t";
+      if (opts.per_core > 0) title << "_per_core";
+      if (opts.udp_reads) title << "_udp";
+      double seconds = std::max<double>(result.elapsed.count(), 1) / 1000.0;
+      double throughput = result.n_ops / seconds;
+      auto us = [&](double q) {
+        return result.latencies.percentile(q) / 1000.0;
+      };
+
+      output << std::fixed << std::setprecision(1) << title.str() << ","
+             << result.elapsed.count() << "," << throughput << "," << us(0.5)
+             << "," << us(0.99) << "," << us(0.999) << "," << result.n_errors
+             << "\n";
+      output.flush();
+      cout_color(GREEN, title.str(), ": ", uint64_t(throughput), " ops/s, p50 ",
+                 us(0.5), "us, p99 ", us(0.99), "us, p999 ", us(0.999),
+                 "us, ", result.n_errors, " errors");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,371 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "client/shardkv_client.hpp"
+#include "common/utils.hpp"
+#include "net/network_conn.hpp"
+
+struct Options {
+  std::vector<std::string> files;
+  // Where the cluster is: a single server, or a shardcontroller whose config
+  // says which server each record goes to
+  std::string server;
+  std::string shardcontroller;
+  // Records per MultiPut, and connections sending them to each server
+  size_t batch_size = 10'000;
+  size_t n_connections = 2;
+  // Threads reading each file; 0 for one per core
+  size_t n_readers = 0;
+  uint64_t ttl_ms = 0;
+};
+
+static void usage() {
+  cerr_color(
+      RED,
+      "Usage: ./bulkload (--server <host:port> | --shardcontroller "
+      "<host:port>)\n"
+      "                  [--batch <records>] [--connections <n per server>] "
+      "[--readers <n>] [--ttl <ms>]\n"
+      "                  <file>...\n"
+      "Each line of the files is a record: \"<key> <value>\", optionally "
+      "preceded by \"put \" (as in gdpr/database.csv).");
+}
+
+static std::optional<Options> parse_args(int argc, char* argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (flag.rfind("--", 0) != 0) {
+      opts.files.push_back(flag);
+      continue;
+    }
+    if (i + 1 >= argc) return std::nullopt;
+    std::string arg = argv[++i];
+
+    if (flag == "--server") {
+      opts.server = arg;
+    } else if (flag == "--shardcontroller") {
+      opts.shardcontroller = arg;
+    } else if (!is_number(arg)) {
+      return std::nullopt;
+    } else if (flag == "--batch") {
+      opts.batch_size = std::max<size_t>(std::stoul(arg), 1);
+    } else if (flag == "--connections") {
+      opts.n_connections = std::max<size_t>(std::stoul(arg), 1);
+    } else if (flag == "--readers") {
+      opts.n_readers = std::stoul(arg);
+    } else if (flag == "--ttl") {
+      opts.ttl_ms = std::stoull(arg);
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (opts.server.empty() == opts.shardcontroller.empty()) return std::nullopt;
+  if (opts.files.empty()) return std::nullopt;
+  if (opts.n_readers == 0) {
+    opts.n_readers = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  return opts;
+}
+
+// A file mapped into memory, read-only, for as long as this lives
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      perror_color(RED, "open");
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        // Read once, front to back: read ahead, and drop pages behind
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        this->data = static_cast<const char*>(data);
+        this->size = st.st_size;
+      } else {
+        perror_color(RED, "mmap");
+      }
+    }
+    this->ok = st.st_size == 0 || this->data;
+    close(fd);
+  }
+  ~MappedFile() {
+    if (this->data) munmap(const_cast<char*>(this->data), this->size);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::string_view contents() const {
+    return {this->data, this->size};
+  }
+
+  bool ok = false;
+
+ private:
+  const char* data = nullptr;
+  size_t size = 0;
+};
+
+// The batches on their way to one server. Readers block once `capacity` are
+// waiting, so that the input is read no faster than the server takes it.
+class BatchQueue {
+ public:
+  explicit BatchQueue(size_t capacity) : capacity(capacity) {
+  }
+
+  void push(MultiPutRequest batch) {
+    std::unique_lock lock(this->mtx);
+    this->not_full.wait(lock,
+                        [&] { return this->batches.size() < this->capacity; });
+    this->batches.push_back(std::move(batch));
+    this->not_empty.notify_one();
+  }
+
+  // The next batch, or std::nullopt once the queue is closed and empty
+  std::optional<MultiPutRequest> pop() {
+    std::unique_lock lock(this->mtx);
+    this->not_empty.wait(
+        lock, [&] { return !this->batches.empty() || this->closed; });
+    if (this->batches.empty()) return std::nullopt;
+    MultiPutRequest batch = std::move(this->batches.front());
+    this->batches.pop_front();
+    this->not_full.notify_one();
+    return batch;
+  }
+
+  void close() {
+    std::unique_lock lock(this->mtx);
+    this->closed = true;
+    this->not_empty.notify_all();
+  }
+
+ private:
+  size_t capacity;
+  std::deque<MultiPutRequest> batches;
+  bool closed = false;
+  std::mutex mtx;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+};
+
+struct Totals {
+  std::atomic<uint64_t> n_records = 0;
+  std::atomic<uint64_t> n_bytes = 0;
+  std::atomic<uint64_t> n_failed = 0;
+  std::atomic<uint64_t> n_malformed = 0;
+};
+
+// Splits `text` into `n` ranges that start at line boundaries
+static std::vector<std::string_view> split_lines(std::string_view text,
+                                                 size_t n) {
+  std::vector<std::string_view> ranges;
+  size_t start = 0;
+  for (size_t i = 1; i <= n && start < text.size(); i++) {
+    size_t end = i == n ? text.size() : text.size() * i / n;
+    end = end < start ? start : end;
+    size_t newline = text.find('\n', end);
+    end = i == n || newline == std::string_view::npos ? text.size()
+                                                       : newline + 1;
+    if (end > start) ranges.push_back(text.substr(start, end - start));
+    start = end;
+  }
+  return ranges;
+}
+
+// Parses the records in `text`, a range of whole lines, into batches for the
+// servers that own their keys
+static void read_records(std::string_view text, const Options& opts,
+                         const std::optional<ShardControllerConfig>& config,
+                         std::map<std::string, BatchQueue>& queues,
+                         Totals& totals) {
+  std::map<std::string, MultiPutRequest> batches;
+  while (!text.empty()) {
+    size_t newline = text.find('\n');
+    std::string_view line = text.substr(0, newline);
+    text.remove_prefix(newline == std::string_view::npos ? text.size()
+                                                         : newline + 1);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if (line.empty()) continue;
+    if (line.starts_with("put ")) line.remove_prefix(4);
+
+    size_t space = line.find(' ');
+    if (space == 0 || space == std::string_view::npos) {
+      totals.n_malformed++;
+      continue;
+    }
+    std::string key(line.substr(0, space));
+    std::optional<std::string> server =
+        config ? config->get_server(key) : opts.server;
+    if (!server || !queues.contains(*server)) {
+      totals.n_failed++;
+      continue;
+    }
+
+    MultiPutRequest& batch = batches[*server];
+    batch.keys.push_back(std::move(key));
+    batch.values.emplace_back(line.substr(space + 1));
+    if (batch.keys.size() >= opts.batch_size) {
+      batch.ttl_ms = opts.ttl_ms;
+      batch.bulk = true;
+      queues.at(*server).push(std::move(batch));
+      batch = MultiPutRequest{};
+    }
+  }
+  for (auto&& [server, batch] : batches) {
+    if (batch.keys.empty()) continue;
+    batch.ttl_ms = opts.ttl_ms;
+    batch.bulk = true;
+    queues.at(server).push(std::move(batch));
+  }
+}
+
+// Sends the batches in `queue` to `server` over a connection of its own. If
+// the connection fails or the server turns a batch down (e.g. its shards
+// moved), the batch is sent again through a client that follows the latest
+// config, if there is one.
+static void send_batches(const std::string& server, BatchQueue& queue,
+                         const Options& opts, Totals& totals) {
+  std::shared_ptr<ServerConn> conn = connect_to_server(server);
+  std::unique_ptr<ShardKvClient> fallback;
+  while (auto batch = queue.pop()) {
+    uint64_t n_records = batch->keys.size();
+    uint64_t n_bytes = 0;
+    for (size_t i = 0; i < n_records; i++) {
+      n_bytes += batch->keys[i].size() + batch->values[i].size();
+    }
+    // Serialized without copying the batch; it's only needed again if the
+    // batch has to be sent another way
+    std::optional<Message> msg = serialize_request(std::move(*batch));
+
+    bool ok = false;
+    if (conn && msg && conn->send_request(*msg)) {
+      std::optional<Response> res = conn->recv_response();
+      ok = res && std::holds_alternative<MultiPutResponse>(*res);
+      if (!res) conn.reset();
+      if (auto* error_res = res ? std::get_if<ErrorResponse>(&*res) : nullptr) {
+        cerr_color(YELLOW, "Server ", server,
+                   " turned down a batch: ", error_res->msg);
+      }
+    } else {
+      conn.reset();
+    }
+    std::optional<Request> retry;
+    if (!ok && msg && !opts.shardcontroller.empty()) {
+      retry = deserialize_request(*msg);
+    }
+    if (auto* retry_req =
+            retry ? std::get_if<MultiPutRequest>(&*retry) : nullptr) {
+      if (!fallback) {
+        fallback = std::make_unique<ShardKvClient>(opts.shardcontroller);
+      }
+      ok = fallback->MultiPut(retry_req->keys, retry_req->values,
+                              std::chrono::milliseconds(opts.ttl_ms));
+    }
+
+    if (ok) {
+      totals.n_records += n_records;
+      totals.n_bytes += n_bytes;
+    } else {
+      totals.n_failed += n_records;
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  auto parsed = parse_args(argc, argv);
+  if (!parsed) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  const Options& opts = *parsed;
+
+  std::optional<ShardControllerConfig> config;
+  std::vector<std::string> servers{opts.server};
+  if (!opts.shardcontroller.empty()) {
+    config = ShardKvClient(opts.shardcontroller).Query();
+    if (!config) {
+      cerr_color(RED, "Failed to query the shardcontroller at ",
+                 opts.shardcontroller);
+      return EXIT_FAILURE;
+    }
+    servers.clear();
+    for (auto&& [server, _] : config->server_to_shards) {
+      servers.push_back(server);
+    }
+  }
+
+  std::vector<std::unique_ptr<MappedFile>> files;
+  for (auto&& path : opts.files) {
+    files.push_back(std::make_unique<MappedFile>(path));
+    if (!files.back()->ok) {
+      cerr_color(RED, "Failed to read ", path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  Totals totals;
+  // Two batches in flight per connection: one being sent, one ready to go
+  std::map<std::string, BatchQueue> queues;
+  for (auto&& server : servers) {
+    queues.try_emplace(server, 2 * opts.n_connections);
+  }
+  std::vector<std::thread> senders;
+  for (auto&& [server, queue] : queues) {
+    for (size_t i = 0; i < opts.n_connections; i++) {
+      senders.emplace_back(send_batches, std::cref(server), std::ref(queue),
+                           std::cref(opts), std::ref(totals));
+    }
+  }
+
+  std::vector<std::thread> readers;
+  for (auto&& file : files) {
+    for (auto&& range : split_lines(file->contents(), opts.n_readers)) {
+      readers.emplace_back(read_records, range, std::cref(opts),
+                           std::cref(config), std::ref(queues),
+                           std::ref(totals));
+    }
+  }
+  for (auto&& thread : readers) thread.join();
+  for (auto&& [_, queue] : queues) queue.close();
+  for (auto&& thread : senders) thread.join();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << std::fixed << std::setprecision(0) << "Loaded "
+            << totals.n_records << " records ("
+            << std::setprecision(1) << totals.n_bytes / 1e6 << " MB) into "
+            << servers.size() << " server(s) in " << std::setprecision(2)
+            << seconds << "s: " << std::setprecision(0)
+            << totals.n_records / std::max(seconds, 1e-9) << " records/s\n";
+  if (totals.n_malformed > 0) {
+    cerr_color(YELLOW, "Skipped ", totals.n_malformed.load(),
+               " lines without a key and value.");
+  }
+  if (totals.n_failed > 0) {
+    cerr_color(RED, "Failed to load ", totals.n_failed.load(), " records.");
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
@@ -6,14 +6,22 @@
 
 // Commands
 #include "client/cmd/appendcommand.hpp"
+#include "client/cmd/cascommand.hpp"
+#include "client/cmd/decrementcommand.hpp"
 #include "client/cmd/deletecommand.hpp"
+#include "client/cmd/deleteifequalscommand.hpp"
 #include "client/cmd/gdpr_deletecommand.hpp"
 #include "client/cmd/getcommand.hpp"
+#include "client/cmd/getfilecommand.hpp"
+#include "client/cmd/incrementcommand.hpp"
 #include "client/cmd/movecommand.hpp"
 #include "client/cmd/multigetcommand.hpp"
 #include "client/cmd/multiputcommand.hpp"
 #include "client/cmd/putcommand.hpp"
+#include "client/cmd/putfilecommand.hpp"
+#include "client/cmd/putifabsentcommand.hpp"
 #include "client/cmd/querycommand.hpp"
+#include "client/cmd/statscommand.hpp"
 #include "common/color.hpp"
 #include "repl/repl.hpp"
 
@@ -52,14 +60,30 @@ int main(int argc, char* argv[]) {
   repl.add_command(pc);
   AppendCommand ac{client};
   repl.add_command(ac);
+  PutFileCommand pfc{client};
+  repl.add_command(pfc);
+  GetFileCommand gfc{client};
+  repl.add_command(gfc);
   DeleteCommand dc{client};
   repl.add_command(dc);
   MultiGetCommand mgc{client};
   repl.add_command(mgc);
   MultiPutCommand mpc{client};
   repl.add_command(mpc);
+  CasCommand casc{client};
+  repl.add_command(casc);
+  IncrementCommand ic{client};
+  repl.add_command(ic);
+  DecrementCommand decc{client};
+  repl.add_command(decc);
+  PutIfAbsentCommand piac{client};
+  repl.add_command(piac);
+  DeleteIfEqualsCommand diec{client};
+  repl.add_command(diec);
   GDPRDeleteCommand gdel{client};
   repl.add_command(gdel);
+  StatsCommand sc{client};
+  repl.add_command(sc);
 
   repl.run();
 
@@ -0,0 +1,270 @@
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <vector>
+
+#include "bench/bench_client.hpp"
+#include "bench/cluster.hpp"
+#include "bench/open_loop.hpp"
+#include "bench/workload.hpp"
+#include "client/shardkv_client.hpp"
+#include "common/utils.hpp"
+
+// How long the responses to a step's requests get to come in after its last
+// request is sent
+constexpr auto DRAIN_TIMEOUT = std::chrono::seconds(10);
+
+// A step is saturated once it completes less than this fraction of the load
+// offered to it
+constexpr double SATURATION_FRACTION = 0.95;
+
+struct Options {
+  std::string workload = "A";
+  std::optional<KeyDistribution> distribution;
+  uint64_t n_records = 10'000;
+  size_t value_size = 100;
+  // Offered load, in operations per second: from `start_rate` up to
+  // `max_rate`, `rate_step` at a time, each for `duration_ms`
+  uint64_t start_rate = 2'000;
+  uint64_t rate_step = 2'000;
+  uint64_t max_rate = 100'000;
+  uint64_t duration_ms = 5'000;
+  size_t n_connections = 4;
+  // The p99 latency beyond which a step counts as saturated
+  uint64_t slo_us = 1'000;
+  // Where the cluster is; if neither is set, one is started in this process
+  // with `n_servers` servers, listening from `port` up
+  std::string server;
+  std::string shardcontroller;
+  size_t n_servers = 1;
+  std::string port = "12000";
+  std::string output = "loadgen-runtime.csv";
+  std::string report = "loadgen-report.txt";
+};
+
+static void usage() {
+  cerr_color(
+      RED,
+      "Usage: ./loadgen [--workload A|B|C|D] "
+      "[--distribution uniform|zipfian|latest]\n"
+      "                 [--records <n>] [--value-size <bytes>] "
+      "[--connections <n>] [--duration <ms>]\n"
+      "                 [--start-rate <ops/s>] [--rate-step <ops/s>] "
+      "[--max-rate <ops/s>] [--slo <p99 us>]\n"
+      "                 [--server <host:port> | --shardcontroller <host:port> "
+      "| --servers <n> [--port <port>]]\n"
+      "                 [--output <csv file>] [--report <file>]");
+}
+
+static std::optional<Options> parse_args(int argc, char* argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) return std::nullopt;
+    std::string arg = argv[++i];
+
+    if (flag == "--workload") {
+      // Scans and read-modify-writes take more than one request each
+      if (arg.size() != 1 || !Workload::ycsb(arg[0]) ||
+          !OpenLoopGenerator::supports(*Workload::ycsb(arg[0]))) {
+        return std::nullopt;
+      }
+      opts.workload = arg;
+    } else if (flag == "--distribution") {
+      opts.distribution = parse_distribution(arg);
+      if (!opts.distribution) return std::nullopt;
+    } else if (flag == "--server") {
+      opts.server = arg;
+    } else if (flag == "--shardcontroller") {
+      opts.shardcontroller = arg;
+    } else if (flag == "--output") {
+      opts.output = arg;
+    } else if (flag == "--report") {
+      opts.report = arg;
+    } else if (!is_number(arg)) {
+      return std::nullopt;
+    } else if (flag == "--records") {
+      opts.n_records = std::stoull(arg);
+    } else if (flag == "--value-size") {
+      opts.value_size = std::stoul(arg);
+    } else if (flag == "--connections") {
+      opts.n_connections = std::max<size_t>(std::stoul(arg), 1);
+    } else if (flag == "--duration") {
+      opts.duration_ms = std::max<uint64_t>(std::stoull(arg), 1);
+    } else if (flag == "--start-rate") {
+      opts.start_rate = std::stoull(arg);
+    } else if (flag == "--rate-step") {
+      opts.rate_step = std::stoull(arg);
+    } else if (flag == "--max-rate") {
+      opts.max_rate = std::stoull(arg);
+    } else if (flag == "--slo") {
+      opts.slo_us = std::stoull(arg);
+    } else if (flag == "--servers") {
+      opts.n_servers = std::max<size_t>(std::stoul(arg), 1);
+    } else if (flag == "--port") {
+      opts.port = arg;
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (!opts.server.empty() && !opts.shardcontroller.empty()) return std::nullopt;
+  if (opts.start_rate == 0 || opts.rate_step == 0) return std::nullopt;
+  return opts;
+}
+
+static double us(const LatencyHistogram& histogram, double q) {
+  return histogram.percentile(q) / 1000.0;
+}
+
+static bool saturated(const OpenLoopResult& result, const Options& opts) {
+  return result.achieved < SATURATION_FRACTION * result.offered ||
+         us(result.latencies, 0.99) > opts.slo_us || result.n_errors > 0;
+}
+
+// The knee is the highest offered load that the cluster kept up with, within
+// the latency objective, before the first step that it didn't
+static void write_report(std::ostream& out, const Options& opts,
+                         const std::string& title,
+                         const std::vector<OpenLoopResult>& steps) {
+  out << "Open-loop load test: " << title << ", " << opts.n_connections
+      << " connections per server, " << opts.duration_ms << "ms per step\n"
+      << "Latency is measured from each request's intended send time.\n\n";
+  out << std::setw(10) << "offered" << std::setw(10) << "achieved"
+      << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+      << std::setw(10) << "p99.9 us" << std::setw(11) << "max us"
+      << std::setw(10) << "lag p99" << std::setw(8) << "errors" << "\n";
+
+  std::optional<double> knee;
+  bool saturated_yet = false;
+  for (auto&& step : steps) {
+    bool over = saturated(step, opts);
+    if (!over && !saturated_yet) knee = step.offered;
+    saturated_yet |= over;
+    out << std::fixed << std::setprecision(0) << std::setw(10) << step.offered
+        << std::setw(10) << step.achieved << std::setprecision(1)
+        << std::setw(10) << us(step.latencies, 0.5) << std::setw(10)
+        << us(step.latencies, 0.99) << std::setw(10)
+        << us(step.latencies, 0.999) << std::setw(11)
+        << step.latencies.max() / 1000.0 << std::setw(10)
+        << us(step.send_lag, 0.99) << std::setw(8) << step.n_errors
+        << (over ? "  saturated" : "") << "\n";
+  }
+
+  out << std::setprecision(0) << "\n";
+  if (!knee) {
+    out << "Saturated at the lowest offered load (" << opts.start_rate
+        << " ops/s); lower --start-rate.\n";
+  } else if (!saturated_yet) {
+    out << "Not saturated up to " << *knee
+        << " ops/s; raise --max-rate to find the knee.\n";
+  } else {
+    out << "Knee: " << *knee << " ops/s (p99 within " << opts.slo_us
+        << "us, at least " << SATURATION_FRACTION * 100
+        << "% of the offered load completed, no errors).\n";
+  }
+  if (!steps.empty() && us(steps.back().send_lag, 0.99) > opts.slo_us) {
+    out << "The generator fell behind its schedule at the highest load; add "
+           "--connections or run it on more cores.\n";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  auto parsed = parse_args(argc, argv);
+  if (!parsed) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  const Options& opts = *parsed;
+
+  LocalCluster cluster;
+  std::string server = opts.server;
+  std::string shardcontroller = opts.shardcontroller;
+  if (server.empty() && shardcontroller.empty()) {
+    // Every connection has a worker to itself, and the loader one more
+    if (!cluster.start(opts.n_servers, std::stoull(opts.port),
+                       opts.n_connections + 1, server, shardcontroller)) {
+      cerr_color(RED, "Failed to start the load test cluster.");
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::optional<ShardControllerConfig> config;
+  if (!shardcontroller.empty()) {
+    config = ShardKvClient(shardcontroller).Query();
+    if (!config) {
+      cerr_color(RED, "Failed to query the shardcontroller at ",
+                 shardcontroller);
+      return EXIT_FAILURE;
+    }
+  }
+
+  {
+    BenchClient loader = config ? BenchClient(*config) : BenchClient(server);
+    if (!load_records(loader, opts.n_records, opts.value_size)) {
+      cerr_color(RED, "Failed to load the initial records.");
+      return EXIT_FAILURE;
+    }
+  }
+  std::atomic<uint64_t> n_records = opts.n_records;
+
+  Workload workload = *Workload::ycsb(opts.workload[0]);
+  if (opts.distribution) workload.distribution = *opts.distribution;
+  std::ostringstream title;
+  title << "ycsb_" << char(std::tolower(workload.name)) << "_"
+        << distribution_name(workload.distribution) << "_open";
+
+  std::ofstream output(opts.output, std::ios::app);
+  if (!output.is_open()) {
+    cerr_color(RED, "Failed to open ", opts.output);
+    return EXIT_FAILURE;
+  }
+  if (output.tellp() == 0) {
+    output << "title,time,tput,offered,p50_us,p99_us,p999_us,max_us,"
+              "lag_p99_us,errors\n";
+  }
+
+  auto generator = config ? std::make_unique<OpenLoopGenerator>(
+                                *config, opts.n_connections)
+                          : std::make_unique<OpenLoopGenerator>(
+                                server, opts.n_connections);
+  std::vector<OpenLoopResult> steps;
+  for (uint64_t rate = opts.start_rate; rate <= opts.max_rate;
+       rate += opts.rate_step) {
+    if (!generator->connect()) {
+      cerr_color(RED, "Failed to connect to the servers.");
+      return EXIT_FAILURE;
+    }
+    steps.push_back(generator->run(
+        workload, static_cast<double>(rate),
+        std::chrono::milliseconds(opts.duration_ms), opts.value_size,
+        n_records, DRAIN_TIMEOUT));
+    const OpenLoopResult& step = steps.back();
+
+    output << std::fixed << std::setprecision(1) << title.str() << "_" << rate
+           << "," << step.elapsed.count() << "," << step.achieved << ","
+           << step.offered << "," << us(step.latencies, 0.5) << ","
+           << us(step.latencies, 0.99) << "," << us(step.latencies, 0.999)
+           << "," << step.latencies.max() / 1000.0 << ","
+           << us(step.send_lag, 0.99) << "," << step.n_errors << "\n";
+    output.flush();
+    cout_color(saturated(step, opts) ? YELLOW : GREEN, title.str(), " at ",
+               rate, " ops/s: ", uint64_t(step.achieved), " ops/s done, p99 ",
+               us(step.latencies, 0.99), "us, ", step.n_errors, " errors");
+
+    // One step past the knee is enough to show it
+    if (saturated(step, opts)) break;
+  }
+
+  write_report(std::cout, opts, title.str(), steps);
+  std::ofstream report(opts.report);
+  if (!report.is_open()) {
+    cerr_color(RED, "Failed to open ", opts.report);
+    return EXIT_FAILURE;
+  }
+  write_report(report, opts, title.str(), steps);
+  return 0;
+}
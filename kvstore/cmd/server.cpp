@@ -3,26 +3,52 @@
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 
 #include "kvstore/kvstore.hpp"
 #include "repl/repl.hpp"
+#include "server/core_server.hpp"
 #include "server/cmd/joincommand.hpp"
 #include "server/cmd/leavecommand.hpp"
 #include "server/cmd/printcommand.hpp"
 
 int main(int argc, char* argv[]) {
+  // A trailing --udp also serves small reads over UDP (see KvServer)
+  bool udp = argc > 2 && std::string(argv[argc - 1]) == "--udp";
+  if (udp) argc--;
   if (argc < 2 || argc > 4) {
     cerr_color(RED,
                "\nIf on Concurrent Store:\n"
-               "\t./server <port> [n_workers]\n"
+               "\t./server <port> [n_workers] [--udp]\n"
+               "\t./server <port> --per-core [n_cores]\n"
                "If on Distributed Store:\n"
-               "\t./server <port> <shardcontroller hostname:port> [n_workers]");
+               "\t./server <port> <shardcontroller hostname:port> [n_workers] "
+               "[--udp]");
     return EXIT_FAILURE;
   }
 
   std::shared_ptr<KvServer> server;
 
   std::string addr = get_host_address(argv[1]);
+
+  // Concurrent Store with a thread per core, each owning part of the keys
+  if (argc >= 3 && std::string(argv[2]) == "--per-core") {
+    if (udp) {
+      cerr_color(RED, "A per-core server doesn't serve reads over UDP.");
+      return EXIT_FAILURE;
+    }
+    size_t n_cores = argc == 4 ? std::stoul(argv[3])
+                               : std::thread::hardware_concurrency();
+    CoreServer core_server(addr, n_cores);
+    if (core_server.start() < 0) {
+      exit(EXIT_FAILURE);
+    }
+    Repl repl;
+    repl.run();
+    core_server.stop();
+    return 0;
+  }
+
   std::string shardcontroller_addr;
   uint64_t n_workers = N_WORKERS;
 
@@ -45,9 +71,10 @@ int main(int argc, char* argv[]) {
   // If no shardcontroller address specified, Concurrent Store; otherwise,
   // Distributed Store
   if (shardcontroller_addr.empty()) {
-    server = std::make_shared<KvServer>(addr, n_workers);
+    server = std::make_shared<KvServer>(addr, n_workers, udp);
   } else {
-    server = std::make_shared<KvServer>(addr, shardcontroller_addr, n_workers);
+    server = std::make_shared<KvServer>(addr, shardcontroller_addr, n_workers,
+                                        udp);
   }
 
   int ret = server->start();
@@ -7,15 +7,38 @@
 #include "shardcontroller/static_shardcontroller.hpp"
 
 int main(int argc, char* argv[]) {
-  if (argc != 2) {
-    cerr_color(RED, "Usage: ./shardcontroller <PORT>");
+  // With --rebalance, servers report their load and the shardcontroller
+  // automatically splits and moves shards away from overloaded servers. With
+  // --hash, keys are placed by a hash of the whole key instead of its prefix.
+  // With --backups <n>, every server's writes are replicated to n backups.
+  RebalancePolicy policy;
+  ShardingMode mode = ShardingMode::LEXICOGRAPHIC;
+  size_t n_backups = 0;
+  bool valid_args = argc >= 2;
+  for (int i = 2; i < argc; i++) {
+    std::string flag = argv[i];
+    if (flag == "--rebalance") {
+      policy.enabled = true;
+    } else if (flag == "--hash") {
+      mode = ShardingMode::HASH;
+    } else if (flag == "--backups" && i + 1 < argc && is_number(argv[i + 1])) {
+      n_backups = std::stoul(argv[++i]);
+    } else {
+      valid_args = false;
+    }
+  }
+  if (!valid_args) {
+    cerr_color(RED,
+               "Usage: ./shardcontroller <PORT> [--rebalance] [--hash] "
+               "[--backups <n>]");
     exit(EXIT_FAILURE);
   }
 
   // Get shardcontroller address, for servers to connect
   std::string addr = get_host_address(argv[1]);
   std::shared_ptr<Shardcontroller> shardcontroller =
-      std::make_shared<StaticShardController>(addr);
+      std::make_shared<StaticShardController>(addr, policy, mode,
+                                              n_backups);
 
   int ret = shardcontroller->start();
   if (ret < 0) {
@@ -1,31 +1,65 @@
 #include "common/config.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+
 #include "common/color.hpp"
 
 std::string ShardControllerConfig::print() {
     std::stringstream ss;
-    ss << "Shardcontroller configuration: \n";
+    ss << "Shardcontroller configuration"
+       << (this->mode == ShardingMode::HASH ? " (hash sharding)" : "")
+       << ": \n";
     for (auto&& [server, shards] : this->server_to_shards) {
         ss << "- " << server << ": ";
         for (auto&& s : shards) {
             ss << s;
             if (s != shards.back()) ss << ", ";
         }
+        if (auto it = this->server_to_backups.find(server);
+            it != this->server_to_backups.end() && !it->second.empty()) {
+            ss << " (backups:";
+            for (auto&& backup : it->second) ss << ' ' << backup;
+            ss << ')';
+        }
         ss << '\n';
     }
     return ss.str();
 }
 
+std::string ShardControllerConfig::shard_key(const std::string& key) const {
+    if (this->mode == ShardingMode::HASH) {
+        return bucket_to_str(stable_hash(key) % GRANULARITY_OPTS[MAX_GRANULARITY],
+                             MAX_GRANULARITY);
+    }
+    return to_upper(key);
+}
+
 std::optional<std::string> ShardControllerConfig::get_server(
-    const std::string& key) {
-    std::string key_uppercase = to_upper(key);
+    const std::string& key) const {
+    std::string key_uppercase = this->shard_key(key);
     // TODO (Part B, Step 2): Implement!
     // You should use key_uppercase (instead of key) in your implementation
-    for (auto& [server, shards] : server_to_shards) {
-        for (const auto& s : shards) {
-            if(s.contains(key_uppercase))
-            {
-                return server;
+    if (this->shard_index) {
+        // The only shard that can contain the key is the last one starting at
+        // or before it
+        auto& index = *this->shard_index;
+        size_t granularity = index.empty() ? 0 : index.front().first.granularity();
+        std::string prefix = key_uppercase.substr(0, granularity);
+        auto it = std::upper_bound(
+            index.begin(), index.end(), prefix,
+            [](const std::string& p, auto&& entry) { return p < entry.first.lower; });
+        if (it != index.begin() && std::prev(it)->first.contains(key_uppercase)) {
+            return std::prev(it)->second;
+        }
+    } else {
+        for (auto& [server, shards] : server_to_shards) {
+            for (const auto& s : shards) {
+                if(s.contains(key_uppercase))
+                {
+                    return server;
+                }
             }
         }
     }
@@ -37,3 +71,234 @@ std::optional<std::string> ShardControllerConfig::get_server(
         key);
     return std::nullopt;
 }
+
+void ShardControllerConfig::build_index() {
+    std::vector<std::pair<Shard, std::string>> index;
+    for (auto&& [server, shards] : this->server_to_shards) {
+        for (auto&& shard : shards) index.emplace_back(shard, server);
+    }
+    std::sort(index.begin(), index.end());
+
+    // Searching only works over disjoint shards of a single granularity, which
+    // every config from the shardcontroller has; leave anything else unindexed
+    this->shard_index = nullptr;
+    for (size_t i = 1; i < index.size(); i++) {
+        if (index[i].first.granularity() != index[0].first.granularity() ||
+            index[i - 1].first.upper >= index[i].first.lower) {
+            return;
+        }
+    }
+    this->shard_index =
+        std::make_shared<const std::vector<std::pair<Shard, std::string>>>(
+            std::move(index));
+}
+
+std::vector<std::string> ShardControllerConfig::get_replicas(
+    const std::string& key) const {
+    std::optional<std::string> primary = this->get_server(key);
+    if (!primary) return {};
+
+    std::vector<std::string> replicas{*primary};
+    if (auto it = this->server_to_backups.find(*primary);
+        it != this->server_to_backups.end()) {
+        replicas.insert(replicas.end(), it->second.begin(), it->second.end());
+    }
+    return replicas;
+}
+
+bool ShardControllerConfig::is_backup(const std::string& primary,
+                                      const std::string& backup) const {
+    auto it = this->server_to_backups.find(primary);
+    if (it == this->server_to_backups.end()) return false;
+    return std::find(it->second.begin(), it->second.end(), backup) !=
+           it->second.end();
+}
+
+CompactConfig CompactConfig::from(
+    const ShardControllerConfig& config,
+    const std::vector<std::shared_ptr<const CompactConfig>>& recent) {
+    CompactConfig compact;
+    compact.version = config.version;
+    compact.mode = config.mode;
+
+    // Servers the recent configs refer to keep their numbers; the others'
+    // are free to be given out again
+    std::unordered_map<std::string, uint32_t> numbers;
+    std::set<uint32_t> free;
+    if (!recent.empty()) {
+        std::set<uint32_t> used;
+        for (auto&& previous : recent) used.merge(previous->numbers_used());
+        compact.servers = recent.back()->servers;
+        for (uint32_t n = 0; n < compact.servers.size(); n++) {
+            if (used.contains(n)) {
+                numbers[compact.servers[n]] = n;
+            } else {
+                compact.servers[n].clear();
+                free.insert(n);
+            }
+        }
+    }
+    auto number = [&](const std::string& server) {
+        auto it = numbers.find(server);
+        if (it != numbers.end()) return it->second;
+        uint32_t n = compact.servers.size();
+        if (free.empty()) {
+            compact.servers.push_back(server);
+        } else {
+            n = *free.begin();
+            free.erase(free.begin());
+            compact.servers[n] = server;
+        }
+        numbers[server] = n;
+        return n;
+    };
+
+    for (auto&& [server, shards] : config.server_to_shards) {
+        uint32_t n = number(server);
+        compact.members.insert(n);
+        for (auto&& shard : shards) {
+            compact.granularity = shard.granularity();
+            uint32_t lower = str_to_bucket(shard.lower);
+            uint32_t upper = str_to_bucket(shard.upper);
+            compact.ranges[lower] = BucketRange{lower, upper, n};
+        }
+    }
+    for (auto&& [server, version] : config.shards_changed_at) {
+        compact.changed_at[number(server)] = version;
+    }
+    for (auto&& [server, backups] : config.server_to_backups) {
+        if (backups.empty()) continue;
+        auto& numbered = compact.backups[number(server)];
+        for (auto&& backup : backups) numbered.push_back(number(backup));
+    }
+    while (!compact.servers.empty() && compact.servers.back().empty()) {
+        compact.servers.pop_back();
+    }
+    return compact;
+}
+
+ConfigDelta CompactConfig::since(const CompactConfig* old) const {
+    ConfigDelta delta;
+    delta.full = !old || old->granularity != this->granularity ||
+                 old->mode != this->mode;
+    delta.version = this->version;
+    delta.mode = this->mode;
+    delta.granularity = this->granularity;
+
+    // A full delta is the changes from an empty config
+    const CompactConfig none;
+    const CompactConfig& base = delta.full ? none : *old;
+    delta.from_version = base.version;
+    // Freed numbers aren't sent; nothing refers to them
+    for (uint32_t n = 0; n < this->servers.size(); n++) {
+        if (this->servers[n].empty()) continue;
+        if (n >= base.servers.size() || base.servers[n] != this->servers[n]) {
+            delta.new_servers.push_back({n, this->servers[n]});
+        }
+    }
+
+    std::set_difference(this->members.begin(), this->members.end(),
+                        base.members.begin(), base.members.end(),
+                        std::back_inserter(delta.joined));
+    std::set_difference(base.members.begin(), base.members.end(),
+                        this->members.begin(), this->members.end(),
+                        std::back_inserter(delta.left));
+
+    for (auto&& [lower, range] : base.ranges) {
+        auto it = this->ranges.find(lower);
+        if (it == this->ranges.end() || it->second != range) {
+            delta.removed_ranges.push_back(lower);
+        }
+    }
+    for (auto&& [lower, range] : this->ranges) {
+        auto it = base.ranges.find(lower);
+        if (it == base.ranges.end() || it->second != range) {
+            delta.added_ranges.push_back(range);
+        }
+    }
+
+    for (auto&& [n, version] : this->changed_at) {
+        auto it = base.changed_at.find(n);
+        if (it == base.changed_at.end() || it->second != version) {
+            delta.changed_at.push_back({n, version});
+        }
+    }
+    for (auto&& [n, _] : base.changed_at) {
+        if (!this->changed_at.contains(n)) delta.unchanged_at.push_back(n);
+    }
+
+    for (auto&& [n, backups] : this->backups) {
+        auto it = base.backups.find(n);
+        if (it == base.backups.end() || it->second != backups) {
+            delta.backups.push_back({n, backups});
+        }
+    }
+    for (auto&& [n, _] : base.backups) {
+        if (!this->backups.contains(n)) delta.backups.push_back({n, {}});
+    }
+    return delta;
+}
+
+bool CompactConfig::apply(const ConfigDelta& delta) {
+    if (delta.full) {
+        *this = CompactConfig{};
+    } else if (delta.from_version != this->version) {
+        return false;
+    }
+
+    this->version = delta.version;
+    this->mode = delta.mode;
+    this->granularity = delta.granularity;
+    for (auto&& [n, address] : delta.new_servers) {
+        if (n >= this->servers.size()) this->servers.resize(n + 1);
+        this->servers[n] = address;
+    }
+    this->members.insert(delta.joined.begin(), delta.joined.end());
+    for (uint32_t n : delta.left) this->members.erase(n);
+    for (uint32_t lower : delta.removed_ranges) this->ranges.erase(lower);
+    for (auto&& range : delta.added_ranges) this->ranges[range.lower] = range;
+    for (auto&& [n, version] : delta.changed_at) this->changed_at[n] = version;
+    for (uint32_t n : delta.unchanged_at) this->changed_at.erase(n);
+    for (auto&& [n, backups] : delta.backups) {
+        if (backups.empty()) {
+            this->backups.erase(n);
+        } else {
+            this->backups[n] = backups;
+        }
+    }
+    return true;
+}
+
+ShardControllerConfig CompactConfig::expand() const {
+    ShardControllerConfig config;
+    config.version = this->version;
+    config.mode = this->mode;
+    for (uint32_t n : this->members) {
+        config.server_to_shards[this->servers[n]];
+    }
+    for (auto&& [lower, range] : this->ranges) {
+        config.server_to_shards[this->servers[range.server]].push_back(
+            Shard{bucket_to_str(range.lower, this->granularity),
+                  bucket_to_str(range.upper, this->granularity)});
+    }
+    for (auto&& [n, version] : this->changed_at) {
+        config.shards_changed_at[this->servers[n]] = version;
+    }
+    for (auto&& [n, backups] : this->backups) {
+        auto& named = config.server_to_backups[this->servers[n]];
+        for (uint32_t backup : backups) named.push_back(this->servers[backup]);
+    }
+    config.build_index();
+    return config;
+}
+
+std::set<uint32_t> CompactConfig::numbers_used() const {
+    std::set<uint32_t> used = this->members;
+    for (auto&& [_, range] : this->ranges) used.insert(range.server);
+    for (auto&& [n, _] : this->changed_at) used.insert(n);
+    for (auto&& [n, backups] : this->backups) {
+        used.insert(n);
+        used.insert(backups.begin(), backups.end());
+    }
+    return used;
+}
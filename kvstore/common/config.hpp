@@ -1,22 +1,158 @@
 #ifndef COMMON_CONFIG_HPP
 #define COMMON_CONFIG_HPP
 
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <optional>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "common/shard.hpp"
 
+// How keys are placed into the bucket space that shards cover.
+enum class ShardingMode : uint8_t {
+  // By the key's first MAX_GRANULARITY characters (case-insensitive), so keys
+  // that share a prefix (e.g. user_*) all land in the same shard.
+  LEXICOGRAPHIC,
+  // By a stable hash of the whole key, which spreads keys evenly over the
+  // buckets regardless of their prefixes.
+  HASH,
+};
+
 // Struct representing a Shardcontroller's configuration.
 struct ShardControllerConfig {
   // map each server address to the shards it's responsible for
   std::map<std::string, std::vector<Shard>> server_to_shards;
 
+  // How keys map onto shards; fixed for the lifetime of a cluster
+  ShardingMode mode = ShardingMode::LEXICOGRAPHIC;
+
+  // Incremented by the shardcontroller every time the configuration changes
+  uint64_t version = 0;
+  // The version at which each server's shards last changed. A server that
+  // missed versions uses this to tell which servers may have held its shards
+  // in the meantime.
+  std::map<std::string, uint64_t> shards_changed_at = {};
+
+  // Ordered backups of each server. A shard's replica set is the server that
+  // holds it (its primary), followed by that server's backups.
+  std::map<std::string, std::vector<std::string>> server_to_backups = {};
+
+  // Every shard and its server, sorted by lower bound, for get_server to
+  // binary search. Built by build_index (configs received from the
+  // shardcontroller come with one), and not sent over the network; without
+  // it, get_server scans every server's shards.
+  std::shared_ptr<const std::vector<std::pair<Shard, std::string>>>
+      shard_index = nullptr;
+
+  // Everything but shard_index goes over the network
+  constexpr static auto serialize(auto& archive, auto& self) {
+    return archive(self.server_to_shards, self.mode, self.version,
+                   self.shards_changed_at, self.server_to_backups);
+  }
+
   // Pretty printing of configuration
   std::string print();
+  // Gets the position of the key in the bucket space, i.e. the string that
+  // shard bounds are compared against (c.f. Shard::contains).
+  std::string shard_key(const std::string& key) const;
   // Gets the server with the shard for the key.
-  std::optional<std::string> get_server(const std::string& key);
+  std::optional<std::string> get_server(const std::string& key) const;
+  // (Re)builds shard_index from server_to_shards. Has to be called again after
+  // server_to_shards changes.
+  void build_index();
+  // Gets the replica set (primary first) of the shard for the key.
+  std::vector<std::string> get_replicas(const std::string& key) const;
+  // Checks whether `backup` is one of `primary`'s backups.
+  bool is_backup(const std::string& primary, const std::string& backup) const;
+};
+
+// A shard as a range of buckets at the config's granularity (c.f.
+// str_to_bucket), held by the server numbered `server`
+struct BucketRange {
+  uint32_t lower;
+  uint32_t upper;
+  uint32_t server;
+
+  bool operator==(const BucketRange&) const = default;
+};
+
+struct ServerVersion {
+  uint32_t server;
+  uint64_t version;
+};
+
+struct ServerBackups {
+  uint32_t server;
+  std::vector<uint32_t> backups;
+};
+
+struct NumberedServer {
+  uint32_t server;
+  std::string address;
+};
+
+// What changed in a config since an earlier version, for servers and clients
+// that already have that version (c.f. CompactConfig): servers go by number,
+// with each address sent once, and shards as bucket ranges. A full delta
+// holds the whole config instead, and applies to any version.
+struct ConfigDelta {
+  bool full = false;
+  uint64_t from_version = 0;
+  uint64_t version = 0;
+  ShardingMode mode = ShardingMode::LEXICOGRAPHIC;
+  uint8_t granularity = 0;
+  // Servers numbered since from_version, with their addresses
+  std::vector<NumberedServer> new_servers;
+  // Servers that joined, and that left
+  std::vector<uint32_t> joined;
+  std::vector<uint32_t> left;
+  // Lower bounds of the ranges that are gone, and the ranges that are new
+  std::vector<uint32_t> removed_ranges;
+  std::vector<BucketRange> added_ranges;
+  // New shards_changed_at entries, and servers whose entry is gone
+  std::vector<ServerVersion> changed_at;
+  std::vector<uint32_t> unchanged_at;
+  // Servers whose backups changed (to none, if empty)
+  std::vector<ServerBackups> backups;
+};
+
+// A config in the form deltas are made from and applied to. Servers are
+// numbered in the order the shardcontroller first saw them, and keep their
+// numbers after they leave for as long as a config that changes are still
+// worked out from refers to them, so that a number means the same server in
+// all of those. After that, the number goes to the next server to join.
+struct CompactConfig {
+  uint64_t version = 0;
+  ShardingMode mode = ShardingMode::LEXICOGRAPHIC;
+  uint8_t granularity = 0;
+  // Addresses by number (empty for numbers that are free)
+  std::vector<std::string> servers;
+  std::set<uint32_t> members;
+  // Ranges by lower bound
+  std::map<uint32_t, BucketRange> ranges;
+  std::map<uint32_t, uint64_t> changed_at;
+  // Only servers that have backups
+  std::map<uint32_t, std::vector<uint32_t>> backups;
+
+  // The compact form of `config`, whose shards all have the same
+  // granularity, numbering servers as the last of `recent` did, and new ones
+  // with numbers none of `recent` refers to, or after them.
+  static CompactConfig from(
+      const ShardControllerConfig& config,
+      const std::vector<std::shared_ptr<const CompactConfig>>& recent = {});
+  // The changes from `old` to this config, or all of it without `old` (or if
+  // the granularity changed since).
+  ConfigDelta since(const CompactConfig* old) const;
+  // Applies `delta`, unless it's neither full nor from this version, in which
+  // case this is left as it was and false is returned.
+  bool apply(const ConfigDelta& delta);
+  // The config in full, with its index built
+  ShardControllerConfig expand() const;
+  // The numbers of the servers this config refers to
+  std::set<uint32_t> numbers_used() const;
 };
 
 #endif /* end of include guard */
@@ -37,6 +37,13 @@ std::pair<Shard, Shard> split_shard(const Shard& shard, const std::string& at,
                                  {upper_lower, shard.upper}};
 }
 
+Shard refine_shard(const Shard& shard, size_t granularity) {
+  assert(shard.granularity() <= granularity && granularity <= MAX_GRANULARITY);
+  size_t extra = granularity - shard.granularity();
+  return Shard{shard.lower + std::string(extra, VALID_CHARS.front()),
+               shard.upper + std::string(extra, VALID_CHARS.back())};
+}
+
 OverlapStatus get_overlap(const Shard& a, const Shard& b) {
   if (a.upper < b.lower || b.upper < a.lower) {
     /**
@@ -107,6 +107,10 @@ std::pair<Shard, Shard> split_shard(const Shard& shard);
 std::pair<Shard, Shard> split_shard(const Shard& shard, const std::string& at,
                                     bool first = true);
 
+// Returns the same key range as `shard`, at a finer (or equal) granularity.
+// e.g., for shard = [A, C] and granularity = 2, returns [A0, CZ].
+Shard refine_shard(const Shard& shard, size_t granularity);
+
 // Returns the overlap status of 'a' relative to 'b'.
 //
 // The comments in each case show an example of what a pair of shards in that
@@ -0,0 +1,73 @@
+#ifndef COMMON_SPSC_QUEUE_HPP
+#define COMMON_SPSC_QUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Assumed cache line size, to keep the two sides' indices from sharing one
+#define CACHE_LINE_SIZE 64
+
+// A bounded, lock-free queue from exactly one producer thread to exactly one
+// consumer thread. Each side only writes its own index, and keeps a copy of
+// the other side's that it refreshes only when the queue looks full (or
+// empty), so that the shared indices' cache lines move between cores about
+// once per batch rather than once per item.
+template <typename T>
+class SpscQueue {
+ public:
+  // Holds up to `capacity` items, rounded up to a power of two
+  explicit SpscQueue(size_t capacity)
+      : mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1),
+        slots(this->mask + 1) {
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Producer only. Returns false, leaving `item` as it was, if the queue is
+  // full.
+  bool try_push(T&& item) {
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    if (tail - this->head_seen > this->mask) {
+      this->head_seen = this->head.load(std::memory_order_acquire);
+      if (tail - this->head_seen > this->mask) return false;
+    }
+    this->slots[tail & this->mask] = std::move(item);
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only
+  std::optional<T> try_pop() {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    if (head == this->tail_seen) {
+      this->tail_seen = this->tail.load(std::memory_order_acquire);
+      if (head == this->tail_seen) return std::nullopt;
+    }
+    std::optional<T> item = std::move(this->slots[head & this->mask]);
+    this->head.store(head + 1, std::memory_order_release);
+    return item;
+  }
+
+  // Consumer only
+  bool empty() const {
+    return this->head.load(std::memory_order_relaxed) ==
+           this->tail.load(std::memory_order_acquire);
+  }
+
+ private:
+  const size_t mask;
+  std::vector<T> slots;
+  // The consumer's side, then the producer's
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head = 0;
+  size_t tail_seen = 0;
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail = 0;
+  size_t head_seen = 0;
+};
+
+#endif /* end of include guard */
@@ -1,5 +1,8 @@
 #include "common/utils.hpp"
 
+#include <atomic>
+#include <thread>
+
 std::vector<std::string> split(const std::string& s, char delim) {
   std::vector<std::string> res;
 
@@ -32,3 +35,40 @@ std::string to_lower(const std::string& s) {
                  [](unsigned char c) { return std::tolower(c); });
   return res;
 }
+
+uint64_t stable_hash(const std::string& s) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : s) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool parallel_for(size_t n, size_t max_parallel,
+                  const std::function<bool(size_t)>& fn) {
+  size_t n_threads = std::min(n, max_parallel);
+  if (n_threads <= 1) {
+    for (size_t i = 0; i < n; i++) {
+      if (!fn(i)) return false;
+    }
+    return true;
+  }
+
+  // Each thread claims the next unstarted index until none are left (or
+  // something has failed), so a slow call never holds up the others.
+  std::atomic<size_t> next = 0;
+  std::atomic<bool> ok = true;
+  auto run = [&] {
+    for (size_t i = next++; i < n && ok; i = next++) {
+      if (!fn(i)) ok = false;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(n_threads - 1);
+  for (size_t t = 0; t + 1 < n_threads; t++) threads.emplace_back(run);
+  run();
+  for (auto&& thr : threads) thr.join();
+  return ok;
+}
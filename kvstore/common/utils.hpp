@@ -3,6 +3,8 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstdint>
+#include <functional>
 #include <numeric>
 #include <sstream>
 #include <string>
@@ -22,4 +24,15 @@ bool is_number(const std::string& s);
 std::string to_upper(const std::string& s);
 std::string to_lower(const std::string& s);
 
+// 64-bit FNV-1a hash of a string. Unlike std::hash, the result is the same in
+// every process and on every platform, so it can be used to place keys.
+uint64_t stable_hash(const std::string& s);
+
+// Calls fn(i) for each i in [0, n), running at most `max_parallel` calls at
+// once. Once a call returns false, no new calls are started. Returns true iff
+// every call returned true. With max_parallel <= 1, the calls run in order on
+// the calling thread.
+bool parallel_for(size_t n, size_t max_parallel,
+                  const std::function<bool(size_t)>& fn);
+
 #endif /* end of include guard */
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef COMMON_WRITER_PRIORITY_MUTEX_HPP
+#define COMMON_WRITER_PRIORITY_MUTEX_HPP
+
+#include <pthread.h>
+
+// A shared mutex whose exclusive lockers go ahead of shared lockers that
+// arrive after them. std::shared_mutex lets shared lockers keep coming in
+// while one is waiting to lock it exclusively, which starves it for as long
+// as they overlap. Works with std::unique_lock and std::shared_lock, but
+// mustn't be locked shared twice by the same thread, as the second one would
+// wait behind an exclusive locker waiting on the first.
+class WriterPriorityMutex {
+ public:
+  WriterPriorityMutex() {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&this->rwlock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+  }
+  ~WriterPriorityMutex() {
+    pthread_rwlock_destroy(&this->rwlock);
+  }
+
+  WriterPriorityMutex(const WriterPriorityMutex&) = delete;
+  WriterPriorityMutex& operator=(const WriterPriorityMutex&) = delete;
+
+  void lock() {
+    pthread_rwlock_wrlock(&this->rwlock);
+  }
+  bool try_lock() {
+    return pthread_rwlock_trywrlock(&this->rwlock) == 0;
+  }
+  void unlock() {
+    pthread_rwlock_unlock(&this->rwlock);
+  }
+
+  void lock_shared() {
+    pthread_rwlock_rdlock(&this->rwlock);
+  }
+  bool try_lock_shared() {
+    return pthread_rwlock_tryrdlock(&this->rwlock) == 0;
+  }
+  void unlock_shared() {
+    pthread_rwlock_unlock(&this->rwlock);
+  }
+
+ private:
+  pthread_rwlock_t rwlock;
+};
+
+#endif /* end of include guard */
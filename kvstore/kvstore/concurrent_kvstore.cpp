@@ -1,59 +1,333 @@
 #include "concurrent_kvstore.hpp"
 
+#include <algorithm>
+#include <iterator>
 #include <mutex>
+#include <numeric>
 #include <optional>
+#include <unordered_map>
+
+std::optional<std::string> DbMap::insertItem(
+    size_t b, const std::string& key, std::string_view value,
+    TimerWheel::Clock::time_point expires_at) {
+    assert(b < BUCKET_COUNT);
+
+    this->versions[b]++;
+    for (DbItem** link = &this->buckets[b]; *link; link = &(*link)->next) {
+        if ((*link)->key() != key) continue;
+        std::string old((*link)->value());
+        this->overwrite_item(b, link, value, expires_at);
+        return old;
+    }
+    DbItem* item = this->make_item(b, key, value, expires_at);
+    item->next = this->buckets[b];
+    this->buckets[b] = item;
+    return std::nullopt;
+}
+
+std::vector<std::optional<std::string>> DbMap::insertItems(
+    size_t b, const std::vector<std::string>& keys,
+    const std::vector<std::string>& values, const std::vector<size_t>& indices,
+    TimerWheel::Clock::time_point expires_at) {
+    assert(b < BUCKET_COUNT);
+
+    // A key given more than once replaces its own earlier value, so only its
+    // last value is stored
+    std::vector<std::optional<std::string>> olds(indices.size());
+    std::unordered_map<std::string_view, size_t> last;
+    last.reserve(indices.size());
+    for (size_t n = 0; n < indices.size(); n++) {
+        auto [it, inserted] = last.try_emplace(keys[indices[n]], n);
+        if (!inserted) {
+            olds[n] = values[indices[it->second]];
+            it->second = n;
+        }
+    }
+    // Which of `indices` holds each key's first value
+    std::unordered_map<std::string_view, size_t> first;
+    first.reserve(last.size());
+    for (size_t n = indices.size(); n-- > 0;) {
+        first[keys[indices[n]]] = n;
+    }
+
+    this->versions[b]++;
+    for (DbItem** link = &this->buckets[b]; *link; link = &(*link)->next) {
+        auto it = last.find((*link)->key());
+        if (it == last.end()) continue;
+        olds[first[it->first]] = std::string((*link)->value());
+        this->overwrite_item(b, link, values[indices[it->second]], expires_at);
+        last.erase(it);
+    }
+    for (auto&& [key, n] : last) {
+        DbItem* item =
+            this->make_item(b, key, values[indices[n]], expires_at);
+        item->next = this->buckets[b];
+        this->buckets[b] = item;
+    }
+    return olds;
+}
+
+bool DbMap::empty() {
+    for (size_t b = 0; b < BUCKET_COUNT; b++) {
+        std::shared_lock lock(this->locks[b]);
+        if (this->buckets[b]) return false;
+    }
+    return true;
+}
+
+bool DbMap::claimed(size_t b, const std::vector<std::string>& keys,
+                    const std::vector<size_t>& indices) const {
+    if (this->claims[b].empty()) return false;
+    return std::any_of(indices.begin(), indices.end(),
+                       [&](size_t i) { return this->claimed(b, keys[i]); });
+}
+
+void DbMap::claim(size_t b, const std::vector<std::string>& keys,
+                  const std::vector<size_t>& indices) {
+    assert(b < BUCKET_COUNT);
+
+    WriteLock lock(this->locks[b]);
+    wait_out_claims(lock, [&] { return this->claimed(b, keys, indices); });
+    for (size_t i : indices) this->claims[b].push_back(keys[i]);
+    // Readers that looked at the bucket before can tell it's changing
+    this->versions[b]++;
+}
+
+void DbMap::release(size_t b, const std::vector<std::string>& keys,
+                    const std::vector<size_t>& indices) {
+    assert(b < BUCKET_COUNT);
+
+    auto& claims = this->claims[b];
+    for (size_t i : indices) {
+        claims.erase(std::find(claims.begin(), claims.end(), keys[i]));
+    }
+}
+
+std::shared_ptr<DbMap::Snapshot> DbMap::snapshot(
+    TimerWheel::Clock::time_point taken_at) {
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->taken_at = taken_at;
+    for (size_t b = 0; b < BUCKET_COUNT; b++) {
+        snapshot->versions[b] = this->versions[b];
+    }
+    this->snapshots.push_back(snapshot);
+    return snapshot;
+}
+
+std::vector<DbMap::Snapshot::Item> DbMap::read_snapshot(Snapshot& snapshot,
+                                                        size_t b) {
+    assert(b < BUCKET_COUNT);
+
+    auto live = [&](TimerWheel::Clock::time_point expires_at) {
+        return expires_at == TimerWheel::Clock::time_point{} ||
+               expires_at > snapshot.taken_at;
+    };
+    std::shared_lock lock(this->locks[b]);
+    std::vector<Snapshot::Item> items = std::move(snapshot.saved[b]);
+    snapshot.saved[b].clear();
+    std::erase_if(items, [&](auto&& item) { return !live(item.expires_at); });
+    for (const DbItem* item = this->buckets[b]; item; item = item->next) {
+        if (item->version > snapshot.versions[b]) continue;
+        if (!live(item->expires_at)) continue;
+        items.push_back({std::string(item->key()), std::string(item->value()),
+                         item->expires_at});
+    }
+    snapshot.read[b] = true;
+    return items;
+}
+
+bool DbMap::removeItem(size_t b, const std::string& key) {
+    assert(b < BUCKET_COUNT);
+
+    this->versions[b]++;
+    for (DbItem** link = &this->buckets[b]; *link; link = &(*link)->next) {
+        if ((*link)->key() == key) {
+            this->free_item(b, link);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::pair<std::string, std::string>> DbMap::removeItems(
+    size_t b, const std::function<bool(std::string_view)>& pick) {
+    assert(b < BUCKET_COUNT);
+
+    this->versions[b]++;
+    std::vector<std::pair<std::string, std::string>> removed;
+    for (DbItem** link = &this->buckets[b]; *link;) {
+        if (!pick((*link)->key())) {
+            link = &(*link)->next;
+            continue;
+        }
+        removed.emplace_back((*link)->key(), (*link)->value());
+        this->free_item(b, link);
+    }
+    return removed;
+}
+
+std::optional<std::string> DbMap::expireItem(
+    size_t b, const std::string& key, TimerWheel::Clock::time_point deadline) {
+    assert(b < BUCKET_COUNT);
+
+    for (DbItem** link = &this->buckets[b]; *link; link = &(*link)->next) {
+        if ((*link)->key() == key && (*link)->expires_at == deadline) {
+            this->versions[b]++;
+            std::string value((*link)->value());
+            this->free_item(b, link);
+            return value;
+        }
+    }
+    return std::nullopt;
+}
+
+DbItem* DbMap::make_item(size_t b, std::string_view key, std::string_view value,
+                         TimerWheel::Clock::time_point expires_at) {
+    size_t size = DbItem::size_for(key.size(), value.size());
+    auto* item = static_cast<DbItem*>(this->arenas[b].allocate(size));
+    item->next = nullptr;
+    item->expires_at = expires_at;
+    item->version = this->versions[b];
+    item->key_size = key.size();
+    item->value_size = value.size();
+    std::copy(key.begin(), key.end(), item->data());
+    std::copy(value.begin(), value.end(), item->data() + key.size());
+    this->n_bytes[b] += key.size() + value.size();
+    return item;
+}
+
+void DbMap::save_for_snapshots(size_t b, const DbItem& item) {
+    for (auto&& snapshot : this->snapshots) {
+        // Written since the snapshot was taken, so it already has a copy
+        if (snapshot->read[b] || item.version > snapshot->versions[b]) continue;
+        snapshot->saved[b].push_back({std::string(item.key()),
+                                      std::string(item.value()),
+                                      item.expires_at});
+    }
+}
+
+void DbMap::overwrite_item(size_t b, DbItem** link, std::string_view value,
+                           TimerWheel::Clock::time_point expires_at) {
+    DbItem* item = *link;
+    this->save_for_snapshots(b, *item);
+    std::string_view key = item->key();
+    // Overwrite in place if the new value fits in the same size class
+    if (SlabArena::block_size(item->size()) ==
+        SlabArena::block_size(DbItem::size_for(key.size(), value.size()))) {
+        std::copy(value.begin(), value.end(), item->data() + key.size());
+        this->n_bytes[b] += value.size();
+        this->n_bytes[b] -= item->value_size;
+        item->value_size = value.size();
+        item->expires_at = expires_at;
+        item->version = this->versions[b];
+    } else {
+        DbItem* replacement = this->make_item(b, key, value, expires_at);
+        replacement->next = item->next;
+        item->next = nullptr;
+        *link = replacement;
+        this->n_bytes[b] -= item->key_size + item->value_size;
+        this->arenas[b].deallocate(item, item->size());
+    }
+}
+
+void DbMap::free_item(size_t b, DbItem** link) {
+    DbItem* item = *link;
+    this->save_for_snapshots(b, *item);
+    *link = item->next;
+    this->n_bytes[b] -= item->key_size + item->value_size;
+    this->arenas[b].deallocate(item, item->size());
+}
 
 bool ConcurrentKvStore::Get(const GetRequest* req, GetResponse* res) {
     // TODO (Part A, Step 3 and Step 4): Implement!
 
-    size_t b = this->store.bucket(req->key);
-    std::shared_lock lock(this->store.locks[b]);
-    auto result = this->store.getIfExists(b, req->key);
-    if(result == std::nullopt)
+    std::shared_lock layout(this->partitions_mtx);
+    DbMap& store = this->partition_for(req->key).store;
+    size_t b = store.bucket(req->key);
+    auto lock = store.lock_unclaimed<DbMap::ReadLock>(b, req->key);
+    auto result = store.getIfExists(b, req->key);
+    if(result == nullptr)
     {
         return false;
     }
-    res->value = result->value;
+    res->value = result->value();
+    res->ttl_ms = TimerWheel::ms_until(result->expires_at);
+    return true;
+}
+
+bool ConcurrentKvStore::GetRange(const GetStreamRequest* req,
+                                 GetStreamResponse* res) {
+    std::shared_lock layout(this->partitions_mtx);
+    DbMap& store = this->partition_for(req->key).store;
+    size_t b = store.bucket(req->key);
+    auto lock = store.lock_unclaimed<DbMap::ReadLock>(b, req->key);
+    auto result = store.getIfExists(b, req->key);
+    if (result == nullptr) {
+        return false;
+    }
+    std::string_view value = result->value();
+    size_t offset = std::min<uint64_t>(req->offset, value.size());
+    res->chunk = value.substr(
+        offset, std::min<uint64_t>(req->max_bytes, STREAM_CHUNK_SIZE));
+    res->total_size = value.size();
+    res->version = result->version;
+    res->ttl_ms = TimerWheel::ms_until(result->expires_at);
     return true;
 }
 
 bool ConcurrentKvStore::Put(const PutRequest* req, PutResponse*) {
     // TODO (Part A, Step 3 and Step 4): Implement!
 
-    size_t b = this->store.bucket(req->key);
-    std::unique_lock lock(this->store.locks[b]);
-    this->store.insertItem(b, req->key, req->value);
+    std::shared_lock layout(this->partitions_mtx);
+    Partition& p = this->partition_for(req->key);
+    size_t b = p.store.bucket(req->key);
+    auto lock = p.store.lock_unclaimed<DbMap::WriteLock>(b, req->key);
+    auto deadline = TimerWheel::deadline_after(req->ttl_ms);
+    auto old = p.store.insertItem(b, req->key, req->value, deadline);
+    reindex(p.refs, req->key, old, req->value);
+    if (req->ttl_ms) this->expiry.schedule(req->key, deadline);
     return true;
 }
 
 bool ConcurrentKvStore::Append(const AppendRequest* req, AppendResponse*) {
     // TODO (Part A, Step 3 and Step 4): Implement!
-    size_t b = this->store.bucket(req->key);
-    std::unique_lock lock(this->store.locks[b]);
-    auto result = this->store.getIfExists(b, req->key);
+    std::shared_lock layout(this->partitions_mtx);
+    Partition& p = this->partition_for(req->key);
+    size_t b = p.store.bucket(req->key);
+    auto lock = p.store.lock_unclaimed<DbMap::WriteLock>(b, req->key);
+    auto result = p.store.getIfExists(b, req->key);
     std::string new_value;
+    TimerWheel::Clock::time_point deadline;
     if(!result)
     {
         new_value = req->value;
     }
     else {
-        new_value = result->value + req->value;
+        new_value = result->value();
+        new_value += req->value;
+        deadline = result->expires_at;
     }
-    this->store.insertItem(b, req->key, new_value);
+    if (req->ttl_ms) deadline = TimerWheel::deadline_after(req->ttl_ms);
+    auto old = p.store.insertItem(b, req->key, new_value, deadline);
+    reindex(p.refs, req->key, old, new_value);
+    if (req->ttl_ms) this->expiry.schedule(req->key, deadline);
     return true;
 }
 
 bool ConcurrentKvStore::Delete(const DeleteRequest* req, DeleteResponse* res) {
     // TODO (Part A, Step 3 and Step 4): Implement!
 
-    size_t b = this->store.bucket(req->key);
-    std::unique_lock lock(this->store.locks[b]);
-    auto result = this->store.getIfExists(b, req->key);
-    if(result == std::nullopt) {
+    std::shared_lock layout(this->partitions_mtx);
+    Partition& p = this->partition_for(req->key);
+    size_t b = p.store.bucket(req->key);
+    auto lock = p.store.lock_unclaimed<DbMap::WriteLock>(b, req->key);
+    auto result = p.store.getIfExists(b, req->key);
+    if(result == nullptr) {
         return false;
     }
-    res->value = result->value;
-    bool deleted = this->store.removeItem(b, req->key);
+    res->value = result->value();
+    bool deleted = p.store.removeItem(b, req->key);
+    reindex(p.refs, req->key, res->value, "");
     return deleted;
 }
 
@@ -62,28 +336,29 @@ bool ConcurrentKvStore::MultiGet(const MultiGetRequest* req,
     // TODO (Part A, Step 3 and Step 4): Implement!
     res->values.clear();
 
-    std::vector<size_t> ids;
-    for (auto& k : req->keys)
-        ids.push_back(this->store.bucket(k));
+    // Visit each bucket once, for all of its keys
+    std::shared_lock layout(this->partitions_mtx);
+    std::map<Stripe, std::vector<size_t>> by_stripe;
+    for (size_t i = 0; i < req->keys.size(); ++i)
+        by_stripe[this->stripe_for(req->keys[i])].push_back(i);
+    std::vector<Stripe> stripes;
+    for (auto&& [stripe, _] : by_stripe)
+        stripes.push_back(stripe);
 
-    std::sort(ids.begin(), ids.end());
-    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
-    std::vector<std::shared_lock<std::shared_mutex>> guards;
-    for (auto b : ids)
-        guards.emplace_back(this->store.locks[b]);
-
-    for(size_t i = 0; i < req->keys.size(); ++i)
-    {
-        std::string key = req->keys[i];
-        size_t b = this->store.bucket(key);
-        auto val_it = this->store.getIfExists(b, key);
-        if(val_it == std::nullopt)
-        {
-            res->values.clear();
-            return false;
+    // A missing key fails the whole request, whenever it's seen
+    std::vector<std::string> values(req->keys.size());
+    bool ok = this->read_consistently(stripes, [&](size_t n) {
+        auto [p, b] = stripes[n];
+        DbMap& store = this->partitions[p]->store;
+        for (size_t i : by_stripe[stripes[n]]) {
+            auto val_it = store.getIfExists(b, req->keys[i]);
+            if (val_it == nullptr) return false;
+            values[i] = val_it->value();
         }
-        res->values.push_back(val_it->value);
-    }
+        return true;
+    });
+    if (!ok) return false;
+    res->values = std::move(values);
     return true;
 }
 
@@ -95,45 +370,746 @@ bool ConcurrentKvStore::MultiPut(const MultiPutRequest* req,
         return false;
     }
 
-    std::vector<size_t> ids;
-    for (auto& k : req->keys)
-        ids.push_back(this->store.bucket(k));
+    // Do all the work that doesn't need the locks up front, so that they're
+    // only held while the items are swapped in
+    std::shared_lock layout(this->partitions_mtx);
+    std::map<Stripe, std::vector<size_t>> by_stripe;
+    std::vector<std::vector<std::string>> new_refs(req->keys.size());
+    for (size_t i = 0; i < req->keys.size(); ++i) {
+        by_stripe[this->stripe_for(req->keys[i])].push_back(i);
+        new_refs[i] = RefIndex::identifiers(req->values[i]);
+    }
+    auto deadline = TimerWheel::deadline_after(req->ttl_ms);
 
-    std::sort(ids.begin(), ids.end());
-    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
-    std::vector<std::unique_lock<std::shared_mutex>> guards;
-    for (auto b : ids)
-        guards.emplace_back(this->store.locks[b]);
+    // Swaps in a bucket's items, and indexes them all in one go. Requires the
+    // bucket's lock.
+    auto write_bucket = [&](const Stripe& stripe,
+                            const std::vector<size_t>& indices) {
+        Partition& p = *this->partitions[stripe.first];
+        auto olds = p.store.insertItems(stripe.second, req->keys, req->values,
+                                        indices, deadline);
+        std::vector<RefIndex::Change> changes;
+        for (size_t n = 0; n < indices.size(); n++) {
+            size_t i = indices[n];
+            changes.push_back({req->keys[i],
+                               RefIndex::identifiers(olds[n] ? *olds[n] : ""),
+                               std::move(new_refs[i])});
+        }
+        p.refs.update(changes);
+    };
+    auto store_of = [&](const Stripe& stripe) -> DbMap& {
+        return this->partitions[stripe.first]->store;
+    };
 
-    for(size_t i = 0; i < req->keys.size(); ++i)
-    {
-        auto key = req->keys[i];
-        auto val = req->values[i];
-        size_t b = this->store.bucket(key);
-        this->store.insertItem(b, key, val);
+    if (req->bulk) {
+        // A bulk load needn't be atomic: each bucket is written under its own
+        // lock alone, so the rest of the store stays readable meanwhile
+        for (auto&& [stripe, indices] : by_stripe) {
+            DbMap& store = store_of(stripe);
+            size_t b = stripe.second;
+            DbMap::WriteLock lock(store.locks[b]);
+            DbMap::wait_out_claims(lock, [&] {
+                return store.claimed(b, req->keys, indices);
+            });
+            write_bucket(stripe, indices);
+        }
+    } else {
+        // Claim every key, a bucket at a time in bucket order (so that
+        // MultiPuts of the same keys don't wait on each other's claims), then
+        // write each bucket's keys and let go of them. No one else reads or
+        // writes a claimed key, and all of them are claimed before any is
+        // written, so the write appears to happen at once without holding
+        // more than one bucket's lock at a time.
+        for (auto&& [stripe, indices] : by_stripe)
+            store_of(stripe).claim(stripe.second, req->keys, indices);
+
+        for (auto&& [stripe, indices] : by_stripe) {
+            DbMap& store = store_of(stripe);
+            DbMap::WriteLock lock(store.locks[stripe.second]);
+            write_bucket(stripe, indices);
+            store.release(stripe.second, req->keys, indices);
+        }
     }
 
+    // The timers check the deadline when they fire, so they can be set after
+    if (req->ttl_ms) this->expiry.schedule(req->keys, deadline);
+    return true;
+}
+
+bool ConcurrentKvStore::CompareAndSwap(const CompareAndSwapRequest* req,
+                                       CompareAndSwapResponse* res) {
+    std::shared_lock layout(this->partitions_mtx);
+    Partition& p = this->partition_for(req->key);
+    size_t b = p.store.bucket(req->key);
+    auto lock = p.store.lock_unclaimed<DbMap::WriteLock>(b, req->key);
+    auto result = p.store.getIfExists(b, req->key);
+    res->swapped = result && result->value() == req->expected;
+    if (res->swapped) {
+        auto old = p.store.insertItem(b, req->key, req->desired,
+                                      result->expires_at);
+        reindex(p.refs, req->key, old, req->desired);
+        res->value = req->desired;
+    } else {
+        res->value = result ? result->value() : "";
+    }
+    return true;
+}
+
+bool ConcurrentKvStore::Increment(const IncrementRequest* req,
+                                  IncrementResponse* res) {
+    std::shared_lock layout(this->partitions_mtx);
+    Partition& p = this->partition_for(req->key);
+    size_t b = p.store.bucket(req->key);
+    auto lock = p.store.lock_unclaimed<DbMap::WriteLock>(b, req->key);
+    auto result = p.store.getIfExists(b, req->key);
+    auto sum = add_to(result ? std::string(result->value()) : "0", req->delta);
+    if (!sum) {
+        return false;
+    }
+    // Numbers mention nothing, but this may replace an expired value that did
+    auto value = std::to_string(*sum);
+    auto old = p.store.insertItem(b, req->key, value,
+                                  result ? result->expires_at
+                                         : TimerWheel::Clock::time_point{});
+    reindex(p.refs, req->key, old, value);
+    res->value = *sum;
+    return true;
+}
+
+bool ConcurrentKvStore::PutIfAbsent(const PutIfAbsentRequest* req,
+                                    PutIfAbsentResponse* res) {
+    std::shared_lock layout(this->partitions_mtx);
+    Partition& p = this->partition_for(req->key);
+    size_t b = p.store.bucket(req->key);
+    auto lock = p.store.lock_unclaimed<DbMap::WriteLock>(b, req->key);
+    auto result = p.store.getIfExists(b, req->key);
+    res->inserted = !result;
+    if (res->inserted) {
+        auto deadline = TimerWheel::deadline_after(req->ttl_ms);
+        auto old = p.store.insertItem(b, req->key, req->value, deadline);
+        reindex(p.refs, req->key, old, req->value);
+        if (req->ttl_ms) this->expiry.schedule(req->key, deadline);
+        res->value = req->value;
+    } else {
+        res->value = result->value();
+    }
+    return true;
+}
+
+bool ConcurrentKvStore::DeleteIfEquals(const DeleteIfEqualsRequest* req,
+                                       DeleteIfEqualsResponse* res) {
+    std::shared_lock layout(this->partitions_mtx);
+    Partition& p = this->partition_for(req->key);
+    size_t b = p.store.bucket(req->key);
+    auto lock = p.store.lock_unclaimed<DbMap::WriteLock>(b, req->key);
+    auto result = p.store.getIfExists(b, req->key);
+    res->deleted = result && result->value() == req->expected &&
+                   p.store.removeItem(b, req->key);
+    if (res->deleted) {
+        // The item is gone, but it held what was expected
+        reindex(p.refs, req->key, req->expected, "");
+    }
     return true;
 }
 
 std::vector<std::string> ConcurrentKvStore::AllKeys() {
     // TODO (Part A, Step 3 and Step 4): Implement!
     std::vector<std::string> allkeys;
+    auto snapshot = this->TakeSnapshot();
+    while (true) {
+        KvItems items = snapshot->Next(SNAPSHOT_BATCH_SIZE);
+        if (items.keys.empty()) break;
+        allkeys.insert(allkeys.end(),
+                       std::make_move_iterator(items.keys.begin()),
+                       std::make_move_iterator(items.keys.end()));
+    }
+    return allkeys;
+}
 
-    // 1. Lock ALL buckets in order (shared = readers)
-    std::vector<std::shared_lock<std::shared_mutex>> guards;
-    guards.reserve(this->store.buckets.size());
-    for (size_t i = 0; i < this->store.buckets.size(); ++i) {
-        guards.emplace_back(this->store.locks[i]);
+class ConcurrentKvStore::StoreSnapshot : public KvSnapshot {
+ public:
+    explicit StoreSnapshot(ConcurrentKvStore& store) : store(store) {
     }
 
-    for (size_t i = 0; i < this->store.buckets.size(); ++i) {
-        auto& bucket = this->store.buckets[i];
+    ~StoreSnapshot() override {
+        std::unique_lock layout(this->store.partitions_mtx);
+        for (size_t p = 0; p < this->partitions.size(); p++) {
+            std::erase(this->partitions[p]->store.snapshots, this->views[p]);
+        }
+    }
 
-        for (auto& item : bucket) {
-            allkeys.push_back(item.key);
+    KvItems Next(size_t max_items) override {
+        KvItems items;
+        while (items.keys.size() < std::max<size_t>(max_items, 1)) {
+            if (this->next_item == this->bucket.size()) {
+                if (this->p == this->partitions.size()) break;
+                this->bucket = this->partitions[this->p]->store.read_snapshot(
+                    *this->views[this->p], this->b);
+                this->next_item = 0;
+                if (++this->b == DbMap::BUCKET_COUNT) {
+                    this->b = 0;
+                    this->p++;
+                }
+                continue;
+            }
+            auto& item = this->bucket[this->next_item++];
+            items.keys.push_back(std::move(item.key));
+            items.values.push_back(std::move(item.value));
+            items.ttls_ms.push_back(TimerWheel::ms_until(item.expires_at));
         }
+        return items;
     }
 
-    return allkeys;
+    ConcurrentKvStore& store;
+    // The partitions when the snapshot was taken, and its view of each
+    std::vector<std::shared_ptr<Partition>> partitions;
+    std::vector<std::shared_ptr<DbMap::Snapshot>> views;
+
+ private:
+    // The next bucket to read, and the items of the last one read
+    size_t p = 0, b = 0;
+    std::vector<DbMap::Snapshot::Item> bucket;
+    size_t next_item = 0;
+};
+
+std::unique_ptr<KvSnapshot> ConcurrentKvStore::TakeSnapshot() {
+    auto snapshot = std::make_unique<StoreSnapshot>(*this);
+    // A snapshot doesn't tell keys that moved out of a partition apart, so
+    // they're swept out first
+    std::unique_lock layout(this->partitions_mtx);
+    while (std::any_of(this->partitions.begin(), this->partitions.end(),
+                       [](auto&& p) { return p->strays.load(); })) {
+        layout.unlock();
+        this->sweep();
+        layout.lock();
+    }
+    // With no operation under way, every bucket's version marks the same
+    // point in time
+    auto taken_at = TimerWheel::Clock::now();
+    for (auto&& p : this->partitions) {
+        snapshot->partitions.push_back(p);
+        snapshot->views.push_back(p->store.snapshot(taken_at));
+    }
+    return snapshot;
+}
+
+// The index of the shard among `shards` (sorted, not overlapping) that holds
+// `position`, or shards.size() if none does.
+static size_t shard_index(const std::vector<Shard>& shards,
+                          const std::string& position) {
+    auto it = std::upper_bound(shards.begin(), shards.end(), position,
+                               [](const std::string& pos, const Shard& shard) {
+                                   return pos < shard.lower;
+                               });
+    if (it != shards.begin() && std::prev(it)->contains(position)) {
+        return std::prev(it) - shards.begin();
+    }
+    return shards.size();
+}
+
+// Whether all of `inner` is in `outer`
+static bool within(const Shard& inner, const Shard& outer) {
+    size_t granularity = std::max(inner.granularity(), outer.granularity());
+    return get_overlap(refine_shard(inner, granularity),
+                       refine_shard(outer, granularity)) ==
+           OverlapStatus::COMPLETELY_CONTAINED;
+}
+
+void ConcurrentKvStore::Repartition(std::vector<Shard> shards,
+                                    KeyPosition position) {
+    std::sort(shards.begin(), shards.end());
+    std::unique_lock repartitioning(this->repartition_mtx);
+
+    // The new layout is built while the store is in use, under the layout's
+    // shared lock: partitions that stay are reused as they are, one that's
+    // split is reused for its first part, and the keys that move are copied
+    // into new partitions no one else can see yet. Buckets written meanwhile
+    // are copied again, and the exclusive lock is only taken to catch up on
+    // the last of those and swap the partitions in. The keys that moved out
+    // of reused partitions are swept out after.
+    bool fresh_rest = false;
+    while (true) {
+        std::shared_lock layout(this->partitions_mtx);
+        // The old partitions go once they're swapped out (and no snapshot
+        // reads them)
+        std::vector<std::shared_ptr<Partition>> old = this->partitions;
+        size_t old_rest = old.size() - 1;
+        bool unchanged = shards.size() == old_rest &&
+                         std::equal(shards.begin(), shards.end(), old.begin(),
+                                    [](const Shard& shard, auto&& p) {
+                                        return shard == p->shard;
+                                    });
+        if (unchanged) return;
+
+        // The new partitions, and for each old one, the new one it becomes
+        // (if it's reused)
+        size_t rest = shards.size();
+        std::vector<std::shared_ptr<Partition>> next;
+        std::vector<std::optional<size_t>> becomes(old.size());
+        bool any_new = false;
+        for (auto&& shard : shards) {
+            size_t p = 0;
+            while (p < old_rest &&
+                   (becomes[p] || !within(shard, old[p]->shard))) {
+                p++;
+            }
+            if (p < old_rest) {
+                becomes[p] = next.size();
+                next.push_back(old[p]);
+            } else {
+                next.push_back(std::make_shared<Partition>(shard, this->hasher));
+                any_new = true;
+            }
+        }
+        // The rest is reused too, unless keys from partitions that aren't have
+        // to go in it
+        if (fresh_rest) {
+            next.push_back(std::make_shared<Partition>(Shard{}, this->hasher));
+        } else {
+            becomes[old_rest] = rest;
+            next.push_back(old[old_rest]);
+        }
+
+        // Which old buckets have keys to copy out: those of partitions that
+        // aren't reused, or are split, and the rest's if it may hold keys of a
+        // new partition
+        auto to_copy = [&](size_t p) {
+            if (!becomes[p]) return true;
+            if (p == old_rest) return any_new;
+            return !(old[p]->shard == shards[*becomes[p]]);
+        };
+        // What was copied out of each old bucket, as (new partition, key), and
+        // the bucket's version when it was
+        std::vector<std::vector<std::pair<size_t, std::string>>> copied(
+            old.size() * DbMap::BUCKET_COUNT);
+        std::vector<uint64_t> copied_at(copied.size());
+        // Set if a key has to go in the rest while it's reused
+        bool rest_needed = false;
+        // Copies the keys that move out of bucket `b` of old partition `p`,
+        // dropping what an earlier copy of the bucket left
+        auto copy_bucket = [&](size_t p, size_t b) {
+            auto& copies = copied[p * DbMap::BUCKET_COUNT + b];
+            for (auto&& [n, key] : copies) {
+                Partition& to = *next[n];
+                auto removed = to.store.removeItems(
+                    to.store.bucket(key),
+                    [&](std::string_view k) { return k == key; });
+                for (auto&& [_, value] : removed) {
+                    reindex(to.refs, key, value, "");
+                }
+            }
+            copies.clear();
+
+            DbMap& from = old[p]->store;
+            DbMap::ReadLock lock(from.locks[b]);
+            copied_at[p * DbMap::BUCKET_COUNT + b] = from.versions[b];
+            for (const DbItem* item = from.buckets[b]; item;
+                 item = item->next) {
+                if (item->expired()) continue;
+                std::string key(item->key());
+                size_t n = shard_index(shards, position(key));
+                if (becomes[p] == n) continue;
+                if (becomes[old_rest] == n) {
+                    rest_needed = true;
+                    return;
+                }
+                Partition& to = *next[n];
+                std::string value(item->value());
+                auto replaced = to.store.insertItem(to.store.bucket(key), key,
+                                                    value, item->expires_at);
+                reindex(to.refs, key, replaced, value);
+                copies.emplace_back(n, std::move(key));
+            }
+        };
+        // Copies all the buckets to copy, or only those changed since they
+        // last were. Returns how many it copied.
+        auto copy_buckets = [&](bool changed_only) {
+            size_t n_copied = 0;
+            for (size_t p = 0; p < old.size() && !rest_needed; p++) {
+                if (!to_copy(p)) continue;
+                for (size_t b = 0; b < DbMap::BUCKET_COUNT && !rest_needed;
+                     b++) {
+                    if (changed_only &&
+                        old[p]->store.versions[b] ==
+                            copied_at[p * DbMap::BUCKET_COUNT + b]) {
+                        continue;
+                    }
+                    copy_bucket(p, b);
+                    n_copied++;
+                }
+            }
+            return n_copied;
+        };
+
+        size_t n_copied = copy_buckets(false);
+        for (size_t pass = 0; n_copied > 0 && !rest_needed &&
+                              pass < REPARTITION_CATCH_UP_PASSES;
+             pass++) {
+            n_copied = copy_buckets(true);
+        }
+        if (rest_needed) {
+            fresh_rest = true;
+            continue;
+        }
+
+        layout.unlock();
+        std::unique_lock exclusive(this->partitions_mtx);
+        // A shard dropped or attached in between changed what was copied
+        if (this->partitions != old) continue;
+        copy_buckets(true);
+        if (rest_needed) {
+            fresh_rest = true;
+            continue;
+        }
+        for (size_t p = 0; p < old.size(); p++) {
+            if (!becomes[p]) continue;
+            if (*becomes[p] < rest) old[p]->shard = shards[*becomes[p]];
+            for (size_t b = 0; b < DbMap::BUCKET_COUNT; b++) {
+                if (!copied[p * DbMap::BUCKET_COUNT + b].empty()) {
+                    old[p]->strays = true;
+                }
+            }
+        }
+        this->partitions = std::move(next);
+        this->position = std::move(position);
+        exclusive.unlock();
+
+        this->sweep();
+        return;
+    }
+}
+
+void ConcurrentKvStore::sweep() {
+    std::shared_lock layout(this->partitions_mtx);
+    for (size_t p = 0; p < this->partitions.size(); p++) {
+        Partition& partition = *this->partitions[p];
+        if (!partition.strays) continue;
+        for (size_t b = 0; b < DbMap::BUCKET_COUNT; b++) {
+            DbMap::WriteLock lock(partition.store.locks[b]);
+            auto removed = partition.store.removeItems(
+                b, [&](std::string_view key) {
+                    return this->index_for(std::string(key)) != p;
+                });
+            for (auto&& [key, value] : removed) {
+                reindex(partition.refs, key, value, "");
+            }
+        }
+        partition.strays = false;
+    }
+}
+
+std::vector<std::string> ConcurrentKvStore::AllKeys(const Shard& shard) {
+    std::shared_lock layout(this->partitions_mtx);
+    std::vector<bool> partly;
+    std::vector<Stripe> stripes = this->stripes_in(shard, partly);
+
+    std::vector<std::vector<std::string>> stripe_keys(stripes.size());
+    this->read_consistently(stripes, [&](size_t n) {
+        auto [p, b] = stripes[n];
+        stripe_keys[n].clear();
+        for (const DbItem* item = this->partitions[p]->store.buckets[b]; item;
+             item = item->next) {
+            if (this->in_shard(shard, partly, p, *item)) {
+                stripe_keys[n].emplace_back(item->key());
+            }
+        }
+        return true;
+    });
+
+    std::vector<std::string> keys;
+    for (auto&& found : stripe_keys) {
+        keys.insert(keys.end(), std::make_move_iterator(found.begin()),
+                    std::make_move_iterator(found.end()));
+    }
+    return keys;
+}
+
+KvItems ConcurrentKvStore::ShardItems(const Shard& shard) {
+    std::shared_lock layout(this->partitions_mtx);
+    std::vector<bool> partly;
+    std::vector<Stripe> stripes = this->stripes_in(shard, partly);
+
+    std::vector<KvItems> stripe_items(stripes.size());
+    this->read_consistently(stripes, [&](size_t n) {
+        auto [p, b] = stripes[n];
+        stripe_items[n] = {};
+        for (const DbItem* item = this->partitions[p]->store.buckets[b]; item;
+             item = item->next) {
+            if (!this->in_shard(shard, partly, p, *item)) continue;
+            stripe_items[n].keys.emplace_back(item->key());
+            stripe_items[n].values.emplace_back(item->value());
+            stripe_items[n].ttls_ms.push_back(
+                TimerWheel::ms_until(item->expires_at));
+        }
+        return true;
+    });
+
+    KvItems items;
+    for (auto&& found : stripe_items) {
+        items.keys.insert(items.keys.end(),
+                          std::make_move_iterator(found.keys.begin()),
+                          std::make_move_iterator(found.keys.end()));
+        items.values.insert(items.values.end(),
+                            std::make_move_iterator(found.values.begin()),
+                            std::make_move_iterator(found.values.end()));
+        items.ttls_ms.insert(items.ttls_ms.end(), found.ttls_ms.begin(),
+                             found.ttls_ms.end());
+    }
+    return items;
+}
+
+uint64_t ConcurrentKvStore::ShardBytes(const Shard& shard) {
+    std::shared_lock layout(this->partitions_mtx);
+    std::vector<bool> partly;
+    uint64_t bytes = 0;
+    for (auto [p, b] : this->stripes_in(shard, partly)) {
+        DbMap& store = this->partitions[p]->store;
+        std::shared_lock lock(store.locks[b]);
+        if (!partly[p]) {
+            bytes += store.n_bytes[b];
+            continue;
+        }
+        for (const DbItem* item = store.buckets[b]; item; item = item->next) {
+            if (this->in_shard(shard, partly, p, *item)) {
+                bytes += item->key_size + item->value_size;
+            }
+        }
+    }
+    return bytes;
+}
+
+void ConcurrentKvStore::DropShard(const Shard& shard) {
+    {
+        std::shared_lock layout(this->partitions_mtx);
+        auto p = this->partition_of(shard);
+        if (p && this->partitions[*p]->store.empty()) return;
+    }
+
+    // Made up front, so that the layout is only held for the swap. Whatever
+    // was in the partition goes with it once the layout is let go, and no
+    // snapshot reads it.
+    auto swapped = std::make_shared<Partition>(shard, this->hasher);
+    {
+        std::unique_lock layout(this->partitions_mtx);
+        if (auto p = this->partition_of(shard)) {
+            std::swap(this->partitions[*p], swapped);
+            return;
+        }
+    }
+
+    // Not a partition, so its keys go one at a time
+    for (auto&& key : this->AllKeys(shard)) {
+        DeleteRequest req{key};
+        DeleteResponse res;
+        this->Delete(&req, &res);
+    }
+}
+
+void ConcurrentKvStore::AttachShard(const Shard& shard, KvItems items) {
+    // Puts the items into a partition that's already in use
+    auto put_each = [&] {
+        for (size_t i = 0; i < items.keys.size(); i++) {
+            PutRequest req{items.keys[i], std::move(items.values[i]),
+                           items.ttls_ms[i]};
+            PutResponse res;
+            this->Put(&req, &res);
+        }
+    };
+    bool empty;
+    {
+        std::shared_lock layout(this->partitions_mtx);
+        auto p = this->partition_of(shard);
+        empty = p && this->partitions[*p]->store.empty();
+    }
+    if (!empty) {
+        put_each();
+        return;
+    }
+
+    // Build the partition where no one else can see it, then swap it in,
+    // unless the one it would replace was written to meanwhile
+    auto built = std::make_shared<Partition>(shard, this->hasher);
+    std::vector<TimerWheel::Clock::time_point> deadlines;
+    for (size_t i = 0; i < items.keys.size(); i++) {
+        const std::string& key = items.keys[i];
+        deadlines.push_back(TimerWheel::deadline_after(items.ttls_ms[i]));
+        size_t b = built->store.bucket(key);
+        auto old = built->store.insertItem(b, key, items.values[i],
+                                           deadlines.back());
+        reindex(built->refs, key, old, items.values[i]);
+    }
+    {
+        std::unique_lock layout(this->partitions_mtx);
+        auto p = this->partition_of(shard);
+        empty = p && this->partitions[*p]->store.empty();
+        if (empty) std::swap(this->partitions[*p], built);
+    }
+    if (!empty) {
+        put_each();
+        return;
+    }
+
+    for (size_t i = 0; i < items.keys.size(); i++) {
+        if (!items.ttls_ms[i]) continue;
+        this->expiry.schedule(items.keys[i], deadlines[i]);
+    }
+}
+
+size_t ConcurrentKvStore::index_for(const std::string& key) const {
+    size_t rest = this->partitions.size() - 1;
+    // Only the rest, until the store is partitioned
+    if (rest == 0) return 0;
+
+    // The only partition that can hold the key is the last one starting at or
+    // before it
+    std::string position = this->position(key);
+    auto it = std::upper_bound(
+        this->partitions.begin(), this->partitions.begin() + rest, position,
+        [](const std::string& pos, auto&& p) { return pos < p->shard.lower; });
+    if (it != this->partitions.begin() &&
+        (*std::prev(it))->shard.contains(position)) {
+        return std::prev(it) - this->partitions.begin();
+    }
+    return rest;
+}
+
+std::optional<size_t> ConcurrentKvStore::partition_of(
+    const Shard& shard) const {
+    auto end = std::prev(this->partitions.end());
+    auto it = std::lower_bound(
+        this->partitions.begin(), end, shard,
+        [](auto&& p, const Shard& s) { return p->shard < s; });
+    if (it == end || !((*it)->shard == shard)) return std::nullopt;
+    return it - this->partitions.begin();
+}
+
+std::vector<ConcurrentKvStore::Stripe> ConcurrentKvStore::stripes_in(
+    const Shard& shard, std::vector<bool>& partly) const {
+    partly.assign(this->partitions.size(), true);
+    std::vector<Stripe> stripes;
+    for (size_t p = 0; p < this->partitions.size(); p++) {
+        const Shard& bounds = this->partitions[p]->shard;
+        // The rest may hold keys from anywhere
+        if (p + 1 < this->partitions.size()) {
+            size_t granularity =
+                std::max(bounds.granularity(), shard.granularity());
+            OverlapStatus overlap =
+                get_overlap(refine_shard(bounds, granularity),
+                            refine_shard(shard, granularity));
+            if (overlap == OverlapStatus::NO_OVERLAP) continue;
+            partly[p] = overlap != OverlapStatus::COMPLETELY_CONTAINED ||
+                        this->partitions[p]->strays;
+        }
+        for (size_t b = 0; b < DbMap::BUCKET_COUNT; b++)
+            stripes.emplace_back(p, b);
+    }
+    return stripes;
+}
+
+bool ConcurrentKvStore::in_shard(const Shard& shard,
+                                 const std::vector<bool>& partly, size_t p,
+                                 const DbItem& item) const {
+    if (item.expired()) return false;
+    if (!partly[p]) return true;
+    std::string key(item.key());
+    if (this->partitions[p]->strays && this->index_for(key) != p) return false;
+    return shard.contains(this->position(key));
+}
+
+bool ConcurrentKvStore::read_consistently(
+    const std::vector<Stripe>& stripes,
+    const std::function<bool(size_t)>& read) {
+    auto lock_of = [&](size_t n) -> std::shared_mutex& {
+        auto [p, b] = stripes[n];
+        return this->partitions[p]->store.locks[b];
+    };
+    auto version_of = [&](size_t n) -> uint64_t {
+        auto [p, b] = stripes[n];
+        return this->partitions[p]->store.versions[b];
+    };
+    // Requires the bucket's lock
+    auto claimed = [&](size_t n) {
+        auto [p, b] = stripes[n];
+        return !this->partitions[p]->store.claims[b].empty();
+    };
+
+    // One bucket's lock is all it takes to read it consistently
+    if (stripes.size() == 1) {
+        DbMap::ReadLock lock(lock_of(0));
+        DbMap::wait_out_claims(lock, [&] { return claimed(0); });
+        return read(0);
+    }
+
+    // If no bucket changed between being read and the last one being read,
+    // they all held what was read at that moment
+    std::vector<uint64_t> seen(stripes.size());
+    for (size_t attempt = 0; attempt < OPTIMISTIC_READ_ATTEMPTS; attempt++) {
+        bool unchanged = true;
+        for (size_t n = 0; n < stripes.size() && unchanged; n++) {
+            DbMap::ReadLock lock(lock_of(n));
+            // A MultiPut is writing to the bucket; try again once it's done
+            if (claimed(n)) {
+                unchanged = false;
+                break;
+            }
+            seen[n] = version_of(n);
+            if (!read(n)) return false;
+        }
+        for (size_t n = 0; n < stripes.size() && unchanged; n++) {
+            unchanged = version_of(n) == seen[n];
+        }
+        if (unchanged) return true;
+        std::this_thread::yield();
+    }
+
+    std::vector<DbMap::ReadLock> guards;
+    guards.reserve(stripes.size());
+    while (true) {
+        for (size_t n = 0; n < stripes.size(); n++)
+            guards.emplace_back(lock_of(n));
+        bool any_claimed = false;
+        for (size_t n = 0; n < stripes.size() && !any_claimed; n++) {
+            any_claimed = claimed(n);
+        }
+        if (!any_claimed) break;
+        guards.clear();
+        std::this_thread::yield();
+    }
+    for (size_t n = 0; n < stripes.size(); n++) {
+        if (!read(n)) return false;
+    }
+    return true;
+}
+
+void ConcurrentKvStore::expire(const std::string& key,
+                               TimerWheel::Clock::time_point deadline) {
+    std::shared_lock layout(this->partitions_mtx);
+    Partition& p = this->partition_for(key);
+    size_t b = p.store.bucket(key);
+    auto lock = p.store.lock_unclaimed<DbMap::WriteLock>(b, key);
+    auto old = p.store.expireItem(b, key, deadline);
+    if (old) reindex(p.refs, key, old, "");
+}
+
+std::vector<std::string> ConcurrentKvStore::Referencing(const std::string& id) {
+    std::shared_lock layout(this->partitions_mtx);
+    std::vector<std::string> keys;
+    for (size_t p = 0; p < this->partitions.size(); p++) {
+        auto found = this->partitions[p]->refs.lookup(id);
+        if (this->partitions[p]->strays) {
+            std::erase_if(found, [&](auto&& key) {
+                return this->index_for(key) != p;
+            });
+        }
+        keys.insert(keys.end(), std::make_move_iterator(found.begin()),
+                    std::make_move_iterator(found.end()));
+    }
+    return keys;
+}
+
+void ConcurrentKvStore::reindex(RefIndex& refs, const std::string& key,
+                                const std::optional<std::string>& old,
+                                const std::string& value) {
+    refs.update(key, RefIndex::identifiers(old ? *old : ""),
+                RefIndex::identifiers(value));
 }
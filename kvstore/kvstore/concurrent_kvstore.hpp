@@ -1,34 +1,68 @@
 #ifndef CONCURRENT_KVSTORE_HPP
 #define CONCURRENT_KVSTORE_HPP
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <functional>
-#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "common/utils.hpp"
+#include "common/writer_priority_mutex.hpp"
 #include "kvstore.hpp"
 #include "net/server_commands.hpp"
+#include "ref_index.hpp"
+#include "slab_arena.hpp"
+#include "timer_wheel.hpp"
 
 /**
- * Struct encapsulating a database item. This is optional, but you may find this
- * helpful in your DbMap implementation.
+ * Struct encapsulating a database item: a header, followed by the key's and
+ * then the value's bytes, all in one block from its bucket's arena.
  */
 struct DbItem {
-  std::string key;
-  std::string value;
+  // The next item in the bucket
+  DbItem* next;
+  // When the item expires, or the epoch if it doesn't
+  TimerWheel::Clock::time_point expires_at;
+  // Its bucket's version as of the item's last write
+  uint64_t version;
+  uint32_t key_size;
+  uint32_t value_size;
 
-  DbItem(std::string& k, std::string& v) {
-    this->key = k;
-    this->value = v;
+  std::string_view key() const {
+    return {this->data(), this->key_size};
+  }
+  std::string_view value() const {
+    return {this->data() + this->key_size, this->value_size};
+  }
+
+  bool expired() const {
+    return this->expires_at != TimerWheel::Clock::time_point{} &&
+           this->expires_at <= TimerWheel::Clock::now();
+  }
+
+  // The size of the block holding an item with this key and value
+  static size_t size_for(size_t key_size, size_t value_size) {
+    return sizeof(DbItem) + key_size + value_size;
+  }
+  size_t size() const {
+    return size_for(this->key_size, this->value_size);
   }
 
-  bool operator==(const DbItem& item) {
-    return (this->key == item.key && this->value == item.value);
+  char* data() {
+    return reinterpret_cast<char*>(this + 1);
+  }
+  const char* data() const {
+    return reinterpret_cast<const char*>(this + 1);
   }
 };
 
@@ -39,61 +73,179 @@ class DbMap {
  public:
   DbMap(std::function<size_t(std::string)> hasher) : hasher(hasher) {
   }
+  // Items live in the arenas, which free them all as they go, so dropping a
+  // map doesn't walk its items
+  ~DbMap() = default;
+
+  DbMap(const DbMap&) = delete;
+  DbMap& operator=(const DbMap&) = delete;
 
   static constexpr size_t BUCKET_COUNT = 60;
 
-  // Bucket associative array, with corresponding mutexes to protect access.
-  std::array<std::list<DbItem>, BUCKET_COUNT> buckets;
+  // Each bucket's items, as a linked list allocated from the bucket's arena,
+  // with corresponding mutexes to protect access (to the arena too).
+  std::array<DbItem*, BUCKET_COUNT> buckets{};
+  std::array<SlabArena, BUCKET_COUNT> arenas;
 
   std::array<std::shared_mutex, BUCKET_COUNT> locks;
+  using ReadLock = std::shared_lock<std::shared_mutex>;
+  using WriteLock = std::unique_lock<std::shared_mutex>;
+
+  // Bumped by every change to a bucket, while its lock is held, so that a
+  // reader can tell whether a bucket changed since it last looked
+  std::array<std::atomic<uint64_t>, BUCKET_COUNT> versions{};
+
+  // Bytes of keys and values in each bucket, counting expired items that
+  // haven't been removed yet. Protected by the bucket's lock.
+  std::array<uint64_t, BUCKET_COUNT> n_bytes{};
+
+  // The keys in each bucket claimed by MultiPuts under way, which no one else
+  // reads or writes until they've been written (c.f.
+  // ConcurrentKvStore::MultiPut). Protected by the bucket's lock.
+  std::array<std::vector<std::string_view>, BUCKET_COUNT> claims;
 
   // TODO (Part A, Step 4): You will need to add fields to synchronize access to
   // the hashmap buckets!
 
+  // What a snapshot still needs of the map: the items each bucket held when
+  // it was taken. Those not written since are still in the bucket, as their
+  // version is at most the bucket's version back then; the others are copied
+  // here by the write that first changes or removes them. Once the snapshot
+  // has read a bucket, it no longer needs it.
+  struct Snapshot {
+    struct Item {
+      std::string key, value;
+      TimerWheel::Clock::time_point expires_at;
+    };
+
+    TimerWheel::Clock::time_point taken_at;
+    std::array<uint64_t, BUCKET_COUNT> versions{};
+    // Protected by the bucket's lock
+    std::array<bool, BUCKET_COUNT> read{};
+    std::array<std::vector<Item>, BUCKET_COUNT> saved;
+  };
+  // The snapshots that writers save items for. Only changed while no one
+  // writes to the map (c.f. ConcurrentKvStore::partitions_mtx).
+  std::vector<std::shared_ptr<Snapshot>> snapshots;
+
   // Return the index of the bucket to search for `key`.
   size_t bucket(std::string key) const {
     return hasher(key) % BUCKET_COUNT;
   }
 
-  // Returns the DbItem with key 'key' in bucket `b` if it exists, std::nullopt
-  // otherwise Assumes that `b` == this->bucket(key).
-  std::optional<DbItem> getIfExists(size_t b, std::string key) {
+  // Returns the DbItem with key 'key' in bucket `b` if it exists (and hasn't
+  // expired), nullptr otherwise. It's only valid while the bucket's lock is
+  // held, and until the key is next written. Assumes that `b` ==
+  // this->bucket(key).
+  const DbItem* getIfExists(size_t b, const std::string& key) const {
     assert(b < BUCKET_COUNT);
-    for (const auto& item : this->buckets[b]) {
-      if (item.key == key) {
+    for (const DbItem* item = this->buckets[b]; item; item = item->next) {
+      if (item->key() == key) {
+        if (item->expired()) return nullptr;
         return item;
       }
     }
-    return std::nullopt;
+    return nullptr;
   }
 
-  // Insert a new DbItem with key 'key' and value 'value' to bucket `b`.
-  // If key already exists, updates value to `value`.
+  // Insert a new DbItem with key 'key' and value 'value' to bucket `b`, which
+  // expires at `expires_at` (if set).
+  // If key already exists, updates value to `value`, returning the value it
+  // replaced (even if that had expired).
   // Assumes that `b` == this->bucket(key).
-  void insertItem(size_t b, std::string key, std::string value) {
-    assert(b < BUCKET_COUNT);
+  std::optional<std::string> insertItem(
+      size_t b, const std::string& key, std::string_view value,
+      TimerWheel::Clock::time_point expires_at = {});
 
-    for (auto& item : this->buckets[b]) {
-      if (item.key == key) {
-        item.value = value;
-        return;
-      }
+  // Inserts the keys and values at `indices` (in that order) as insertItem
+  // would one at a time, but in a single pass over bucket `b`. Returns the
+  // value each one replaced. Assumes that all the keys are in bucket `b`.
+  std::vector<std::optional<std::string>> insertItems(
+      size_t b, const std::vector<std::string>& keys,
+      const std::vector<std::string>& values,
+      const std::vector<size_t>& indices,
+      TimerWheel::Clock::time_point expires_at = {});
+
+  // Whether no bucket holds any items, even expired ones. Takes each
+  // bucket's lock in turn.
+  bool empty();
+
+  // Whether any of the keys at `indices` (all in bucket `b`) is claimed.
+  // Requires the bucket's lock.
+  bool claimed(size_t b, const std::vector<std::string>& keys,
+               const std::vector<size_t>& indices) const;
+  bool claimed(size_t b, std::string_view key) const {
+    return std::find(this->claims[b].begin(), this->claims[b].end(), key) !=
+           this->claims[b].end();
+  }
+
+  // Drops and takes `lock` on bucket `b` again until `claimed()` is false,
+  // letting the MultiPuts that claimed keys there finish.
+  template <typename Lock, typename Claimed>
+  static void wait_out_claims(Lock& lock, Claimed claimed) {
+    while (claimed()) {
+      lock.unlock();
+      std::this_thread::yield();
+      lock.lock();
     }
-    this->buckets[b].emplace_back(key, value);
   }
 
+  // Takes bucket `b`'s lock (a ReadLock or WriteLock) once `key` in it isn't
+  // claimed.
+  template <typename Lock>
+  Lock lock_unclaimed(size_t b, std::string_view key) {
+    Lock lock(this->locks[b]);
+    wait_out_claims(lock, [&] { return this->claimed(b, key); });
+    return lock;
+  }
+
+  // Claims the keys at `indices` (all in bucket `b`, and alive until they're
+  // released) once none of them is claimed by another MultiPut. Takes the
+  // bucket's lock.
+  void claim(size_t b, const std::vector<std::string>& keys,
+             const std::vector<size_t>& indices);
+  // Lets go of the claims on the keys at `indices`. Requires the bucket's
+  // lock.
+  void release(size_t b, const std::vector<std::string>& keys,
+               const std::vector<size_t>& indices);
+
+  // Registers a snapshot of the map as of `taken_at`, which must be now.
+  // Requires that no one writes to the map meanwhile.
+  std::shared_ptr<Snapshot> snapshot(TimerWheel::Clock::time_point taken_at);
+
+  // The items of bucket `b` in `snapshot` that hadn't expired when it was
+  // taken, after which the snapshot is done with the bucket. Takes the
+  // bucket's lock.
+  std::vector<Snapshot::Item> read_snapshot(Snapshot& snapshot, size_t b);
+
   // Remove a DbItem with key `key` from bucket `b`.
   // Assumes that `b` == this->getBucketIndex(key).
-  bool removeItem(size_t b, std::string key) {
-    assert(b < BUCKET_COUNT);
+  bool removeItem(size_t b, const std::string& key);
 
-    size_t num_removed = this->buckets[b].remove_if(
-        [&](auto&& item) { return item.key == key; });
-    return num_removed > 0;
-  }
+  // Removes the items in bucket `b` whose keys `pick` returns true for (even
+  // expired ones), returning their keys and values.
+  std::vector<std::pair<std::string, std::string>> removeItems(
+      size_t b, const std::function<bool(std::string_view)>& pick);
+
+  // Remove the DbItem with key `key` from bucket `b` if it's still set to
+  // expire at `deadline`, returning its value.
+  // Assumes that `b` == this->bucket(key).
+  std::optional<std::string> expireItem(size_t b, const std::string& key,
+                                        TimerWheel::Clock::time_point deadline);
 
  private:
   std::function<size_t(std::string)> hasher;
+
+  // Allocates an item in bucket `b`'s arena, without linking it in
+  DbItem* make_item(size_t b, std::string_view key, std::string_view value,
+                    TimerWheel::Clock::time_point expires_at);
+  // Copies `item` for the snapshots that still need it, before it's changed
+  void save_for_snapshots(size_t b, const DbItem& item);
+  // Sets the value of the item `*link` points to, in place if it fits
+  void overwrite_item(size_t b, DbItem** link, std::string_view value,
+                      TimerWheel::Clock::time_point expires_at);
+  // Unlinks the item `*link` points to from its bucket, and frees it
+  void free_item(size_t b, DbItem** link);
 };
 
 class ConcurrentKvStore : public KvStore {
@@ -103,22 +255,142 @@ class ConcurrentKvStore : public KvStore {
   // otherwise, feel free to ignore!
   ConcurrentKvStore(
       std::function<size_t(std::string)> hasher = std::hash<std::string>())
-      : store(hasher) {
+      : hasher(hasher),
+        expiry([this](const std::string& key,
+                      TimerWheel::Clock::time_point deadline) {
+          this->expire(key, deadline);
+        }) {
+    // Until the store is partitioned, every key is in the rest
+    this->partitions.push_back(std::make_shared<Partition>(Shard{}, hasher));
   }
   ~ConcurrentKvStore() = default;
 
   bool Get(const GetRequest* req, GetResponse* res) override;
+  bool GetRange(const GetStreamRequest* req, GetStreamResponse* res) override;
   bool Put(const PutRequest* req, PutResponse* res) override;
   bool Append(const AppendRequest* req, AppendResponse* res) override;
   bool Delete(const DeleteRequest* req, DeleteResponse* res) override;
   bool MultiGet(const MultiGetRequest* req, MultiGetResponse* res) override;
   bool MultiPut(const MultiPutRequest* req, MultiPutResponse* res) override;
+  bool CompareAndSwap(const CompareAndSwapRequest* req,
+                      CompareAndSwapResponse* res) override;
+  bool Increment(const IncrementRequest* req, IncrementResponse* res) override;
+  bool PutIfAbsent(const PutIfAbsentRequest* req,
+                   PutIfAbsentResponse* res) override;
+  bool DeleteIfEquals(const DeleteIfEqualsRequest* req,
+                      DeleteIfEqualsResponse* res) override;
 
+  // Reads a snapshot, so writers aren't held up
   std::vector<std::string> AllKeys() override;
+  // Holds up operations only while the snapshot is taken and let go of
+  std::unique_ptr<KvSnapshot> TakeSnapshot() override;
+  std::vector<std::string> Referencing(const std::string& id) override;
+
+  void Repartition(std::vector<Shard> shards, KeyPosition position) override;
+  std::vector<std::string> AllKeys(const Shard& shard) override;
+  KvItems ShardItems(const Shard& shard) override;
+  uint64_t ShardBytes(const Shard& shard) override;
+  void DropShard(const Shard& shard) override;
+  void AttachShard(const Shard& shard, KvItems items) override;
 
  private:
-  // Your internal key-value store implementation!
-  DbMap store;
+  // Your internal key-value store implementation! Keys are kept in one map
+  // per shard the store is partitioned into, each with its own reference
+  // index, so that a shard can be swapped out or in whole.
+  struct Partition {
+    Partition(Shard shard, std::function<size_t(std::string)> hasher)
+        : shard(std::move(shard)), store(hasher) {
+    }
+
+    // Empty for the partition holding the keys outside every shard
+    Shard shard;
+    DbMap store;
+    // Which keys mention which identifiers, updated under the bucket lock of
+    // each write
+    RefIndex refs;
+    // Set while the partition still holds the keys that moved out of it when
+    // it was last repartitioned, until they're swept out. Lookups don't reach
+    // them, and reading the partition whole skips them.
+    std::atomic<bool> strays = false;
+  };
+  std::function<size_t(std::string)> hasher;
+
+  // Reads the partitions as they were when it was taken, one bucket at a
+  // time, keeping them around even if the layout has changed since
+  class StoreSnapshot;
+
+  // The partitions, sorted by shard, followed by the one for the rest. An
+  // operation holds partitions_mtx shared for as long as it uses them;
+  // changing the layout (or the partitions' snapshots) holds it exclusively,
+  // ahead of operations that start meanwhile, so that a steady stream of them
+  // doesn't hold it up. A partition taken out of the layout isn't written to
+  // again.
+  std::vector<std::shared_ptr<Partition>> partitions;
+  KeyPosition position = to_upper;
+  WriterPriorityMutex partitions_mtx;
+  // Held throughout a Repartition, so that one layout is built at a time
+  std::mutex repartition_mtx;
+
+  // How many times the buckets written while a new layout is built are copied
+  // again before the exclusive lock is taken to catch up and swap it in
+  static constexpr size_t REPARTITION_CATCH_UP_PASSES = 3;
+
+  // Removes the keys that moved out of partitions (c.f. Partition::strays),
+  // one bucket lock at a time.
+  void sweep();
+
+  // The index of the partition holding `key`, that partition, and the index
+  // of the one that is exactly `shard` (if any). Require partitions_mtx.
+  size_t index_for(const std::string& key) const;
+  Partition& partition_for(const std::string& key) {
+    return *this->partitions[this->index_for(key)];
+  }
+  std::optional<size_t> partition_of(const Shard& shard) const;
+
+  // A bucket of one of the partitions: (partition index, bucket). Ordered the
+  // way locks on several buckets are taken.
+  using Stripe = std::pair<size_t, size_t>;
+  // Requires partitions_mtx.
+  Stripe stripe_for(const std::string& key) const {
+    size_t p = this->index_for(key);
+    return {p, this->partitions[p]->store.bucket(key)};
+  }
+  // The buckets of the partitions `shard` overlaps, and for each partition,
+  // whether its keys need checking: it's only partly inside `shard`, or still
+  // holds keys that moved out of it. Requires partitions_mtx.
+  std::vector<Stripe> stripes_in(const Shard& shard,
+                                 std::vector<bool>& partly) const;
+  // Whether `item`, in partition `p`, is one of `shard`'s unexpired items, and
+  // not one that moved out of the partition (c.f. stripes_in). Requires
+  // partitions_mtx.
+  bool in_shard(const Shard& shard, const std::vector<bool>& partly, size_t p,
+                const DbItem& item) const;
+
+  // Updates `refs` after `key`'s value `old` (if any) was replaced by `value`.
+  static void reindex(RefIndex& refs, const std::string& key,
+                      const std::optional<std::string>& old,
+                      const std::string& value);
+
+  // How many times a multi-bucket read is tried one lock at a time before it
+  // takes all of its locks together
+  static constexpr size_t OPTIMISTIC_READ_ATTEMPTS = 3;
+
+  // Calls `read(n)` for each of `stripes` (ascending, without duplicates)
+  // with the n-th one's shared lock held, such that the reads together see
+  // the store as it was at a single point in time. Buckets are first read one
+  // lock at a time and their versions checked again afterwards; only if
+  // writers keep changing them are all the locks held at once. A bucket with
+  // keys claimed by a MultiPut isn't read until it's done. `read` may be
+  // called for a bucket more than once, and should overwrite what it read
+  // before. Stops and returns false as soon as `read` does. Requires
+  // partitions_mtx.
+  bool read_consistently(const std::vector<Stripe>& stripes,
+                         const std::function<bool(size_t)>& read);
+
+  // Removes keys whose time to live ran out, one bucket lock at a time.
+  // Declared after `partitions`, so that it stops before they go away.
+  TimerWheel expiry;
+  void expire(const std::string& key, TimerWheel::Clock::time_point deadline);
 };
 
 #endif /* end of include guard */
@@ -1,24 +1,113 @@
 #ifndef KVSTORE_HPP
 #define KVSTORE_HPP
 
+#include <charconv>
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
+#include "common/shard.hpp"
 #include "net/server_commands.hpp"
 
+// Items read out of a store, or to put into one, all at once (see
+// KvStore::ShardItems)
+struct KvItems {
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  std::vector<uint64_t> ttls_ms;
+};
+
+// How many items at a time a store's own readers take from a snapshot
+#define SNAPSHOT_BATCH_SIZE 1024
+
+// A store's unexpired items as of a single point in time, read a batch at a
+// time while the store goes on being used (see KvStore::TakeSnapshot)
+class KvSnapshot {
+ public:
+  virtual ~KvSnapshot() = default;
+  // Up to `max_items` more of the items (at least one, while any are left);
+  // empty once every item has been read
+  virtual KvItems Next(size_t max_items) = 0;
+};
+
 class KvStore {
  public:
   virtual ~KvStore() = default;
 
   virtual bool Get(const GetRequest* req, GetResponse* res) = 0;
+  // Reads one chunk of a value without copying the rest of it, along with a
+  // version that changes whenever the key is written (see GetStreamResponse)
+  virtual bool GetRange(const GetStreamRequest* req,
+                        GetStreamResponse* res) = 0;
   virtual bool Put(const PutRequest* req, PutResponse*) = 0;
   virtual bool Append(const AppendRequest* req, AppendResponse*) = 0;
   virtual bool Delete(const DeleteRequest* req, DeleteResponse* res) = 0;
   virtual bool MultiGet(const MultiGetRequest* req, MultiGetResponse* res) = 0;
   virtual bool MultiPut(const MultiPutRequest* req, MultiPutResponse*) = 0;
 
+  // Conditional writes; a failed condition still succeeds (with the response
+  // saying so). Increment fails if the key doesn't hold a decimal integer or
+  // the result would overflow.
+  virtual bool CompareAndSwap(const CompareAndSwapRequest* req,
+                              CompareAndSwapResponse* res) = 0;
+  virtual bool Increment(const IncrementRequest* req,
+                         IncrementResponse* res) = 0;
+  virtual bool PutIfAbsent(const PutIfAbsentRequest* req,
+                           PutIfAbsentResponse* res) = 0;
+  virtual bool DeleteIfEquals(const DeleteIfEqualsRequest* req,
+                              DeleteIfEqualsResponse* res) = 0;
+
   virtual std::vector<std::string> AllKeys() = 0;
+  // A snapshot of the store that writes made after it was taken don't show
+  // up in. It mustn't outlive the store.
+  virtual std::unique_ptr<KvSnapshot> TakeSnapshot() = 0;
+
+  // Where a key is in the shard space (c.f. ShardControllerConfig::shard_key)
+  using KeyPosition = std::function<std::string(const std::string&)>;
+
+  // Keeps the keys in each of `shards` (which mustn't overlap) apart from the
+  // rest, so that a shard's keys can be listed, dropped or brought in without
+  // going through the others. Partitions in both the old and the new layout
+  // are kept as they are, and one that's split keeps the keys of the first of
+  // its parts; only the others' keys move. Until this is first called, keys
+  // are placed by their upper-cased selves.
+  virtual void Repartition(std::vector<Shard> shards, KeyPosition position) = 0;
+
+  // The methods below take any shard, but are only spared from going through
+  // keys one by one for a shard that's exactly a partition.
+
+  // The keys in `shard`
+  virtual std::vector<std::string> AllKeys(const Shard& shard) = 0;
+  // The items in `shard`, as of a single point in time
+  virtual KvItems ShardItems(const Shard& shard) = 0;
+  // The bytes of keys and values in `shard` (perhaps counting expired ones)
+  virtual uint64_t ShardBytes(const Shard& shard) = 0;
+  // Removes every key in `shard`, at once for a partition
+  virtual void DropShard(const Shard& shard) = 0;
+  // Puts `items`, all in `shard`, as Put would. If the shard's partition is
+  // empty, it's replaced by one built from them beforehand.
+  virtual void AttachShard(const Shard& shard, KvItems items) = 0;
+
+  // Keys whose values mention the identifier `id` (see RefIndex), found
+  // without scanning the store. May include keys that have expired but not
+  // been removed yet.
+  virtual std::vector<std::string> Referencing(const std::string& id) = 0;
+
+ protected:
+  // Adds `delta` to the integer in `value`, or returns std::nullopt if `value`
+  // isn't one or the sum overflows.
+  static std::optional<int64_t> add_to(const std::string& value, int64_t delta) {
+    int64_t n;
+    const char* end = value.data() + value.size();
+    auto [ptr, ec] = std::from_chars(value.data(), end, n);
+    if (ec != std::errc{} || ptr != end) return std::nullopt;
+    if (__builtin_add_overflow(n, delta, &n)) return std::nullopt;
+    return n;
+  }
 };
 
 #endif /* end of include guard */
@@ -0,0 +1,81 @@
+#include "ref_index.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+
+std::vector<std::string> RefIndex::identifiers(std::string_view text) {
+    auto is_word = [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    };
+
+    std::vector<std::string> ids;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (!is_word(text[i])) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        bool numbered = false;
+        for (; i < text.size() && is_word(text[i]); i++) {
+            numbered |= text[i] == '_' && i + 1 < text.size() &&
+                        std::isdigit(static_cast<unsigned char>(text[i + 1]));
+        }
+        if (numbered) ids.emplace_back(text.substr(start, i - start));
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+void RefIndex::update(const std::string& key,
+                      const std::vector<std::string>& before,
+                      const std::vector<std::string>& after) {
+    // Most values mention nothing; don't touch the lock for them
+    if (before == after) return;
+
+    std::lock_guard lock(this->mtx);
+    this->apply(key, before, after);
+}
+
+void RefIndex::update(const std::vector<Change>& changes) {
+    bool changed = std::any_of(changes.begin(), changes.end(), [](auto&& c) {
+        return c.before != c.after;
+    });
+    if (!changed) return;
+
+    std::lock_guard lock(this->mtx);
+    for (auto&& change : changes) {
+        if (change.before != change.after) {
+            this->apply(change.key, change.before, change.after);
+        }
+    }
+}
+
+void RefIndex::apply(const std::string& key,
+                     const std::vector<std::string>& before,
+                     const std::vector<std::string>& after) {
+    std::vector<std::string> removed, added;
+    std::set_difference(before.begin(), before.end(), after.begin(),
+                        after.end(), std::back_inserter(removed));
+    std::set_difference(after.begin(), after.end(), before.begin(),
+                        before.end(), std::back_inserter(added));
+
+    for (auto&& id : removed) {
+        auto it = this->keys_by_id.find(id);
+        if (it == this->keys_by_id.end()) continue;
+        it->second.erase(key);
+        if (it->second.empty()) this->keys_by_id.erase(it);
+    }
+    for (auto&& id : added) {
+        this->keys_by_id[id].insert(key);
+    }
+}
+
+std::vector<std::string> RefIndex::lookup(const std::string& id) {
+    std::lock_guard lock(this->mtx);
+    auto it = this->keys_by_id.find(id);
+    if (it == this->keys_by_id.end()) return {};
+    return {it->second.begin(), it->second.end()};
+}
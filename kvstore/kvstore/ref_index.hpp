@@ -0,0 +1,48 @@
+#ifndef REF_INDEX_HPP
+#define REF_INDEX_HPP
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Inverted index from the identifiers mentioned in values (names like
+// "user_15" or "post_7": a run of letters, digits and underscores with a digit
+// right after an underscore) to the keys whose values mention them, so that
+// every key referring to a user can be found without scanning the store.
+//
+// Stores keep it up to date as part of each write, under the same lock as the
+// write itself, so that the index changes in the same order as the values.
+class RefIndex {
+ public:
+  // The distinct identifiers in `text`, in sorted order.
+  static std::vector<std::string> identifiers(std::string_view text);
+
+  // Records that `key`'s value went from mentioning `before` to mentioning
+  // `after` (both as returned by `identifiers`).
+  void update(const std::string& key, const std::vector<std::string>& before,
+              const std::vector<std::string>& after);
+
+  // The same for many keys at once, taking the lock only once
+  struct Change {
+    const std::string& key;
+    std::vector<std::string> before;
+    std::vector<std::string> after;
+  };
+  void update(const std::vector<Change>& changes);
+
+  // The keys whose values mention `id`.
+  std::vector<std::string> lookup(const std::string& id);
+
+ private:
+  std::mutex mtx;
+  // Requires mtx
+  void apply(const std::string& key, const std::vector<std::string>& before,
+             const std::vector<std::string>& after);
+
+  std::unordered_map<std::string, std::unordered_set<std::string>> keys_by_id;
+};
+
+#endif /* end of include guard */
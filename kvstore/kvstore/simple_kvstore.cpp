@@ -1,10 +1,34 @@
 #include "simple_kvstore.hpp"
 
+#include <algorithm>
+
+class SimpleKvStore::CopiedSnapshot : public KvSnapshot {
+ public:
+    explicit CopiedSnapshot(KvItems items) : items(std::move(items)) {
+    }
+
+    KvItems Next(size_t max_items) override {
+        KvItems batch;
+        size_t end = std::min(this->items.keys.size(),
+                              this->next + std::max<size_t>(max_items, 1));
+        for (; this->next < end; this->next++) {
+            batch.keys.push_back(std::move(this->items.keys[this->next]));
+            batch.values.push_back(std::move(this->items.values[this->next]));
+            batch.ttls_ms.push_back(this->items.ttls_ms[this->next]);
+        }
+        return batch;
+    }
+
+ private:
+    KvItems items;
+    size_t next = 0;
+};
+
 bool SimpleKvStore::Get(const GetRequest* req, GetResponse* res) {
     // TODO (Part A, Step 1 and Step 2): Implement!
 
     std::lock_guard<std::mutex> lock(mtx);
-    auto it = store.find(req->key);
+    auto it = this->find(req->key);
     if(it == store.end())
     {
         return false;
@@ -15,6 +39,37 @@ bool SimpleKvStore::Get(const GetRequest* req, GetResponse* res) {
         joint_val += f;
 
     res->value = joint_val;
+    res->ttl_ms = 0;
+    if (auto deadline = deadlines.find(req->key); deadline != deadlines.end()) {
+        res->ttl_ms = TimerWheel::ms_until(deadline->second);
+    }
+    return true;
+}
+
+bool SimpleKvStore::GetRange(const GetStreamRequest* req,
+                             GetStreamResponse* res) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = this->find(req->key);
+    if (it == store.end()) {
+        return false;
+    }
+    // Copy only the part of the fragments that the chunk covers
+    uint64_t end =
+        req->offset + std::min<uint64_t>(req->max_bytes, STREAM_CHUNK_SIZE);
+    uint64_t start = 0;
+    res->chunk.clear();
+    for (auto& f : it->second) {
+        uint64_t from = std::clamp(req->offset, start, start + f.size());
+        uint64_t to = std::clamp(end, start, start + f.size());
+        res->chunk.append(f, from - start, to - from);
+        start += f.size();
+    }
+    res->total_size = start;
+    res->version = n_writes;
+    res->ttl_ms = 0;
+    if (auto deadline = deadlines.find(req->key); deadline != deadlines.end()) {
+        res->ttl_ms = TimerWheel::ms_until(deadline->second);
+    }
     return true;
 }
 
@@ -22,7 +77,11 @@ bool SimpleKvStore::Put(const PutRequest* req, PutResponse*) {
     // TODO (Part A, Step 1 and Step 2): Implement!
 
     std::lock_guard<std::mutex> lock(mtx);
+    refs.update(req->key, refs_of(req->key),
+                RefIndex::identifiers(req->value));
     store[req->key] = { req->value };
+    set_ttl(req->key, req->ttl_ms);
+    n_writes++;
     return true;
 }
 
@@ -30,7 +89,8 @@ bool SimpleKvStore::Append(const AppendRequest* req, AppendResponse*) {
     // TODO (Part A, Step 1 and Step 2): Implement!
 
     std::lock_guard<std::mutex> lock(mtx);
-    auto it = store.find(req->key);
+    auto it = this->find(req->key);
+    auto before = refs_of(req->key);
 
     // Key does not exist
     if(it == store.end())
@@ -40,6 +100,10 @@ bool SimpleKvStore::Append(const AppendRequest* req, AppendResponse*) {
     else {
         store[req->key].push_back(req->value);
     }
+    refs.update(req->key, before, refs_of(req->key));
+    n_writes++;
+    // Without a TTL, the key keeps its expiry
+    if (req->ttl_ms) set_ttl(req->key, req->ttl_ms);
     return true;
 }
 
@@ -47,7 +111,7 @@ bool SimpleKvStore::Delete(const DeleteRequest* req, DeleteResponse* res) {
     // TODO (Part A, Step 1 and Step 2): Implement!
 
     std::lock_guard<std::mutex> lock(mtx);
-    auto it = store.find(req->key);
+    auto it = this->find(req->key);
     if(it == store.end())
     {
         return false;
@@ -59,6 +123,9 @@ bool SimpleKvStore::Delete(const DeleteRequest* req, DeleteResponse* res) {
 
     res->value = joint_val;
     store.erase(req->key);
+    deadlines.erase(req->key);
+    refs.update(req->key, RefIndex::identifiers(joint_val), {});
+    n_writes++;
     return true;
 }
 
@@ -71,7 +138,7 @@ bool SimpleKvStore::MultiGet(const MultiGetRequest* req,
 
     for(size_t i = 0; i < req->keys.size(); ++i)
     {
-        auto val_it = store.find(req->keys[i]);
+        auto val_it = this->find(req->keys[i]);
         if(val_it == store.end())
         {
             return false;
@@ -100,19 +167,248 @@ bool SimpleKvStore::MultiPut(const MultiPutRequest* req, MultiPutResponse*) {
     {
         auto key = req->keys[i];
         auto val = req->values[i];
+        refs.update(key, refs_of(key), RefIndex::identifiers(val));
         store[key] = { val };
+        set_ttl(key, req->ttl_ms);
+    }
+    n_writes++;
+
+    return true;
+}
+
+bool SimpleKvStore::CompareAndSwap(const CompareAndSwapRequest* req,
+                                   CompareAndSwapResponse* res) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = this->find(req->key);
+    std::string joint_val;
+    if (it != store.end()) {
+        for (auto& f : it->second)
+            joint_val += f;
+    }
+
+    res->swapped = it != store.end() && joint_val == req->expected;
+    if (res->swapped) {
+        it->second = { req->desired };
+        refs.update(req->key, RefIndex::identifiers(joint_val),
+                    RefIndex::identifiers(req->desired));
+        joint_val = req->desired;
+        n_writes++;
+    }
+    res->value = joint_val;
+    return true;
+}
+
+bool SimpleKvStore::Increment(const IncrementRequest* req,
+                              IncrementResponse* res) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = this->find(req->key);
+    std::string joint_val = "0";
+    if (it != store.end()) {
+        joint_val.clear();
+        for (auto& f : it->second)
+            joint_val += f;
+    }
+
+    auto sum = add_to(joint_val, req->delta);
+    if (!sum) {
+        return false;
+    }
+    store[req->key] = { std::to_string(*sum) };
+    n_writes++;
+    res->value = *sum;
+    return true;
+}
+
+bool SimpleKvStore::PutIfAbsent(const PutIfAbsentRequest* req,
+                                PutIfAbsentResponse* res) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->find(req->key);
+    auto [it, inserted] = store.try_emplace(req->key);
+    if (inserted) {
+        it->second = { req->value };
+        set_ttl(req->key, req->ttl_ms);
+        refs.update(req->key, {}, RefIndex::identifiers(req->value));
+        n_writes++;
+    }
+
+    std::string joint_val;
+    for (auto& f : it->second)
+        joint_val += f;
+    res->inserted = inserted;
+    res->value = joint_val;
+    return true;
+}
+
+bool SimpleKvStore::DeleteIfEquals(const DeleteIfEqualsRequest* req,
+                                   DeleteIfEqualsResponse* res) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = this->find(req->key);
+    std::string joint_val;
+    if (it != store.end()) {
+        for (auto& f : it->second)
+            joint_val += f;
     }
 
+    res->deleted = it != store.end() && joint_val == req->expected;
+    if (res->deleted) {
+        store.erase(it);
+        deadlines.erase(req->key);
+        refs.update(req->key, RefIndex::identifiers(joint_val), {});
+        n_writes++;
+    }
     return true;
 }
 
 std::vector<std::string> SimpleKvStore::AllKeys() {
     // TODO (Part A, Step 1 and Step 2): Implement!
 
+    std::lock_guard<std::mutex> lock(mtx);
     std::vector<std::string> allkeys;
+    auto now = TimerWheel::Clock::now();
     for(auto it = store.begin(); it != store.end(); ++it)
     {
+        auto deadline = deadlines.find(it->first);
+        if (deadline != deadlines.end() && deadline->second <= now) continue;
         allkeys.push_back(it->first);
     }
     return allkeys;
 }
+
+std::unique_ptr<KvSnapshot> SimpleKvStore::TakeSnapshot() {
+    std::lock_guard<std::mutex> lock(mtx);
+    KvItems items;
+    auto now = TimerWheel::Clock::now();
+    for (auto&& [key, fragments] : store) {
+        uint64_t ttl_ms = 0;
+        if (auto deadline = deadlines.find(key); deadline != deadlines.end()) {
+            if (deadline->second <= now) continue;
+            ttl_ms = TimerWheel::ms_until(deadline->second);
+        }
+        std::string value;
+        for (auto& f : fragments) value += f;
+        items.keys.push_back(key);
+        items.values.push_back(std::move(value));
+        items.ttls_ms.push_back(ttl_ms);
+    }
+    return std::make_unique<CopiedSnapshot>(std::move(items));
+}
+
+void SimpleKvStore::Repartition(std::vector<Shard>, KeyPosition position) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->position = std::move(position);
+}
+
+std::vector<std::string> SimpleKvStore::AllKeys(const Shard& shard) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<std::string> keys;
+    for (auto&& [key, _] : items_in(shard)) keys.push_back(key);
+    return keys;
+}
+
+KvItems SimpleKvStore::ShardItems(const Shard& shard) {
+    std::lock_guard<std::mutex> lock(mtx);
+    KvItems items;
+    for (auto&& [key, value] : items_in(shard)) {
+        uint64_t ttl_ms = 0;
+        if (auto deadline = deadlines.find(key); deadline != deadlines.end()) {
+            ttl_ms = TimerWheel::ms_until(deadline->second);
+        }
+        items.keys.push_back(key);
+        items.values.push_back(std::move(value));
+        items.ttls_ms.push_back(ttl_ms);
+    }
+    return items;
+}
+
+uint64_t SimpleKvStore::ShardBytes(const Shard& shard) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint64_t bytes = 0;
+    for (auto&& [key, value] : items_in(shard)) {
+        bytes += key.size() + value.size();
+    }
+    return bytes;
+}
+
+void SimpleKvStore::DropShard(const Shard& shard) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto&& [key, value] : items_in(shard)) {
+        refs.update(key, RefIndex::identifiers(value), {});
+        store.erase(key);
+        deadlines.erase(key);
+    }
+    n_writes++;
+}
+
+void SimpleKvStore::AttachShard(const Shard&, KvItems items) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (size_t i = 0; i < items.keys.size(); i++) {
+        const std::string& key = items.keys[i];
+        refs.update(key, refs_of(key), RefIndex::identifiers(items.values[i]));
+        store[key] = {std::move(items.values[i])};
+        set_ttl(key, items.ttls_ms[i]);
+    }
+    n_writes++;
+}
+
+void SimpleKvStore::expire(const std::string& key,
+                           TimerWheel::Clock::time_point deadline) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = deadlines.find(key);
+    if (it == deadlines.end() || it->second != deadline) return;
+    refs.update(key, refs_of(key), {});
+    store.erase(key);
+    deadlines.erase(it);
+    n_writes++;
+}
+
+std::map<std::string, std::vector<std::string>>::iterator SimpleKvStore::find(
+    const std::string& key) {
+    auto deadline = deadlines.find(key);
+    if (deadline != deadlines.end() &&
+        deadline->second <= TimerWheel::Clock::now()) {
+        refs.update(key, refs_of(key), {});
+        store.erase(key);
+        deadlines.erase(deadline);
+        n_writes++;
+        return store.end();
+    }
+    return store.find(key);
+}
+
+void SimpleKvStore::set_ttl(const std::string& key, uint64_t ttl_ms) {
+    if (ttl_ms == 0) {
+        deadlines.erase(key);
+        return;
+    }
+    auto deadline = TimerWheel::deadline_after(ttl_ms);
+    deadlines[key] = deadline;
+    expiry.schedule(key, deadline);
+}
+
+std::vector<std::string> SimpleKvStore::Referencing(const std::string& id) {
+    return refs.lookup(id);
+}
+
+std::vector<std::string> SimpleKvStore::refs_of(const std::string& key) {
+    auto it = store.find(key);
+    if (it == store.end()) return {};
+    std::string joint_val;
+    for (auto& f : it->second)
+        joint_val += f;
+    return RefIndex::identifiers(joint_val);
+}
+
+std::vector<std::pair<std::string, std::string>> SimpleKvStore::items_in(
+    const Shard& shard) {
+    std::vector<std::pair<std::string, std::string>> items;
+    auto now = TimerWheel::Clock::now();
+    for (auto&& [key, fragments] : store) {
+        auto deadline = deadlines.find(key);
+        if (deadline != deadlines.end() && deadline->second <= now) continue;
+        if (!shard.contains(position(key))) continue;
+        std::string value;
+        for (auto& f : fragments) value += f;
+        items.emplace_back(key, std::move(value));
+    }
+    return items;
+}
@@ -4,27 +4,80 @@
 #include <map>
 #include <mutex>
 
+#include "common/utils.hpp"
 #include "kvstore.hpp"
 #include "net/server_commands.hpp"
+#include "ref_index.hpp"
+#include "timer_wheel.hpp"
 
 class SimpleKvStore : public KvStore {
  public:
-  SimpleKvStore() = default;
+  SimpleKvStore()
+      : expiry([this](const std::string& key,
+                      TimerWheel::Clock::time_point deadline) {
+          this->expire(key, deadline);
+        }) {
+  }
   ~SimpleKvStore() = default;
 
   bool Get(const GetRequest* req, GetResponse* res) override;
+  bool GetRange(const GetStreamRequest* req, GetStreamResponse* res) override;
   bool Put(const PutRequest* req, PutResponse*) override;
   bool Append(const AppendRequest* req, AppendResponse*) override;
   bool Delete(const DeleteRequest* req, DeleteResponse* res) override;
   bool MultiGet(const MultiGetRequest* req, MultiGetResponse* res) override;
   bool MultiPut(const MultiPutRequest* req, MultiPutResponse*) override;
+  bool CompareAndSwap(const CompareAndSwapRequest* req,
+                      CompareAndSwapResponse* res) override;
+  bool Increment(const IncrementRequest* req, IncrementResponse* res) override;
+  bool PutIfAbsent(const PutIfAbsentRequest* req,
+                   PutIfAbsentResponse* res) override;
+  bool DeleteIfEquals(const DeleteIfEqualsRequest* req,
+                      DeleteIfEqualsResponse* res) override;
 
   std::vector<std::string> AllKeys() override;
+  // Copies every item up front, under the store's lock
+  std::unique_ptr<KvSnapshot> TakeSnapshot() override;
+  std::vector<std::string> Referencing(const std::string& id) override;
+
+  // One map has nothing to partition, so these go through every key
+  void Repartition(std::vector<Shard> shards, KeyPosition position) override;
+  std::vector<std::string> AllKeys(const Shard& shard) override;
+  KvItems ShardItems(const Shard& shard) override;
+  uint64_t ShardBytes(const Shard& shard) override;
+  void DropShard(const Shard& shard) override;
+  void AttachShard(const Shard& shard, KvItems items) override;
 
  private:
+  class CopiedSnapshot;
+
   std::map<std::string, std::vector<std::string>> store;
+  // Deadlines of the keys that expire
+  std::map<std::string, TimerWheel::Clock::time_point> deadlines;
+  // Which keys mention which identifiers
+  RefIndex refs;
+  // Bumped by every write, and used as every key's version: a simple way to
+  // make sure a key's version changes when it's written, if not only then
+  uint64_t n_writes = 0;
+  // Places keys in the shard space
+  KeyPosition position = to_upper;
   std::mutex mtx;
 
+  // Declared last, so that it stops before the rest goes away
+  TimerWheel expiry;
+  void expire(const std::string& key, TimerWheel::Clock::time_point deadline);
+
+  // Finds `key`, first dropping it if it has expired. Requires `mtx`.
+  std::map<std::string, std::vector<std::string>>::iterator find(
+      const std::string& key);
+  // Sets when `key` expires (never, if `ttl_ms` is 0). Requires `mtx`.
+  void set_ttl(const std::string& key, uint64_t ttl_ms);
+  // Identifiers in the stored value of `key`, if any. Requires `mtx`.
+  std::vector<std::string> refs_of(const std::string& key);
+  // The unexpired keys in `shard`, with their values. Requires `mtx`.
+  std::vector<std::pair<std::string, std::string>> items_in(
+      const Shard& shard);
+
 };
 
 #endif /* end of include guard */
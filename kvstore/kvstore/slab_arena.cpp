@@ -0,0 +1,161 @@
+#include "slab_arena.hpp"
+
+#include <sys/mman.h>
+
+#include <bit>
+#include <new>
+
+SlabArena::SlabArena() {
+    this->with_room.fill(nullptr);
+}
+
+SlabArena::~SlabArena() {
+    for (char* region : this->regions) {
+        munmap(region, REGION_SLABS * SLAB_SIZE);
+    }
+    while (this->bigs) {
+        Big* big = this->bigs;
+        this->bigs = big->next;
+        ::operator delete(big);
+    }
+}
+
+size_t SlabArena::size_class(size_t size) {
+    if (size <= 16 * N_SMALL_CLASSES) return size == 0 ? 0 : (size - 1) / 16;
+    // Above 256 bytes, four classes per power of two: 320, 384, 448, 512, ...
+    size_t power = std::bit_width(size - 1) - 1;
+    size_t quarter = size_t(1) << (power - 2);
+    size_t steps = (size - 1 - (size_t(1) << power)) / quarter;
+    return N_SMALL_CLASSES + (power - 8) * 4 + steps;
+}
+
+size_t SlabArena::class_size(size_t size_class) {
+    if (size_class < N_SMALL_CLASSES) return 16 * (size_class + 1);
+    size_t power = 8 + (size_class - N_SMALL_CLASSES) / 4;
+    size_t steps = (size_class - N_SMALL_CLASSES) % 4 + 1;
+    return (size_t(1) << power) + steps * (size_t(1) << (power - 2));
+}
+
+size_t SlabArena::block_size(size_t size) {
+    if (size > MAX_SLAB_BLOCK) return BIG_HEADER + size;
+    return class_size(size_class(size));
+}
+
+void* SlabArena::allocate(size_t size) {
+    if (size > MAX_SLAB_BLOCK) {
+        auto* big = static_cast<Big*>(::operator new(BIG_HEADER + size));
+        big->prev = nullptr;
+        big->next = this->bigs;
+        if (this->bigs) this->bigs->prev = big;
+        this->bigs = big;
+        this->n_bytes += BIG_HEADER + size;
+        return reinterpret_cast<char*>(big) + BIG_HEADER;
+    }
+
+    size_t c = size_class(size);
+    Slab* slab = this->with_room[c] ? this->with_room[c] : this->new_slab(c);
+    void* block;
+    if (slab->free) {
+        block = slab->free;
+        slab->free = *static_cast<void**>(block);
+    } else {
+        block = reinterpret_cast<char*>(slab) + SLAB_HEADER +
+                size_t(slab->n_carved) * slab->block_size;
+        slab->n_carved++;
+    }
+    slab->n_live++;
+    if (!slab->free && slab->n_carved == slab->n_blocks) this->unlink(slab, c);
+    return block;
+}
+
+void SlabArena::deallocate(void* block, size_t size) {
+    if (size > MAX_SLAB_BLOCK) {
+        auto* big = reinterpret_cast<Big*>(static_cast<char*>(block) -
+                                           BIG_HEADER);
+        if (big->prev) big->prev->next = big->next;
+        if (big->next) big->next->prev = big->prev;
+        if (this->bigs == big) this->bigs = big->next;
+        this->n_bytes -= BIG_HEADER + size;
+        ::operator delete(big);
+        return;
+    }
+
+    size_t c = size_class(size);
+    auto* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(block) &
+                                         ~uintptr_t(SLAB_SIZE - 1));
+    *static_cast<void**>(block) = slab->free;
+    slab->free = block;
+    slab->n_live--;
+    if (!slab->has_room) this->link(slab, c);
+
+    // Keep one slab with room around, so that a class that keeps allocating
+    // and freeing a block doesn't take a slab from the system every time
+    if (slab->n_live == 0 && (slab->prev || slab->next)) {
+        this->unlink(slab, c);
+        this->release(slab);
+    }
+}
+
+void SlabArena::link(Slab* slab, size_t size_class) {
+    slab->prev = nullptr;
+    slab->next = this->with_room[size_class];
+    if (slab->next) slab->next->prev = slab;
+    this->with_room[size_class] = slab;
+    slab->has_room = true;
+}
+
+void SlabArena::unlink(Slab* slab, size_t size_class) {
+    if (slab->prev) slab->prev->next = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    if (this->with_room[size_class] == slab) {
+        this->with_room[size_class] = slab->next;
+    }
+    slab->prev = slab->next = nullptr;
+    slab->has_room = false;
+}
+
+SlabArena::Slab* SlabArena::new_slab(size_t size_class) {
+    Slab* slab;
+    if (!this->released.empty()) {
+        slab = this->released.back();
+        this->released.pop_back();
+    } else {
+        if (this->n_region_slabs == REGION_SLABS) {
+            // Map a slab more than needed, then trim it down to a region
+            // aligned to the slab size
+            size_t size = (REGION_SLABS + 1) * SLAB_SIZE;
+            void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                -1, 0);
+            if (memory == MAP_FAILED) throw std::bad_alloc();
+            char* start = static_cast<char*>(memory);
+            char* region = reinterpret_cast<char*>(
+                (reinterpret_cast<uintptr_t>(start) + SLAB_SIZE - 1) &
+                ~uintptr_t(SLAB_SIZE - 1));
+            char* end = region + REGION_SLABS * SLAB_SIZE;
+            if (region > start) munmap(start, region - start);
+            if (start + size > end) munmap(end, start + size - end);
+            this->regions.push_back(region);
+            this->n_region_slabs = 0;
+        }
+        slab = reinterpret_cast<Slab*>(this->regions.back() +
+                                       this->n_region_slabs * SLAB_SIZE);
+        this->n_region_slabs++;
+    }
+    this->n_bytes += SLAB_SIZE;
+
+    slab->free = nullptr;
+    slab->n_live = 0;
+    slab->n_carved = 0;
+    slab->block_size = class_size(size_class);
+    slab->n_blocks = (SLAB_SIZE - SLAB_HEADER) / slab->block_size;
+    this->link(slab, size_class);
+    return slab;
+}
+
+void SlabArena::release(Slab* slab) {
+    // The pages read as zeroes if they're touched again
+    madvise(slab, SLAB_SIZE, MADV_DONTNEED);
+    this->released.push_back(slab);
+    this->n_bytes -= SLAB_SIZE;
+}
@@ -0,0 +1,94 @@
+#ifndef SLAB_ARENA_HPP
+#define SLAB_ARENA_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Slabs are this big, and aligned to their size, reserved from the system
+// REGION_SLABS at a time; blocks bigger than MAX_SLAB_BLOCK are allocated on
+// their own
+#define SLAB_SIZE (64 * 1024)
+#define REGION_SLABS 16
+#define MAX_SLAB_BLOCK 4096
+
+// Allocates small blocks in size classes, carved out of slabs that each hold
+// blocks of a single class. A block costs its size rounded up to its class
+// (16-byte steps up to 256 bytes, then a quarter of a power of two at a time),
+// with no per-block header: a block's slab is found by rounding its address
+// down to the slab size, and its class by the size it was allocated with.
+//
+// Freed blocks are reused by their own slab. A slab whose blocks are all free
+// (unless it's its class's last slab with room) has its memory handed back to
+// the system, and is kept for any class to reuse; the address space is only
+// unmapped with the arena. Reserving whole regions keeps the number of
+// mappings low enough for stores of hundreds of millions of items.
+//
+// Not thread-safe; each store stripe has its own arena under its own lock.
+class SlabArena {
+ public:
+  SlabArena();
+  ~SlabArena();
+
+  SlabArena(const SlabArena&) = delete;
+  SlabArena& operator=(const SlabArena&) = delete;
+
+  // A block of at least `size` bytes, aligned to 16 bytes
+  void* allocate(size_t size);
+  // Frees `block`, which must have been allocated from this arena with `size`
+  void deallocate(void* block, size_t size);
+
+  // How many bytes a block of `size` bytes actually takes
+  static size_t block_size(size_t size);
+  // Bytes taken from the system, for slabs and big blocks
+  size_t footprint() const {
+    return this->n_bytes;
+  }
+
+ private:
+  static constexpr size_t N_SMALL_CLASSES = 16;
+  static constexpr size_t N_CLASSES = N_SMALL_CLASSES + 4 * 4;
+
+  // The header at the start of every slab, followed by its blocks
+  struct Slab {
+    // Neighbors in its class's list of slabs with room
+    Slab* prev;
+    Slab* next;
+    // Freed blocks, each holding a pointer to the next
+    void* free;
+    // Blocks handed out and not freed, and blocks carved out so far
+    uint32_t n_live;
+    uint32_t n_carved;
+    uint32_t n_blocks;
+    uint32_t block_size;
+    bool has_room;
+  };
+  static constexpr size_t SLAB_HEADER = (sizeof(Slab) + 15) / 16 * 16;
+
+  // A big block's header, linking it to the others so they can be freed
+  struct Big {
+    Big* prev;
+    Big* next;
+  };
+  static constexpr size_t BIG_HEADER = (sizeof(Big) + 15) / 16 * 16;
+
+  std::array<Slab*, N_CLASSES> with_room;
+  // Reserved regions, how many slabs of the last one are in use so far, and
+  // slabs whose memory went back to the system
+  std::vector<char*> regions;
+  size_t n_region_slabs = REGION_SLABS;
+  std::vector<Slab*> released;
+  Big* bigs = nullptr;
+  size_t n_bytes = 0;
+
+  static size_t size_class(size_t size);
+  static size_t class_size(size_t size_class);
+
+  void link(Slab* slab, size_t size_class);
+  void unlink(Slab* slab, size_t size_class);
+  Slab* new_slab(size_t size_class);
+  void release(Slab* slab);
+};
+
+#endif /* end of include guard */
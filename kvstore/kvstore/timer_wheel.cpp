@@ -0,0 +1,128 @@
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+TimerWheel::~TimerWheel() {
+    {
+        std::unique_lock lock(this->mtx);
+        this->stopped = true;
+    }
+    this->cv.notify_all();
+    if (this->thread.joinable()) this->thread.join();
+}
+
+void TimerWheel::schedule(const std::string& key, Clock::time_point deadline) {
+    std::unique_lock lock(this->mtx);
+    this->place(Timer{key, deadline, this->tick_of(deadline)});
+    this->n_timers++;
+}
+
+void TimerWheel::schedule(const std::vector<std::string>& keys,
+                          Clock::time_point deadline) {
+    std::unique_lock lock(this->mtx);
+    uint64_t tick = this->tick_of(deadline);
+    for (auto&& key : keys) this->place(Timer{key, deadline, tick});
+    this->n_timers += keys.size();
+}
+
+uint64_t TimerWheel::tick_of(Clock::time_point deadline) {
+    if (!this->thread.joinable()) {
+        this->start = Clock::now();
+        this->thread = std::thread(&TimerWheel::run, this);
+    }
+
+    // Round up, so that the timer never fires before its deadline
+    uint64_t tick = 0;
+    if (deadline > this->start) {
+        tick = (deadline - this->start + this->tick - Clock::duration(1)) /
+               this->tick;
+    }
+    return tick;
+}
+
+TimerWheel::Clock::time_point TimerWheel::deadline_after(uint64_t ttl_ms) {
+    if (ttl_ms == 0) return {};
+    // Far enough out to mean "never", without overflowing the clock
+    constexpr uint64_t max_ttl_ms = uint64_t(1) << 40;
+    return Clock::now() +
+           std::chrono::milliseconds(std::min(ttl_ms, max_ttl_ms));
+}
+
+uint64_t TimerWheel::ms_until(Clock::time_point deadline) {
+    if (deadline == Clock::time_point{}) return 0;
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline -
+                                                             Clock::now());
+    return std::max<int64_t>(left.count(), 1);
+}
+
+void TimerWheel::run() {
+    std::unique_lock lock(this->mtx);
+    while (!this->stopped) {
+        this->cv.wait_for(lock, this->tick, [&] { return this->stopped; });
+
+        // Process every tick that has fully elapsed. With nothing scheduled,
+        // there's nothing to walk through.
+        uint64_t now_tick = (Clock::now() - this->start) / this->tick;
+        if (this->n_timers == 0) {
+            this->next_tick = std::max(this->next_tick, now_tick + 1);
+            continue;
+        }
+        std::vector<Timer> due;
+        while (this->next_tick <= now_tick) {
+            this->advance(due);
+        }
+        if (due.empty()) continue;
+        this->n_timers -= due.size();
+
+        // Expiring takes store locks, so don't hold up scheduling meanwhile
+        lock.unlock();
+        for (auto&& timer : due) {
+            this->expire(timer.key, timer.deadline);
+        }
+        lock.lock();
+    }
+}
+
+void TimerWheel::place(Timer timer) {
+    // Timers that are already due go in the next slot to be processed. Ones
+    // beyond the top wheel's reach go in its furthest slot for now, and get
+    // placed again (with their actual tick) when that slot is cascaded.
+    uint64_t tick = std::max(timer.tick, this->next_tick);
+    uint64_t delta = tick - this->next_tick;
+    if (delta < (1 << ROOT_BITS)) {
+        this->root[tick & ((1 << ROOT_BITS) - 1)].push_back(std::move(timer));
+        return;
+    }
+    size_t level = 0;
+    size_t shift = ROOT_BITS;
+    while (level + 1 < N_LEVELS && delta >= (uint64_t(1) << (shift + LEVEL_BITS))) {
+        level++;
+        shift += LEVEL_BITS;
+    }
+    uint64_t reach = uint64_t(1) << (shift + LEVEL_BITS);
+    if (delta >= reach) tick = this->next_tick + reach - 1;
+    this->levels[level][(tick >> shift) & ((1 << LEVEL_BITS) - 1)].push_back(
+        std::move(timer));
+}
+
+void TimerWheel::advance(std::vector<Timer>& due) {
+    // Each time a wheel wraps around, the next slot of the wheel above it
+    // comes within reach; spread its timers over the wheels below
+    size_t slot = this->next_tick & ((1 << ROOT_BITS) - 1);
+    size_t shift = ROOT_BITS;
+    for (size_t level = 0; slot == 0 && level < N_LEVELS; level++) {
+        slot = (this->next_tick >> shift) & ((1 << LEVEL_BITS) - 1);
+        std::vector<Timer> cascaded = std::move(this->levels[level][slot]);
+        this->levels[level][slot].clear();
+        for (auto&& timer : cascaded) {
+            this->place(std::move(timer));
+        }
+        shift += LEVEL_BITS;
+    }
+
+    auto& expiring = this->root[this->next_tick & ((1 << ROOT_BITS) - 1)];
+    std::move(expiring.begin(), expiring.end(), std::back_inserter(due));
+    expiring.clear();
+    this->next_tick++;
+}
@@ -0,0 +1,92 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How often, in milliseconds, the timer wheel checks for keys to expire
+#define EXPIRY_TICK_MS 10
+
+// Expires keys at their deadlines from a background thread, without scanning
+// the store. Deadlines are kept in a hierarchical timer wheel: a root wheel of
+// one-tick slots for the next 256 ticks, and coarser wheels above it whose
+// slots are redistributed ("cascaded") into the wheel below as their time
+// comes up. Scheduling is O(1), and each timer is cascaded at most once per
+// level, so expiry is O(1) amortized.
+//
+// The wheel only remembers (key, deadline) pairs; it's up to the callback to
+// check that the key still has that deadline, so a key that's been overwritten
+// or deleted since doesn't need its timer cancelled.
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Callback =
+      std::function<void(const std::string& key, Clock::time_point deadline)>;
+
+  explicit TimerWheel(
+      Callback expire,
+      std::chrono::milliseconds tick = std::chrono::milliseconds(EXPIRY_TICK_MS))
+      : expire(std::move(expire)), tick(tick) {
+  }
+  ~TimerWheel();
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Calls the callback for `key` once `deadline` has passed (up to a tick
+  // later). The background thread is started by the first call.
+  void schedule(const std::string& key, Clock::time_point deadline);
+  void schedule(const std::vector<std::string>& keys,
+                Clock::time_point deadline);
+
+  // The deadline `ttl_ms` milliseconds from now, or the epoch (no deadline) if
+  // `ttl_ms` is 0; and back, rounding up so that a pending deadline is never 0.
+  static Clock::time_point deadline_after(uint64_t ttl_ms);
+  static uint64_t ms_until(Clock::time_point deadline);
+
+ private:
+  static constexpr size_t ROOT_BITS = 8;
+  static constexpr size_t LEVEL_BITS = 6;
+  static constexpr size_t N_LEVELS = 3;
+
+  struct Timer {
+    std::string key;
+    Clock::time_point deadline;
+    uint64_t tick;
+  };
+
+  Callback expire;
+  std::chrono::milliseconds tick;
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool stopped = false;
+  std::thread thread;
+
+  // Ticks are counted from `start`; all ticks before `next_tick` have been
+  // processed
+  Clock::time_point start;
+  uint64_t next_tick = 0;
+  size_t n_timers = 0;
+  std::array<std::vector<Timer>, 1 << ROOT_BITS> root;
+  std::array<std::array<std::vector<Timer>, 1 << LEVEL_BITS>, N_LEVELS> levels;
+
+  void run();
+  // The tick `deadline` falls in, after starting the background thread if
+  // it isn't running yet. Requires `mtx`.
+  uint64_t tick_of(Clock::time_point deadline);
+  // Puts `timer` in the slot for its tick, relative to `next_tick`. Requires
+  // `mtx`.
+  void place(Timer timer);
+  // Processes `next_tick`, moving its due timers into `due`. Requires `mtx`.
+  void advance(std::vector<Timer>& due);
+};
+
+#endif /* end of include guard */
@@ -49,6 +49,11 @@ bool ClientConn::send_response(Response response) {
   return send_message(fd, &*msg);
 }
 
+bool ClientConn::send_response(const Message& msg) {
+  std::unique_lock lock(this->send_mtx);
+  return send_message(fd, &msg);
+}
+
 bool ServerConn::close() {
   ::close(this->fd);
   return true;
@@ -70,6 +75,11 @@ bool ServerConn::send_request(Request req) {
   return send_message(fd, &*msg);
 }
 
+bool ServerConn::send_request(const Message& msg) {
+  std::unique_lock lock(this->send_mtx);
+  return send_message(fd, &msg);
+}
+
 std::optional<Response> ServerConn::recv_response() {
   Message msg{};
 
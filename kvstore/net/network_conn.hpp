@@ -54,6 +54,11 @@ struct ClientConn {
    * Sends a given response to the client, returning true on success.
    */
   bool send_response(Response response);
+  /*
+   * Sends a response that has already been serialized (e.g. one cached for
+   * many clients), returning true on success.
+   */
+  bool send_response(const Message& msg);
 
  private:
   // Mutexes to prevent sending/receiving from multiple threads at once
@@ -93,6 +98,11 @@ struct ServerConn {
    * Sends a given request to the server, returning true on success.
    */
   bool send_request(Request request);
+  /*
+   * Sends a request that has already been serialized (e.g. to serialize it
+   * without a copy, but still have it for a retry), returning true on success.
+   */
+  bool send_request(const Message& msg);
   /*
    * Receives a response from the server, if one has been sent. Otherwise, if
    * the server has disconnected, no request has been sent, or an error occurs,
@@ -1,8 +1,8 @@
 #include "net/network_helpers.hpp"
 
-int sendall(int fd, void* buf, size_t len, int flags, milliseconds timeout) {
+int sendall(int fd, const void* buf, size_t len, int flags, milliseconds timeout) {
   size_t n_sent = 0, n_to_send = len;
-  char* data = (char*)buf;
+  const char* data = (const char*)buf;
   auto begin = system_clock::now();
   while (n_sent < n_to_send) {
     // If desired, check if timed out
@@ -50,7 +50,18 @@ int recvall(int fd, void* buf, size_t len, int flags, milliseconds timeout) {
   return n_recvd;
 }
 
-int open_listener_socket(const std::string& address) {
+bool set_recv_timeout(int fd, milliseconds timeout) {
+  struct timeval tv;
+  tv.tv_sec = timeout.count() / 1000;
+  tv.tv_usec = (timeout.count() % 1000) * 1000;
+  if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+    perror_color(RED, "setsockopt");
+    return false;
+  }
+  return true;
+}
+
+int open_listener_socket(const std::string& address, bool reuse_port) {
   size_t splitIdx = address.find(':');
   if (splitIdx == std::string::npos) {
     cerr_color(RED, "Invalid address: ", address);
@@ -94,6 +105,12 @@ int open_listener_socket(const std::string& address) {
       perror_color(YELLOW, "setsockopt");
       continue;
     }
+    if (reuse_port && setsockopt(listener_fd, SOL_SOCKET, SO_REUSEPORT, &yes,
+                                 sizeof(yes)) == -1) {
+      close(listener_fd);
+      perror_color(YELLOW, "setsockopt");
+      continue;
+    }
 
     // assign name to the desired socket
     if ((ret = bind(listener_fd, cur->ai_addr, cur->ai_addrlen)) == -1) {
@@ -122,6 +139,48 @@ int open_listener_socket(const std::string& address) {
   return listener_fd;
 };
 
+int open_datagram_socket(const std::string& address) {
+  size_t splitIdx = address.find(':');
+  if (splitIdx == std::string::npos) {
+    cerr_color(RED, "Invalid address: ", address);
+    return -1;
+  }
+  std::string port = address.substr(splitIdx + 1);
+
+  int ret, fd = -1;
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_PASSIVE;
+  if ((ret = getaddrinfo(NULL, port.c_str(), &hints, &res)) != 0) {
+    cerr_color(RED, "getaddrinfo: ", gai_strerror(ret));
+    return -1;
+  }
+
+  struct addrinfo* cur;
+  for (cur = res; cur != NULL; cur = cur->ai_next) {
+    fd = socket(cur->ai_family, cur->ai_socktype, cur->ai_protocol);
+    if (fd == -1) {
+      perror_color(YELLOW, "socket");
+      continue;
+    }
+    if (bind(fd, cur->ai_addr, cur->ai_addrlen) == -1) {
+      close(fd);
+      perror_color(YELLOW, "bind");
+      continue;
+    }
+    break;
+  }
+  freeaddrinfo(res);
+
+  if (!cur) {
+    cerr_color(RED, "no available datagram sockets on port ", port);
+    return -1;
+  }
+  return fd;
+}
+
 int connect_to_address(const std::string& address) {
   size_t splitIdx = address.find(':');
   if (splitIdx == std::string::npos) {
@@ -165,6 +224,46 @@ int connect_to_address(const std::string& address) {
   return cfd;
 }
 
+int connect_datagram_socket(const std::string& address) {
+  size_t splitIdx = address.find(':');
+  if (splitIdx == std::string::npos) {
+    cerr_color(RED, "Invalid address: ", address);
+    return -1;
+  }
+  std::string hostname = address.substr(0, splitIdx);
+  std::string port = address.substr(splitIdx + 1);
+
+  int ret, fd = -1;
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if ((ret = getaddrinfo(hostname.c_str(), port.c_str(), &hints, &res)) != 0) {
+    cerr_color(RED, "getaddrinfo: ", gai_strerror(ret));
+    return -1;
+  }
+
+  // connect only sets where datagrams go (and come from); nothing is sent
+  struct addrinfo* cur;
+  for (cur = res; cur != NULL; cur = cur->ai_next) {
+    fd = socket(cur->ai_family, cur->ai_socktype, cur->ai_protocol);
+    if (fd == -1) {
+      perror_color(YELLOW, "socket");
+      continue;
+    }
+    if (connect(fd, cur->ai_addr, cur->ai_addrlen) == -1) {
+      close(fd);
+      perror_color(YELLOW, "connect");
+      continue;
+    }
+    break;
+  }
+  freeaddrinfo(res);
+
+  if (!cur) return -1;
+  return fd;
+}
+
 std::string get_host_address(const char* port) {
   // Get our hostname for readability
   char hostnamebuf[256] = {0};
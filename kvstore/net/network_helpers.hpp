@@ -28,17 +28,33 @@ using namespace std::chrono;
  * specified amount if timeout > 0 (in this case, returns ETIMEOUT. Otherwise,
  * returns the result of send/recv).
  */
-int sendall(int fd, void* buf, size_t len, int flags,
+int sendall(int fd, const void* buf, size_t len, int flags,
             milliseconds timeout = 0ms);
 int recvall(int fd, void* buf, size_t len, int flags,
             milliseconds timeout = 0ms);
 
 /*
- * Opens a listener socket on the specified address (hostname:port).
+ * Makes receives on the socket fail (with EAGAIN) after waiting for the
+ * specified amount without data. Returns true on success.
+ */
+bool set_recv_timeout(int fd, milliseconds timeout);
+
+/*
+ * Opens a listener socket on the specified address (hostname:port). With
+ * reuse_port, several sockets can listen on the same port, and the kernel
+ * spreads incoming connections over them.
  * On success, a file descriptor for the new socket is returned.  On error, -1
  * is returned.
  */
-int open_listener_socket(const std::string& address);
+int open_listener_socket(const std::string& address, bool reuse_port = false);
+
+/*
+ * The same for UDP: opens a socket bound to the specified address's port, which
+ * receives datagrams sent to it from anywhere.
+ * On success, a file descriptor for the new socket is returned.  On error, -1
+ * is returned.
+ */
+int open_datagram_socket(const std::string& address);
 
 /*
  * Establishes a connection to the specified address.
@@ -47,6 +63,14 @@ int open_listener_socket(const std::string& address);
  */
 int connect_to_address(const std::string& address);
 
+/*
+ * Opens a UDP socket that sends datagrams to the specified address, and only
+ * receives datagrams from there.
+ * On success, a file descriptor for the new socket is returned.  On error, -1
+ * is returned.
+ */
+int connect_datagram_socket(const std::string& address);
+
 /*
  * Creates an address string of hostname:port, from the current host and given
  * port.
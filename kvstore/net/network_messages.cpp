@@ -1,18 +1,21 @@
 #include "net/network_messages.hpp"
 
+#include <sys/uio.h>
+
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstring>
+#include <iterator>
 
 #include "net/network_helpers.hpp"
 
-bool send_message(int fd, Message* msg, milliseconds timeout) {
+bool send_message(int fd, const Message* msg, milliseconds timeout) {
   // must specify non-zero timeout
   assert(timeout > 0ms);
   assert(msg->sz == msg->buf.size());
 
-  // First, send message type
-  int curr = sendall(fd, &msg->type, sizeof(msg->type), MSG_NOSIGNAL);
-  if (curr < 0) {
+  auto fail = [&](ssize_t curr) {
     if (curr == ETIMEOUT) {
       // Print if timed out
       cerr_color(RED, "Send on ", fd, " timed out.");
@@ -21,34 +24,35 @@ bool send_message(int fd, Message* msg, milliseconds timeout) {
       perror_color(RED, "send");
     }
     return false;
-  }
-  assert(curr == sizeof(msg->type));
+  };
 
-  // Convert size to network order, then send
+  // Send the type, the size (in network order) and the payload in a single
+  // gather write, so that a small message goes out as one segment rather than
+  // each part waiting for the previous one to be acknowledged. Then finish
+  // whatever part didn't fit.
   size_t size_nbo = htonl(msg->sz);
-  curr = sendall(fd, &size_nbo, sizeof(size_nbo), MSG_NOSIGNAL);
-  if (curr < 0) {
-    if (curr == ETIMEOUT) {
-      cerr_color(RED, "Send on ", fd, " timed out.");
-    } else if (errno != EBADF && errno != EPIPE) {
-      perror_color(RED, "send");
-    }
-    return false;
+  struct iovec parts[] = {
+      {const_cast<MessageType*>(&msg->type), sizeof(msg->type)},
+      {&size_nbo, sizeof(size_nbo)},
+      {const_cast<std::byte*>(msg->buf.data()), msg->sz}};
+  struct msghdr hdr {};
+  hdr.msg_iov = parts;
+  hdr.msg_iovlen = std::size(parts);
+  ssize_t sent = sendmsg(fd, &hdr, MSG_NOSIGNAL);
+  if (sent < 0) {
+    return fail(sent);
   }
-  assert(curr == sizeof(size_nbo));
 
-  if (msg->sz > 0) {
-    std::byte* data = &msg->buf[0];
-    curr = sendall(fd, data, msg->sz, 0, timeout);
+  for (auto&& part : parts) {
+    size_t done = std::min<size_t>(sent, part.iov_len);
+    sent -= done;
+    if (done == part.iov_len) continue;
+    int curr = sendall(fd, static_cast<std::byte*>(part.iov_base) + done,
+                       part.iov_len - done, MSG_NOSIGNAL, timeout);
     if (curr < 0) {
-      if (curr == ETIMEOUT) {
-        cerr_color(RED, "Send on ", fd, " timed out.");
-      } else if (errno != EBADF && errno != EPIPE) {
-        perror_color(RED, "send");
-      }
-      return false;
+      return fail(curr);
     }
-    assert(size_t(curr) == msg->sz);
+    assert(size_t(curr) == part.iov_len - done);
   }
 
   return true;
@@ -64,7 +68,7 @@ bool recv_message(int fd, Message* msg, milliseconds timeout) {
     // In this case, recv got an EOF, so other end closed the connection.
     return false;
   } else if (curr < 0) {
-    if (curr == ETIMEOUT) {
+    if (curr == ETIMEOUT || errno == EAGAIN) {
       // Print if timed out
       cerr_color(RED, "Recv on ", fd, " timed out.");
     } else if (errno != EBADF) {
@@ -80,7 +84,7 @@ bool recv_message(int fd, Message* msg, milliseconds timeout) {
   if (curr == 0) {
     return false;
   } else if (curr < 0) {
-    if (curr == ETIMEOUT) {
+    if (curr == ETIMEOUT || errno == EAGAIN) {
       cerr_color(RED, "Recv on ", fd, " timed out.");
     } else if (errno != EBADF) {
       perror_color(RED, "recv");
@@ -98,7 +102,7 @@ bool recv_message(int fd, Message* msg, milliseconds timeout) {
     if (curr == 0) {
       return false;
     } else if (curr < 0) {
-      if (curr == ETIMEOUT) {
+      if (curr == ETIMEOUT || errno == EAGAIN) {
         cerr_color(RED, "Recv on ", fd, " timed out.");
       } else if (errno != EBADF) {
         perror_color(RED, "recv");
@@ -111,6 +115,60 @@ bool recv_message(int fd, Message* msg, milliseconds timeout) {
   return true;
 }
 
+// A message's header on the wire: its type, then its size (a 32-bit network
+// order value in a size_t)
+constexpr size_t HEADER_SIZE = sizeof(MessageType) + sizeof(size_t);
+
+void append_message(std::vector<std::byte>& out, const Message& msg) {
+  size_t size_nbo = htonl(msg.sz);
+  size_t start = out.size();
+  out.resize(start + HEADER_SIZE + msg.buf.size());
+  std::byte* at = out.data() + start;
+  std::memcpy(at, &msg.type, sizeof(msg.type));
+  std::memcpy(at + sizeof(msg.type), &size_nbo, sizeof(size_nbo));
+  std::copy(msg.buf.begin(), msg.buf.end(), at + HEADER_SIZE);
+}
+
+bool take_message(const std::vector<std::byte>& in, size_t& offset,
+                  Message* msg) {
+  if (in.size() - offset < HEADER_SIZE) return false;
+  const std::byte* at = in.data() + offset;
+  size_t size_nbo;
+  std::memcpy(&msg->type, at, sizeof(msg->type));
+  std::memcpy(&size_nbo, at + sizeof(msg->type), sizeof(size_nbo));
+  msg->sz = ntohl(size_nbo);
+  if (in.size() - offset < HEADER_SIZE + msg->sz) return false;
+
+  msg->buf.assign(at + HEADER_SIZE, at + HEADER_SIZE + msg->sz);
+  offset += HEADER_SIZE + msg->sz;
+  return true;
+}
+
+void write_datagram(std::vector<std::byte>& out, uint64_t id,
+                    const Message* msg) {
+  out.resize(sizeof(id));
+  std::memcpy(out.data(), &id, sizeof(id));
+  if (msg) append_message(out, *msg);
+}
+
+bool read_datagram(const std::vector<std::byte>& in, uint64_t* id,
+                   std::optional<Message>* msg) {
+  if (in.size() < sizeof(*id)) return false;
+  std::memcpy(id, in.data(), sizeof(*id));
+  msg->reset();
+  if (in.size() == sizeof(*id)) return true;
+
+  size_t offset = sizeof(*id);
+  Message taken;
+  if (!take_message(in, offset, &taken) || offset != in.size()) return false;
+  *msg = std::move(taken);
+  return true;
+}
+
+bool is_not_responsible(const ErrorResponse& error) {
+  return error.msg.starts_with(NOT_RESPONSIBLE_ERROR);
+}
+
 std::optional<Message> serialize_request(Request request) {
   Message msg{};
 
@@ -128,12 +186,27 @@ std::optional<Message> serialize_request(Request request) {
   } else if (auto* req = std::get_if<QueryRequest>(&request)) {
     msg.type = MessageType::QUERY;
     if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<ConfigChangesRequest>(&request)) {
+    msg.type = MessageType::CONFIG_CHANGES;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<ReportLoadRequest>(&request)) {
+    msg.type = MessageType::REPORT_LOAD;
+    if (!success(out(*req))) return std::nullopt;
   } else if (auto* req = std::get_if<GetRequest>(&request)) {
     msg.type = MessageType::GET;
     if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<LeaseGetRequest>(&request)) {
+    msg.type = MessageType::LEASE_GET;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<GetStreamRequest>(&request)) {
+    msg.type = MessageType::GET_STREAM;
+    if (!success(out(*req))) return std::nullopt;
   } else if (auto* req = std::get_if<PutRequest>(&request)) {
     msg.type = MessageType::PUT;
     if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<PutStreamRequest>(&request)) {
+    msg.type = MessageType::PUT_STREAM;
+    if (!success(out(*req))) return std::nullopt;
   } else if (auto* req = std::get_if<AppendRequest>(&request)) {
     msg.type = MessageType::APPEND;
     if (!success(out(*req))) return std::nullopt;
@@ -146,6 +219,33 @@ std::optional<Message> serialize_request(Request request) {
   } else if (auto* req = std::get_if<MultiPutRequest>(&request)) {
     msg.type = MessageType::MULTI_PUT;
     if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<CompareAndSwapRequest>(&request)) {
+    msg.type = MessageType::COMPARE_AND_SWAP;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<IncrementRequest>(&request)) {
+    msg.type = MessageType::INCREMENT;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<PutIfAbsentRequest>(&request)) {
+    msg.type = MessageType::PUT_IF_ABSENT;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<DeleteIfEqualsRequest>(&request)) {
+    msg.type = MessageType::DELETE_IF_EQUALS;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<GDPRPurgeRequest>(&request)) {
+    msg.type = MessageType::GDPR_PURGE;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<StatsRequest>(&request)) {
+    msg.type = MessageType::STATS;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<ReplicateRequest>(&request)) {
+    msg.type = MessageType::REPLICATE;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<PullRequest>(&request)) {
+    msg.type = MessageType::PULL;
+    if (!success(out(*req))) return std::nullopt;
+  } else if (auto* req = std::get_if<HandoffRequest>(&request)) {
+    msg.type = MessageType::HANDOFF;
+    if (!success(out(*req))) return std::nullopt;
   } else {
     throw std::logic_error{
         "Invalid request variant! Please post privately on Edstem if this "
@@ -187,18 +287,48 @@ std::optional<Request> deserialize_request(Message message) {
       request = req;
       break;
     }
+    case MessageType::CONFIG_CHANGES: {
+      ConfigChangesRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::REPORT_LOAD: {
+      ReportLoadRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
     case MessageType::GET: {
       GetRequest req{};
       if (!success(in(req))) return std::nullopt;
       request = req;
       break;
     }
+    case MessageType::LEASE_GET: {
+      LeaseGetRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::GET_STREAM: {
+      GetStreamRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
     case MessageType::PUT: {
       PutRequest req{};
       if (!success(in(req))) return std::nullopt;
       request = req;
       break;
     }
+    case MessageType::PUT_STREAM: {
+      PutStreamRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
     case MessageType::APPEND: {
       AppendRequest req{};
       if (!success(in(req))) return std::nullopt;
@@ -223,6 +353,60 @@ std::optional<Request> deserialize_request(Message message) {
       request = req;
       break;
     }
+    case MessageType::COMPARE_AND_SWAP: {
+      CompareAndSwapRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::INCREMENT: {
+      IncrementRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::PUT_IF_ABSENT: {
+      PutIfAbsentRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::DELETE_IF_EQUALS: {
+      DeleteIfEqualsRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::GDPR_PURGE: {
+      GDPRPurgeRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::STATS: {
+      StatsRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::REPLICATE: {
+      ReplicateRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::PULL: {
+      PullRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
+    case MessageType::HANDOFF: {
+      HandoffRequest req{};
+      if (!success(in(req))) return std::nullopt;
+      request = req;
+      break;
+    }
     default:
       throw std::logic_error{
           "Invalid message type! Please post privately on Edstem if this "
@@ -250,12 +434,27 @@ std::optional<Message> serialize_response(Response response) {
   } else if (auto* res = std::get_if<QueryResponse>(&response)) {
     msg.type = MessageType::QUERY;
     if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<ConfigChangesResponse>(&response)) {
+    msg.type = MessageType::CONFIG_CHANGES;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<ReportLoadResponse>(&response)) {
+    msg.type = MessageType::REPORT_LOAD;
+    if (!success(out(*res))) return std::nullopt;
   } else if (auto* res = std::get_if<GetResponse>(&response)) {
     msg.type = MessageType::GET;
     if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<LeaseGetResponse>(&response)) {
+    msg.type = MessageType::LEASE_GET;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<GetStreamResponse>(&response)) {
+    msg.type = MessageType::GET_STREAM;
+    if (!success(out(*res))) return std::nullopt;
   } else if (auto* res = std::get_if<PutResponse>(&response)) {
     msg.type = MessageType::PUT;
     if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<PutStreamResponse>(&response)) {
+    msg.type = MessageType::PUT_STREAM;
+    if (!success(out(*res))) return std::nullopt;
   } else if (auto* res = std::get_if<AppendResponse>(&response)) {
     msg.type = MessageType::APPEND;
     if (!success(out(*res))) return std::nullopt;
@@ -268,6 +467,33 @@ std::optional<Message> serialize_response(Response response) {
   } else if (auto* res = std::get_if<MultiPutResponse>(&response)) {
     msg.type = MessageType::MULTI_PUT;
     if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<CompareAndSwapResponse>(&response)) {
+    msg.type = MessageType::COMPARE_AND_SWAP;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<IncrementResponse>(&response)) {
+    msg.type = MessageType::INCREMENT;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<PutIfAbsentResponse>(&response)) {
+    msg.type = MessageType::PUT_IF_ABSENT;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<DeleteIfEqualsResponse>(&response)) {
+    msg.type = MessageType::DELETE_IF_EQUALS;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<GDPRPurgeResponse>(&response)) {
+    msg.type = MessageType::GDPR_PURGE;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<StatsResponse>(&response)) {
+    msg.type = MessageType::STATS;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<ReplicateResponse>(&response)) {
+    msg.type = MessageType::REPLICATE;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<PullResponse>(&response)) {
+    msg.type = MessageType::PULL;
+    if (!success(out(*res))) return std::nullopt;
+  } else if (auto* res = std::get_if<HandoffResponse>(&response)) {
+    msg.type = MessageType::HANDOFF;
+    if (!success(out(*res))) return std::nullopt;
   } else if (auto* res = std::get_if<ErrorResponse>(&response)) {
     msg.type = MessageType::ERROR;
     if (!success(out(*res))) return std::nullopt;
@@ -309,6 +535,19 @@ std::optional<Response> deserialize_response(Message message) {
     case MessageType::QUERY: {
       QueryResponse res{};
       if (!success(in(res))) return std::nullopt;
+      res.config.build_index();
+      response = res;
+      break;
+    }
+    case MessageType::CONFIG_CHANGES: {
+      ConfigChangesResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::REPORT_LOAD: {
+      ReportLoadResponse res{};
+      if (!success(in(res))) return std::nullopt;
       response = res;
       break;
     }
@@ -318,12 +557,30 @@ std::optional<Response> deserialize_response(Message message) {
       response = res;
       break;
     }
+    case MessageType::LEASE_GET: {
+      LeaseGetResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::GET_STREAM: {
+      GetStreamResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
     case MessageType::PUT: {
       PutResponse res{};
       if (!success(in(res))) return std::nullopt;
       response = res;
       break;
     }
+    case MessageType::PUT_STREAM: {
+      PutStreamResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
     case MessageType::APPEND: {
       AppendResponse res{};
       if (!success(in(res))) return std::nullopt;
@@ -348,6 +605,60 @@ std::optional<Response> deserialize_response(Message message) {
       response = res;
       break;
     }
+    case MessageType::COMPARE_AND_SWAP: {
+      CompareAndSwapResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::INCREMENT: {
+      IncrementResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::PUT_IF_ABSENT: {
+      PutIfAbsentResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::DELETE_IF_EQUALS: {
+      DeleteIfEqualsResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::GDPR_PURGE: {
+      GDPRPurgeResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::STATS: {
+      StatsResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::REPLICATE: {
+      ReplicateResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::PULL: {
+      PullResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
+    case MessageType::HANDOFF: {
+      HandoffResponse res{};
+      if (!success(in(res))) return std::nullopt;
+      response = res;
+      break;
+    }
     case MessageType::ERROR: {
       ErrorResponse res{};
       if (!success(in(res))) return std::nullopt;
@@ -3,6 +3,8 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <optional>
 #include <thread>
 #include <variant>
 #include <vector>
@@ -19,16 +21,30 @@ using namespace std::chrono;
 enum class MessageType {
   // KvServer messages
   GET,
+  LEASE_GET,
+  GET_STREAM,
   PUT,
+  PUT_STREAM,
   APPEND,
   DELETE,
   MULTI_GET,
   MULTI_PUT,
+  COMPARE_AND_SWAP,
+  INCREMENT,
+  PUT_IF_ABSENT,
+  DELETE_IF_EQUALS,
+  GDPR_PURGE,
+  STATS,
+  REPLICATE,
+  PULL,
+  HANDOFF,
   // Shardcontroller messages
   JOIN,
   LEAVE,
   MOVE,
   QUERY,
+  CONFIG_CHANGES,
+  REPORT_LOAD,
   // Error
   ERROR
 };
@@ -46,26 +62,62 @@ struct Message {
 };
 
 // Generic send/receive message helper functions.
-bool send_message(int fd, Message* msg, milliseconds timeout = 400ms);
+bool send_message(int fd, const Message* msg, milliseconds timeout = 400ms);
 bool recv_message(int fd, Message* msg, milliseconds timeout = 400ms);
 
+// The same framing, for non-blocking sockets that buffer their own bytes:
+// append_message adds `msg` to `out` as send_message would send it, and
+// take_message parses the message at `offset` in `in`, if all of it is there,
+// moving `offset` past it.
+void append_message(std::vector<std::byte>& out, const Message& msg);
+bool take_message(const std::vector<std::byte>& in, size_t& offset,
+                  Message* msg);
+
+// Largest datagram the UDP fast path (see KvServer) sends: an Ethernet
+// frame's payload less the IP and UDP headers, so that none are fragmented
+#define MAX_DATAGRAM_SIZE 1472
+
+// Datagrams carry an id, which a reply repeats so that replies to requests
+// that were retried can be told apart, then a message as append_message frames
+// it. A reply with no message means the response didn't fit in a datagram.
+// write_datagram replaces what's in `out`; read_datagram fails on anything
+// that isn't a whole datagram.
+void write_datagram(std::vector<std::byte>& out, uint64_t id,
+                    const Message* msg);
+bool read_datagram(const std::vector<std::byte>& in, uint64_t* id,
+                   std::optional<Message>* msg);
+
 // define a generic Error response message.
 struct ErrorResponse {
   std::string msg;
 };
 
+// What a server answers a request for keys it isn't responsible for, having
+// applied none of it, so that a client with an outdated config can tell that
+// apart from other errors and send the request again elsewhere.
+#define NOT_RESPONSIBLE_ERROR "server not responsible for key"
+bool is_not_responsible(const ErrorResponse& error);
+
 using Request = std::variant<
     // Shardcontroller requests
     JoinRequest, LeaveRequest, MoveRequest, QueryRequest,
+    ConfigChangesRequest, ReportLoadRequest,
     // KvServer requests
-    GetRequest, PutRequest, AppendRequest, DeleteRequest, MultiGetRequest,
-    MultiPutRequest>;
+    GetRequest, LeaseGetRequest, GetStreamRequest, PutRequest,
+    PutStreamRequest, AppendRequest, DeleteRequest, MultiGetRequest,
+    MultiPutRequest, CompareAndSwapRequest, IncrementRequest,
+    PutIfAbsentRequest, DeleteIfEqualsRequest, GDPRPurgeRequest, StatsRequest,
+    ReplicateRequest, PullRequest, HandoffRequest>;
 using Response = std::variant<
     // Shardcontroller responses
     JoinResponse, LeaveResponse, MoveResponse, QueryResponse,
+    ConfigChangesResponse, ReportLoadResponse,
     // KvServer responses
-    GetResponse, PutResponse, AppendResponse, DeleteResponse, MultiGetResponse,
-    MultiPutResponse,
+    GetResponse, LeaseGetResponse, GetStreamResponse, PutResponse,
+    PutStreamResponse, AppendResponse, DeleteResponse, MultiGetResponse,
+    MultiPutResponse, CompareAndSwapResponse, IncrementResponse,
+    PutIfAbsentResponse, DeleteIfEqualsResponse, GDPRPurgeResponse,
+    StatsResponse, ReplicateResponse, PullResponse, HandoffResponse,
     // Error response
     ErrorResponse>;
 
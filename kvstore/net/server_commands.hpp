@@ -1,23 +1,67 @@
 #ifndef NET_SERVER_COMMANDS_HPP
 #define NET_SERVER_COMMANDS_HPP
 
+#include <cstdint>
 #include <string>
 #include <variant>
 #include <vector>
 
+// Values too large for a single message are streamed in chunks of at most
+// STREAM_CHUNK_SIZE bytes, one request per chunk.
+#define STREAM_CHUNK_SIZE (1 << 20)
+
 // Requests
 struct GetRequest {
   std::string key;
+  // If nonzero, a backup replica may answer instead of the primary, as long as
+  // its copy of the key is at most this many milliseconds behind.
+  uint64_t max_staleness_ms = 0;
+};
+
+// A Get that also leases the key to the client's near cache (see LeaseTable).
+// `epoch` and `since` say which of the server's revocations the client has
+// already seen, so that the response only carries newer ones.
+struct LeaseGetRequest {
+  std::string key;
+  uint64_t epoch = 0;
+  uint64_t since = 0;
 };
 
+// Reads the chunk of up to `max_bytes` (and at most STREAM_CHUNK_SIZE) of the
+// key's value that starts at `offset`
+struct GetStreamRequest {
+  std::string key;
+  uint64_t offset = 0;
+  uint64_t max_bytes = STREAM_CHUNK_SIZE;
+};
+
+// Writes may set a time to live: if `ttl_ms` is nonzero, the key expires that
+// many milliseconds after the write and is no longer served. Otherwise, a Put
+// makes the key persistent, while an Append keeps the key's current expiry.
 struct PutRequest {
   std::string key;
   std::string value;
+  uint64_t ttl_ms = 0;
+};
+
+// One chunk of a value streamed to the server, which writes the key once the
+// last chunk is in. The first chunk has `stream_id` 0, and its response says
+// which ID the others carry; each chunk's `offset` must be where the previous
+// one ended. `total_size`, if known, lets the server allocate the value once.
+struct PutStreamRequest {
+  std::string key;
+  uint64_t stream_id = 0;
+  uint64_t offset = 0;
+  std::string chunk = {};
+  bool last = false;
+  uint64_t total_size = 0;
+  uint64_t ttl_ms = 0;
 };
 
 struct AppendRequest {
   std::string key;
   std::string value;
+  uint64_t ttl_ms = 0;
 };
 
 struct DeleteRequest {
@@ -28,17 +72,120 @@ struct MultiGetRequest {
   std::vector<std::string> keys;
 };
 
+// A bulk MultiPut (from a bulk load) needn't be atomic: the server may write
+// its keys a few at a time, and doesn't count them as accesses.
 struct MultiPutRequest {
   std::vector<std::string> keys;
   std::vector<std::string> values;
+  uint64_t ttl_ms = 0;
+  bool bulk = false;
+};
+
+// Conditional writes, each applied atomically on the server: set `key` to
+// `desired` only if it currently holds `expected`; add `delta` (which may be
+// negative) to a key holding a decimal integer, treating a missing key as 0;
+// set `key` only if it doesn't exist; delete `key` only if it holds `expected`.
+struct CompareAndSwapRequest {
+  std::string key;
+  std::string expected;
+  std::string desired;
+};
+
+struct IncrementRequest {
+  std::string key;
+  int64_t delta;
+};
+
+struct PutIfAbsentRequest {
+  std::string key;
+  std::string value;
+  uint64_t ttl_ms = 0;
+};
+
+struct DeleteIfEqualsRequest {
+  std::string key;
+  std::string expected;
+};
+
+// Erases a user from the keys the recipient owns: deletes `keys` (the user's
+// own records), and redacts every mention of `user` or of those keys in other
+// values. Sent to every server.
+struct GDPRPurgeRequest {
+  std::string user;
+  std::vector<std::string> keys;
+};
+
+// Asks a server for its access statistics (see StatsResponse)
+struct StatsRequest {};
+
+// Sent by a primary to one of its backups: the current values of keys that
+// changed on the primary, and how much longer they live (0 if they don't
+// expire). Keys whose `deleted` flag is set no longer exist. A batch with no
+// keys is a heartbeat.
+struct ReplicateRequest {
+  std::string primary;
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  std::vector<uint64_t> ttls_ms;
+  std::vector<uint8_t> deleted;
+  // Set if the primary had nothing else queued for this backup when it sent
+  // the batch, i.e. the backup is fully caught up once it applies it.
+  bool caught_up;
+};
+
+// Sent by a server that is taking over a shard to the shard's previous owner,
+// to fetch keys it doesn't have yet while the handoff is in progress.
+struct PullRequest {
+  std::vector<std::string> keys;
+};
+
+// Sent by a shard's previous owner once it has given up the shard: every key
+// it held in the ranges the recipient now owns, with their remaining times to
+// live. This commits the handoff of those ranges as of config `version`.
+struct HandoffRequest {
+  std::string source;
+  uint64_t version;
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  std::vector<uint64_t> ttls_ms;
 };
 
 // Responses
 struct GetResponse {
   std::string value;
+  // How much longer the key lives, or 0 if it doesn't expire
+  uint64_t ttl_ms = 0;
+};
+
+// The key's value, which the client may cache for `lease_ms` unless a
+// revocation for it shows up first. `revoked` holds the keys the server
+// revoked since the request's `since`, up to `seq`; if `flush` is set, the
+// client missed some and must drop everything it cached from the server.
+struct LeaseGetResponse {
+  std::string value;
+  uint64_t lease_ms = 0;
+  uint64_t epoch = 0;
+  uint64_t seq = 0;
+  std::vector<std::string> revoked = {};
+  bool flush = false;
+};
+
+// A chunk of the key's value, along with the whole value's size and version.
+// The version changes with every write to the key, so chunks read with
+// different versions belong to different values.
+struct GetStreamResponse {
+  std::string chunk;
+  uint64_t total_size = 0;
+  uint64_t version = 0;
+  uint64_t ttl_ms = 0;
 };
 
 struct PutResponse {};
+// The stream's ID, and how many of its bytes the server has received
+struct PutStreamResponse {
+  uint64_t stream_id;
+  uint64_t received;
+};
 struct AppendResponse {};
 struct DeleteResponse {
   std::string value;
@@ -47,5 +194,54 @@ struct MultiGetResponse {
   std::vector<std::string> values;
 };
 struct MultiPutResponse {};
+// Whether the conditional write happened, and the key's value afterwards (or
+// the value that stopped it); empty if the key doesn't exist.
+struct CompareAndSwapResponse {
+  bool swapped;
+  std::string value;
+};
+struct IncrementResponse {
+  int64_t value;
+};
+struct PutIfAbsentResponse {
+  bool inserted;
+  std::string value;
+};
+struct DeleteIfEqualsResponse {
+  bool deleted;
+};
+struct GDPRPurgeResponse {
+  std::vector<std::string> deleted;
+  std::vector<std::string> redacted;
+};
+// How often a key was accessed, as estimated by a server's count-min sketch:
+// never less than the true count, and rarely much more.
+struct KeyCount {
+  std::string key;
+  uint64_t count;
+};
+// The keys a server's requests accessed during its last complete stats window
+// (or, before one completes, the current window so far): how many accesses
+// there were, and the most accessed keys, hottest first.
+struct StatsResponse {
+  uint64_t window_ms = 0;
+  uint64_t n_accesses = 0;
+  std::vector<KeyCount> hot_keys = {};
+};
+struct ReplicateResponse {};
+// The requested keys that exist on the previous owner, with their values and
+// remaining times to live, and the latest config it has handed off everything
+// it lost in (so it has no handoff left to make for any config up to that).
+struct PullResponse {
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  std::vector<uint64_t> ttls_ms;
+  uint64_t handed_off_through = 0;
+};
+// Keys the recipient no longer owns by the time the handoff arrives; the sender
+// keeps those
+struct HandoffResponse {
+  std::vector<std::string> rejected;
+};
 
 #endif /* end of include guard */
@@ -1,12 +1,14 @@
 #ifndef NET_SHARDCONTROLLER_COMMANDS_HPP
 #define NET_SHARDCONTROLLER_COMMANDS_HPP
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
 
 #include "common/config.hpp"
 #include "common/shard.hpp"
+#include "net/server_commands.hpp"
 
 // Requests
 struct JoinRequest {
@@ -20,6 +22,26 @@ struct MoveRequest {
   std::vector<Shard> shards;
 };
 struct QueryRequest {};
+// Asks for the changes to the config since version `since_version`, which
+// come as a full config if the shardcontroller no longer has that version
+struct ConfigChangesRequest {
+  uint64_t since_version = 0;
+};
+
+// Load a server observed on one of its shards during its last report window.
+struct ShardLoad {
+  Shard shard;
+  uint64_t n_requests;  // requests that touched the shard during the window
+  uint64_t n_bytes;     // bytes of keys + values stored in the shard
+};
+struct ReportLoadRequest {
+  std::string server;
+  uint64_t window_ms;
+  std::vector<ShardLoad> loads;
+  // The server's hottest keys, which the rebalancer takes into account when
+  // it splits a shard
+  StatsResponse stats = {};
+};
 
 // Responses
 struct JoinResponse {};
@@ -28,5 +50,9 @@ struct MoveResponse {};
 struct QueryResponse {
   ShardControllerConfig config;
 };
+struct ConfigChangesResponse {
+  ConfigDelta changes;
+};
+struct ReportLoadResponse {};
 
 #endif /* end of include guard */
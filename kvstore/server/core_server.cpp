@@ -0,0 +1,502 @@
+#include "core_server.hpp"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+#include <map>
+#include <type_traits>
+
+#include "common/utils.hpp"
+
+// How many events a core handles per wakeup, how long it waits for one, and
+// how long it waits before retrying a backlog a full queue held up
+constexpr int MAX_EVENTS = 64;
+constexpr int TICK_MS = 100;
+constexpr int BACKLOG_RETRY_MS = 1;
+// How much a core reads from a socket at a time
+constexpr size_t READ_SIZE = 64 * 1024;
+
+// The key of a single-key request the server serves, if `req` is one
+static const std::string* key_of(const Request& req) {
+    return std::visit(
+        [](auto&& r) -> const std::string* {
+            using R = std::decay_t<decltype(r)>;
+            if constexpr (std::is_same_v<R, GetRequest> ||
+                          std::is_same_v<R, PutRequest> ||
+                          std::is_same_v<R, AppendRequest> ||
+                          std::is_same_v<R, DeleteRequest> ||
+                          std::is_same_v<R, CompareAndSwapRequest> ||
+                          std::is_same_v<R, IncrementRequest> ||
+                          std::is_same_v<R, PutIfAbsentRequest> ||
+                          std::is_same_v<R, DeleteIfEqualsRequest>) {
+                return &r.key;
+            } else {
+                return nullptr;
+            }
+        },
+        req);
+}
+
+// Serves a key-value request from a core's store, answering as a standalone
+// KvServer would
+static Response serve(KvStore& store, Request& req) {
+    if (auto* get_req = std::get_if<GetRequest>(&req)) {
+        GetResponse get_res;
+        if (store.Get(get_req, &get_res)) return get_res;
+        return ErrorResponse{"key does not exist in the KVStore"};
+    } else if (auto* put_req = std::get_if<PutRequest>(&req)) {
+        PutResponse put_res;
+        if (store.Put(put_req, &put_res)) return put_res;
+        return ErrorResponse{"internal KVStore error"};
+    } else if (auto* append_req = std::get_if<AppendRequest>(&req)) {
+        AppendResponse append_res;
+        if (store.Append(append_req, &append_res)) return append_res;
+        return ErrorResponse{"internal KVStore error"};
+    } else if (auto* delete_req = std::get_if<DeleteRequest>(&req)) {
+        DeleteResponse delete_res;
+        if (store.Delete(delete_req, &delete_res)) return delete_res;
+        return ErrorResponse{"key does not exist in the KVStore"};
+    } else if (auto* multiget_req = std::get_if<MultiGetRequest>(&req)) {
+        MultiGetResponse multiget_res;
+        if (store.MultiGet(multiget_req, &multiget_res)) return multiget_res;
+        return ErrorResponse{"key(s) do not exist in the KVStore"};
+    } else if (auto* multiput_req = std::get_if<MultiPutRequest>(&req)) {
+        MultiPutResponse multiput_res;
+        if (store.MultiPut(multiput_req, &multiput_res)) return multiput_res;
+        return ErrorResponse{"internal KVStore error"};
+    } else if (auto* cas_req = std::get_if<CompareAndSwapRequest>(&req)) {
+        CompareAndSwapResponse cas_res;
+        if (store.CompareAndSwap(cas_req, &cas_res)) return cas_res;
+        return ErrorResponse{"internal KVStore error"};
+    } else if (auto* incr_req = std::get_if<IncrementRequest>(&req)) {
+        IncrementResponse incr_res;
+        if (store.Increment(incr_req, &incr_res)) return incr_res;
+        return ErrorResponse{"value is not an integer or would overflow"};
+    } else if (auto* pia_req = std::get_if<PutIfAbsentRequest>(&req)) {
+        PutIfAbsentResponse pia_res;
+        if (store.PutIfAbsent(pia_req, &pia_res)) return pia_res;
+        return ErrorResponse{"internal KVStore error"};
+    } else if (auto* die_req = std::get_if<DeleteIfEqualsRequest>(&req)) {
+        DeleteIfEqualsResponse die_res;
+        if (store.DeleteIfEquals(die_req, &die_res)) return die_res;
+        return ErrorResponse{"internal KVStore error"};
+    }
+    return ErrorResponse{"request not served by a per-core server"};
+}
+
+CoreServer::CoreServer(const std::string& address, size_t n_cores)
+    : address(address), n_cores(std::max<size_t>(n_cores, 1)) {
+}
+
+CoreServer::~CoreServer() {
+    this->stop();
+}
+
+int CoreServer::start() {
+    for (size_t i = 0; i < this->n_cores; i++) {
+        auto core = std::make_unique<Core>();
+        core->id = i;
+        core->inbox.resize(this->n_cores);
+        for (size_t from = 0; from < this->n_cores; from++) {
+            if (from == i) continue;
+            core->inbox[from] =
+                std::make_unique<SpscQueue<Forward>>(CORE_QUEUE_CAPACITY);
+        }
+        core->backlog.resize(this->n_cores);
+        core->sent_to.resize(this->n_cores);
+        this->cores.push_back(std::move(core));
+    }
+
+    for (auto&& core : this->cores) {
+        core->listener_fd = open_listener_socket(this->address, true);
+        if (core->listener_fd < 0) return -1;
+        core->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        core->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        int flags = fcntl(core->listener_fd, F_GETFL, 0);
+        epoll_event wake_event{}, listener_event{};
+        wake_event.events = listener_event.events = EPOLLIN;
+        wake_event.data.u64 = WAKE_ID;
+        listener_event.data.u64 = LISTENER_ID;
+        if (core->epoll_fd < 0 || core->wake_fd < 0 ||
+            fcntl(core->listener_fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+            epoll_ctl(core->epoll_fd, EPOLL_CTL_ADD, core->wake_fd,
+                      &wake_event) < 0 ||
+            epoll_ctl(core->epoll_fd, EPOLL_CTL_ADD, core->listener_fd,
+                      &listener_event) < 0) {
+            perror_color(RED, "Failed to set up a core");
+            return -1;
+        }
+    }
+
+    for (auto&& core : this->cores) {
+        core->thread = std::thread(&CoreServer::run, this, std::ref(*core));
+    }
+    cout_color(BLUE, "Listening on: ", this->address, " (", this->n_cores,
+               " cores)");
+    return 0;
+}
+
+void CoreServer::stop() {
+    if (this->is_stopped.exchange(true)) return;
+
+    uint64_t one = 1;
+    for (auto&& core : this->cores) {
+        if (core->wake_fd >= 0 && write(core->wake_fd, &one, sizeof(one)) < 0) {
+            perror_color(RED, "write");
+        }
+    }
+    for (auto&& core : this->cores) {
+        if (core->thread.joinable()) core->thread.join();
+        for (int fd : {core->listener_fd, core->epoll_fd, core->wake_fd}) {
+            if (fd >= 0) ::close(fd);
+        }
+    }
+}
+
+size_t CoreServer::core_for(const std::string& key) const {
+    return stable_hash(key) % this->n_cores;
+}
+
+void CoreServer::run(Core& core) {
+    epoll_event events[MAX_EVENTS];
+    while (!this->is_stopped) {
+        int timeout = TICK_MS;
+        bool backlogged =
+            std::any_of(core.backlog.begin(), core.backlog.end(),
+                        [](auto&& backlog) { return !backlog.empty(); });
+        if (backlogged) {
+            timeout = BACKLOG_RETRY_MS;
+        } else {
+            // Pairs with the fence in send_forwards: either the senders see
+            // that this core is asleep and wake it up, or it sees what they
+            // sent and doesn't sleep
+            core.asleep.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            for (auto&& queue : core.inbox) {
+                if (queue && !queue->empty()) timeout = 0;
+            }
+        }
+        int n = epoll_wait(core.epoll_fd, events, MAX_EVENTS, timeout);
+        core.asleep.store(false, std::memory_order_relaxed);
+        if (n < 0 && errno != EINTR) {
+            perror_color(RED, "epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == WAKE_ID) {
+                uint64_t count;
+                while (read(core.wake_fd, &count, sizeof(count)) > 0) {
+                }
+                continue;
+            }
+            if (id == LISTENER_ID) {
+                this->accept_clients(core);
+                continue;
+            }
+            auto it = core.conns.find(id);
+            // Already closed during this round
+            if (it == core.conns.end()) continue;
+            Connection& conn = *it->second;
+            bool ok = true;
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                ok = this->receive(core, conn);
+            }
+            if (ok && (events[i].events & EPOLLOUT)) {
+                ok = this->flush(core, conn);
+            }
+            if (!ok) this->close_connection(core, id);
+        }
+
+        this->take_forwards(core);
+        this->send_forwards(core);
+
+        // Each connection's responses from this round go out together
+        std::vector<uint64_t> to_flush;
+        to_flush.swap(core.to_flush);
+        for (uint64_t id : to_flush) {
+            auto it = core.conns.find(id);
+            if (it == core.conns.end()) continue;
+            if (!this->flush(core, *it->second)) this->close_connection(core, id);
+        }
+    }
+
+    for (auto&& [_, conn] : core.conns) ::close(conn->fd);
+    core.conns.clear();
+}
+
+void CoreServer::accept_clients(Core& core) {
+    while (true) {
+        int fd = accept4(core.listener_fd, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror_color(RED, "accept");
+            }
+            return;
+        }
+        int yes = 1;
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)) < 0) {
+            perror_color(YELLOW, "setsockopt");
+        }
+
+        auto conn = std::make_unique<Connection>();
+        conn->id = core.next_conn_id++;
+        conn->fd = fd;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = conn->id;
+        if (epoll_ctl(core.epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            perror_color(RED, "epoll_ctl");
+            ::close(fd);
+            continue;
+        }
+        core.conns.emplace(conn->id, std::move(conn));
+    }
+}
+
+bool CoreServer::receive(Core& core, Connection& conn) {
+    bool open = true;
+    while (true) {
+        size_t start = conn.in.size();
+        conn.in.resize(start + READ_SIZE);
+        ssize_t got = recv(conn.fd, conn.in.data() + start, READ_SIZE, 0);
+        conn.in.resize(start + std::max<ssize_t>(got, 0));
+        if (got > 0) continue;
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (got < 0 && errno != ECONNRESET) perror_color(RED, "recv");
+        open = false;
+        break;
+    }
+
+    Message msg{};
+    while (take_message(conn.in, conn.in_done, &msg)) {
+        std::optional<Request> req = deserialize_request(std::move(msg));
+        if (!req) {
+            cerr_color(RED, "Error deserializing request.");
+            return false;
+        }
+        this->dispatch(core, conn, std::move(*req));
+    }
+
+    // Keep only what's left to parse
+    conn.in.erase(conn.in.begin(), conn.in.begin() + conn.in_done);
+    conn.in_done = 0;
+    return open;
+}
+
+bool CoreServer::flush(Core& core, Connection& conn) {
+    while (conn.out_done < conn.out.size()) {
+        ssize_t sent = send(conn.fd, conn.out.data() + conn.out_done,
+                            conn.out.size() - conn.out_done, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                if (errno != EPIPE && errno != ECONNRESET) {
+                    perror_color(RED, "send");
+                }
+                return false;
+            }
+            // Carry on once the socket has room again
+            if (!conn.writing) {
+                epoll_event event{};
+                event.events = EPOLLIN | EPOLLOUT;
+                event.data.u64 = conn.id;
+                epoll_ctl(core.epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+                conn.writing = true;
+            }
+            return true;
+        }
+        conn.out_done += sent;
+    }
+
+    conn.out.clear();
+    conn.out_done = 0;
+    if (conn.writing) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = conn.id;
+        epoll_ctl(core.epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+        conn.writing = false;
+    }
+    return true;
+}
+
+void CoreServer::close_connection(Core& core, uint64_t conn_id) {
+    auto it = core.conns.find(conn_id);
+    if (it == core.conns.end()) return;
+    // Closing the socket takes it out of the epoll set; responses still on
+    // their way from other cores are dropped when they arrive
+    ::close(it->second->fd);
+    core.conns.erase(it);
+}
+
+void CoreServer::dispatch(Core& core, Connection& conn, Request req) {
+    uint64_t seq = conn.first_seq + conn.pending.size();
+    Pending& pending = conn.pending.emplace_back();
+
+    // The request's parts, and the cores they go to
+    std::vector<std::pair<size_t, Request>> parts;
+    auto by_core = [&](const std::vector<std::string>& keys) {
+        std::map<size_t, std::vector<size_t>> positions;
+        for (size_t i = 0; i < keys.size(); i++) {
+            positions[this->core_for(keys[i])].push_back(i);
+        }
+        return positions;
+    };
+    if (auto* multiget_req = std::get_if<MultiGetRequest>(&req);
+        multiget_req && !multiget_req->keys.empty()) {
+        auto positions = by_core(multiget_req->keys);
+        if (positions.size() == 1) {
+            parts.emplace_back(positions.begin()->first, std::move(req));
+        } else {
+            pending.res = MultiGetResponse{
+                std::vector<std::string>(multiget_req->keys.size())};
+            for (auto&& [owner, indices] : positions) {
+                MultiGetRequest part;
+                for (size_t i : indices) {
+                    part.keys.push_back(std::move(multiget_req->keys[i]));
+                }
+                parts.emplace_back(owner, std::move(part));
+                pending.positions.push_back(std::move(indices));
+            }
+        }
+    } else if (auto* multiput_req = std::get_if<MultiPutRequest>(&req);
+               multiput_req && !multiput_req->keys.empty() &&
+               multiput_req->keys.size() == multiput_req->values.size()) {
+        auto positions = by_core(multiput_req->keys);
+        if (positions.size() == 1) {
+            parts.emplace_back(positions.begin()->first, std::move(req));
+        } else {
+            pending.res = MultiPutResponse{};
+            for (auto&& [owner, indices] : positions) {
+                MultiPutRequest part{{}, {}, multiput_req->ttl_ms};
+                for (size_t i : indices) {
+                    part.keys.push_back(std::move(multiput_req->keys[i]));
+                    part.values.push_back(std::move(multiput_req->values[i]));
+                }
+                parts.emplace_back(owner, std::move(part));
+                pending.positions.push_back(std::move(indices));
+            }
+        }
+    } else if (const std::string* key = key_of(req)) {
+        parts.emplace_back(this->core_for(*key), std::move(req));
+    } else {
+        // Answered (or rejected) by the store here
+        parts.emplace_back(core.id, std::move(req));
+    }
+
+    pending.n_left = parts.size();
+    for (size_t i = 0; i < parts.size(); i++) {
+        auto& [owner, part] = parts[i];
+        if (owner == core.id) {
+            this->complete(core, conn, seq, i, serve(core.store, part));
+        } else {
+            this->forward(core, owner,
+                          Forward{core.id, Ticket{conn.id, seq, i},
+                                  std::move(part)});
+        }
+    }
+}
+
+void CoreServer::complete(Core& core, Connection& conn, uint64_t seq,
+                          size_t part, Response res) {
+    Pending& pending = conn.pending[seq - conn.first_seq];
+    if (pending.positions.empty()) {
+        pending.res = std::move(res);
+    } else if (std::holds_alternative<ErrorResponse>(*pending.res)) {
+        // A split request fails with the first error one of its parts gets
+    } else if (std::holds_alternative<ErrorResponse>(res)) {
+        pending.res = std::move(res);
+    } else if (auto* multiget_res = std::get_if<MultiGetResponse>(&res)) {
+        auto& values = std::get<MultiGetResponse>(*pending.res).values;
+        const auto& positions = pending.positions[part];
+        for (size_t j = 0; j < positions.size(); j++) {
+            values[positions[j]] = std::move(multiget_res->values[j]);
+        }
+    }
+    if (--pending.n_left > 0) return;
+
+    while (!conn.pending.empty() && conn.pending.front().n_left == 0) {
+        Response& ready = *conn.pending.front().res;
+        if (auto* error_res = std::get_if<ErrorResponse>(&ready)) {
+            cerr_color(RED, "Request on server ", this->address,
+                       " failed: ", error_res->msg);
+        }
+        std::optional<Message> msg = serialize_response(std::move(ready));
+        if (!msg) {
+            msg = serialize_response(ErrorResponse{"failed to serialize response"});
+        }
+        append_message(conn.out, *msg);
+        conn.pending.pop_front();
+        conn.first_seq++;
+    }
+    core.to_flush.push_back(conn.id);
+}
+
+void CoreServer::take_forwards(Core& core) {
+    for (auto&& queue : core.inbox) {
+        if (!queue) continue;
+        while (std::optional<Forward> msg = queue->try_pop()) {
+            if (auto* req = std::get_if<Request>(&msg->msg)) {
+                this->forward(core, msg->from,
+                              Forward{core.id, msg->ticket,
+                                      serve(core.store, *req)});
+                continue;
+            }
+            auto it = core.conns.find(msg->ticket.conn_id);
+            // The connection closed in the meantime
+            if (it == core.conns.end()) continue;
+            this->complete(core, *it->second, msg->ticket.seq,
+                           msg->ticket.part,
+                           std::move(std::get<Response>(msg->msg)));
+        }
+    }
+}
+
+void CoreServer::forward(Core& core, size_t to, Forward msg) {
+    auto& backlog = core.backlog[to];
+    // Behind whatever is already waiting, so that messages arrive in order
+    if (!backlog.empty() ||
+        !this->cores[to]->inbox[core.id]->try_push(std::move(msg))) {
+        backlog.push_back(std::move(msg));
+    }
+    core.sent_to[to] = true;
+}
+
+void CoreServer::send_forwards(Core& core) {
+    bool sent = false;
+    for (size_t to = 0; to < this->n_cores; to++) {
+        auto& backlog = core.backlog[to];
+        if (!backlog.empty()) {
+            auto& queue = *this->cores[to]->inbox[core.id];
+            while (!backlog.empty() &&
+                   queue.try_push(std::move(backlog.front()))) {
+                backlog.pop_front();
+                core.sent_to[to] = true;
+            }
+        }
+        sent |= core.sent_to[to];
+    }
+    if (!sent) return;
+
+    // Pairs with the fence in run
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t one = 1;
+    for (size_t to = 0; to < this->n_cores; to++) {
+        if (!core.sent_to[to]) continue;
+        core.sent_to[to] = false;
+        Core& other = *this->cores[to];
+        if (other.asleep.exchange(false) &&
+            write(other.wake_fd, &one, sizeof(one)) < 0) {
+            perror_color(RED, "write");
+        }
+    }
+}
@@ -0,0 +1,154 @@
+#ifndef CORE_SERVER_HPP
+#define CORE_SERVER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "common/spsc_queue.hpp"
+#include "kvstore/concurrent_kvstore.hpp"
+#include "net/network_messages.hpp"
+
+// How many messages each queue between two cores holds; messages that don't
+// fit wait on the sending core until the receiving one catches up
+#define CORE_QUEUE_CAPACITY 1024
+
+// A standalone server (like a KvServer without a shardcontroller) in which
+// cores share nothing. Each of its threads (one per core) owns the keys that
+// hash to it, in a store of its own, and runs an event loop over the
+// connections it accepted itself: every thread listens on the same port, and
+// the kernel spreads connections over them. A request for another core's keys
+// is forwarded to that core, and its response sent back, over lock-free queues
+// (one per ordered pair of cores), so a store is only ever touched by its own
+// thread. Each connection's requests are still answered in order.
+//
+// Only key-value requests are served: there is no shardcontroller,
+// replication, leases or streaming. A MultiGet or MultiPut is split by core,
+// so a MultiPut is atomic on each core, but not across cores.
+class CoreServer {
+ public:
+  explicit CoreServer(const std::string& address, size_t n_cores);
+  ~CoreServer();
+
+  // Starts the server, listening with one socket per core.
+  int start();
+  void stop();
+
+  CoreServer(const CoreServer&) = delete;
+  CoreServer& operator=(const CoreServer&) = delete;
+
+ private:
+  // epoll identifies the wakeup descriptor and the listener by these, and
+  // connections by their ids
+  static constexpr uint64_t WAKE_ID = 0;
+  static constexpr uint64_t LISTENER_ID = 1;
+  static constexpr uint64_t FIRST_CONN_ID = 2;
+
+  // Where a forwarded part of a request is answered to, on the core that
+  // forwarded it: the connection (by id, as it may close in the meantime),
+  // the request's place among the connection's requests, and which of the
+  // request's parts it is.
+  struct Ticket {
+    uint64_t conn_id;
+    uint64_t seq;
+    size_t part;
+  };
+
+  // What cores send each other: a request for the receiving core's keys, or
+  // the response to one it forwarded
+  struct Forward {
+    size_t from = 0;
+    Ticket ticket{0, 0, 0};
+    std::variant<Request, Response> msg;
+  };
+
+  // A request waiting for its response. A MultiGet or MultiPut over several
+  // cores is answered once all of its parts are; `positions` holds where each
+  // part's keys were in the request.
+  struct Pending {
+    size_t n_left = 0;
+    std::vector<std::vector<size_t>> positions;
+    std::optional<Response> res;
+  };
+
+  struct Connection {
+    uint64_t id;
+    int fd;
+    std::vector<std::byte> in, out;
+    size_t in_done = 0, out_done = 0;
+    bool writing = false;
+    // Requests received and not yet answered, oldest (number first_seq) first
+    std::deque<Pending> pending;
+    uint64_t first_seq = 0;
+  };
+
+  struct Core {
+    size_t id = 0;
+    ConcurrentKvStore store;
+    int listener_fd = -1, epoll_fd = -1, wake_fd = -1;
+    std::thread thread;
+
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> conns;
+    uint64_t next_conn_id = FIRST_CONN_ID;
+    // Connections with responses to send at the end of this round
+    std::vector<uint64_t> to_flush;
+
+    // Messages from each core, and ones for each core that didn't fit in its
+    // queue yet. Cores sent anything this round are woken up at its end.
+    std::vector<std::unique_ptr<SpscQueue<Forward>>> inbox;
+    std::vector<std::deque<Forward>> backlog;
+    std::vector<bool> sent_to;
+    // Set while the core may be blocked waiting for events, for senders to
+    // wake it up
+    std::atomic<bool> asleep = false;
+  };
+
+  std::string address;
+  size_t n_cores;
+  std::vector<std::unique_ptr<Core>> cores;
+  std::atomic<bool> is_stopped = false;
+
+  size_t core_for(const std::string& key) const;
+
+  /**
+   * A core's event loop: accept connections, read requests and serve or
+   * forward them, take in messages from other cores, and send responses. Exits
+   * when the server has been stopped.
+   */
+  void run(Core& core);
+
+  void accept_clients(Core& core);
+  // Read what a connection sent and dispatch its requests; false if it closed
+  bool receive(Core& core, Connection& conn);
+  bool flush(Core& core, Connection& conn);
+  void close_connection(Core& core, uint64_t conn_id);
+
+  /**
+   * Start answering a request: serve the parts of it on this core's keys
+   * right away, and forward the rest to their cores.
+   */
+  void dispatch(Core& core, Connection& conn, Request req);
+
+  /**
+   * Take in one part's response, and queue up every response that's now
+   * ready at the front of the connection.
+   */
+  void complete(Core& core, Connection& conn, uint64_t seq, size_t part,
+                Response res);
+
+  // Serve the requests other cores forwarded, and complete the responses they
+  // sent back
+  void take_forwards(Core& core);
+  void forward(Core& core, size_t to, Forward msg);
+  // Push what's left of the backlog, and wake up the cores sent anything
+  void send_forwards(Core& core);
+};
+
+#endif /* end of include guard */
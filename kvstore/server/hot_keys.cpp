@@ -0,0 +1,149 @@
+#include "hot_keys.hpp"
+
+#include <algorithm>
+#include <functional>
+
+// The 64-bit finalizer of SplitMix64, which spreads every input bit over the
+// whole output
+static uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Orders a min-heap of KeyCounts on count
+static bool hotter(const KeyCount& a, const KeyCount& b) {
+    return a.count > b.count;
+}
+
+HotKeyTracker::HotKeyTracker(std::chrono::milliseconds window,
+                             size_t n_hot_keys)
+    : window(window),
+      n_hot_keys(n_hot_keys),
+      window_start(Clock::now().time_since_epoch().count()) {
+}
+
+std::array<size_t, HotKeyTracker::DEPTH> HotKeyTracker::slots(
+    const std::string& key) {
+    // Each row's column comes from a different combination of two hashes
+    // (Kirsch and Mitzenmacher), which is as good as independent hashes here
+    uint64_t h1 = mix(std::hash<std::string>{}(key));
+    uint64_t h2 = mix(h1) | 1;
+    std::array<size_t, DEPTH> slots;
+    for (size_t row = 0; row < DEPTH; row++) {
+        slots[row] = (row << WIDTH_BITS) | ((h1 + row * h2) & WIDTH_MASK);
+    }
+    return slots;
+}
+
+void HotKeyTracker::record(const std::string& key) {
+    size_t s = this->current.load(std::memory_order_acquire);
+    Sketch& sketch = this->sketches[s];
+    uint64_t estimate = UINT32_MAX;
+    for (size_t slot : slots(key)) {
+        estimate = std::min<uint64_t>(
+            estimate,
+            sketch.counters[slot].fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+    uint64_t n =
+        sketch.n_accesses.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    bool check_window = n % ROTATE_CHECK_INTERVAL == 0;
+    if (!check_window &&
+        estimate < this->admit_at.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::unique_lock lock(this->top_mtx, std::try_to_lock);
+    if (!lock) return;
+    if (estimate >= this->admit_at.load(std::memory_order_relaxed)) {
+        this->offer(key, estimate, s);
+    }
+    if (check_window) this->maybe_rotate(Clock::now());
+}
+
+StatsResponse HotKeyTracker::stats() {
+    std::unique_lock lock(this->top_mtx);
+    auto now = Clock::now();
+    this->maybe_rotate(now);
+    if (this->last) return *this->last;
+
+    Clock::time_point start{
+        Clock::duration(this->window_start.load(std::memory_order_relaxed))};
+    const Sketch& sketch = this->sketches[this->current.load()];
+    return StatsResponse{
+        static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - start)
+                .count()),
+        sketch.n_accesses.load(std::memory_order_relaxed), this->hottest()};
+}
+
+void HotKeyTracker::offer(const std::string& key, uint64_t count,
+                          size_t sketch) {
+    // Estimates from a window that has since ended don't belong in this one
+    if (sketch != this->current.load(std::memory_order_relaxed)) return;
+
+    auto it = std::find_if(this->top.begin(), this->top.end(),
+                           [&](auto&& entry) { return entry.key == key; });
+    if (it != this->top.end()) {
+        it->count = std::max(it->count, count);
+        std::make_heap(this->top.begin(), this->top.end(), hotter);
+    } else if (this->top.size() < this->n_hot_keys) {
+        this->top.push_back(KeyCount{key, count});
+        std::push_heap(this->top.begin(), this->top.end(), hotter);
+    } else if (count > this->top.front().count) {
+        std::pop_heap(this->top.begin(), this->top.end(), hotter);
+        this->top.back() = KeyCount{key, count};
+        std::push_heap(this->top.begin(), this->top.end(), hotter);
+    }
+    if (this->top.size() == this->n_hot_keys) {
+        this->admit_at.store(this->top.front().count,
+                             std::memory_order_relaxed);
+    }
+}
+
+void HotKeyTracker::maybe_rotate(Clock::time_point now) {
+    Clock::time_point start{
+        Clock::duration(this->window_start.load(std::memory_order_relaxed))};
+    if (now - start < this->window) return;
+
+    size_t s = this->current.load(std::memory_order_relaxed);
+    this->last = StatsResponse{
+        static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - start)
+                .count()),
+        this->sketches[s].n_accesses.load(std::memory_order_relaxed),
+        this->hottest()};
+
+    // The other sketch last counted the window before the one that just
+    // ended; by now, nothing is still counting into it
+    Sketch& next = this->sketches[1 - s];
+    for (auto&& counter : next.counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    next.n_accesses.store(0, std::memory_order_relaxed);
+    this->top.clear();
+    this->admit_at.store(0, std::memory_order_relaxed);
+    this->window_start.store(now.time_since_epoch().count(),
+                             std::memory_order_relaxed);
+    this->current.store(1 - s, std::memory_order_release);
+}
+
+std::vector<KeyCount> HotKeyTracker::hottest() const {
+    // Accesses that found top_mtx taken weren't offered, so the counts in
+    // `top` may be behind the sketch's
+    const Sketch& sketch = this->sketches[this->current.load()];
+    std::vector<KeyCount> sorted = this->top;
+    for (auto&& entry : sorted) {
+        uint64_t estimate = UINT32_MAX;
+        for (size_t slot : slots(entry.key)) {
+            estimate = std::min<uint64_t>(
+                estimate,
+                sketch.counters[slot].load(std::memory_order_relaxed));
+        }
+        entry.count = std::max(entry.count, estimate);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](auto&& a, auto&& b) {
+        return a.count > b.count || (a.count == b.count && a.key < b.key);
+    });
+    return sorted;
+}
@@ -0,0 +1,93 @@
+#ifndef HOT_KEYS_HPP
+#define HOT_KEYS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "net/server_commands.hpp"
+
+// How many of its hottest keys a server reports, and how long each of its
+// stats windows lasts
+#define N_HOT_KEYS 10
+#define HOT_KEY_WINDOW_MS 1000
+
+// Finds the most accessed keys of each time window, without a counter per key.
+// Accesses are counted in a count-min sketch: DEPTH rows of counters, each
+// indexed by a different hash of the key. A key's estimate is the smallest of
+// its counters, which can only be inflated by other keys colliding with it in
+// every row. Counting is a few relaxed atomic increments, so request threads
+// never wait on each other to record an access.
+//
+// Keys whose estimate reaches the coldest of the current top N_HOT_KEYS are
+// offered to the top-k heap. Only then is its lock taken, and only if it's
+// free: a hot key that misses its turn gets another on its next access.
+//
+// Windows are rotated by whichever call first sees that the current one is
+// over, with two sketches alternating so that the finished window's counters
+// can be cleared while the next one counts.
+class HotKeyTracker {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit HotKeyTracker(
+      std::chrono::milliseconds window =
+          std::chrono::milliseconds(HOT_KEY_WINDOW_MS),
+      size_t n_hot_keys = N_HOT_KEYS);
+
+  HotKeyTracker(const HotKeyTracker&) = delete;
+  HotKeyTracker& operator=(const HotKeyTracker&) = delete;
+
+  void record(const std::string& key);
+
+  // The last complete window's accesses and hottest keys, or the current
+  // window's so far if none has completed yet.
+  StatsResponse stats();
+
+ private:
+  static constexpr size_t DEPTH = 4;
+  static constexpr size_t WIDTH_BITS = 11;
+  static constexpr uint64_t WIDTH_MASK = (uint64_t(1) << WIDTH_BITS) - 1;
+  // Accesses between checks for the end of the window
+  static constexpr uint64_t ROTATE_CHECK_INTERVAL = 256;
+
+  struct Sketch {
+    std::array<std::atomic<uint32_t>, DEPTH << WIDTH_BITS> counters{};
+    std::atomic<uint64_t> n_accesses = 0;
+  };
+
+  std::chrono::milliseconds window;
+  size_t n_hot_keys;
+
+  std::array<Sketch, 2> sketches;
+  // The sketch counting the current window, and when that window started (as
+  // a count of Clock ticks)
+  std::atomic<size_t> current = 0;
+  std::atomic<Clock::rep> window_start;
+
+  // The current window's hottest keys, as a min-heap on count, and the last
+  // complete window's stats. Protected by top_mtx.
+  std::mutex top_mtx;
+  std::vector<KeyCount> top;
+  std::optional<StatsResponse> last;
+  // The estimate a key needs to be offered to `top`: 0 until it's full, then
+  // its smallest count
+  std::atomic<uint64_t> admit_at = 0;
+
+  // The counters of `key` in each row of a sketch
+  static std::array<size_t, DEPTH> slots(const std::string& key);
+  // Puts `key`, estimated at `count` in sketch `sketch`, into `top` if it's
+  // among the hottest keys. Requires top_mtx.
+  void offer(const std::string& key, uint64_t count, size_t sketch);
+  // Finishes the current window at `now` if it's over. Requires top_mtx.
+  void maybe_rotate(Clock::time_point now);
+  // `top`, hottest first. Requires top_mtx.
+  std::vector<KeyCount> hottest() const;
+};
+
+#endif /* end of include guard */
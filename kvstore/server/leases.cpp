@@ -0,0 +1,60 @@
+#include "leases.hpp"
+
+#include <algorithm>
+
+LeaseTable::LeaseTable(std::chrono::milliseconds duration, size_t log_size)
+    : duration(duration),
+      log_size(log_size),
+      // Distinct for every start, so that a restarted server's numbering
+      // isn't mistaken for the old one's
+      epoch(std::max<uint64_t>(
+          std::chrono::system_clock::now().time_since_epoch().count(), 1)) {
+}
+
+LeaseTable::Grant LeaseTable::grant(const std::string& key, uint64_t epoch,
+                                    uint64_t since) {
+    auto now = Clock::now();
+    std::unique_lock lock(this->mtx);
+    auto& expiry = this->leases[key];
+    expiry = std::max(expiry, now + this->duration);
+
+    if (this->leases.size() >= this->next_sweep) {
+        std::erase_if(this->leases,
+                      [&](auto&& lease) { return lease.second <= now; });
+        this->next_sweep =
+            std::max<size_t>(this->leases.size() * 2, LEASE_LOG_SIZE);
+    }
+    this->n_leases.store(this->leases.size());
+
+    Grant grant{this->duration, this->epoch, this->last_seq, {}, false};
+    // Revocations after `since` that are no longer logged were missed
+    uint64_t first_logged =
+        this->log.empty() ? this->last_seq + 1 : this->log.front().first;
+    if (epoch != this->epoch || since > this->last_seq ||
+        since + 1 < first_logged) {
+        grant.flush = true;
+        return grant;
+    }
+    auto it = std::upper_bound(
+        this->log.begin(), this->log.end(), since,
+        [](uint64_t seq, auto&& entry) { return seq < entry.first; });
+    for (; it != this->log.end(); it++) grant.revoked.push_back(it->second);
+    return grant;
+}
+
+void LeaseTable::revoke(const std::vector<std::string>& keys) {
+    if (this->n_leases.load() == 0) return;
+    auto now = Clock::now();
+    std::unique_lock lock(this->mtx);
+    for (auto&& key : keys) {
+        auto it = this->leases.find(key);
+        if (it == this->leases.end()) continue;
+        // An expired lease needs no revoking; nobody may still use it
+        if (it->second > now) {
+            this->log.emplace_back(++this->last_seq, key);
+            if (this->log.size() > this->log_size) this->log.pop_front();
+        }
+        this->leases.erase(it);
+    }
+    this->n_leases.store(this->leases.size());
+}
@@ -0,0 +1,76 @@
+#ifndef LEASES_HPP
+#define LEASES_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// How long clients may cache a value they read with a lease, and how many
+// revocations a server remembers for clients to catch up on
+#define LEASE_MS 1000
+#define LEASE_LOG_SIZE 4096
+
+// The read leases a server has handed out to clients' near caches.
+//
+// A lease lets a client serve a key from its own memory until the lease
+// expires. Writing a key revokes its outstanding leases by appending the key to
+// a log of revocations, numbered in order; a client catches up on the log the
+// next time it asks this server for a lease. So a cached value is never older
+// than the client's last lease request to the server, or than the lease.
+//
+// Logs are numbered per epoch (each start of a server), and only the last
+// `log_size` revocations are kept; a client that's in a different epoch or
+// has fallen further behind must drop everything it cached from the server.
+class LeaseTable {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit LeaseTable(
+      std::chrono::milliseconds duration = std::chrono::milliseconds(LEASE_MS),
+      size_t log_size = LEASE_LOG_SIZE);
+
+  LeaseTable(const LeaseTable&) = delete;
+  LeaseTable& operator=(const LeaseTable&) = delete;
+
+  struct Grant {
+    std::chrono::milliseconds duration;
+    uint64_t epoch;
+    // The last revocation logged before the lease was granted
+    uint64_t seq;
+    // What was revoked after `since`, unless `flush` is set
+    std::vector<std::string> revoked;
+    bool flush;
+  };
+
+  // Leases `key` to a client that has seen the revocations of `epoch` up to
+  // `since`. Must be called before the key is read, so that a write racing
+  // with the read is sure to revoke the lease.
+  Grant grant(const std::string& key, uint64_t epoch, uint64_t since);
+
+  // Revokes the outstanding leases on `keys`, which were just written
+  void revoke(const std::vector<std::string>& keys);
+
+ private:
+  std::chrono::milliseconds duration;
+  size_t log_size;
+  const uint64_t epoch;
+
+  // When each leased key's last lease expires, and the revocations logged so
+  // far, oldest first. Protected by mtx; n_leases mirrors leases.size() so
+  // that writes can skip the lock while nothing is leased.
+  std::unordered_map<std::string, Clock::time_point> leases;
+  std::deque<std::pair<uint64_t, std::string>> log;
+  uint64_t last_seq = 0;
+  // The lease count at which expired leases are next swept away
+  size_t next_sweep = LEASE_LOG_SIZE;
+  std::atomic<size_t> n_leases = 0;
+  std::mutex mtx;
+};
+
+#endif /* end of include guard */
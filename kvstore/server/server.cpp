@@ -13,6 +13,23 @@ int KvServer::start() {
     if (this->listener_fd < 0) {
         return -1;
     }
+
+    // And, optionally, the UDP socket on the same port
+    if (this->udp) {
+        this->udp_fd = open_datagram_socket(address);
+        if (this->udp_fd < 0) {
+            close(this->listener_fd);
+            return -1;
+        }
+        if (!set_recv_timeout(this->udp_fd, UDP_POLL_INTERVAL)) {
+            close(this->udp_fd);
+            close(this->listener_fd);
+            return -1;
+        }
+        for (size_t i = 0; i < UDP_WORKERS; i++) {
+            this->udp_workers.emplace_back(&KvServer::udp_loop, this);
+        }
+    }
     this->client_listener = std::thread(&KvServer::accept_clients_loop, this);
     cout_color(BLUE, "Listening on: ", this->address);
 
@@ -20,6 +37,7 @@ int KvServer::start() {
     this->workers.resize(this->n_workers);
     this->conn_queues.resize(this->n_workers);
     this->conn_queue_mtxs.resize(this->n_workers);
+    this->conn_queue_cvs.resize(this->n_workers);
     size_t i = 0;
     for (auto&& worker : this->workers) {
         worker = std::thread(&KvServer::work_loop, this, i);
@@ -52,6 +70,7 @@ int KvServer::start() {
 
         this->shardcontroller_querier =
             std::thread(&KvServer::process_config_loop, this);
+        this->replicator = std::thread(&KvServer::replicate_loop, this);
         cout_color(BLUE, "Shardcontroller on: ", this->shardcontroller_address);
     }
 
@@ -66,6 +85,12 @@ void KvServer::stop() {
     cout_color(BLUE, "Joining client listener thread...");
     this->client_listener.join();
 
+    if (this->udp_fd >= 0) {
+        shutdown(this->udp_fd, SHUT_RDWR);
+        for (auto&& thr : this->udp_workers) thr.join();
+        close(this->udp_fd);
+    }
+
     // Stop connection queue, and close & join workers
     for (size_t i = 0; i < this->n_workers; i++) {
         auto& queue = this->conn_queues[i];
@@ -75,6 +100,7 @@ void KvServer::stop() {
             client->shutdown();
         }
         this->conn_queue_mtxs[i].unlock();
+        this->conn_queue_cvs[i].notify_all();
     }
     for (auto&& thr : this->workers) thr.join();
 
@@ -88,6 +114,11 @@ void KvServer::stop() {
 
         cout_color(BLUE, "Joining query shardcontroller thread...");
         this->shardcontroller_querier.join();
+        {
+            std::unique_lock lock(this->replication_mtx);
+            this->replication_cv.notify_all();
+        }
+        this->replicator.join();
         this->shardcontroller_conn->shutdown();
     }
 }
@@ -118,30 +149,46 @@ bool KvServer::Leave() {
     return false;
 }
 
-std::optional<QueryResponse> KvServer::query_shardcontroller(
+std::optional<ShardControllerConfig> KvServer::query_shardcontroller(
     std::shared_ptr<ServerConn> conn) {
-    QueryRequest req{};
+    // Changes that don't follow on from the config this server has (which
+    // they always should) are dropped, and the whole config fetched again
+    for (size_t attempt = 0; attempt < 2; attempt++) {
+        ConfigChangesRequest req{this->compact_config.version};
+        if (!conn->send_request(req)) {
+            return std::nullopt;
+        }
 
-    if (!conn->send_request(req)) {
-        return std::nullopt;
+        auto res = conn->recv_response();
+        if (!res) {
+            return std::nullopt;
+        }
+        auto* changes_res = std::get_if<ConfigChangesResponse>(&*res);
+        if (!changes_res) {
+            return std::nullopt;
+        }
+        if (this->compact_config.apply(changes_res->changes)) {
+            return this->compact_config.expand();
+        }
+        this->compact_config = {};
     }
+    return std::nullopt;
+}
 
-    auto res = conn->recv_response();
-    if (!res) {
-        return std::nullopt;
-    }
-    auto* query_res = std::get_if<QueryResponse>(&*res);
-    if (!query_res) {
-        return std::nullopt;
-    }
-    return *query_res;
+// Checks whether two shards share any keys, even at different granularities
+static bool shards_overlap(const Shard& a, const Shard& b) {
+    size_t granularity = std::max(a.granularity(), b.granularity());
+    return get_overlap(refine_shard(a, granularity), refine_shard(b, granularity)) !=
+           OverlapStatus::NO_OVERLAP;
 }
 
 bool KvServer::process_config() {
     // TODO (Part B, Step 2): Implement!
+    std::unique_lock lock(this->process_config_mtx);
+    return this->sync_config();
+}
 
-    std::unique_lock lock(this->config_mtx);
-
+bool KvServer::sync_config() {
     auto res = this->query_shardcontroller(this->shardcontroller_querier_conn);
     if (!res) {
         cerr_color(RED, "Failed to receive query response from shardcontroller.");
@@ -150,58 +197,174 @@ bool KvServer::process_config() {
 
     // TODO: Update this->config to reflect the result from querying the
     // shardcontroller
-    this->config = res->config;
-
-
-    // to_transfer maps server --> [<vector of keys to transfer to server>,
-    // <vector of values to transfer to server>]
-    // You're free to use a different data structure if you'd
-    // like, although note you'll have to change our transferring code if you do
-    std::map<std::string, std::array<std::vector<std::string>, 2>> to_transfer;
-
-    // TODO:
-    //  1. Get all of the server's key-value pairs (which KvStore functions might
-    //  help you with this?)
-    //  2. For each pair, check if the server is still responsible for it.
-    //  If the server is no longer responsible for the pair,
-    //  add the pair to_transfer under the key of the newly-responsible (i.e.,
-    //  destination) server and delete the pair from this server's store.
-
-    std::vector<std::string>allkeys = this->store->AllKeys();
-    MultiGetRequest req = {.keys = allkeys};
-    MultiGetResponse response;
-    bool result = this->store->MultiGet(&req, &response);
-    if(!result)
-    {
-        return false;
+    std::shared_ptr<const Routing> old_routing = this->routing.load();
+    const ShardControllerConfig& old_config = old_routing->config;
+    std::vector<std::string> old_backups;
+    if (auto it = old_config.server_to_backups.find(this->address);
+        it != old_config.server_to_backups.end()) {
+        old_backups = it->second;
     }
-    for (size_t i = 0; i < allkeys.size(); ++i) {
-        const std::string& key = allkeys[i];
-        const std::string& value = response.values[i];
 
-        std::optional<std::string> dest = this->config.get_server(key);
+    auto next = std::make_shared<Routing>();
+    next->config = std::move(*res);
+    const ShardControllerConfig& config = next->config;
+    std::vector<std::string> backups;
+    if (auto it = config.server_to_backups.find(this->address);
+        it != config.server_to_backups.end()) {
+        backups = it->second;
+    }
+    if (auto it = config.server_to_shards.find(this->address);
+        it != config.server_to_shards.end()) {
+        next->owned_shards = it->second;
+    }
 
-        if (!dest) {
-            cerr_color(RED, "No server found for key ", key);
-            return false;
+    // Keep counting hits if this server's shards didn't change, and restart
+    // load accounting if they did
+    const std::vector<Shard>& previously_owned = old_routing->owned_shards;
+    bool shards_changed = next->owned_shards != previously_owned;
+    next->shard_hits = std::deque<std::atomic<uint64_t>>(next->owned_shards.size());
+    if (!shards_changed) {
+        for (size_t i = 0; i < next->shard_hits.size(); i++) {
+            next->shard_hits[i] = old_routing->shard_hits[i].load();
+        }
+    }
+
+    // Track incoming handoffs before any request can write to the new ranges,
+    // then publish the new config
+    this->update_handoffs(old_config, *next);
+    this->routing.store(next);
+    if (shards_changed) {
+        std::unique_lock lock(this->load_mtx);
+        this->load_window_start = steady_clock::now();
+    }
+
+    // Grace period: wait for requests that checked their keys against the old
+    // config to finish, so that none of them writes a key after it's been
+    // scanned below. They're only in flight around their store operations,
+    // so this is short; other holders of the old snapshot don't count.
+    while (old_routing->in_flight > 0) {
+        std::this_thread::sleep_for(100us);
+    }
+
+    // to_transfer maps server --> the keys to transfer to it, with their values
+    // and times to live (the rest of the Handoff request is filled in when
+    // it's sent)
+    std::map<std::string, HandoffRequest> to_transfer;
+    // Every server that took over part of this server's old shards gets a
+    // handoff, even if there's nothing to send, as that commits it
+    for (auto&& lost : previously_owned) {
+        for (auto&& [server, shards] : config.server_to_shards) {
+            if (server == this->address) continue;
+            for (auto&& shard : shards) {
+                if (shards_overlap(lost, shard)) to_transfer[server];
+            }
+        }
+    }
+    // Shards handed off to each server, to drop here once it has them
+    std::map<std::string, std::vector<Shard>> to_drop;
+
+    // Keep the keys of the shards this server holds apart in the store: its
+    // own, those of the primaries it backs, and those it's handing off (so
+    // that they're read and dropped as a whole). The keys of any other shard
+    // stay in the rest.
+    std::vector<Shard> held = next->owned_shards;
+    for (auto&& [server, shards] : config.server_to_shards) {
+        if (server == this->address) continue;
+        bool backing = config.is_backup(server, this->address);
+        for (auto&& shard : shards) {
+            bool handed_off =
+                std::any_of(previously_owned.begin(), previously_owned.end(),
+                            [&](const Shard& lost) { return shards_overlap(lost, shard); });
+            if (backing || handed_off) held.push_back(shard);
         }
+    }
+    ShardControllerConfig placement;
+    placement.mode = config.mode;
+    this->store->Repartition(std::move(held),
+                             [placement](const std::string& key) {
+                                 return placement.shard_key(key);
+                             });
+
+    std::vector<uint64_t> shard_bytes;
+    for (auto&& shard : next->owned_shards) {
+        shard_bytes.push_back(this->store->ShardBytes(shard));
+    }
 
-        if (*dest != this->address) {
-            auto& entry = to_transfer[*dest];
-            entry[0].push_back(key);
-            entry[1].push_back(value);
+    for (auto&& [server, shards] : config.server_to_shards) {
+        if (server == this->address) continue;
+        // A backup of the new primary keeps its copy either way
+        bool backing = config.is_backup(server, this->address);
+        for (auto&& shard : shards) {
+            auto rejected_here = [&](const std::string& key) {
+                return this->rejected_handoffs.contains(key) &&
+                       shard.contains(config.shard_key(key));
+            };
+            bool was_primary =
+                std::any_of(previously_owned.begin(), previously_owned.end(),
+                            [&](const Shard& lost) { return shards_overlap(lost, shard); }) ||
+                std::any_of(this->rejected_handoffs.begin(),
+                            this->rejected_handoffs.end(), rejected_here);
+            if (!was_primary) {
+                if (!backing) this->store->DropShard(shard);
+                continue;
+            }
 
-            // delete locally
-            DeleteRequest dreq{key};
-            DeleteResponse dres;
-            this->store->Delete(&dreq, &dres);
+            // Only a key's previous primary hands it over; a backup's copy may
+            // be stale
+            KvItems items = this->store->ShardItems(shard);
+            auto& entry = to_transfer[server];
+            for (size_t i = 0; i < items.keys.size(); i++) {
+                std::string position = config.shard_key(items.keys[i]);
+                bool primary =
+                    std::any_of(previously_owned.begin(), previously_owned.end(),
+                                [&](const Shard& lost) { return lost.contains(position); }) ||
+                    this->rejected_handoffs.contains(items.keys[i]);
+                if (!primary) continue;
+                entry.keys.push_back(std::move(items.keys[i]));
+                entry.values.push_back(std::move(items.values[i]));
+                entry.ttls_ms.push_back(items.ttls_ms[i]);
+            }
+            // Keep serving pulls for the keys until the handoff commits
+            if (!backing) to_drop[server].push_back(shard);
         }
     }
 
+    this->rejected_handoffs.clear();
+    {
+        std::unique_lock lock(this->load_mtx);
+        this->shard_bytes = std::move(shard_bytes);
+    }
+
+    // Bring backups up to date: new backups get everything this server is the
+    // primary for, and if its shards changed, so do all of them
+    std::vector<std::string> resync;
+    for (auto&& backup : backups) {
+        if (shards_changed || std::find(old_backups.begin(), old_backups.end(),
+                                        backup) == old_backups.end()) {
+            resync.push_back(backup);
+        }
+    }
+    std::vector<std::string> primary_keys;
+    if (!resync.empty()) {
+        for (auto&& shard : next->owned_shards) {
+            std::vector<std::string> keys = this->store->AllKeys(shard);
+            primary_keys.insert(primary_keys.end(), keys.begin(), keys.end());
+        }
+    }
+    {
+        std::unique_lock replication_lock(this->replication_mtx);
+        std::erase_if(this->pending_replication, [&](auto&& entry) {
+            return std::find(backups.begin(), backups.end(), entry.first) ==
+                   backups.end();
+        });
+    }
+    this->replicate(resync, primary_keys);
+
+    uint64_t version = config.version;
 
     // NOTE: Comment this in to transfer the keys!
     // for each server responsible for moved keys:
-    for (auto&& [s, responsible_pairs] : to_transfer) {
+    for (auto&& [s, req] : to_transfer) {
         while (true) {
             // connect to server
             std::shared_ptr<ServerConn> conn = connect_to_server(s);
@@ -209,21 +372,488 @@ bool KvServer::process_config() {
                 cerr_color(RED, "Failed to connect to server ", s);
                 continue;
             }
-            // make MultiPut request
-            MultiPutRequest req{responsible_pairs[0], responsible_pairs[1]};
+            // make Handoff request
+            req.source = this->address;
+            req.version = version;
             if (!conn->send_request(req)) continue;
 
             // receive response, and check for success
             std::optional<Response> res = conn->recv_response();
             if (!res) continue;
-            if (std::get_if<ErrorResponse>(&*res)) continue;
+            auto* handoff_res = std::get_if<HandoffResponse>(&*res);
+            if (!handoff_res) continue;
+            // Keys the destination gave up on before they arrived stay here
+            // until a later config says where they go
+            this->rejected_handoffs.insert(handoff_res->rejected.begin(),
+                                           handoff_res->rejected.end());
             break;
         }
+
+        // The destination has the rest now, so drop them locally: whole
+        // shards at once, unless some of their keys have to stay
+        for (auto&& shard : to_drop[s]) {
+            bool keep_some = std::any_of(
+                this->rejected_handoffs.begin(), this->rejected_handoffs.end(),
+                [&](const std::string& key) {
+                    return shard.contains(config.shard_key(key));
+                });
+            if (!keep_some) {
+                this->store->DropShard(shard);
+                continue;
+            }
+            for (auto&& key : this->store->AllKeys(shard)) {
+                if (this->rejected_handoffs.contains(key)) continue;
+                DeleteRequest dreq{key};
+                DeleteResponse dres;
+                this->store->Delete(&dreq, &dres);
+            }
+        }
     }
+    this->handed_off_through = version;
 
     return true;
 }
 
+void KvServer::refresh_config() {
+    uint64_t version = this->routing.load()->config.version;
+
+    std::unique_lock lock(this->process_config_mtx, std::defer_lock);
+    if (!lock.try_lock_for(CONFIG_REFRESH_WAIT)) return;
+    // Someone else caught up while we waited
+    if (this->routing.load()->config.version != version) return;
+    this->sync_config();
+}
+
+void KvServer::update_handoffs(const ShardControllerConfig& old_config,
+                               const Routing& next) {
+    std::unique_lock lock(this->handoff_mtx);
+    auto now = steady_clock::now();
+    auto add_incoming = [&](const std::string& server, const Shard& shard) {
+        if (server == this->address ||
+            this->committed_handoffs[server] > old_config.version) {
+            return;
+        }
+        auto [it, inserted] = this->incoming_handoffs.try_emplace(
+            server, Handoff{{}, old_config.version + 1, now});
+        it->second.shards.push_back(shard);
+
+        // Writes and pulls from earlier handoffs of the range are superseded
+        auto in_shard = [&](const std::string& key) {
+            return shard.contains(next.config.shard_key(key));
+        };
+        std::erase_if(this->handoff_written, in_shard);
+        std::erase_if(this->handoff_pulled, in_shard);
+    };
+
+    // Ranges this server took over from other servers since the old config
+    if (old_config.version + 1 == next.config.version) {
+        for (auto&& [server, shards] : old_config.server_to_shards) {
+            for (auto&& shard : shards) {
+                bool taken_over = std::any_of(
+                    next.owned_shards.begin(), next.owned_shards.end(),
+                    [&](const Shard& owned) { return shards_overlap(shard, owned); });
+                if (taken_over) add_incoming(server, shard);
+            }
+        }
+    } else if (old_config.version < next.config.version) {
+        // Missed some configs, so any of this server's shards may have passed
+        // through any server whose shards changed in the meantime
+        auto changed_since_old = [&](const std::string& server) {
+            auto it = next.config.shards_changed_at.find(server);
+            return it != next.config.shards_changed_at.end() &&
+                   it->second > old_config.version;
+        };
+        if (changed_since_old(this->address)) {
+            for (auto&& [server, _] : next.config.shards_changed_at) {
+                if (!changed_since_old(server)) continue;
+                for (auto&& owned : next.owned_shards) add_incoming(server, owned);
+            }
+        }
+    }
+
+    // Give up on handoffs of ranges this server no longer owns, and on sources
+    // that never commit (e.g. because they crashed)
+    std::erase_if(this->incoming_handoffs, [&](auto&& entry) {
+        auto& handoff = entry.second;
+        bool still_owned = std::any_of(
+            handoff.shards.begin(), handoff.shards.end(), [&](const Shard& shard) {
+                return std::any_of(
+                    next.owned_shards.begin(), next.owned_shards.end(),
+                    [&](const Shard& owned) { return shards_overlap(shard, owned); });
+            });
+        return !still_owned || now - handoff.started > HANDOFF_TIMEOUT;
+    });
+    if (this->incoming_handoffs.empty()) {
+        this->handoff_written.clear();
+        this->handoff_pulled.clear();
+    } else {
+        // What happened to keys while this server last owned them says nothing
+        // about the next time it owns them
+        auto not_owned = [&](const std::string& key) {
+            std::string position = next.config.shard_key(key);
+            return std::none_of(
+                next.owned_shards.begin(), next.owned_shards.end(),
+                [&](const Shard& owned) { return owned.contains(position); });
+        };
+        std::erase_if(this->handoff_written, not_owned);
+        std::erase_if(this->handoff_pulled, not_owned);
+    }
+    this->n_incoming = this->incoming_handoffs.size();
+}
+
+void KvServer::pull_incoming(const std::vector<std::string>& keys) {
+    if (this->shardcontroller_address.empty() || this->n_incoming == 0) return;
+
+    std::vector<std::string> positions;
+    {
+        std::shared_ptr<const Routing> routing = this->routing.load();
+        for (auto&& key : keys) {
+            auto server = routing->config.get_server(key);
+            // Only pull keys this server owns
+            positions.push_back(server && *server == this->address
+                                    ? routing->config.shard_key(key)
+                                    : "");
+        }
+    }
+
+    // Group the keys that still need pulling by where they may be coming from.
+    // Even keys that are here may be stale, e.g. if they were handed off and
+    // written elsewhere before coming back.
+    std::map<std::string, std::vector<std::string>> to_pull;
+    {
+        std::unique_lock lock(this->handoff_mtx);
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (positions[i].empty() || this->handoff_written.contains(keys[i]) ||
+                this->handoff_pulled.contains(keys[i])) {
+                continue;
+            }
+            for (auto&& [source, handoff] : this->incoming_handoffs) {
+                bool incoming = std::any_of(
+                    handoff.shards.begin(), handoff.shards.end(),
+                    [&](const Shard& shard) { return shard.contains(positions[i]); });
+                if (incoming) to_pull[source].push_back(keys[i]);
+            }
+        }
+    }
+    if (to_pull.empty()) return;
+
+    // Pulled keys --> their values and times to live, and how far each source
+    // has handed off
+    std::map<std::string, std::pair<std::string, uint64_t>> pulled;
+    std::set<std::string> answered;
+    std::map<std::string, uint64_t> handed_off;
+    for (auto&& [source, source_keys] : to_pull) {
+        std::shared_ptr<ServerConn> conn = connect_to_server(source);
+        if (!conn || !set_recv_timeout(conn->fd, PULL_TIMEOUT) ||
+            !conn->send_request(PullRequest{source_keys})) {
+            continue;
+        }
+        std::optional<Response> res = conn->recv_response();
+        if (!res) continue;
+        auto* pull_res = std::get_if<PullResponse>(&*res);
+        if (!pull_res) continue;
+        answered.insert(source_keys.begin(), source_keys.end());
+        handed_off[source] = pull_res->handed_off_through;
+        for (size_t i = 0; i < pull_res->keys.size(); i++) {
+            pulled.try_emplace(pull_res->keys[i], std::move(pull_res->values[i]),
+                               pull_res->ttls_ms[i]);
+        }
+    }
+
+    // Install what we got, unless the keys were written here since. A source
+    // that doesn't have a key isn't proof that it was deleted (it may never
+    // have held it), so local copies are kept in that case.
+    std::vector<std::string> installed;
+    {
+        std::unique_lock lock(this->handoff_mtx);
+        if (this->incoming_handoffs.empty()) return;
+        // A source that has made all its handoffs up to the config this one
+        // started in, but not this one, never held the ranges: there's
+        // nothing to pull from it
+        for (auto&& [source, version] : handed_off) {
+            auto it = this->incoming_handoffs.find(source);
+            if (it == this->incoming_handoffs.end() ||
+                it->second.min_version > version) {
+                continue;
+            }
+            auto& committed = this->committed_handoffs[source];
+            committed = std::max(committed, version);
+            this->incoming_handoffs.erase(it);
+        }
+        for (auto&& key : answered) {
+            if (this->handoff_written.contains(key) ||
+                !this->handoff_pulled.insert(key).second) {
+                continue;
+            }
+            auto it = pulled.find(key);
+            if (it == pulled.end()) continue;
+            PutRequest put_req{key, it->second.first, it->second.second};
+            PutResponse put_res;
+            this->store->Put(&put_req, &put_res);
+            installed.push_back(key);
+        }
+        if (this->incoming_handoffs.empty()) {
+            this->handoff_written.clear();
+            this->handoff_pulled.clear();
+        }
+        this->n_incoming = this->incoming_handoffs.size();
+    }
+    this->replicate(installed);
+}
+
+std::unique_lock<std::mutex> KvServer::lock_for_write(
+    const std::vector<std::string>& keys) {
+    if (this->n_incoming == 0) return {};
+    std::unique_lock lock(this->handoff_mtx);
+    if (this->incoming_handoffs.empty()) return {};
+    this->handoff_written.insert(keys.begin(), keys.end());
+    return lock;
+}
+
+PullResponse KvServer::serve_pull(const PullRequest* req) {
+    // Answer from the store regardless of the config: this server keeps the
+    // keys it's handing off until the handoff commits. How far it has handed
+    // off is read first, so that it never covers a handoff made after the
+    // keys were read.
+    PullResponse res;
+    res.handed_off_through = this->handed_off_through;
+    for (auto&& key : req->keys) {
+        GetRequest get_req{key};
+        GetResponse get_res;
+        if (this->store->Get(&get_req, &get_res)) {
+            res.keys.push_back(key);
+            res.values.push_back(std::move(get_res.value));
+            res.ttls_ms.push_back(get_res.ttl_ms);
+        }
+    }
+    return res;
+}
+
+std::optional<HandoffResponse> KvServer::apply_handoff(const HandoffRequest* req) {
+    // Ownership is judged by a config at least as new as the sender's; if we
+    // can't catch up right now, the sender tries again
+    if (this->routing.load()->config.version < req->version) {
+        this->refresh_config();
+    }
+    std::shared_ptr<const Routing> routing = this->enter_routing();
+    if (routing->config.version < req->version) return std::nullopt;
+
+    HandoffResponse res;
+    std::vector<std::string> applied;
+    {
+        std::unique_lock lock(this->handoff_mtx);
+        // Each of this server's shards is a partition of the store, so the
+        // keys for one that's still empty go in as a whole
+        std::map<size_t, KvItems> by_shard;
+        for (size_t i = 0; i < req->keys.size(); i++) {
+            const std::string& key = req->keys[i];
+            auto server = routing->config.get_server(key);
+            if (!server || *server != this->address) {
+                // Moved on before the handoff arrived; the sender keeps it
+                res.rejected.push_back(key);
+                continue;
+            }
+            if (this->handoff_written.contains(key)) continue;
+            std::string position = routing->config.shard_key(key);
+            auto owned = std::find_if(
+                routing->owned_shards.begin(), routing->owned_shards.end(),
+                [&](const Shard& shard) { return shard.contains(position); });
+            KvItems& items = by_shard[owned - routing->owned_shards.begin()];
+            items.keys.push_back(key);
+            items.values.push_back(req->values[i]);
+            items.ttls_ms.push_back(req->ttls_ms[i]);
+            applied.push_back(key);
+        }
+        for (auto&& [i, items] : by_shard) {
+            this->store->AttachShard(routing->owned_shards[i], std::move(items));
+        }
+
+        auto& committed = this->committed_handoffs[req->source];
+        committed = std::max(committed, req->version);
+        auto it = this->incoming_handoffs.find(req->source);
+        if (it != this->incoming_handoffs.end() &&
+            it->second.min_version <= req->version) {
+            this->incoming_handoffs.erase(it);
+        }
+        if (this->incoming_handoffs.empty()) {
+            this->handoff_written.clear();
+            this->handoff_pulled.clear();
+        }
+        this->n_incoming = this->incoming_handoffs.size();
+    }
+    this->replicate(applied);
+    return res;
+}
+
+bool KvServer::report_load() {
+    ReportLoadRequest req{this->address, 0, {}};
+    {
+        std::shared_ptr<const Routing> routing = this->routing.load();
+        if (routing->owned_shards.empty()) return true;
+        std::unique_lock lock(this->load_mtx);
+        auto now = steady_clock::now();
+        req.window_ms = duration_cast<milliseconds>(now - this->load_window_start).count();
+        for (size_t i = 0; i < routing->owned_shards.size(); i++) {
+            // Sizes are from the last scan, which may predate the config
+            uint64_t bytes = this->shard_bytes.size() == routing->owned_shards.size()
+                                 ? this->shard_bytes[i]
+                                 : 0;
+            req.loads.push_back(ShardLoad{routing->owned_shards[i],
+                                          routing->shard_hits[i].exchange(0), bytes});
+        }
+        this->load_window_start = now;
+    }
+    req.stats = this->hot_keys.stats();
+
+    if (!this->shardcontroller_querier_conn->send_request(req)) return false;
+    std::optional<Response> res = this->shardcontroller_querier_conn->recv_response();
+    if (!res) return false;
+    return std::get_if<ReportLoadResponse>(&*res) != nullptr;
+}
+
+void KvServer::replicate(const std::vector<std::string>& keys) {
+    this->leases.revoke(keys);
+    std::shared_ptr<const Routing> routing = this->routing.load();
+    auto it = routing->config.server_to_backups.find(this->address);
+    if (it == routing->config.server_to_backups.end()) return;
+    this->replicate(it->second, keys);
+}
+
+void KvServer::replicate(const std::vector<std::string>& backups,
+                         const std::vector<std::string>& keys) {
+    if (backups.empty() || keys.empty()) return;
+    std::unique_lock lock(this->replication_mtx);
+    for (auto&& backup : backups) {
+        this->pending_replication[backup].insert(keys.begin(), keys.end());
+    }
+    this->replication_cv.notify_one();
+}
+
+void KvServer::replicate_loop() {
+    while (!this->is_stopped) {
+        std::vector<std::string> backups;
+        {
+            std::shared_ptr<const Routing> routing = this->routing.load();
+            if (auto it = routing->config.server_to_backups.find(this->address);
+                it != routing->config.server_to_backups.end()) {
+                backups = it->second;
+            }
+        }
+
+        for (auto&& backup : backups) {
+            // Take up to REPLICATION_WINDOW batches of pending keys. Only the
+            // current value of each key is shipped, so a key written many
+            // times since the last batch is sent once.
+            std::vector<ReplicateRequest> batches;
+            {
+                std::unique_lock lock(this->replication_mtx);
+                auto& pending = this->pending_replication[backup];
+                do {
+                    ReplicateRequest batch{this->address, {}, {}, {}, {}, false};
+                    while (!pending.empty() &&
+                           batch.keys.size() < REPLICATION_BATCH_SIZE) {
+                        batch.keys.push_back(
+                            std::move(pending.extract(pending.begin()).value()));
+                    }
+                    batch.caught_up = pending.empty();
+                    batches.push_back(std::move(batch));
+                } while (!pending.empty() && batches.size() < REPLICATION_WINDOW);
+            }
+            for (auto&& batch : batches) {
+                for (auto&& key : batch.keys) {
+                    GetRequest get_req{key};
+                    GetResponse get_res;
+                    bool exists = this->store->Get(&get_req, &get_res);
+                    batch.values.push_back(exists ? std::move(get_res.value) : "");
+                    batch.ttls_ms.push_back(exists ? get_res.ttl_ms : 0);
+                    batch.deleted.push_back(!exists);
+                }
+            }
+
+            // Pipeline the batches: send all of them, then collect the
+            // responses, which come back in order. A connection ties up one of
+            // the backup's workers for as long as it's open, so only keep it
+            // for this round.
+            std::shared_ptr<ServerConn> conn = connect_to_server(backup);
+            size_t n_sent = 0;
+            while (conn && n_sent < batches.size() &&
+                   conn->send_request(batches[n_sent])) {
+                n_sent++;
+            }
+            size_t n_acked = 0;
+            while (conn && n_acked < n_sent) {
+                std::optional<Response> res = conn->recv_response();
+                if (!res || !std::get_if<ReplicateResponse>(&*res)) break;
+                n_acked++;
+            }
+
+            if (conn) conn->shutdown();
+
+            // Anything not acknowledged is retried next round
+            if (n_acked < batches.size()) {
+                std::unique_lock lock(this->replication_mtx);
+                for (size_t i = n_acked; i < batches.size(); i++) {
+                    this->pending_replication[backup].insert(
+                        batches[i].keys.begin(), batches[i].keys.end());
+                }
+            }
+        }
+
+        std::unique_lock lock(this->replication_mtx);
+        this->replication_cv.wait_for(lock, REPLICATION_HEARTBEAT, [&] {
+            if (this->is_stopped) return true;
+            for (auto&& [_, pending] : this->pending_replication) {
+                if (!pending.empty()) return true;
+            }
+            return false;
+        });
+    }
+}
+
+bool KvServer::apply_replicate(const ReplicateRequest* req) {
+    if (!this->routing.load()->config.is_backup(req->primary, this->address)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < req->keys.size(); i++) {
+        if (req->deleted[i]) {
+            DeleteRequest delete_req{req->keys[i]};
+            DeleteResponse delete_res;
+            this->store->Delete(&delete_req, &delete_res);
+        } else {
+            PutRequest put_req{req->keys[i], req->values[i], req->ttls_ms[i]};
+            PutResponse put_res;
+            this->store->Put(&put_req, &put_res);
+        }
+    }
+
+    if (req->caught_up) {
+        std::unique_lock lock(this->replication_mtx);
+        this->caught_up_at[req->primary] = steady_clock::now();
+    }
+    return true;
+}
+
+bool KvServer::fresh_replica_for(const std::string& key,
+                                 milliseconds max_staleness) {
+    if (this->shardcontroller_address.empty()) return false;
+
+    std::string primary;
+    {
+        std::shared_ptr<const Routing> routing = this->routing.load();
+        auto server = routing->config.get_server(key);
+        if (!server || !routing->config.is_backup(*server, this->address)) {
+            return false;
+        }
+        primary = *server;
+    }
+
+    std::unique_lock lock(this->replication_mtx);
+    auto it = this->caught_up_at.find(primary);
+    return it != this->caught_up_at.end() &&
+           steady_clock::now() - it->second <= max_staleness;
+}
+
 /* ==================================================*/
 /* === INTERNALS: DO NOT MODIFY BELOW THIS LINE ===  */
 /* ==================================================*/
@@ -242,6 +872,7 @@ void KvServer::accept_clients_loop() {
         this->conn_queue_mtxs[next_worker].lock();
         this->conn_queues[next_worker].push_back(client);
         this->conn_queue_mtxs[next_worker].unlock();
+        this->conn_queue_cvs[next_worker].notify_one();
         next_worker = (next_worker + 1) % this->n_workers;
     }
 }
@@ -252,15 +883,17 @@ void KvServer::work_loop(size_t worker_id) {
     // requests until the client closes the connection.
     while (!this->is_stopped) {
         std::shared_ptr<ClientConn> client;
-        // if this returns false, queue stopped
-        this->conn_queue_mtxs[worker_id].lock();
-        if (!this->conn_queues[worker_id].empty()) {
+        {
+            // Sleep until a connection arrives (or the server stops)
+            std::unique_lock lock(this->conn_queue_mtxs[worker_id]);
+            this->conn_queue_cvs[worker_id].wait(lock, [&] {
+                return this->is_stopped || !this->conn_queues[worker_id].empty();
+            });
+            if (this->conn_queues[worker_id].empty()) {
+                continue;
+            }
             client = this->conn_queues[worker_id].front();
             this->conn_queues[worker_id].pop_front();
-            this->conn_queue_mtxs[worker_id].unlock();
-        } else {
-            this->conn_queue_mtxs[worker_id].unlock();
-            continue;
         }
 
         while (true) {
@@ -282,101 +915,562 @@ void KvServer::work_loop(size_t worker_id) {
     }
 }
 
-bool KvServer::responsible_for(const std::string& key) {
+void KvServer::udp_loop() {
+    // One batch's datagrams and replies, with their headers for recvmmsg and
+    // sendmmsg. Received datagrams are shrunk to their length to be read, but
+    // keep their capacity, so the buffers never move.
+    std::vector<std::vector<std::byte>> in(UDP_BATCH_SIZE), out(UDP_BATCH_SIZE);
+    std::vector<sockaddr_storage> from(UDP_BATCH_SIZE);
+    std::vector<iovec> in_iovs(UDP_BATCH_SIZE), out_iovs(UDP_BATCH_SIZE);
+    std::vector<mmsghdr> in_hdrs(UDP_BATCH_SIZE), out_hdrs(UDP_BATCH_SIZE);
+    for (size_t i = 0; i < UDP_BATCH_SIZE; i++) {
+        in[i].resize(MAX_DATAGRAM_SIZE);
+        in_iovs[i] = {in[i].data(), MAX_DATAGRAM_SIZE};
+    }
+
+    while (!this->is_stopped) {
+        for (size_t i = 0; i < UDP_BATCH_SIZE; i++) {
+            in_hdrs[i] = {};
+            in_hdrs[i].msg_hdr.msg_name = &from[i];
+            in_hdrs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+            in_hdrs[i].msg_hdr.msg_iov = &in_iovs[i];
+            in_hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+        // Wait for a datagram, then take whatever else has arrived with it
+        int n_in = recvmmsg(this->udp_fd, in_hdrs.data(), UDP_BATCH_SIZE,
+                            MSG_WAITFORONE, nullptr);
+        if (n_in <= 0) continue;
+
+        size_t n_out = 0;
+        for (int i = 0; i < n_in; i++) {
+            // Anything that isn't a whole request is dropped unanswered
+            uint64_t id;
+            std::optional<Message> msg;
+            in[i].resize(in_hdrs[i].msg_len);
+            bool parsed = read_datagram(in[i], &id, &msg) && msg;
+            in[i].resize(MAX_DATAGRAM_SIZE);
+            if (!parsed) continue;
+            std::optional<Request> req = deserialize_request(std::move(*msg));
+            if (!req) continue;
+
+            Response res = ErrorResponse{
+                "only Get and MultiGet requests are served over UDP"};
+            if (std::holds_alternative<GetRequest>(*req) ||
+                std::holds_alternative<MultiGetRequest>(*req)) {
+                res = this->process_request(std::move(*req));
+            }
+            if (auto* error_res = std::get_if<ErrorResponse>(&res)) {
+                cerr_color(RED, "Request on server ", this->address,
+                           " failed: ", error_res->msg);
+            }
+            std::optional<Message> res_msg = serialize_response(res);
+            if (!res_msg) continue;
+            write_datagram(out[n_out], id, &*res_msg);
+            if (out[n_out].size() > MAX_DATAGRAM_SIZE) {
+                write_datagram(out[n_out], id, nullptr);
+            }
+
+            out_iovs[n_out] = {out[n_out].data(), out[n_out].size()};
+            out_hdrs[n_out] = {};
+            out_hdrs[n_out].msg_hdr.msg_name = &from[i];
+            out_hdrs[n_out].msg_hdr.msg_namelen = in_hdrs[i].msg_hdr.msg_namelen;
+            out_hdrs[n_out].msg_hdr.msg_iov = &out_iovs[n_out];
+            out_hdrs[n_out].msg_hdr.msg_iovlen = 1;
+            n_out++;
+        }
+
+        // A reply that can't be sent is skipped; its client will ask again
+        for (size_t sent = 0; sent < n_out;) {
+            int curr = sendmmsg(this->udp_fd, out_hdrs.data() + sent,
+                                n_out - sent, 0);
+            sent += curr > 0 ? curr : 1;
+        }
+    }
+}
+
+bool KvServer::responsible_for(const Routing& routing, const std::string& key) {
     // For Concurrent Store, no shardcontroller exists, so no-op
     if (this->shardcontroller_address.empty()) return true;
 
-    std::shared_lock lock(this->config_mtx);
-    auto server = this->config.get_server(key);
+    auto server = routing.config.get_server(key);
     if (!server) return false;
-    return *server == this->address;
+    if (*server != this->address) return false;
+    this->record_hit(routing, key);
+    return true;
 }
 
-bool KvServer::responsible_for(const std::vector<std::string>& keys) {
+bool KvServer::responsible_for(const Routing& routing,
+                               const std::vector<std::string>& keys) {
     // For Concurrent Store, no shardcontroller exists, so no-op
     if (this->shardcontroller_address.empty()) return true;
 
-    std::shared_lock lock(this->config_mtx);
     for (auto&& k : keys) {
-        auto server = this->config.get_server(k);
+        auto server = routing.config.get_server(k);
         if (!server) return false;
         if (*server != this->address) return false;
     }
+    for (auto&& k : keys) this->record_hit(routing, k);
     return true;
 }
 
+void KvServer::record_hit(const Routing& routing, const std::string& key) {
+    std::string position = routing.config.shard_key(key);
+    for (size_t i = 0; i < routing.owned_shards.size(); i++) {
+        if (routing.owned_shards[i].contains(position)) {
+            routing.shard_hits[i].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+// Returns the keys a client request reads or writes.
+static std::vector<std::string> request_keys(const Request& req) {
+    if (auto* get_req = std::get_if<GetRequest>(&req)) return {get_req->key};
+    if (auto* lease_req = std::get_if<LeaseGetRequest>(&req)) {
+        return {lease_req->key};
+    }
+    if (auto* get_stream_req = std::get_if<GetStreamRequest>(&req)) {
+        return {get_stream_req->key};
+    }
+    if (auto* put_req = std::get_if<PutRequest>(&req)) return {put_req->key};
+    if (auto* put_stream_req = std::get_if<PutStreamRequest>(&req)) {
+        return {put_stream_req->key};
+    }
+    if (auto* append_req = std::get_if<AppendRequest>(&req)) {
+        return {append_req->key};
+    }
+    if (auto* delete_req = std::get_if<DeleteRequest>(&req)) {
+        return {delete_req->key};
+    }
+    if (auto* multiget_req = std::get_if<MultiGetRequest>(&req)) {
+        return multiget_req->keys;
+    }
+    if (auto* multiput_req = std::get_if<MultiPutRequest>(&req)) {
+        return multiput_req->keys;
+    }
+    if (auto* cas_req = std::get_if<CompareAndSwapRequest>(&req)) {
+        return {cas_req->key};
+    }
+    if (auto* incr_req = std::get_if<IncrementRequest>(&req)) {
+        return {incr_req->key};
+    }
+    if (auto* pia_req = std::get_if<PutIfAbsentRequest>(&req)) {
+        return {pia_req->key};
+    }
+    if (auto* die_req = std::get_if<DeleteIfEqualsRequest>(&req)) {
+        return {die_req->key};
+    }
+    return {};
+}
+
+std::shared_ptr<const KvServer::Routing> KvServer::prepare_keys(
+    const Request& req) {
+    std::vector<std::string> keys = request_keys(req);
+    if (keys.empty()) return nullptr;
+    // Bulk loads don't say anything about which keys are hot
+    auto* multiput_req = std::get_if<MultiPutRequest>(&req);
+    if (!multiput_req || !multiput_req->bulk) {
+        for (auto&& key : keys) this->hot_keys.record(key);
+    }
+    if (this->shardcontroller_address.empty()) return this->enter_routing();
+
+    // A client with a newer config than ours: catch up instead of turning the
+    // request away
+    std::shared_ptr<const Routing> current = this->routing.load();
+    bool owned = std::all_of(keys.begin(), keys.end(), [&](auto&& key) {
+        auto server = current->config.get_server(key);
+        return server && *server == this->address;
+    });
+    current.reset();
+    auto* get_req = std::get_if<GetRequest>(&req);
+    if (!owned && !(get_req && get_req->max_staleness_ms > 0)) {
+        this->refresh_config();
+    }
+
+    // Keys in ranges still being handed off may only be up to date at the
+    // previous owner
+    this->pull_incoming(keys);
+    return this->enter_routing();
+}
+
+std::shared_ptr<const KvServer::Routing> KvServer::enter_routing() {
+    while (true) {
+        std::shared_ptr<const Routing> routing = this->routing.load();
+        routing->in_flight++;
+        // A config published before the count went up may not have waited
+        // for this request
+        if (this->routing.load() == routing) {
+            const Routing* entered = routing.get();
+            return std::shared_ptr<const Routing>(
+                entered, [routing = std::move(routing)](const Routing*) {
+                    routing->in_flight--;
+                });
+        }
+        routing->in_flight--;
+    }
+}
+
 Response KvServer::process_request(Request req) {
+    std::shared_ptr<const Routing> routing = this->prepare_keys(req);
     Response res;
     if (auto* get_req = std::get_if<GetRequest>(&req)) {
-        bool responsible = this->responsible_for(get_req->key);
+        // Backups may serve reads that tolerate some staleness
+        bool responsible =
+            this->responsible_for(*routing, get_req->key) ||
+            (get_req->max_staleness_ms > 0 &&
+             this->fresh_replica_for(get_req->key,
+                                     milliseconds(get_req->max_staleness_ms)));
         GetResponse get_res;
         if (responsible && this->store->Get(get_req, &get_res)) {
             res = get_res;
         } else {
             res = ErrorResponse{
-                !responsible ? std::string("server not responsible for key")
+                !responsible ? std::string(NOT_RESPONSIBLE_ERROR)
+                : std::string("key does not exist in the KVStore")};
+        }
+    } else if (auto* lease_req = std::get_if<LeaseGetRequest>(&req)) {
+        bool responsible = this->responsible_for(*routing, lease_req->key);
+        // Leased before the read, so that a write racing with the read is sure
+        // to revoke the lease
+        std::optional<LeaseTable::Grant> grant;
+        if (responsible) {
+            grant = this->leases.grant(lease_req->key, lease_req->epoch,
+                                       lease_req->since);
+        }
+        GetRequest get_req{lease_req->key};
+        GetResponse get_res;
+        if (grant && this->store->Get(&get_req, &get_res)) {
+            // Keys that expire sooner aren't cached past their expiry
+            uint64_t lease_ms = grant->duration.count();
+            if (get_res.ttl_ms > 0) {
+                lease_ms = std::min(lease_ms, get_res.ttl_ms);
+            }
+            res = LeaseGetResponse{std::move(get_res.value), lease_ms,
+                                   grant->epoch, grant->seq,
+                                   std::move(grant->revoked), grant->flush};
+        } else {
+            res = ErrorResponse{
+                !responsible ? std::string(NOT_RESPONSIBLE_ERROR)
+                : std::string("key does not exist in the KVStore")};
+        }
+    } else if (auto* get_stream_req = std::get_if<GetStreamRequest>(&req)) {
+        bool responsible = this->responsible_for(*routing, get_stream_req->key);
+        GetStreamResponse get_stream_res;
+        if (responsible &&
+            this->store->GetRange(get_stream_req, &get_stream_res)) {
+            res = std::move(get_stream_res);
+        } else {
+            res = ErrorResponse{
+                !responsible ? std::string(NOT_RESPONSIBLE_ERROR)
                 : std::string("key does not exist in the KVStore")};
         }
     } else if (auto* put_req = std::get_if<PutRequest>(&req)) {
-        bool responsible = this->responsible_for(put_req->key);
+        bool responsible = this->responsible_for(*routing, put_req->key);
         PutResponse put_res;
-        if (responsible && this->store->Put(put_req, &put_res)) {
+        bool ok = false;
+        if (responsible) {
+            auto write_lock = this->lock_for_write({put_req->key});
+            ok = this->store->Put(put_req, &put_res);
+        }
+        if (ok) {
+            this->replicate({put_req->key});
             res = put_res;
         } else {
             // Put should never fail
             res = ErrorResponse{!responsible
-                                ? std::string("server not responsible for key")
+                                ? std::string(NOT_RESPONSIBLE_ERROR)
                                 : std::string("internal KVStore error")};
         }
+    } else if (auto* put_stream_req = std::get_if<PutStreamRequest>(&req)) {
+        // Each chunk goes straight into the value being assembled, which is
+        // only written to the store once it's complete
+        bool responsible = this->responsible_for(*routing, put_stream_req->key);
+        uint64_t id = put_stream_req->stream_id;
+        if (responsible && id == 0 && put_stream_req->offset == 0) {
+            id = this->streams.open(put_stream_req->key,
+                                    put_stream_req->total_size);
+        }
+        std::optional<uint64_t> received;
+        if (responsible) {
+            received = this->streams.append(id, put_stream_req->key,
+                                            put_stream_req->offset,
+                                            put_stream_req->chunk);
+        }
+        std::optional<std::string> value;
+        if (received && put_stream_req->last) value = this->streams.close(id);
+        bool ok = received && (!put_stream_req->last || value);
+        if (value) {
+            PutRequest put_req{put_stream_req->key, std::move(*value),
+                               put_stream_req->ttl_ms};
+            PutResponse put_res;
+            {
+                auto write_lock = this->lock_for_write({put_req.key});
+                ok = this->store->Put(&put_req, &put_res);
+            }
+            if (ok) this->replicate({put_req.key});
+        } else if (!ok) {
+            // The client starts over, so what it sent so far is of no use
+            this->streams.close(id);
+        }
+        if (ok) {
+            res = PutStreamResponse{id, *received};
+        } else {
+            res = ErrorResponse{
+                !responsible ? std::string(NOT_RESPONSIBLE_ERROR)
+                : !received  ? std::string("no stream of the key at that offset")
+                             : std::string("internal KVStore error")};
+        }
     } else if (auto* append_req = std::get_if<AppendRequest>(&req)) {
-        bool responsible = this->responsible_for(append_req->key);
+        bool responsible = this->responsible_for(*routing, append_req->key);
         AppendResponse append_res;
-        if (responsible && this->store->Append(append_req, &append_res)) {
+        bool ok = false;
+        if (responsible) {
+            auto write_lock = this->lock_for_write({append_req->key});
+            ok = this->store->Append(append_req, &append_res);
+        }
+        if (ok) {
+            this->replicate({append_req->key});
             res = append_res;
         } else {
             res = ErrorResponse{!responsible
-                                ? std::string("server not responsible for key")
+                                ? std::string(NOT_RESPONSIBLE_ERROR)
                                 : std::string("internal KVStore error")};
         }
     } else if (auto* delete_req = std::get_if<DeleteRequest>(&req)) {
-        bool responsible = this->responsible_for(delete_req->key);
+        bool responsible = this->responsible_for(*routing, delete_req->key);
         DeleteResponse delete_res;
-        if (responsible && this->store->Delete(delete_req, &delete_res)) {
+        bool ok = false;
+        if (responsible) {
+            auto write_lock = this->lock_for_write({delete_req->key});
+            ok = this->store->Delete(delete_req, &delete_res);
+        }
+        if (ok) {
+            this->replicate({delete_req->key});
             res = delete_res;
         } else {
             res = ErrorResponse{
-                !responsible ? std::string("server not responsible for key")
+                !responsible ? std::string(NOT_RESPONSIBLE_ERROR)
                 : std::string("key does not exist in the KVStore")};
         }
     } else if (auto* multiget_req = std::get_if<MultiGetRequest>(&req)) {
-        bool responsible = this->responsible_for(multiget_req->keys);
+        bool responsible = this->responsible_for(*routing, multiget_req->keys);
         MultiGetResponse multiget_res;
         if (responsible && this->store->MultiGet(multiget_req, &multiget_res)) {
             res = multiget_res;
         } else {
             res = ErrorResponse{
-                !responsible ? std::string("server not responsible for key(s)")
+                !responsible ? std::string(NOT_RESPONSIBLE_ERROR "(s)")
                 : std::string("key(s) do not exist in the KVStore")};
         }
     } else if (auto* multiput_req = std::get_if<MultiPutRequest>(&req)) {
-        bool responsible = this->responsible_for(multiput_req->keys);
+        bool responsible = this->responsible_for(*routing, multiput_req->keys);
         MultiPutResponse multiput_res;
-        if (responsible && this->store->MultiPut(multiput_req, &multiput_res)) {
+        bool ok = false;
+        if (responsible) {
+            auto write_lock = this->lock_for_write(multiput_req->keys);
+            ok = this->store->MultiPut(multiput_req, &multiput_res);
+        }
+        if (ok) {
+            this->replicate(multiput_req->keys);
             res = multiput_res;
         } else {
             res = ErrorResponse{!responsible
-                                ? std::string("server not responsible for key(s)")
+                                ? std::string(NOT_RESPONSIBLE_ERROR "(s)")
+                                : std::string("internal KVStore error")};
+        }
+    } else if (auto* cas_req = std::get_if<CompareAndSwapRequest>(&req)) {
+        bool responsible = this->responsible_for(*routing, cas_req->key);
+        CompareAndSwapResponse cas_res;
+        bool ok = false;
+        if (responsible) {
+            auto write_lock = this->lock_for_write({cas_req->key});
+            ok = this->store->CompareAndSwap(cas_req, &cas_res);
+        }
+        if (ok) {
+            // Nothing to replicate if the condition didn't hold
+            if (cas_res.swapped) this->replicate({cas_req->key});
+            res = cas_res;
+        } else {
+            res = ErrorResponse{!responsible
+                                ? std::string(NOT_RESPONSIBLE_ERROR)
+                                : std::string("internal KVStore error")};
+        }
+    } else if (auto* incr_req = std::get_if<IncrementRequest>(&req)) {
+        bool responsible = this->responsible_for(*routing, incr_req->key);
+        IncrementResponse incr_res;
+        bool ok = false;
+        if (responsible) {
+            auto write_lock = this->lock_for_write({incr_req->key});
+            ok = this->store->Increment(incr_req, &incr_res);
+        }
+        if (ok) {
+            this->replicate({incr_req->key});
+            res = incr_res;
+        } else {
+            res = ErrorResponse{!responsible
+                                ? std::string(NOT_RESPONSIBLE_ERROR)
+                                : std::string("value is not an integer or would overflow")};
+        }
+    } else if (auto* pia_req = std::get_if<PutIfAbsentRequest>(&req)) {
+        bool responsible = this->responsible_for(*routing, pia_req->key);
+        PutIfAbsentResponse pia_res;
+        bool ok = false;
+        if (responsible) {
+            auto write_lock = this->lock_for_write({pia_req->key});
+            ok = this->store->PutIfAbsent(pia_req, &pia_res);
+        }
+        if (ok) {
+            if (pia_res.inserted) this->replicate({pia_req->key});
+            res = pia_res;
+        } else {
+            res = ErrorResponse{!responsible
+                                ? std::string(NOT_RESPONSIBLE_ERROR)
                                 : std::string("internal KVStore error")};
         }
+    } else if (auto* die_req = std::get_if<DeleteIfEqualsRequest>(&req)) {
+        bool responsible = this->responsible_for(*routing, die_req->key);
+        DeleteIfEqualsResponse die_res;
+        bool ok = false;
+        if (responsible) {
+            auto write_lock = this->lock_for_write({die_req->key});
+            ok = this->store->DeleteIfEquals(die_req, &die_res);
+        }
+        if (ok) {
+            if (die_res.deleted) this->replicate({die_req->key});
+            res = die_res;
+        } else {
+            res = ErrorResponse{!responsible
+                                ? std::string(NOT_RESPONSIBLE_ERROR)
+                                : std::string("internal KVStore error")};
+        }
+    } else if (auto* purge_req = std::get_if<GDPRPurgeRequest>(&req)) {
+        res = this->gdpr_purge(purge_req);
+    } else if (std::get_if<StatsRequest>(&req)) {
+        res = this->hot_keys.stats();
+    } else if (auto* replicate_req = std::get_if<ReplicateRequest>(&req)) {
+        if (this->apply_replicate(replicate_req)) {
+            res = ReplicateResponse{};
+        } else {
+            res = ErrorResponse{"server is not a backup for " +
+                                replicate_req->primary};
+        }
+    } else if (auto* pull_req = std::get_if<PullRequest>(&req)) {
+        res = this->serve_pull(pull_req);
+    } else if (auto* handoff_req = std::get_if<HandoffRequest>(&req)) {
+        if (auto handoff_res = this->apply_handoff(handoff_req)) {
+            res = *handoff_res;
+        } else {
+            res = ErrorResponse{"server is behind the handoff's config"};
+        }
     } else {
         throw std::logic_error{"invalid variant!"};
     }
     return res;
 }
 
+// Removes the identifiers in `terms` from `value`. From a value that's just a
+// comma-separated list of names (like "user_1,user_2") matching items are
+// dropped; anywhere else, each mention is replaced with "[deleted]".
+static std::string redact(const std::string& value,
+                          const std::set<std::string>& terms) {
+    auto is_word = [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    };
+    bool is_list = std::all_of(value.begin(), value.end(), [&](char c) {
+        return is_word(c) || c == ',';
+    });
+    if (is_list) {
+        std::string kept;
+        for (auto&& item : split(value, ',')) {
+            if (terms.contains(item)) continue;
+            if (!kept.empty()) kept += ',';
+            kept += item;
+        }
+        return kept;
+    }
+
+    std::string redacted;
+    size_t i = 0;
+    while (i < value.size()) {
+        size_t start = i;
+        while (i < value.size() && is_word(value[i])) i++;
+        if (i == start) {
+            redacted += value[i++];
+            continue;
+        }
+        std::string word = value.substr(start, i - start);
+        redacted += terms.contains(word) ? "[deleted]" : word;
+    }
+    return redacted;
+}
+
+GDPRPurgeResponse KvServer::gdpr_purge(const GDPRPurgeRequest* req) {
+    // Each key is checked against the latest config just before it's purged,
+    // and stays in flight under it until it is (as for a client request), so
+    // that a key whose shard moves away meanwhile is left to its new owner
+    auto owned = [&](const Routing& routing, const std::string& key) {
+        if (this->shardcontroller_address.empty()) return true;
+        auto server = routing.config.get_server(key);
+        return server && *server == this->address;
+    };
+
+    GDPRPurgeResponse res;
+    for (auto&& key : req->keys) {
+        std::shared_ptr<const Routing> routing = this->enter_routing();
+        if (!owned(*routing, key)) continue;
+        auto write_lock = this->lock_for_write({key});
+        DeleteRequest delete_req{key};
+        DeleteResponse delete_res;
+        if (this->store->Delete(&delete_req, &delete_res)) {
+            res.deleted.push_back(key);
+        }
+    }
+    if (!res.deleted.empty()) this->replicate(res.deleted);
+
+    // Everything else that mentions the user or one of their records
+    std::set<std::string> terms(req->keys.begin(), req->keys.end());
+    terms.insert(req->user);
+    std::set<std::string> mentioning;
+    for (auto&& term : terms) {
+        for (auto&& key : this->store->Referencing(term)) {
+            if (!terms.contains(key)) mentioning.insert(key);
+        }
+    }
+    for (auto&& key : mentioning) {
+        std::shared_ptr<const Routing> routing = this->enter_routing();
+        if (!owned(*routing, key)) continue;
+        auto write_lock = this->lock_for_write({key});
+        // Retry if a client writes the key in between, so its write can't
+        // bring back a mention
+        while (true) {
+            GetRequest get_req{key};
+            GetResponse get_res;
+            if (!this->store->Get(&get_req, &get_res)) break;
+            std::string redacted = redact(get_res.value, terms);
+            if (redacted == get_res.value) break;
+
+            CompareAndSwapRequest cas_req{key, get_res.value, redacted};
+            CompareAndSwapResponse cas_res;
+            this->store->CompareAndSwap(&cas_req, &cas_res);
+            if (cas_res.swapped) {
+                res.redacted.push_back(key);
+                break;
+            }
+        }
+    }
+    if (!res.redacted.empty()) this->replicate(res.redacted);
+    return res;
+}
+
 void KvServer::process_config_loop() {
     int failure_count = 0;
+    size_t round = 0;
     while (!this->is_stopped) {
+        // Report load about once a second; if a report is lost, the
+        // shardcontroller just sees no load from this server until the next one
+        if (++round % 4 == 0) {
+            this->report_load();
+        }
         if (this->process_config()) {
             failure_count = 0;
         } else {
@@ -393,20 +1487,18 @@ void KvServer::process_config_loop() {
 }
 
 ShardControllerConfig KvServer::get_config() {
-    return this->config;
+    return this->routing.load()->config;
 }
 
 std::map<std::string, std::string> KvServer::all_kvpairs() {
-    auto keys = this->store->AllKeys();
+    auto snapshot = this->store->TakeSnapshot();
     std::map<std::string, std::string> map;
-    for (auto&& k : keys) {
-        auto req = GetRequest{k};
-        auto res = GetResponse{};
-        // Only add if key still exists
-        if (this->store->Get(&req, &res)) {
-            map[k] = res.value;
+    while (true) {
+        KvItems items = snapshot->Next(SNAPSHOT_BATCH_SIZE);
+        if (items.keys.empty()) break;
+        for (size_t i = 0; i < items.keys.size(); i++) {
+            map[std::move(items.keys[i])] = std::move(items.values[i]);
         }
     }
-
     return map;
 }
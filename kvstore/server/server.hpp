@@ -1,13 +1,17 @@
 #ifndef KVSERVER_HPP
 #define KVSERVER_HPP
 
+#include <algorithm>
 #include <array>
+#include <cctype>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <shared_mutex>
 #include <string>
 #include <thread>
@@ -19,21 +23,58 @@
 #include "net/network_conn.hpp"
 #include "net/network_helpers.hpp"
 #include "net/network_messages.hpp"
+#include "server/hot_keys.hpp"
+#include "server/leases.hpp"
+#include "server/streams.hpp"
 
 #define N_WORKERS 5
 
+// Replication stream tuning: at most this many keys per Replicate batch, at
+// most this many batches in flight per backup, and how often an idle primary
+// tells its backups they're caught up.
+#define REPLICATION_BATCH_SIZE 256
+#define REPLICATION_WINDOW 4
+#define REPLICATION_HEARTBEAT 100ms
+
+// Shard handoffs: how long a server waits for the previous owner of a shard it
+// took over to commit the handoff before giving up on it, how long a request
+// for a key the server doesn't own waits for the config to refresh, and how
+// long a pull waits on a previous owner (whose workers may all be busy pulling
+// from this server) before serving the request without it.
+#define HANDOFF_TIMEOUT 5000ms
+#define CONFIG_REFRESH_WAIT 500ms
+#define PULL_TIMEOUT 250ms
+
+// The UDP fast path (see KvServer's `udp`): how many threads read datagrams
+// from its socket, and at most how many each takes in (and answers) per system
+// call. Waiting threads check this often whether the server has stopped.
+#define UDP_WORKERS 2
+#define UDP_BATCH_SIZE 32
+#define UDP_POLL_INTERVAL 100ms
+
 using namespace std::chrono;
 
 class KvServer {
  public:
-  explicit KvServer(const std::string& address, uint64_t n_workers)
-      : address(address), shardcontroller_address(), n_workers(n_workers) {
+  // With `udp`, the server also serves Gets and MultiGets sent as datagrams
+  // (see UdpClient) on the same port, without the cost of a connection's
+  // framing and a system call per message on each side: datagrams are taken in
+  // and answered in batches. Responses that don't fit in a datagram are
+  // replaced by a reply telling the client to ask over TCP.
+  explicit KvServer(const std::string& address, uint64_t n_workers,
+                    bool udp = false)
+      : address(address),
+        shardcontroller_address(),
+        n_workers(n_workers),
+        udp(udp) {
   }
   explicit KvServer(const std::string& address,
-                    const std::string& shardcontroller_addr, uint64_t n_workers)
+                    const std::string& shardcontroller_addr, uint64_t n_workers,
+                    bool udp = false)
       : address(address),
         shardcontroller_address(shardcontroller_addr),
-        n_workers(n_workers) {
+        n_workers(n_workers),
+        udp(udp) {
   }
   ~KvServer() {
     if (!this->is_stopped) {
@@ -50,9 +91,8 @@ class KvServer {
 
   bool Leave();
 
-  // For debugging purposes, get all key-value pairs from the store. Note that
-  // this operation is not atomic; do not attempt to use this to atomically
-  // retrieve key-value pairs!
+  // For debugging purposes, get all key-value pairs from the store, as of a
+  // single point in time (read from a snapshot, without holding up writes)
   std::map<std::string, std::string> all_kvpairs();
 
   // For debugging purposes, get the shardcontroller config from the server.
@@ -81,14 +121,83 @@ class KvServer {
   // Persistent shardcontroller connection.
   std::shared_ptr<ServerConn> shardcontroller_conn;
 
-  // Shardcontroller configuration.
-  ShardControllerConfig config;
-
-  // mutex to synchronize access to the config
-  std::shared_mutex config_mtx;
+  // Shardcontroller configuration, with this server's shards in it and the
+  // number of requests for each of them since the last load report. Every
+  // processed config is published as a new immutable snapshot, so requests
+  // read it without locking. A request that checks and accesses its keys
+  // counts itself in flight under its snapshot meanwhile (see enter_routing),
+  // which process_config waits out before migrating keys (see sync_config).
+  struct Routing {
+    ShardControllerConfig config;
+    std::vector<Shard> owned_shards;
+    mutable std::deque<std::atomic<uint64_t>> shard_hits;
+    mutable std::atomic<size_t> in_flight = 0;
+  };
+  std::atomic<std::shared_ptr<const Routing>> routing{
+      std::make_shared<const Routing>()};
 
   // END of fields you need for process_config
 
+  // Rest of the load accounting for the shardcontroller's rebalancer: bytes
+  // stored per owned shard as of the last process_config, and when the
+  // current load window started. Protected by load_mtx.
+  std::vector<uint64_t> shard_bytes;
+  steady_clock::time_point load_window_start = steady_clock::now();
+  std::mutex load_mtx;
+
+  // The keys client requests access most, for Stats requests and load reports
+  HotKeyTracker hot_keys;
+
+  // Leases on keys read into clients' near caches, revoked by writes
+  LeaseTable leases;
+
+  // Values clients are streaming in, until their last chunks arrive
+  StreamTable streams;
+
+  // Primary-backup replication. As a primary, keys changed since they were
+  // last shipped to each backup; as a backup, when each primary's stream was
+  // last caught up. Both are protected by replication_mtx.
+  std::map<std::string, std::set<std::string>> pending_replication;
+  std::map<std::string, steady_clock::time_point> caught_up_at;
+  std::mutex replication_mtx;
+  std::condition_variable replication_cv;
+  // Thread that streams pending changes to this server's backups.
+  std::thread replicator;
+
+  // Shard handoffs into this server. While the previous owner (source) of a
+  // range this server took over hasn't committed the handoff, keys in that
+  // range are pulled from it on demand, once each. Keys written or deleted
+  // here in the meantime are recorded, so that the source's older copies
+  // don't overwrite them. Protected by handoff_mtx; n_incoming mirrors
+  // incoming_handoffs.size() so that writes can skip the lock when idle.
+  struct Handoff {
+    std::vector<Shard> shards;
+    // Commits for configs older than this are from earlier handoffs
+    uint64_t min_version;
+    steady_clock::time_point started;
+  };
+  std::map<std::string, Handoff> incoming_handoffs;
+  std::map<std::string, uint64_t> committed_handoffs;
+  std::set<std::string> handoff_written;
+  std::set<std::string> handoff_pulled;
+  std::atomic<size_t> n_incoming = 0;
+  std::mutex handoff_mtx;
+  // The latest config whose handoffs this server has all made (c.f.
+  // PullResponse). A server that missed configs can't tell which of the
+  // servers whose shards changed meanwhile held its new ranges, so it expects
+  // handoffs from all of them; those that have nothing to send say so here.
+  std::atomic<uint64_t> handed_off_through = 0;
+  // Keys a handoff's destination rejected, which this server hands off again
+  // the next time it processes the config. Only used by process_config.
+  std::set<std::string> rejected_handoffs;
+  // The config as last fetched, which the shardcontroller sends the changes
+  // to. Only used by process_config.
+  CompactConfig compact_config;
+
+  // Serializes config processing between the config thread and requests that
+  // refresh the config on demand.
+  std::timed_mutex process_config_mtx;
+
   // An atomic, thread-safe boolean to denote whether the server has been
   // stopped.
   std::atomic<bool> is_stopped;
@@ -106,9 +215,11 @@ class KvServer {
   // Vector of worker threads.
   std::vector<std::thread> workers;
 
-  // Per-worker queues of client connections to handle.
+  // Per-worker queues of client connections to handle, and condition
+  // variables that idle workers wait on for new connections.
   std::vector<std::deque<std::shared_ptr<ClientConn>>> conn_queues;
   std::deque<std::mutex> conn_queue_mtxs;
+  std::deque<std::condition_variable> conn_queue_cvs;
 
   // The address on which the shardcontroller is listening.
   std::string shardcontroller_address;
@@ -116,6 +227,11 @@ class KvServer {
   // Number of worker threads.
   uint64_t n_workers;
 
+  // Whether to serve reads over UDP, and the socket and threads that do
+  bool udp;
+  int udp_fd = -1;
+  std::vector<std::thread> udp_workers;
+
   /**
    * In a loop, accept client connections, then pass each connection into the
    * work queue of client connections to process.
@@ -132,10 +248,24 @@ class KvServer {
   void work_loop(size_t worker_id);
 
   /**
-   * Check whether this server is responsible for a key (or list of keys).
+   * In a loop, take in a batch of datagrams, answer the Gets and MultiGets
+   * among them, and send the replies back as a batch. Exits when the server
+   * has been stopped.
+   */
+  void udp_loop();
+
+  /**
+   * Check whether this server is responsible for a key (or list of keys) in
+   * the given config.
+   */
+  bool responsible_for(const Routing& routing, const std::string& key);
+  bool responsible_for(const Routing& routing,
+                       const std::vector<std::string>& keys);
+
+  /**
+   * Count a request for a key in one of this server's shards.
    */
-  bool responsible_for(const std::string& key);
-  bool responsible_for(const std::vector<std::string>& keys);
+  void record_hit(const Routing& routing, const std::string& key);
 
   /**
    * Query the shardcontroller, then update the config and move outdated pairs
@@ -143,15 +273,113 @@ class KvServer {
    */
   bool process_config();
 
+  /**
+   * process_config, for callers that already hold process_config_mtx.
+   */
+  bool sync_config();
+
+  /**
+   * Called on a request for keys this server doesn't own: the client may have
+   * a newer config than this server, so catch up (unless another thread just
+   * did).
+   */
+  void refresh_config();
+
+  /**
+   * Before serving a client request: refresh the config if the request's keys
+   * aren't owned here, then pull any of them still being handed off. Returns
+   * the config snapshot to serve the request with (nullptr for requests that
+   * aren't about keys).
+   */
+  std::shared_ptr<const Routing> prepare_keys(const Request& req);
+
+  /**
+   * Returns the current config snapshot, with the caller counted in flight
+   * under it until the returned pointer (and its copies) are gone. Hold it
+   * only while checking keys against the config and accessing them in the
+   * store.
+   */
+  std::shared_ptr<const Routing> enter_routing();
+
+  /**
+   * Start tracking handoffs of ranges this server took over in `next`, and
+   * drop ones that are no longer relevant. Expects process_config_mtx to be
+   * held.
+   */
+  void update_handoffs(const ShardControllerConfig& old_config,
+                       const Routing& next);
+
+  /**
+   * Fetch any of `keys` that are in a range still being handed off to this
+   * server, and haven't been pulled or written yet, from the range's previous
+   * owner(s).
+   */
+  void pull_incoming(const std::vector<std::string>& keys);
+
+  /**
+   * Before writing `keys`: if a handoff is in progress, returns a lock on
+   * handoff_mtx (to hold for the write) and records the keys as written here.
+   */
+  std::unique_lock<std::mutex> lock_for_write(const std::vector<std::string>& keys);
+
+  /**
+   * Serve a pull from a server taking over one of this server's old ranges,
+   * and apply a handoff from a shard's previous owner, rejecting keys this
+   * server doesn't own (anymore). A handoff from a config this server can't
+   * catch up to yet fails, for the sender to retry.
+   */
+  PullResponse serve_pull(const PullRequest* req);
+  std::optional<HandoffResponse> apply_handoff(const HandoffRequest* req);
+
+  /**
+   * Erase a user from the keys this server owns: delete their records, then
+   * redact the keys the store's reference index says mention the user or one
+   * of those records. Nothing else is scanned.
+   */
+  GDPRPurgeResponse gdpr_purge(const GDPRPurgeRequest* req);
+
+  /**
+   * Send the per-shard request counts gathered since the last report to the
+   * shardcontroller, then start a new window.
+   */
+  bool report_load();
+
+  /**
+   * Queue the current values of `keys` to be shipped to `backups`. The first
+   * overload looks up this server's backups itself; as every write to keys
+   * this server owns ends with it, it also revokes the keys' leases.
+   */
+  void replicate(const std::vector<std::string>& keys);
+  void replicate(const std::vector<std::string>& backups,
+                 const std::vector<std::string>& keys);
+
+  /**
+   * In a loop, ship pending changes to each backup in pipelined batches (or a
+   * heartbeat, if there are none). Exits when the server has been stopped.
+   */
+  void replicate_loop();
+
+  /**
+   * Apply a batch from one of this server's primaries.
+   */
+  bool apply_replicate(const ReplicateRequest* req);
+
+  /**
+   * Check whether this server is a backup for the key, and has heard from its
+   * primary within `max_staleness`.
+   */
+  bool fresh_replica_for(const std::string& key, milliseconds max_staleness);
+
   /**
    * Process an incoming request: parse its request type, call its appropriate
    * handler (Get, Put, etc.), then get a response.
    */
   Response process_request(Request req);
 
-  // Extracts a query response from the shardcontroller, or an std::nullopt if
-  // one doesn't exist. You might need this when implementing process_config!
-  std::optional<QueryResponse> query_shardcontroller(
+  // Gets the latest config from the shardcontroller (by way of the changes
+  // since compact_config), or an std::nullopt if it can't. You might need this
+  // when implementing process_config!
+  std::optional<ShardControllerConfig> query_shardcontroller(
       std::shared_ptr<ServerConn> conn);
 
   // Wrapper function that calls process_config periodically.
@@ -0,0 +1,59 @@
+#include "streams.hpp"
+
+#include <algorithm>
+
+StreamTable::StreamTable(std::chrono::milliseconds idle_timeout)
+    : idle_timeout(idle_timeout) {
+}
+
+uint64_t StreamTable::open(const std::string& key, uint64_t size_hint) {
+    auto stream = std::make_shared<Stream>();
+    stream->key = key;
+    stream->value.reserve(std::min<uint64_t>(size_hint, STREAM_MAX_RESERVE));
+    stream->touched = Clock::now();
+
+    std::unique_lock lock(this->mtx);
+    // A stream being appended to counts as busy, however long it was idle
+    std::erase_if(this->streams, [&](auto&& entry) {
+        std::unique_lock stream_lock(entry.second->mtx, std::try_to_lock);
+        return stream_lock &&
+               stream->touched - entry.second->touched > this->idle_timeout;
+    });
+    uint64_t id = ++this->last_id;
+    this->streams.emplace(id, std::move(stream));
+    return id;
+}
+
+std::optional<uint64_t> StreamTable::append(uint64_t id, const std::string& key,
+                                            uint64_t offset,
+                                            std::string_view chunk) {
+    std::shared_ptr<Stream> stream = this->find(id);
+    if (!stream) return std::nullopt;
+    std::unique_lock lock(stream->mtx);
+    if (stream->key != key || stream->value.size() != offset) {
+        return std::nullopt;
+    }
+    stream->value.append(chunk);
+    stream->touched = Clock::now();
+    return stream->value.size();
+}
+
+std::optional<std::string> StreamTable::close(uint64_t id) {
+    std::shared_ptr<Stream> stream;
+    {
+        std::unique_lock lock(this->mtx);
+        auto it = this->streams.find(id);
+        if (it == this->streams.end()) return std::nullopt;
+        stream = std::move(it->second);
+        this->streams.erase(it);
+    }
+    std::unique_lock lock(stream->mtx);
+    return std::move(stream->value);
+}
+
+std::shared_ptr<StreamTable::Stream> StreamTable::find(uint64_t id) {
+    std::unique_lock lock(this->mtx);
+    auto it = this->streams.find(id);
+    if (it == this->streams.end()) return nullptr;
+    return it->second;
+}
@@ -0,0 +1,71 @@
+#ifndef STREAMS_HPP
+#define STREAMS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "net/server_commands.hpp"
+
+// How long a value streamed to a server may go without a chunk before the
+// server drops what it has received of it
+#define STREAM_IDLE_MS 30000
+// At most how much room is made for a stream's value up front, whatever size
+// its client says it has; past that, the value grows as chunks arrive
+#define STREAM_MAX_RESERVE (4 * STREAM_CHUNK_SIZE)
+
+// The values clients are streaming to a server (see PutStreamRequest), each
+// assembled from its chunks until the last one arrives.
+//
+// A stream's chunks are appended straight into the value being assembled, so
+// besides the value itself, a transfer only ever holds the chunk in flight.
+// Streams whose client went away are dropped once they've been idle for
+// STREAM_IDLE_MS, the next time a stream is opened.
+class StreamTable {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit StreamTable(std::chrono::milliseconds idle_timeout =
+                           std::chrono::milliseconds(STREAM_IDLE_MS));
+
+  StreamTable(const StreamTable&) = delete;
+  StreamTable& operator=(const StreamTable&) = delete;
+
+  // Starts a stream of `key`'s new value, with room for `size_hint` bytes (up
+  // to STREAM_MAX_RESERVE), and returns its ID
+  uint64_t open(const std::string& key, uint64_t size_hint);
+
+  // Appends `chunk` at `offset` to stream `id` of `key`, returning how many
+  // bytes the stream has received, or std::nullopt if there's no such stream
+  // or `offset` isn't where its last chunk ended
+  std::optional<uint64_t> append(uint64_t id, const std::string& key,
+                                 uint64_t offset, std::string_view chunk);
+
+  // Ends stream `id`, returning the value it assembled
+  std::optional<std::string> close(uint64_t id);
+
+ private:
+  struct Stream {
+    std::string key;
+    std::string value;
+    Clock::time_point touched;
+    // Protects the fields above, so that streams fill up in parallel
+    std::mutex mtx;
+  };
+
+  std::chrono::milliseconds idle_timeout;
+
+  // Protected by mtx, which is only held to find a stream
+  std::unordered_map<uint64_t, std::shared_ptr<Stream>> streams;
+  uint64_t last_id = 0;
+  std::mutex mtx;
+
+  std::shared_ptr<Stream> find(uint64_t id);
+};
+
+#endif /* end of include guard */
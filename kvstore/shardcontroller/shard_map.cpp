@@ -0,0 +1,110 @@
+#include "shard_map.hpp"
+
+#include <cassert>
+#include <iterator>
+
+std::set<std::string> ShardMap::assign(const Shard& shard,
+                                       const std::string& server) {
+    if (this->ranges.empty()) this->gran = shard.granularity();
+    assert(shard.granularity() == this->gran);
+    size_t lower = str_to_bucket(shard.lower), upper = str_to_bucket(shard.upper);
+    assert(lower <= upper);
+
+    // Start from the last range that begins at or before `lower`, in case it
+    // reaches into the moved shard
+    auto it = this->ranges.upper_bound(lower);
+    if (it != this->ranges.begin() && std::prev(it)->second.upper >= lower) {
+        --it;
+    }
+    if (it != this->ranges.end() && it->first == lower &&
+        it->second.upper == upper && it->second.server == server) {
+        return {};
+    }
+
+    std::set<std::string> affected{server};
+    while (it != this->ranges.end() && it->first <= upper) {
+        size_t start = it->first;
+        Range range = it->second;
+        affected.insert(range.server);
+        it = this->erase(it);
+        // Keep whatever parts of the range lie outside the moved shard
+        if (start < lower) {
+            this->insert(start, lower - 1, range.server);
+        }
+        if (range.upper > upper) {
+            it = this->insert(upper + 1, range.upper, range.server);
+        }
+    }
+    this->insert(lower, upper, server);
+    return affected;
+}
+
+std::vector<Shard> ShardMap::remove(const std::string& server) {
+    auto owned = this->server_ranges.find(server);
+    if (owned == this->server_ranges.end()) return {};
+
+    std::vector<Shard> shards;
+    for (size_t lower : owned->second) {
+        auto it = this->ranges.find(lower);
+        shards.push_back(this->to_shard(lower, it->second.upper));
+        this->ranges.erase(it);
+    }
+    this->server_ranges.erase(owned);
+    return shards;
+}
+
+std::vector<Shard> ShardMap::shards_of(const std::string& server) const {
+    auto owned = this->server_ranges.find(server);
+    if (owned == this->server_ranges.end()) return {};
+
+    std::vector<Shard> shards;
+    shards.reserve(owned->second.size());
+    for (size_t lower : owned->second) {
+        shards.push_back(this->to_shard(lower, this->ranges.at(lower).upper));
+    }
+    return shards;
+}
+
+size_t ShardMap::count(const std::string& server) const {
+    auto owned = this->server_ranges.find(server);
+    return owned == this->server_ranges.end() ? 0 : owned->second.size();
+}
+
+void ShardMap::refine(size_t granularity) {
+    assert(this->gran <= granularity && granularity <= MAX_GRANULARITY);
+    size_t factor = GRANULARITY_OPTS[granularity - this->gran];
+    this->gran = granularity;
+    if (factor == 1) return;
+
+    std::map<size_t, Range> refined;
+    for (auto&& [lower, range] : this->ranges) {
+        refined.emplace_hint(
+            refined.end(), lower * factor,
+            Range{range.upper * factor + factor - 1, std::move(range.server)});
+    }
+    this->ranges = std::move(refined);
+    for (auto&& [_, lowers] : this->server_ranges) {
+        std::set<size_t> scaled;
+        for (size_t lower : lowers) scaled.insert(scaled.end(), lower * factor);
+        lowers = std::move(scaled);
+    }
+}
+
+std::map<size_t, ShardMap::Range>::iterator ShardMap::insert(
+    size_t lower, size_t upper, const std::string& server) {
+    this->server_ranges[server].insert(lower);
+    return this->ranges.emplace(lower, Range{upper, server}).first;
+}
+
+std::map<size_t, ShardMap::Range>::iterator ShardMap::erase(
+    std::map<size_t, Range>::iterator it) {
+    auto owned = this->server_ranges.find(it->second.server);
+    owned->second.erase(it->first);
+    if (owned->second.empty()) this->server_ranges.erase(owned);
+    return this->ranges.erase(it);
+}
+
+Shard ShardMap::to_shard(size_t lower, size_t upper) const {
+    return Shard{bucket_to_str(lower, this->gran),
+                 bucket_to_str(upper, this->gran)};
+}
@@ -0,0 +1,60 @@
+#ifndef SHARD_MAP_HPP
+#define SHARD_MAP_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "common/shard.hpp"
+
+// Which server holds each part of the key space, as disjoint bucket ranges
+// (all at the same granularity) in a balanced tree ordered by lower bound.
+// Finding the ranges a move overlaps, or the range a bucket falls into, takes
+// logarithmic time; ranges are only turned back into string bounds when a
+// server's shards are read out.
+class ShardMap {
+ public:
+  // Granularity of the ranges; only meaningful while the map isn't empty.
+  size_t granularity() const {
+    return this->gran;
+  }
+  bool empty() const {
+    return this->ranges.empty();
+  }
+
+  // Gives `shard` to `server`, trimming or removing the ranges it overlaps,
+  // and returns the servers whose ranges changed (including `server`, unless
+  // it already held exactly `shard`). Neighboring ranges aren't merged, so the
+  // shard stays whole. If the map isn't empty, `shard` must be at its
+  // granularity.
+  std::set<std::string> assign(const Shard& shard, const std::string& server);
+
+  // Removes all of `server`'s ranges, returning them in ascending order.
+  std::vector<Shard> remove(const std::string& server);
+
+  // Gets `server`'s shards, in ascending order, or just how many it has.
+  std::vector<Shard> shards_of(const std::string& server) const;
+  size_t count(const std::string& server) const;
+
+  // Rewrites every range at `granularity`, which must not be coarser than the
+  // current one.
+  void refine(size_t granularity);
+
+ private:
+  struct Range {
+    size_t upper;
+    std::string server;
+  };
+  // Ranges by lower bound, and the lower bounds of each server's ranges
+  std::map<size_t, Range> ranges;
+  std::map<std::string, std::set<size_t>> server_ranges;
+  size_t gran = 0;
+
+  std::map<size_t, Range>::iterator insert(size_t lower, size_t upper,
+                                           const std::string& server);
+  std::map<size_t, Range>::iterator erase(std::map<size_t, Range>::iterator it);
+  Shard to_shard(size_t lower, size_t upper) const;
+};
+
+#endif /* end of include guard */
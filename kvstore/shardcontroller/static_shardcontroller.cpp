@@ -1,9 +1,24 @@
 #include "static_shardcontroller.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <set>
+
 bool StaticShardController::Query(const QueryRequest*, QueryResponse* res) {
     // TODO (Part B, Step 1): Implement!
-    std::shared_lock lock(config_mtx);
-    res->config = this->config;
+    res->config = this->current_snapshot()->config;
+    return true;
+}
+
+bool StaticShardController::ConfigChanges(const ConfigChangesRequest* req,
+                                          ConfigChangesResponse* res) {
+    std::shared_ptr<const Snapshot> snap = this->current_snapshot();
+    const CompactConfig* old = nullptr;
+    for (auto&& compact : snap->history) {
+        if (compact->version == req->since_version) old = compact.get();
+    }
+    res->changes = snap->history.back()->since(old);
     return true;
 }
 
@@ -19,6 +34,8 @@ bool StaticShardController::Join(const JoinRequest* req, JoinResponse*) {
     else {
         return false;
     }
+    this->assign_backups(joining_server);
+    this->latest_version = ++this->config.version;
     cout_color(BLUE, "Added server ", req->server,
                " to shardcontroller configuration.");
     return true;
@@ -35,95 +52,478 @@ bool StaticShardController::Leave(const LeaveRequest* req, LeaveResponse*) {
         return false;
     }
 
-    std::vector<Shard> shards = std::move(it->second);
+    std::vector<Shard> shards = this->shard_map.remove(dead_server);
+
+    // Rates of the departing shards, if the server reported them recently
+    std::map<std::string, double> rates;
+    std::vector<std::pair<Shard, double>> departing;
+    if (this->policy.enabled) {
+        rates = this->server_rates();
+        for (auto&& shard : shards) {
+            double rate = 0;
+            if (auto report = this->loads.find(dead_server);
+                report != this->loads.end()) {
+                for (auto&& load : report->second.report.loads) {
+                    if (load.shard == shard) {
+                        rate += load.n_requests * 1000.0 /
+                                std::max<uint64_t>(report->second.report.window_ms, 1);
+                    }
+                }
+            }
+            departing.emplace_back(shard, rate);
+        }
+    }
+
     this->config.server_to_shards.erase(it);
+    this->config.shards_changed_at.erase(dead_server);
+    rates.erase(dead_server);
+    this->loads.erase(dead_server);
+    this->overloaded_rounds.erase(dead_server);
+    this->server_cooldowns.erase(dead_server);
+
+    // The leaving server's first backup already holds a copy of its data, so
+    // promote it to primary for all of the leaving server's shards
+    std::vector<std::string> backups =
+        std::move(this->config.server_to_backups[dead_server]);
+    this->config.server_to_backups.erase(dead_server);
+    this->assign_backups(dead_server);
+
+    if (this->config.server_to_shards.empty()) {
+        this->bump_version({});
+        return true;
+    }
+
+    if (!backups.empty()) {
+        for (auto&& shard : shards) this->shard_map.assign(shard, backups.front());
+        this->bump_version(shards.empty() ? std::set<std::string>{}
+                                          : std::set{backups.front()});
+        return true;
+    }
+
+    if (!this->policy.enabled) {
+        auto first = this->config.server_to_shards.begin()->first;
+        for (auto&& shard : shards) this->shard_map.assign(shard, first);
+        this->bump_version(shards.empty() ? std::set<std::string>{}
+                                          : std::set{first});
+        return true;
+    }
 
-    if (!this->config.server_to_shards.empty()) {
-        auto first = this->config.server_to_shards.begin();
-        first->second.insert(first->second.end(), shards.begin(), shards.end());
+    // Hand out the departing shards hottest-first, each to whichever server is
+    // currently the least loaded (counting the shards it has received so far),
+    // rather than piling them all onto one server.
+    std::sort(departing.begin(), departing.end(),
+              [](auto&& a, auto&& b) { return a.second > b.second; });
+    std::set<std::string> receivers;
+    for (auto&& [shard, rate] : departing) {
+        auto dest = std::min_element(
+            this->config.server_to_shards.begin(),
+            this->config.server_to_shards.end(), [&](auto&& a, auto&& b) {
+                if (rates[a.first] != rates[b.first]) {
+                    return rates[a.first] < rates[b.first];
+                }
+                return this->shard_map.count(a.first) <
+                       this->shard_map.count(b.first);
+            });
+        this->shard_map.assign(shard, dest->first);
+        receivers.insert(dest->first);
+        rates[dest->first] += rate;
     }
+    this->bump_version(receivers);
 
     return true;
 }
 
 bool StaticShardController::Move(const MoveRequest* req, MoveResponse*) {
     // TODO (Part B, Step 1): Implement!
+    std::unique_lock lock(config_mtx);
+    if (!this->move_shards(req->server, req->shards)) {
+        return false;
+    }
+
+    cout_color(DIM, "Moved the following shards to server ", req->server, ":");
+    for (auto&& s : req->shards) print_color(std::cout, DIM, s, " ");
+    std::cout << '\n';
+
+    return true;
+}
+
+bool StaticShardController::move_shards(const std::string& server,
+                                        const std::vector<Shard>& shards) {
+    if (!this->config.server_to_shards.contains(server)) {
+        return false;
+    }
 
-    // TODO: For each shard to be moved, iterate over each server's shards.
-    // For each of the server's shards, if 'moved' overlaps with 'shard', compute
-    // the modified shard and insert it into 'new_shards.' Once the loop ends, we
-    // replace the server's shards with 'new_shards.' You'll find the
-    // 'split_shard' function helpful (c.f. shard.hpp).
+    // If the moved shards don't have the same granularity as the current
+    // shards, emit an error and return before changing anything
+    for (const Shard& moved : shards) {
+        size_t granularity = this->shard_map.empty()
+                                 ? shards.front().granularity()
+                                 : this->shard_map.granularity();
+        if (moved.granularity() != granularity) {
+            cerr_color(
+                RED,
+                "Moving differing shard granularities not currently supported.");
+            return false;
+        }
+    }
+
+    std::set<std::string> changed;
+    for (const Shard& moved : shards) {
+        changed.merge(this->shard_map.assign(moved, server));
+    }
+    this->bump_version(changed);
+    return true;
+}
+
+void StaticShardController::bump_version(const std::set<std::string>& changed) {
+    this->config.version++;
+    for (auto&& server : changed) {
+        this->config.shards_changed_at[server] = this->config.version;
+    }
+    this->latest_version = this->config.version;
+}
+
+std::shared_ptr<const StaticShardController::Snapshot>
+StaticShardController::current_snapshot() {
+    std::shared_ptr<const Snapshot> snap = this->snapshot.load();
+    if (snap && snap->config.version == this->latest_version) {
+        return snap;
+    }
+
+    // The config changed since the last snapshot; the first Query for the new
+    // version publishes it, and the rest wait for that instead of doing it
+    // again
+    std::unique_lock publish_lock(this->publish_mtx);
+    std::shared_lock lock(this->config_mtx);
+    snap = this->snapshot.load();
+    if (snap && snap->config.version == this->config.version) {
+        return snap;
+    }
+
+    auto next = std::make_shared<Snapshot>();
+    next->config = this->config;
+    for (auto&& [server, shards] : next->config.server_to_shards) {
+        shards = this->shard_map.shards_of(server);
+    }
+    std::optional<Message> msg = serialize_response(QueryResponse{next->config});
+    if (!msg) {
+        cerr_color(RED, "Failed to serialize config version ",
+                   this->config.version, '.');
+        return snap;
+    }
+    next->query_response = std::move(*msg);
+
+    // Numbered as the versions kept with it numbered their servers, so that
+    // changes from any of them can refer to servers by number. Numbers only
+    // versions that are dropped refer to are given out again.
+    if (snap) {
+        next->history.assign(
+            snap->history.end() -
+                std::min<size_t>(snap->history.size(), CONFIG_HISTORY - 1),
+            snap->history.end());
+    }
+    auto compact = std::make_shared<const CompactConfig>(
+        CompactConfig::from(next->config, next->history));
+    next->history.push_back(compact);
+    msg = serialize_response(ConfigChangesResponse{compact->since(compact.get())});
+    if (!msg) {
+        cerr_color(RED, "Failed to serialize config version ",
+                   this->config.version, '.');
+        return snap;
+    }
+    next->unchanged_response = std::move(*msg);
+    this->snapshot.store(next);
+    return next;
+}
+
+void StaticShardController::assign_backups(const std::string& changed) {
+    auto& servers = this->config.server_to_shards;
+    if (this->n_backups == 0) return;
+
+    // Chain the backups around the ring of servers, so each server backs up
+    // the n_backups servers before it and load stays even
+    auto backups_of = [&](std::map<std::string, std::vector<Shard>>::iterator it) {
+        size_t n = std::min(this->n_backups, servers.size() - 1);
+        auto& backups = this->config.server_to_backups[it->first];
+        backups.clear();
+        for (size_t j = 0; j < n; j++) {
+            if (++it == servers.end()) it = servers.begin();
+            backups.push_back(it->first);
+        }
+    };
+
+    // While there are few enough servers that every server backs up every
+    // other one, any join or leave changes everyone's backups
+    if (servers.size() <= this->n_backups + 1) {
+        this->config.server_to_backups.clear();
+        if (servers.size() < 2) return;
+        for (auto it = servers.begin(); it != servers.end(); ++it) {
+            backups_of(it);
+        }
+        return;
+    }
+
+    // Otherwise, only the joining server and the n_backups servers before the
+    // changed position on the ring have new backups
+    auto it = servers.lower_bound(changed);
+    if (it != servers.end() && it->first == changed) {
+        backups_of(it);
+    }
+    for (size_t i = 0; i < this->n_backups; i++) {
+        if (it == servers.begin()) it = servers.end();
+        backups_of(--it);
+    }
+}
+
+void StaticShardController::refine_config(size_t granularity) {
+    this->shard_map.refine(granularity);
+}
+
+bool StaticShardController::ReportLoad(const ReportLoadRequest* req,
+                                       ReportLoadResponse*) {
     std::unique_lock lock(config_mtx);
+    if (!this->config.server_to_shards.contains(req->server)) {
+        return false;
+    }
+    this->loads[req->server] = LoadReport{steady_clock::now(), *req};
+    return true;
+}
 
-    std::string dead_server = req->server;
-    auto it = this->config.server_to_shards.find(dead_server);
-    if (it == this->config.server_to_shards.end()) {
-        // this->config.server_to_shards[req->server] = req->shards;
+std::map<std::string, double> StaticShardController::server_rates() {
+    // Reports older than a few rebalancer rounds no longer describe the server
+    auto stale_before = steady_clock::now() - 3 * this->policy.interval;
+
+    std::map<std::string, double> rates;
+    for (auto&& [server, _] : this->config.server_to_shards) {
+        rates[server] = 0;
+        auto it = this->loads.find(server);
+        if (it == this->loads.end() || it->second.received < stale_before) {
+            continue;
+        }
+        auto& report = it->second.report;
+        for (auto&& load : report.loads) {
+            rates[server] +=
+                load.n_requests * 1000.0 / std::max<uint64_t>(report.window_ms, 1);
+        }
+    }
+    return rates;
+}
+
+bool StaticShardController::Rebalance() {
+    std::unique_lock lock(config_mtx);
+    auto now = steady_clock::now();
+    if (this->config.server_to_shards.size() < 2) {
         return false;
     }
 
-    for (Shard moved : req->shards) {
-        for (auto&& [server, shards] : this->config.server_to_shards) {
-            std::vector<Shard> new_shards;
-            for (Shard shard : shards) {
-                // If the moved shard doesn't have the same granularity as the current
-                // shard, emit an error and return
-                if (moved.granularity() != shard.granularity()) {
-                    cerr_color(
-                        RED,
-                        "Moving differing shard granularities not currently supported.");
-                    return false;
-                }
-                // Using overlap status, determine whether shards need to be modified
-                OverlapStatus os = get_overlap(shard, moved);
-                switch (os) {
-                case OverlapStatus::NO_OVERLAP: {
-                    // TODO
-                    new_shards.push_back(shard);
+    // Forget cooldowns that have expired
+    std::erase_if(this->server_cooldowns,
+                  [&](auto&& entry) { return entry.second <= now; });
+    std::erase_if(this->shard_cooldowns,
+                  [&](auto&& entry) { return entry.second <= now; });
+
+    std::map<std::string, double> rates = this->server_rates();
+    double total = 0;
+    for (auto&& [_, rate] : rates) total += rate;
+    double mean = total / rates.size();
+
+    // A server only counts as overloaded once it has stayed above the high
+    // watermark for policy.sustain_rounds consecutive rounds.
+    std::optional<std::string> hot, cold;
+    for (auto&& [server, rate] : rates) {
+        if (rate > this->policy.high_watermark * mean) {
+            this->overloaded_rounds[server]++;
+        } else {
+            this->overloaded_rounds.erase(server);
+        }
+        if (this->server_cooldowns.contains(server)) {
+            continue;
+        }
+        if (this->overloaded_rounds[server] >= this->policy.sustain_rounds &&
+            (!hot || rate > rates[*hot])) {
+            hot = server;
+        }
+    }
+    if (!hot) {
+        return false;
+    }
+    for (auto&& [server, rate] : rates) {
+        if (server != *hot && !this->server_cooldowns.contains(server) &&
+            (!cold || rate < rates[*cold])) {
+            cold = server;
+        }
+    }
+    if (!cold) {
+        return false;
+    }
+    double gap = rates[*hot] - rates[*cold];
+    if (gap < this->policy.min_rate) {
+        return false;
+    }
+
+    // Candidate shards: ones the hot server reported that it still owns as-is,
+    // and that haven't moved recently.
+    auto cooling = [&](const Shard& shard) {
+        Shard fine = refine_shard(shard, MAX_GRANULARITY);
+        for (auto&& [cooled, _] : this->shard_cooldowns) {
+            if (get_overlap(fine, cooled) != OverlapStatus::NO_OVERLAP) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto& report = this->loads[*hot].report;
+    std::vector<Shard> owned = this->shard_map.shards_of(*hot);
+    std::vector<std::pair<Shard, ShardLoad>> candidates;
+    for (auto&& load : report.loads) {
+        if (std::find(owned.begin(), owned.end(), load.shard) != owned.end() &&
+            load.n_requests > 0 && !cooling(load.shard)) {
+            candidates.emplace_back(load.shard, load);
+        }
+    }
+    if (candidates.empty()) {
+        return false;
+    }
+    auto rate_of = [&](const ShardLoad& load) {
+        return load.n_requests * 1000.0 / std::max<uint64_t>(report.window_ms, 1);
+    };
+
+    // Moving a shard with rate r lowers the pair's maximum load only if r <
+    // gap, and evens the pair out best at r = gap / 2. Prefer the shard
+    // closest to that, breaking ties by moving fewer bytes.
+    double target = gap / 2;
+    std::optional<ShardLoad> best;
+    for (auto&& [_, load] : candidates) {
+        double r = rate_of(load);
+        if (r >= gap) continue;
+        if (!best || std::abs(r - target) < std::abs(rate_of(*best) - target) ||
+            (std::abs(r - target) == std::abs(rate_of(*best) - target) &&
+             load.n_bytes < best->n_bytes)) {
+            best = load;
+        }
+    }
+
+    Shard moved;
+    if (best) {
+        moved = best->shard;
+    } else {
+        // Every shard is too hot to move whole, so split the hottest one and
+        // move only part of it: the top buckets that carry about `target`
+        // requests/second, at a finer granularity if a single bucket is too
+        // hot (the config is only refined once a split is found). Requests to
+        // the hot keys the server reported are placed in their buckets; the
+        // rest are assumed to spread evenly.
+        auto hottest = std::max_element(
+            candidates.begin(), candidates.end(), [&](auto&& a, auto&& b) {
+                return rate_of(a.second) < rate_of(b.second);
+            });
+        Shard shard = hottest->first;
+        double r = rate_of(hottest->second);
+        double stats_window =
+            std::max<uint64_t>(report.stats.window_ms, 1) / 1000.0;
+        while (true) {
+            size_t upper = str_to_bucket(shard.upper);
+            size_t n_buckets = upper - str_to_bucket(shard.lower) + 1;
+
+            // Each hot key's distance from the top bucket, and its rate
+            std::vector<std::pair<size_t, double>> hot_keys;
+            double hot_rate = 0;
+            const KeyCount* hottest_key = nullptr;
+            for (auto&& hot_key : report.stats.hot_keys) {
+                std::string position = this->config.shard_key(hot_key.key);
+                std::string prefix = position.substr(0, shard.granularity());
+                if (prefix.size() < shard.granularity() || !is_valid(prefix) ||
+                    !shard.contains(position)) {
                     continue;
                 }
-                case OverlapStatus::OVERLAP_START: {
-                    // TODO
-                    size_t moved_upper = str_to_bucket(moved.upper);
-                    new_shards.push_back(Shard(bucket_to_str(moved_upper+1, moved.granularity()), shard.upper));
-                    continue;
+                hot_keys.emplace_back(upper - str_to_bucket(prefix),
+                                      hot_key.count / stats_window);
+                hot_rate += hot_keys.back().second;
+                if (!hottest_key || hot_key.count > hottest_key->count) {
+                    hottest_key = &hot_key;
                 }
-                case OverlapStatus::OVERLAP_END: {
-                    // TODO
-                    size_t moved_lower = str_to_bucket(moved.lower);
-                    new_shards.push_back(Shard(shard.lower, bucket_to_str(moved_lower-1, moved.granularity())));
-                    continue;
+            }
+            // The windows differ, so the hot keys may seem to add up to more
+            // than the shard's rate
+            double scale = hot_rate > r ? r / hot_rate : 1;
+            double spread = r - hot_rate * scale;
+            auto rate_of_top = [&](size_t n) {
+                double rate = spread * n / n_buckets;
+                for (auto&& [distance, key_rate] : hot_keys) {
+                    if (distance < n) rate += key_rate * scale;
                 }
-                case OverlapStatus::COMPLETELY_CONTAINS: {
-                    // TODO
-                    size_t moved_lower = str_to_bucket(moved.lower);
-                    size_t moved_upper = str_to_bucket(moved.upper);
-                    new_shards.push_back(Shard(shard.lower, bucket_to_str(moved_lower-1, moved.granularity())));
-                    new_shards.push_back(Shard(bucket_to_str(moved_upper+1, moved.granularity()), shard.upper));
-                    continue;
+                return rate;
+            };
+
+            // The most top buckets that carry at most `target`
+            size_t lo = 0, hi = n_buckets;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo + 1) / 2;
+                if (rate_of_top(mid) <= target) {
+                    lo = mid;
+                } else {
+                    hi = mid - 1;
                 }
-                case OverlapStatus::COMPLETELY_CONTAINED:
-                    // TODO
-                    // Do nothing
-                    continue;
+            }
+            size_t n_move = lo;
+            if (n_move >= 1 && n_move < n_buckets) {
+                // split_shard gives `at` to the first shard, so the second
+                // (moved) shard holds the top n_move buckets
+                std::string at =
+                    bucket_to_str(upper - n_move, shard.granularity());
+                moved = split_shard(shard, at).second;
+                break;
+            }
+            if (shard.granularity() == MAX_GRANULARITY) {
+                if (hottest_key && hottest_key->count / stats_window >= target) {
+                    cerr_color(YELLOW, "Shard ", shard, " on ", *hot,
+                               " is too hot to split any further; key ",
+                               hottest_key->key, " alone gets about ",
+                               hottest_key->count / stats_window, " req/s.");
+                } else {
+                    cerr_color(YELLOW, "Shard ", shard, " on ", *hot,
+                               " is too hot to split any further.");
                 }
+                return false;
             }
-            shards = new_shards;
+            shard = refine_shard(shard, shard.granularity() + 1);
+        }
+        if (moved.granularity() > this->shard_map.granularity()) {
+            this->refine_config(moved.granularity());
         }
     }
 
-    // TODO: Now, actually move the shard onto the target server!
-    auto& dest = this->config.server_to_shards[req->server];
-    dest.insert(dest.end(), req->shards.begin(), req->shards.end());
-
-    cout_color(DIM, "Moved the following shards to server ", req->server, ":");
-    for (auto&& s : req->shards) print_color(std::cout, DIM, s, " ");
-    std::cout << '\n';
+    if (!this->move_shards(*cold, {moved})) {
+        return false;
+    }
+    cout_color(BLUE, "Rebalancer moved ", moved, " from ", *hot, " (",
+               rates[*hot], " req/s) to ", *cold, " (", rates[*cold],
+               " req/s).");
 
+    // Both servers' reports are now stale, and neither they nor the moved
+    // range may take part in another move until the cooldown expires.
+    auto until = now + this->policy.cooldown;
+    for (auto&& server : {*hot, *cold}) {
+        this->loads.erase(server);
+        this->overloaded_rounds.erase(server);
+        this->server_cooldowns[server] = until;
+    }
+    this->shard_cooldowns.emplace_back(refine_shard(moved, MAX_GRANULARITY),
+                                       until);
     return true;
 }
 
+void StaticShardController::rebalance_loop() {
+    std::unique_lock lock(this->rebalancer_mtx);
+    while (!this->is_stopped) {
+        this->rebalancer_cv.wait_for(lock, this->policy.interval);
+        if (this->is_stopped) break;
+        lock.unlock();
+        this->Rebalance();
+        lock.lock();
+    }
+}
+
 /* ==================================================*/
 /* === INTERNALS: DO NOT MODIFY BELOW THIS LINE ===  */
 /* ==================================================*/
@@ -138,6 +538,10 @@ int StaticShardController::start() {
     }
     this->client_listener =
         std::thread(&StaticShardController::accept_clients_loop, this);
+    if (this->policy.enabled) {
+        this->rebalancer =
+            std::thread(&StaticShardController::rebalance_loop, this);
+    }
 
     cout_color(BLUE, "Listening on ", this->address);
     return 0;
@@ -150,6 +554,13 @@ void StaticShardController::stop() {
     shutdown(this->listener_fd, SHUT_RDWR);
     cout_color(BLUE, "Joining listener thread...");
     this->client_listener.join();
+    if (this->rebalancer.joinable()) {
+        {
+            std::unique_lock lock(this->rebalancer_mtx);
+            this->rebalancer_cv.notify_all();
+        }
+        this->rebalancer.join();
+    }
 
     // Close all connections
     cout_color(BLUE, "Closing all connections...");
@@ -190,6 +601,25 @@ void StaticShardController::handle_client(std::shared_ptr<ClientConn> client) {
             break;
         }
 
+        // Queries are answered straight from the published snapshot, and so
+        // are requests for changes from those that are up to date
+        if (std::holds_alternative<QueryRequest>(*req)) {
+            std::shared_ptr<const Snapshot> snap = this->current_snapshot();
+            if (!client->send_response(snap->query_response)) {
+                break;
+            }
+            continue;
+        }
+        if (auto* changes_req = std::get_if<ConfigChangesRequest>(&*req)) {
+            std::shared_ptr<const Snapshot> snap = this->current_snapshot();
+            if (changes_req->since_version == snap->config.version) {
+                if (!client->send_response(snap->unchanged_response)) {
+                    break;
+                }
+                continue;
+            }
+        }
+
         Response res = this->process_request(*req);
         if (!client->send_response(res)) {
             break;
@@ -250,6 +680,20 @@ Response StaticShardController::process_request(Request req) {
         } else {
             res = ErrorResponse{"Failed to process Query request."};
         }
+    } else if (auto* changes_req = std::get_if<ConfigChangesRequest>(&req)) {
+        ConfigChangesResponse changes_res{};
+        if (this->ConfigChanges(changes_req, &changes_res)) {
+            res = changes_res;
+        } else {
+            res = ErrorResponse{"Failed to process ConfigChanges request."};
+        }
+    } else if (auto* report_req = std::get_if<ReportLoadRequest>(&req)) {
+        ReportLoadResponse report_res{};
+        if (this->ReportLoad(report_req, &report_res)) {
+            res = report_res;
+        } else {
+            res = ErrorResponse{"Failed to process ReportLoad request."};
+        }
     } else {
         throw std::logic_error{"invalid request variant!"};
     }
@@ -1,9 +1,12 @@
 #ifndef STATIC_SHARDCONTROLLER_HPP
 #define STATIC_SHARDCONTROLLER_HPP
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <map>
 #include <memory>
+#include <set>
 #include <shared_mutex>
 #include <thread>
 
@@ -12,11 +15,44 @@
 #include "net/network_conn.hpp"
 #include "net/network_helpers.hpp"
 #include "net/network_messages.hpp"
+#include "shard_map.hpp"
 #include "shardcontroller.hpp"
 
+using namespace std::chrono;
+
+// How many of the latest published configs are kept to send changes from; a
+// server or client further behind gets the whole config
+#define CONFIG_HISTORY 16
+
+// Configures automatic, load-aware shard placement. When disabled (the
+// default), shards only move when an operator sends a Move, and a leaving
+// server's shards all go to the first remaining server.
+struct RebalancePolicy {
+  bool enabled = false;
+  // How often the rebalancer runs.
+  milliseconds interval = 1000ms;
+  // A server is overloaded once its request rate exceeds this multiple of the
+  // mean rate across servers...
+  double high_watermark = 1.25;
+  // ... and must stay overloaded for this many consecutive rounds before the
+  // rebalancer acts on it.
+  size_t sustain_rounds = 2;
+  // Imbalances smaller than this (in requests/second) are ignored.
+  double min_rate = 10.0;
+  // Once a server has given or received a shard, neither it nor the moved
+  // range is touched again for this long.
+  milliseconds cooldown = 10000ms;
+};
+
 class StaticShardController : public Shardcontroller {
  public:
-  explicit StaticShardController(const std::string& addr) : address(addr) {
+  // Each server is backed up by the next `n_backups` servers (in address
+  // order, wrapping around), which receive a replication stream of its writes.
+  explicit StaticShardController(
+      const std::string& addr, RebalancePolicy policy = {},
+      ShardingMode mode = ShardingMode::LEXICOGRAPHIC, size_t n_backups = 0)
+      : n_backups(n_backups), policy(policy), address(addr) {
+    this->config.mode = mode;
   }
   ~StaticShardController() {
     if (!this->is_stopped) {
@@ -25,9 +61,17 @@ class StaticShardController : public Shardcontroller {
   }
 
   bool Query(const QueryRequest*, QueryResponse* res) override;
+  bool ConfigChanges(const ConfigChangesRequest* req,
+                     ConfigChangesResponse* res) override;
   bool Join(const JoinRequest* req, JoinResponse*) override;
   bool Leave(const LeaveRequest* req, LeaveResponse*) override;
   bool Move(const MoveRequest* req, MoveResponse*) override;
+  bool ReportLoad(const ReportLoadRequest* req, ReportLoadResponse*) override;
+
+  // Runs one round of the rebalancer: if some server has been overloaded for
+  // long enough, moves (splitting first, if needed) one of its shards to the
+  // least loaded server. Returns true if the configuration changed.
+  bool Rebalance();
 
   int start() override;
   void stop() override;
@@ -37,6 +81,79 @@ class StaticShardController : public Shardcontroller {
   ShardControllerConfig config;
   std::shared_mutex config_mtx;
 
+  // Who holds which bucket range. config.server_to_shards only tracks which
+  // servers are in the cluster; their shards are filled in from shard_map
+  // when a snapshot is published. Protected by config_mtx.
+  ShardMap shard_map;
+
+  // The config as of some version, published as an immutable snapshot along
+  // with its serialized QueryResponse. Queries just take a reference to the
+  // current snapshot, without locking, copying or reserializing it; only the
+  // first Query after a change builds the next one (c.f. current_snapshot).
+  // Changes since an earlier version are worked out from the compact forms
+  // of the configs published last (oldest first, ending with this one's),
+  // except for a caller that's up to date, which gets the serialized response
+  // saying nothing changed.
+  struct Snapshot {
+    ShardControllerConfig config;
+    Message query_response;
+    std::vector<std::shared_ptr<const CompactConfig>> history;
+    Message unchanged_response;
+  };
+  std::atomic<std::shared_ptr<const Snapshot>> snapshot;
+  // config.version, readable without config_mtx
+  std::atomic<uint64_t> latest_version = 0;
+  // Serializes building snapshots
+  std::mutex publish_mtx;
+
+  // Gets the snapshot of the latest config, publishing it first if needed.
+  // Expects config_mtx not to be held.
+  std::shared_ptr<const Snapshot> current_snapshot();
+
+  // Moves `shards` to `server`, taking them away from whichever servers
+  // currently hold them. Expects config_mtx to be held exclusively.
+  bool move_shards(const std::string& server, const std::vector<Shard>& shards);
+
+  // Publishes a change to the config: bumps its version, and records it as the
+  // version at which the shards of the `changed` servers changed. Expects
+  // config_mtx to be held exclusively.
+  void bump_version(const std::set<std::string>& changed);
+
+  // Number of backups per server, and a helper that updates
+  // config.server_to_backups after `changed` joins or leaves. Expects
+  // config_mtx to be held exclusively.
+  size_t n_backups;
+  void assign_backups(const std::string& changed);
+
+  // Rewrites every shard in the config at `granularity`, which must not be
+  // coarser than the current one. Expects config_mtx to be held exclusively.
+  void refine_config(size_t granularity);
+
+  // The most recent load report from a server, and when it arrived.
+  struct LoadReport {
+    steady_clock::time_point received;
+    ReportLoadRequest report;
+  };
+
+  RebalancePolicy policy;
+  // Latest load report per server; protected by config_mtx.
+  std::map<std::string, LoadReport> loads;
+  // Number of consecutive rounds each server has been overloaded, and when
+  // each server/range last took part in a move; protected by config_mtx.
+  std::map<std::string, size_t> overloaded_rounds;
+  std::map<std::string, steady_clock::time_point> server_cooldowns;
+  std::vector<std::pair<Shard, steady_clock::time_point>> shard_cooldowns;
+
+  // Reported request rate (requests/second) of each current server. Servers
+  // without a current report count as idle. Expects config_mtx to be held.
+  std::map<std::string, double> server_rates();
+
+  // Background thread that calls Rebalance every policy.interval.
+  std::thread rebalancer;
+  std::mutex rebalancer_mtx;
+  std::condition_variable rebalancer_cv;
+  void rebalance_loop();
+
   /* ==================================================*/
   /* === INTERNALS: DO NOT MODIFY BELOW THIS LINE ===  */
   /* ==================================================*/
@@ -0,0 +1,81 @@
+#include <atomic>
+#include <future>
+#include <string>
+
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t kRandStringLength = 32;
+static constexpr std::size_t kNumThreads = 8;
+static constexpr std::size_t kNumKeys = 100;
+static constexpr std::size_t kNumRounds = 200;
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  auto counters = make_rand_strs(kNumKeys, kRandStringLength);
+  auto cas_counters = make_rand_strs(kNumKeys, kRandStringLength);
+  auto locks = make_rand_strs(kNumKeys, kRandStringLength);
+  for (auto&& key : cas_counters) {
+    auto put_req = PutRequest{.key = key, .value = "0"};
+    auto put_res = PutResponse{};
+    ASSERT(store->Put(&put_req, &put_res));
+  }
+
+  // Each thread bumps every counter kNumRounds times, both with Increment and
+  // with a read-CompareAndSwap loop, and tries to take every lock once. No
+  // update may be lost, and each lock has exactly one winner.
+  std::atomic<std::size_t> n_locks_taken = 0;
+  auto threads = std::vector<std::future<bool>>{};
+  for (std::size_t i = 0; i < kNumThreads; ++i) {
+    threads.push_back(std::async(std::launch::async, [&, tid = i]() {
+      for (std::size_t round = 0; round < kNumRounds; round++) {
+        for (std::size_t k = 0; k < kNumKeys; k++) {
+          auto incr_req = IncrementRequest{.key = counters[k], .delta = 1};
+          auto incr_res = IncrementResponse{};
+          ASSERT(store->Increment(&incr_req, &incr_res));
+
+          auto get_req = GetRequest{.key = cas_counters[k]};
+          auto get_res = GetResponse{};
+          auto cas_res = CompareAndSwapResponse{.swapped = false, .value = ""};
+          ASSERT(store->Get(&get_req, &get_res));
+          while (!cas_res.swapped) {
+            auto cas_req = CompareAndSwapRequest{
+                .key = cas_counters[k],
+                .expected = get_res.value,
+                .desired = std::to_string(std::stoll(get_res.value) + 1)};
+            ASSERT(store->CompareAndSwap(&cas_req, &cas_res));
+            get_res.value = cas_res.value;
+          }
+        }
+      }
+
+      for (std::size_t k = 0; k < kNumKeys; k++) {
+        auto pia_req =
+            PutIfAbsentRequest{.key = locks[k], .value = std::to_string(tid)};
+        auto pia_res = PutIfAbsentResponse{};
+        ASSERT(store->PutIfAbsent(&pia_req, &pia_res));
+        if (pia_res.inserted) n_locks_taken++;
+      }
+      return true;
+    }));
+  }
+
+  auto passed = true;
+  for (auto& t : threads) {
+    passed &= t.get();
+  }
+  ASSERT(passed);
+
+  std::string expected = std::to_string(kNumThreads * kNumRounds);
+  for (std::size_t k = 0; k < kNumKeys; k++) {
+    auto get_req = GetRequest{.key = counters[k]};
+    auto get_res = GetResponse{};
+    ASSERT(store->Get(&get_req, &get_res));
+    ASSERT_EQ(get_res.value, expected);
+
+    get_req.key = cas_counters[k];
+    ASSERT(store->Get(&get_req, &get_res));
+    ASSERT_EQ(get_res.value, expected);
+  }
+  ASSERT_EQ(n_locks_taken.load(), kNumKeys);
+}
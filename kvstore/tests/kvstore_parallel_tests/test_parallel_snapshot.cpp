@@ -0,0 +1,75 @@
+#include <atomic>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t kRandStringLength = 16;
+static constexpr std::size_t kNumPairs = 200;
+static constexpr std::size_t kNumWriters = 4;
+static constexpr std::size_t kNumReaders = 2;
+static constexpr std::size_t kNumSnapshots = 30;
+static constexpr std::size_t kBatchSize = 50;
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  // Each pair of keys is always written together, with the same value, so a
+  // snapshot taken at a single point in time sees the same value in both
+  auto firsts = make_rand_strs(kNumPairs, kRandStringLength);
+  auto seconds = make_rand_strs(kNumPairs, kRandStringLength);
+  auto write_pair = [&](std::size_t i, const std::string& value) {
+    auto mput_req = MultiPutRequest{.keys = {firsts[i], seconds[i]},
+                                    .values = {value, value}};
+    auto mput_res = MultiPutResponse{};
+    return store->MultiPut(&mput_req, &mput_res);
+  };
+  for (std::size_t i = 0; i < kNumPairs; i++) ASSERT(write_pair(i, "0"));
+
+  std::atomic<bool> done = false;
+  std::vector<std::future<bool>> writers;
+  for (std::size_t t = 0; t < kNumWriters; t++) {
+    writers.push_back(std::async(std::launch::async, [&, t] {
+      for (std::size_t n = 0; !done; n++) {
+        // Values of varying lengths, so some are rewritten in place and some
+        // moved
+        std::string value = std::to_string(t) + std::string(n % 50, '_') +
+                            std::to_string(n);
+        ASSERT(write_pair(n % kNumPairs, value));
+      }
+      return true;
+    }));
+  }
+
+  std::vector<std::future<bool>> readers;
+  for (std::size_t t = 0; t < kNumReaders; t++) {
+    readers.push_back(std::async(std::launch::async, [&] {
+      for (std::size_t n = 0; n < kNumSnapshots; n++) {
+        auto snapshot = store->TakeSnapshot();
+        std::unordered_map<std::string, std::string> items;
+        while (true) {
+          KvItems batch = snapshot->Next(kBatchSize);
+          if (batch.keys.empty()) break;
+          for (std::size_t i = 0; i < batch.keys.size(); i++) {
+            items[batch.keys[i]] = batch.values[i];
+          }
+        }
+        ASSERT_EQ(items.size(), 2 * kNumPairs);
+        for (std::size_t i = 0; i < kNumPairs; i++) {
+          ASSERT_EQ(items[firsts[i]], items[seconds[i]]);
+        }
+      }
+      return true;
+    }));
+  }
+
+  auto passed = true;
+  for (auto& r : readers) passed &= r.get();
+  done = true;
+  for (auto& w : writers) passed &= w.get();
+  ASSERT(passed);
+
+  return 0;
+}
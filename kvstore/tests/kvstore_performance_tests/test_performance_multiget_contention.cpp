@@ -0,0 +1,147 @@
+#include <fstream>
+#include <random>
+
+#include "test_utils/test_utils.hpp"
+
+using namespace std;
+static constexpr size_t N_THREADS = 8;
+static constexpr size_t N_KEYS = 10'000;
+static constexpr size_t N_KEYS_PER_MGET = 1'000;
+static constexpr size_t N_MGETS_PER_THREAD = 50;
+static constexpr size_t N_PUTS_PER_THREAD = N_MGETS_PER_THREAD * N_KEYS_PER_MGET;
+static constexpr size_t N_MPUTS_PER_THREAD = 50;
+
+int main(int argc, char* argv[]) {
+  std::ofstream output_file("performance-runtime.csv", std::ios::app);
+  if (!output_file.is_open()) {
+    std::cerr << "Failed to open output file." << std::endl;
+  }
+
+  /*
+    This test measures how well large MultiGets and point writes get along.
+    Half of the threads MultiGet random keys from all over the store, while
+    the other half Put single keys. A MultiGet that locked every bucket it
+    touches for its whole duration would hold up every writer; reading the
+    buckets one at a time and revalidating lets them run side by side. As in
+    the other performance tests, the same work is first done on a single
+    thread for comparison.
+  */
+  auto store = make_unique<ConcurrentKvStore>();
+  vector<string> keys = make_rand_strs(N_KEYS, 32);
+  vector<string> values(N_KEYS, "0");
+  ASSERT(multiput_range(*store, keys, values, 0, N_KEYS, N_KEYS));
+
+  // Each thread's requests, picked up front so that only the store is timed
+  mt19937 gen(0);
+  uniform_int_distribution<size_t> pick(0, N_KEYS - 1);
+  vector<vector<MultiGetRequest>> mgets(N_THREADS / 2);
+  vector<vector<PutRequest>> puts(N_THREADS / 2);
+  for (size_t t = 0; t < N_THREADS / 2; t++) {
+    for (size_t i = 0; i < N_MGETS_PER_THREAD; i++) {
+      MultiGetRequest req;
+      for (size_t k = 0; k < N_KEYS_PER_MGET; k++) {
+        req.keys.push_back(keys[pick(gen)]);
+      }
+      mgets[t].push_back(std::move(req));
+    }
+    for (size_t i = 0; i < N_PUTS_PER_THREAD; i++) {
+      puts[t].push_back(PutRequest{keys[pick(gen)], to_string(i)});
+    }
+  }
+
+  auto reader = [&](size_t t) {
+    for (auto&& req : mgets[t]) {
+      MultiGetResponse res;
+      ASSERT(store->MultiGet(&req, &res));
+      ASSERT_EQ(res.values.size(), N_KEYS_PER_MGET);
+    }
+  };
+  auto writer = [&](size_t t) {
+    for (auto&& req : puts[t]) {
+      PutResponse res;
+      ASSERT(store->Put(&req, &res));
+    }
+  };
+
+  // Time a single thread doing all the work
+  auto start = chrono::high_resolution_clock::now();
+  {
+    thread single_thread([&] {
+      for (size_t t = 0; t < N_THREADS / 2; t++) {
+        reader(t);
+        writer(t);
+      }
+    });
+    single_thread.join();
+  }
+  auto end = chrono::high_resolution_clock::now();
+  auto single_threaded_time =
+      chrono::duration_cast<chrono::milliseconds>(end - start);
+
+  output_file << "single_thread_multiget_put,"
+              << single_threaded_time.count() << ","
+              << to_throughput(single_threaded_time, N_THREADS,
+                               N_PUTS_PER_THREAD)
+              << "\n";
+
+  // Time readers and writers running at the same time
+  start = chrono::high_resolution_clock::now();
+  {
+    vector<thread> threads;
+    for (size_t t = 0; t < N_THREADS / 2; t++) {
+      threads.emplace_back(reader, t);
+      threads.emplace_back(writer, t);
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  end = chrono::high_resolution_clock::now();
+  auto multi_threaded_time =
+      chrono::duration_cast<chrono::milliseconds>(end - start);
+
+  output_file << "multi_thread_multiget_put," << multi_threaded_time.count()
+              << ","
+              << to_throughput(multi_threaded_time, N_THREADS,
+                               N_PUTS_PER_THREAD)
+              << "\n";
+
+  output_file.close();
+
+  /*
+    MultiPuts write their keys one bucket at a time, so make sure a MultiGet
+    never sees half of one: half of the threads MultiPut one value to all of
+    a batch of keys (spread over every bucket), a different value each time,
+    while the other half MultiGet the batch.
+  */
+  vector<string> batch(keys.begin(), keys.begin() + N_KEYS_PER_MGET);
+  vector<string> batch_values(batch.size(), "start");
+  ASSERT(multiput_range(*store, batch, batch_values, 0, batch.size(),
+                        batch.size()));
+  vector<thread> threads;
+  for (size_t t = 0; t < N_THREADS / 2; t++) {
+    threads.emplace_back([&, t] {
+      for (size_t i = 0; i < N_MPUTS_PER_THREAD; i++) {
+        vector<string> batch_values(batch.size(),
+                                    to_string(t) + "_" + to_string(i));
+        auto req = MultiPutRequest{.keys = batch, .values = batch_values};
+        MultiPutResponse res;
+        ASSERT(store->MultiPut(&req, &res));
+      }
+    });
+    threads.emplace_back([&] {
+      for (size_t i = 0; i < N_MGETS_PER_THREAD; i++) {
+        auto req = MultiGetRequest{batch};
+        MultiGetResponse res;
+        ASSERT(store->MultiGet(&req, &res));
+        ASSERT_EQ(res.values.size(), N_KEYS_PER_MGET);
+        for (auto&& value : res.values) {
+          ASSERT_EQ(value, res.values[0]);
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
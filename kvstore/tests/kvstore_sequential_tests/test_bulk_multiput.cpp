@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_utils/test_utils.hpp"
+
+using namespace std::chrono_literals;
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  auto get = [&](const std::string& key) -> std::optional<std::string> {
+    auto get_req = GetRequest{.key = key};
+    auto get_res = GetResponse{};
+    if (!store->Get(&get_req, &get_res)) return std::nullopt;
+    return get_res.value;
+  };
+  auto referencing = [&](const std::string& id) {
+    auto keys = store->Referencing(id);
+    std::sort(keys.begin(), keys.end());
+    return keys;
+  };
+  using Keys = std::vector<std::string>;
+
+  // A bulk MultiPut writes every key, spread over many buckets
+  auto multiput_req = MultiPutRequest{.keys = {}, .values = {}, .bulk = true};
+  for (int i = 0; i < 1000; i++) {
+    multiput_req.keys.push_back("key_" + std::to_string(i));
+    multiput_req.values.push_back("value " + std::to_string(i));
+  }
+  multiput_req.keys.push_back("post_1");
+  multiput_req.values.push_back("by user_1 and user_2");
+  auto multiput_res = MultiPutResponse{};
+  ASSERT(store->MultiPut(&multiput_req, &multiput_res));
+  for (int i = 0; i < 1000; i++) {
+    ASSERT(get("key_" + std::to_string(i)) == "value " + std::to_string(i));
+  }
+  ASSERT_EQ_VECS(referencing("user_1"), Keys{"post_1"});
+  ASSERT_EQ_VECS(referencing("user_2"), Keys{"post_1"});
+
+  // Overwriting keys keeps the reference index up to date
+  multiput_req = MultiPutRequest{
+      .keys = {"post_1", "key_0"}, .values = {"by user_2", "x"}, .bulk = true};
+  ASSERT(store->MultiPut(&multiput_req, &multiput_res));
+  ASSERT(get("key_0") == "x");
+  ASSERT(referencing("user_1").empty());
+  ASSERT_EQ_VECS(referencing("user_2"), Keys{"post_1"});
+
+  // A key given twice ends up with its last value
+  multiput_req = MultiPutRequest{.keys = {"post_1", "post_2", "post_1"},
+                                 .values = {"by user_4", "new", "by user_5"},
+                                 .bulk = true};
+  ASSERT(store->MultiPut(&multiput_req, &multiput_res));
+  ASSERT(get("post_1") == "by user_5");
+  ASSERT(get("post_2") == "new");
+  ASSERT(referencing("user_2").empty());
+  ASSERT(referencing("user_4").empty());
+  ASSERT_EQ_VECS(referencing("user_5"), Keys{"post_1"});
+
+  // Every key gets the TTL
+  multiput_req = MultiPutRequest{.keys = {"t1", "t2", "t3"},
+                                 .values = {"a", "b", "user_3"},
+                                 .ttl_ms = 50,
+                                 .bulk = true};
+  ASSERT(store->MultiPut(&multiput_req, &multiput_res));
+  ASSERT(get("t1") == "a");
+  ASSERT_EQ_VECS(referencing("user_3"), Keys{"t3"});
+  std::this_thread::sleep_for(300ms);
+  for (auto key : {"t1", "t2", "t3"}) ASSERT(!get(key));
+  ASSERT(referencing("user_3").empty());
+  ASSERT(get("key_1") == "value 1");
+
+  // Mismatched keys and values are still rejected
+  multiput_req =
+      MultiPutRequest{.keys = {"a", "b"}, .values = {"1"}, .bulk = true};
+  ASSERT(!store->MultiPut(&multiput_req, &multiput_res));
+
+  return 0;
+}
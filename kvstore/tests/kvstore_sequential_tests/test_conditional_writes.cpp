@@ -0,0 +1,111 @@
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include "test_utils/test_utils.hpp"
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  auto get = [&](const std::string& key) -> std::optional<std::string> {
+    auto get_req = GetRequest{.key = key};
+    auto get_res = GetResponse{};
+    if (!store->Get(&get_req, &get_res)) return std::nullopt;
+    return get_res.value;
+  };
+
+  // PutIfAbsent only writes the first time
+  auto pia_req = PutIfAbsentRequest{.key = "lock", .value = "owner1"};
+  auto pia_res = PutIfAbsentResponse{};
+  ASSERT(store->PutIfAbsent(&pia_req, &pia_res));
+  ASSERT(pia_res.inserted);
+  ASSERT_EQ(pia_res.value, std::string("owner1"));
+
+  pia_req.value = "owner2";
+  ASSERT(store->PutIfAbsent(&pia_req, &pia_res));
+  ASSERT(!pia_res.inserted);
+  ASSERT_EQ(pia_res.value, std::string("owner1"));
+  ASSERT_EQ(*get("lock"), std::string("owner1"));
+
+  // CompareAndSwap only writes if the value matches
+  auto cas_req = CompareAndSwapRequest{
+      .key = "lock", .expected = "owner2", .desired = "owner3"};
+  auto cas_res = CompareAndSwapResponse{};
+  ASSERT(store->CompareAndSwap(&cas_req, &cas_res));
+  ASSERT(!cas_res.swapped);
+  ASSERT_EQ(cas_res.value, std::string("owner1"));
+
+  cas_req.expected = "owner1";
+  ASSERT(store->CompareAndSwap(&cas_req, &cas_res));
+  ASSERT(cas_res.swapped);
+  ASSERT_EQ(cas_res.value, std::string("owner3"));
+  ASSERT_EQ(*get("lock"), std::string("owner3"));
+
+  // ...and never creates a key
+  cas_req = CompareAndSwapRequest{
+      .key = "missing", .expected = "", .desired = "value"};
+  ASSERT(store->CompareAndSwap(&cas_req, &cas_res));
+  ASSERT(!cas_res.swapped);
+  ASSERT(!get("missing"));
+
+  // The same goes for appended values
+  auto append_req = AppendRequest{.key = "lock", .value = "!"};
+  auto append_res = AppendResponse{};
+  ASSERT(store->Append(&append_req, &append_res));
+  cas_req = CompareAndSwapRequest{
+      .key = "lock", .expected = "owner3!", .desired = "owner4"};
+  ASSERT(store->CompareAndSwap(&cas_req, &cas_res));
+  ASSERT(cas_res.swapped);
+
+  // DeleteIfEquals only deletes if the value matches
+  auto die_req = DeleteIfEqualsRequest{.key = "lock", .expected = "owner3"};
+  auto die_res = DeleteIfEqualsResponse{};
+  ASSERT(store->DeleteIfEquals(&die_req, &die_res));
+  ASSERT(!die_res.deleted);
+  ASSERT(get("lock"));
+
+  die_req.expected = "owner4";
+  ASSERT(store->DeleteIfEquals(&die_req, &die_res));
+  ASSERT(die_res.deleted);
+  ASSERT(!get("lock"));
+
+  ASSERT(store->DeleteIfEquals(&die_req, &die_res));
+  ASSERT(!die_res.deleted);
+
+  // Increment starts missing keys at 0, and takes negative deltas
+  auto incr_req = IncrementRequest{.key = "counter", .delta = 5};
+  auto incr_res = IncrementResponse{};
+  ASSERT(store->Increment(&incr_req, &incr_res));
+  ASSERT_EQ(incr_res.value, int64_t(5));
+
+  incr_req.delta = -8;
+  ASSERT(store->Increment(&incr_req, &incr_res));
+  ASSERT_EQ(incr_res.value, int64_t(-3));
+  ASSERT_EQ(*get("counter"), std::string("-3"));
+
+  // A counter is an ordinary value
+  auto put_req = PutRequest{.key = "counter", .value = "41"};
+  auto put_res = PutResponse{};
+  ASSERT(store->Put(&put_req, &put_res));
+  incr_req.delta = 1;
+  ASSERT(store->Increment(&incr_req, &incr_res));
+  ASSERT_EQ(incr_res.value, int64_t(42));
+
+  // Increment fails on values that aren't integers, or on overflow, and leaves
+  // them alone
+  for (auto value : {"", "abc", "12abc", "1.5", " 7"}) {
+    put_req = PutRequest{.key = "counter", .value = value};
+    ASSERT(store->Put(&put_req, &put_res));
+    ASSERT(!store->Increment(&incr_req, &incr_res));
+    ASSERT_EQ(*get("counter"), std::string(value));
+  }
+
+  put_req = PutRequest{
+      .key = "counter",
+      .value = std::to_string(std::numeric_limits<int64_t>::max())};
+  ASSERT(store->Put(&put_req, &put_res));
+  ASSERT(!store->Increment(&incr_req, &incr_res));
+  incr_req.delta = -1;
+  ASSERT(store->Increment(&incr_req, &incr_res));
+  ASSERT_EQ(incr_res.value, std::numeric_limits<int64_t>::max() - 1);
+}
@@ -0,0 +1,61 @@
+#include "test_utils/test_utils.hpp"
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  // A value made of appended pieces, read back in chunks across them
+  std::string expected;
+  for (int i = 0; i < 10; i++) {
+    std::string piece(100 + i, 'a' + i);
+    expected += piece;
+    auto append_req = AppendRequest{.key = "big", .value = piece};
+    auto append_res = AppendResponse{};
+    ASSERT(store->Append(&append_req, &append_res));
+  }
+
+  std::string read;
+  uint64_t version = 0;
+  for (uint64_t offset = 0; offset < expected.size(); offset += 333) {
+    auto range_req =
+        GetStreamRequest{.key = "big", .offset = offset, .max_bytes = 333};
+    auto range_res = GetStreamResponse{};
+    ASSERT(store->GetRange(&range_req, &range_res));
+    ASSERT_EQ(range_res.total_size, expected.size());
+    ASSERT_EQ(range_res.chunk, expected.substr(offset, 333));
+    if (offset > 0) ASSERT_EQ(range_res.version, version);
+    version = range_res.version;
+    read += range_res.chunk;
+  }
+  ASSERT_EQ(read, expected);
+
+  // Past the end, there's nothing left to read
+  auto past_req = GetStreamRequest{.key = "big", .offset = 5000};
+  auto past_res = GetStreamResponse{};
+  ASSERT(store->GetRange(&past_req, &past_res));
+  ASSERT(past_res.chunk.empty());
+
+  // Chunks are capped, however many bytes are asked for
+  std::string huge(STREAM_CHUNK_SIZE + 10, 'x');
+  auto put_req = PutRequest{.key = "huge", .value = huge};
+  auto put_res = PutResponse{};
+  ASSERT(store->Put(&put_req, &put_res));
+  auto huge_req = GetStreamRequest{.key = "huge", .max_bytes = UINT64_MAX};
+  auto huge_res = GetStreamResponse{};
+  ASSERT(store->GetRange(&huge_req, &huge_res));
+  ASSERT_EQ(huge_res.chunk.size(), size_t(STREAM_CHUNK_SIZE));
+  ASSERT_EQ(huge_res.total_size, huge.size());
+
+  // A write to the key gives it a new version
+  auto big_req = GetStreamRequest{.key = "big"};
+  auto before = GetStreamResponse{};
+  ASSERT(store->GetRange(&big_req, &before));
+  auto overwrite_req = PutRequest{.key = "big", .value = expected};
+  ASSERT(store->Put(&overwrite_req, &put_res));
+  auto after = GetStreamResponse{};
+  ASSERT(store->GetRange(&big_req, &after));
+  ASSERT(after.version != before.version);
+
+  auto missing_req = GetStreamRequest{.key = "missing"};
+  auto missing_res = GetStreamResponse{};
+  ASSERT(!store->GetRange(&missing_req, &missing_res));
+}
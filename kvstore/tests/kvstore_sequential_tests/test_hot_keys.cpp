@@ -0,0 +1,86 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "server/hot_keys.hpp"
+#include "test_utils/test_utils.hpp"
+
+using namespace std::chrono_literals;
+
+static constexpr std::size_t kNumThreads = 4;
+static constexpr std::size_t kHotAccesses = 5000;
+static constexpr std::size_t kNumWarmKeys = 20;
+static constexpr std::size_t kWarmAccesses = 200;
+static constexpr std::size_t kNumColdKeys = 20000;
+
+int main() {
+  /*
+    One hot key, a few warm ones and many that are accessed once, recorded
+    from several threads at once. The hot and warm keys must come out on top,
+    in order, with counts that are never too low and only slightly too high.
+  */
+  {
+    HotKeyTracker tracker(1h, kNumWarmKeys + 1);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < kNumThreads; t++) {
+      threads.emplace_back([&, t] {
+        for (std::size_t i = 0; i < kNumColdKeys / kNumThreads; i++) {
+          tracker.record("cold" + std::to_string(t) + "_" + std::to_string(i));
+          if (i % 4 == 0) tracker.record("hot");
+          if (i % 100 == 0) {
+            for (std::size_t w = 0; w < kNumWarmKeys; w++) {
+              tracker.record("warm" + std::to_string(w));
+            }
+          }
+        }
+      });
+    }
+    for (auto&& thread : threads) thread.join();
+
+    StatsResponse stats = tracker.stats();
+    ASSERT_EQ(stats.n_accesses,
+              kNumColdKeys + kHotAccesses + kNumWarmKeys * kWarmAccesses);
+    ASSERT_EQ(stats.hot_keys.size(), kNumWarmKeys + 1);
+    ASSERT_EQ(stats.hot_keys[0].key, std::string("hot"));
+    ASSERT(stats.hot_keys[0].count >= kHotAccesses);
+    ASSERT(stats.hot_keys[0].count < kHotAccesses * 11 / 10);
+    for (std::size_t i = 1; i <= kNumWarmKeys; i++) {
+      ASSERT_EQ(stats.hot_keys[i].key.substr(0, 4), std::string("warm"));
+      ASSERT(stats.hot_keys[i].count >= kWarmAccesses);
+      ASSERT(stats.hot_keys[i].count < kWarmAccesses * 2);
+      ASSERT(stats.hot_keys[i].count <= stats.hot_keys[i - 1].count);
+    }
+  }
+
+  /*
+    Once a window is over, stats describe it, and the next window starts
+    counting from scratch.
+  */
+  {
+    HotKeyTracker tracker(100ms, 2);
+    StatsResponse stats = tracker.stats();
+    ASSERT_EQ(stats.n_accesses, 0UL);
+    ASSERT(stats.hot_keys.empty());
+
+    for (std::size_t i = 0; i < 10; i++) tracker.record("first");
+    tracker.record("second");
+    std::this_thread::sleep_for(150ms);
+
+    stats = tracker.stats();
+    ASSERT(stats.window_ms >= 100);
+    ASSERT_EQ(stats.n_accesses, 11UL);
+    ASSERT_EQ(stats.hot_keys.size(), 2UL);
+    ASSERT_EQ(stats.hot_keys[0].key, std::string("first"));
+    ASSERT_EQ(stats.hot_keys[0].count, 10UL);
+    ASSERT_EQ(stats.hot_keys[1].key, std::string("second"));
+
+    tracker.record("next");
+    std::this_thread::sleep_for(150ms);
+    stats = tracker.stats();
+    ASSERT_EQ(stats.n_accesses, 1UL);
+    ASSERT_EQ(stats.hot_keys.size(), 1UL);
+    ASSERT_EQ(stats.hot_keys[0].key, std::string("next"));
+  }
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_utils/test_utils.hpp"
+
+using namespace std::chrono_literals;
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  auto put = [&](const std::string& key, const std::string& value,
+                 uint64_t ttl_ms = 0) {
+    auto put_req = PutRequest{.key = key, .value = value, .ttl_ms = ttl_ms};
+    auto put_res = PutResponse{};
+    return store->Put(&put_req, &put_res);
+  };
+  auto get = [&](const std::string& key) -> std::optional<std::string> {
+    auto get_req = GetRequest{.key = key};
+    auto get_res = GetResponse{};
+    if (!store->Get(&get_req, &get_res)) return std::nullopt;
+    return get_res.value;
+  };
+  auto sorted = [](std::vector<std::string> keys) {
+    std::sort(keys.begin(), keys.end());
+    return keys;
+  };
+  using Keys = std::vector<std::string>;
+
+  // Keys written before the store is partitioned are placed afterwards
+  ASSERT(put("apple", "red, like post_1"));
+  ASSERT(put("avocado", "green"));
+  ASSERT(put("banana", "yellow"));
+  ASSERT(put("cherry", "red"));
+  ASSERT(put("zucchini", "green"));
+  Shard a{"A", "A"}, b_to_c{"B", "C"}, d_to_y{"D", "Y"};
+  store->Repartition({d_to_y, a, b_to_c}, to_upper);
+  ASSERT_EQ_VECS(sorted(store->AllKeys(a)), (Keys{"apple", "avocado"}));
+  ASSERT_EQ_VECS(sorted(store->AllKeys(b_to_c)), (Keys{"banana", "cherry"}));
+  ASSERT(store->AllKeys(d_to_y).empty());
+  ASSERT_EQ(store->AllKeys().size(), 5ul);
+  ASSERT_EQ_VECS(store->Referencing("post_1"), Keys{"apple"});
+
+  // Any range can be listed, not only a partition
+  ASSERT_EQ_VECS(store->AllKeys(Shard{"C", "Z"}), (Keys{"cherry", "zucchini"}));
+  ASSERT_EQ_VECS(store->AllKeys(Shard{"AP", "AP"}), Keys{"apple"});
+
+  // A shard's items come with their values, and its size counts both
+  ASSERT(put("banana", "ripe", 60000));
+  KvItems items = store->ShardItems(b_to_c);
+  ASSERT_EQ(items.keys.size(), 2ul);
+  for (size_t i = 0; i < items.keys.size(); i++) {
+    ASSERT(get(items.keys[i]) == items.values[i]);
+    ASSERT_EQ(items.ttls_ms[i] > 0, items.keys[i] == "banana");
+  }
+  ASSERT_EQ(store->ShardBytes(b_to_c),
+            std::string("bananaripecherryred").size());
+
+  // Dropping a shard takes all of its keys and nothing else
+  store->DropShard(b_to_c);
+  ASSERT(!get("banana"));
+  ASSERT(!get("cherry"));
+  ASSERT(store->AllKeys(b_to_c).empty());
+  ASSERT_EQ(store->ShardBytes(b_to_c), 0ul);
+  ASSERT(get("apple") == "red, like post_1");
+  ASSERT(get("zucchini") == "green");
+  ASSERT(put("cherry", "dark red"));
+  ASSERT(get("cherry") == "dark red");
+
+  // Attaching fills an empty shard, or merges into one in use, either way as
+  // Puts would
+  store->AttachShard(d_to_y, KvItems{{"date", "elderberry"},
+                                     {"brown", "purple, like post_1"},
+                                     {0, 100}});
+  ASSERT(get("date") == "brown");
+  ASSERT(get("elderberry") == "purple, like post_1");
+  ASSERT_EQ_VECS(sorted(store->Referencing("post_1")),
+                 (Keys{"apple", "elderberry"}));
+  store->AttachShard(
+      a, KvItems{{"apple", "apricot"}, {"green", "orange"}, {0, 0}});
+  ASSERT(get("apple") == "green");
+  ASSERT(get("apricot") == "orange");
+  ASSERT(get("avocado") == "green");
+  ASSERT_EQ_VECS(store->Referencing("post_1"), Keys{"elderberry"});
+  // Attached keys still expire
+  std::this_thread::sleep_for(300ms);
+  ASSERT(!get("elderberry"));
+  ASSERT(get("date") == "brown");
+
+  // A new layout keeps the keys, wherever they end up
+  Shard a_to_m{"A", "M"}, n_to_z{"N", "Z"};
+  store->Repartition({a_to_m, n_to_z}, to_upper);
+  ASSERT_EQ_VECS(sorted(store->AllKeys(a_to_m)),
+                 (Keys{"apple", "apricot", "avocado", "cherry", "date"}));
+  ASSERT_EQ_VECS(store->AllKeys(n_to_z), Keys{"zucchini"});
+  ASSERT(get("cherry") == "dark red");
+  ASSERT(put("kiwi", "brown"));
+  ASSERT_EQ(store->AllKeys().size(), 7ul);
+
+  // A split keeps every key once, in the part it belongs to
+  ASSERT(put("kiwi", "green, like post_2"));
+  Shard a_to_c{"A", "C"}, d_to_m{"D", "M"};
+  store->Repartition({a_to_c, d_to_m, n_to_z}, to_upper);
+  ASSERT_EQ_VECS(sorted(store->AllKeys(a_to_c)),
+                 (Keys{"apple", "apricot", "avocado", "cherry"}));
+  ASSERT_EQ_VECS(sorted(store->AllKeys(d_to_m)), (Keys{"date", "kiwi"}));
+  ASSERT_EQ(store->AllKeys().size(), 7ul);
+  ASSERT_EQ_VECS(store->Referencing("post_2"), Keys{"kiwi"});
+  ASSERT(get("kiwi") == "green, like post_2");
+
+  // Keys of shards that are no longer kept apart go back in the rest
+  store->Repartition({a_to_c}, to_upper);
+  ASSERT_EQ(store->AllKeys().size(), 7ul);
+  ASSERT_EQ_VECS(sorted(store->AllKeys(d_to_m)), (Keys{"date", "kiwi"}));
+  store->DropShard(d_to_m);
+  ASSERT(!get("kiwi"));
+  ASSERT(get("zucchini") == "green");
+  ASSERT_EQ(store->AllKeys().size(), 5ul);
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_utils/test_utils.hpp"
+
+using namespace std::chrono_literals;
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  auto put = [&](const std::string& key, const std::string& value,
+                 uint64_t ttl_ms = 0) {
+    auto put_req = PutRequest{.key = key, .value = value, .ttl_ms = ttl_ms};
+    auto put_res = PutResponse{};
+    return store->Put(&put_req, &put_res);
+  };
+  auto referencing = [&](const std::string& id) {
+    auto keys = store->Referencing(id);
+    std::sort(keys.begin(), keys.end());
+    return keys;
+  };
+  using Keys = std::vector<std::string>;
+
+  // Identifiers are whole words with a number after an underscore; "user_1"
+  // doesn't match "user_15" or "user_1_posts"
+  ASSERT(put("post_1", "hello @user_1, meet user_15!"));
+  ASSERT(put("all_users", "user_1,user_15"));
+  ASSERT(put("user_1_posts", "post_1"));
+  ASSERT(put("bio", "user_ and user_x are not identifiers"));
+  ASSERT_EQ_VECS(referencing("user_1"), (Keys{"all_users", "post_1"}));
+  ASSERT_EQ_VECS(referencing("user_15"), (Keys{"all_users", "post_1"}));
+  ASSERT_EQ_VECS(referencing("post_1"), Keys{"user_1_posts"});
+  ASSERT(referencing("user_").empty());
+  ASSERT(referencing("user").empty());
+
+  // Overwriting, appending and deleting keep the index up to date
+  ASSERT(put("post_1", "hello @user_15"));
+  ASSERT_EQ_VECS(referencing("user_1"), Keys{"all_users"});
+  auto append_req = AppendRequest{.key = "all_users", .value = ",user_16"};
+  auto append_res = AppendResponse{};
+  ASSERT(store->Append(&append_req, &append_res));
+  ASSERT_EQ_VECS(referencing("user_16"), Keys{"all_users"});
+  // A mention split across two appends counts once it's whole
+  append_req = AppendRequest{.key = "user_1_posts", .value = ",post_"};
+  ASSERT(store->Append(&append_req, &append_res));
+  append_req = AppendRequest{.key = "user_1_posts", .value = "2"};
+  ASSERT(store->Append(&append_req, &append_res));
+  ASSERT_EQ_VECS(referencing("post_2"), Keys{"user_1_posts"});
+
+  auto delete_req = DeleteRequest{.key = "all_users"};
+  auto delete_res = DeleteResponse{};
+  ASSERT(store->Delete(&delete_req, &delete_res));
+  ASSERT(referencing("user_1").empty());
+  ASSERT_EQ_VECS(referencing("user_15"), Keys{"post_1"});
+
+  // So do the atomic operations
+  auto cas_req = CompareAndSwapRequest{
+      .key = "post_1", .expected = "hello @user_15", .desired = "hi user_2"};
+  auto cas_res = CompareAndSwapResponse{};
+  ASSERT(store->CompareAndSwap(&cas_req, &cas_res));
+  ASSERT(cas_res.swapped);
+  ASSERT(referencing("user_15").empty());
+  ASSERT_EQ_VECS(referencing("user_2"), Keys{"post_1"});
+  auto die_req = DeleteIfEqualsRequest{.key = "post_1", .expected = "hi user_2"};
+  auto die_res = DeleteIfEqualsResponse{};
+  ASSERT(store->DeleteIfEquals(&die_req, &die_res));
+  ASSERT(die_res.deleted);
+  ASSERT(referencing("user_2").empty());
+
+  // Expired keys drop out of the index once they're removed
+  ASSERT(put("story", "by user_3", 50));
+  ASSERT_EQ_VECS(referencing("user_3"), Keys{"story"});
+  std::this_thread::sleep_for(300ms);
+  ASSERT(referencing("user_3").empty());
+
+  return 0;
+}
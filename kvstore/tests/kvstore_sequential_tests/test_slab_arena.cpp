@@ -0,0 +1,67 @@
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "kvstore/slab_arena.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t kNumBlocks = 20000;
+
+int main() {
+  /*
+    Blocks of many sizes, small and big, are aligned, don't overlap, and keep
+    what's written to them. Freeing them all gives the memory back, except
+    for at most one slab per size class.
+  */
+  {
+    SlabArena arena;
+    std::mt19937 rng(42);
+    std::vector<std::pair<char*, std::size_t>> blocks;
+    for (std::size_t i = 0; i < kNumBlocks; i++) {
+      // Mostly small items, with the odd big one
+      std::size_t size = i % 100 == 0 ? 5000 + rng() % 20000 : rng() % 600;
+      auto* block = static_cast<char*>(arena.allocate(size));
+      ASSERT(reinterpret_cast<std::uintptr_t>(block) % 16 == 0);
+      ASSERT(SlabArena::block_size(size) >= size);
+      std::memset(block, static_cast<int>(i % 251), size);
+      blocks.emplace_back(block, size);
+    }
+    for (std::size_t i = 0; i < kNumBlocks; i++) {
+      auto [block, size] = blocks[i];
+      for (std::size_t j = 0; j < size; j++) {
+        ASSERT_EQ(static_cast<unsigned char>(block[j]),
+                  static_cast<unsigned char>(i % 251));
+      }
+    }
+
+    // Free every other block, then allocate them again: the freed blocks are
+    // reused rather than taking more memory
+    std::size_t footprint = arena.footprint();
+    for (std::size_t i = 0; i < kNumBlocks; i += 2) {
+      arena.deallocate(blocks[i].first, blocks[i].second);
+    }
+    for (std::size_t i = 0; i < kNumBlocks; i += 2) {
+      blocks[i].first = static_cast<char*>(arena.allocate(blocks[i].second));
+    }
+    ASSERT(arena.footprint() <= footprint);
+
+    for (auto&& [block, size] : blocks) arena.deallocate(block, size);
+    ASSERT(arena.footprint() <= 32 * SLAB_SIZE);
+  }
+
+  /*
+    Small blocks take their size rounded up to a 16-byte step, and a quarter
+    of a power of two above 256 bytes.
+  */
+  {
+    ASSERT_EQ(SlabArena::block_size(1), 16UL);
+    ASSERT_EQ(SlabArena::block_size(72), 80UL);
+    ASSERT_EQ(SlabArena::block_size(256), 256UL);
+    ASSERT_EQ(SlabArena::block_size(257), 320UL);
+    ASSERT_EQ(SlabArena::block_size(513), 640UL);
+    ASSERT_EQ(SlabArena::block_size(MAX_SLAB_BLOCK), 4096UL);
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_utils/test_utils.hpp"
+
+using namespace std::chrono_literals;
+
+constexpr std::size_t kNumKeys = 500;
+constexpr std::size_t kBatchSize = 7;
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  auto put = [&](const std::string& key, const std::string& value,
+                 uint64_t ttl_ms = 0) {
+    auto put_req = PutRequest{.key = key, .value = value, .ttl_ms = ttl_ms};
+    auto put_res = PutResponse{};
+    return store->Put(&put_req, &put_res);
+  };
+  // Reads a snapshot in small batches
+  auto read_all = [&](KvSnapshot& snapshot) {
+    std::map<std::string, std::pair<std::string, uint64_t>> items;
+    while (true) {
+      KvItems batch = snapshot.Next(kBatchSize);
+      if (batch.keys.empty()) break;
+      ASSERT(batch.keys.size() <= kBatchSize);
+      ASSERT_EQ(batch.keys.size(), batch.values.size());
+      ASSERT_EQ(batch.keys.size(), batch.ttls_ms.size());
+      for (std::size_t i = 0; i < batch.keys.size(); i++) {
+        ASSERT(items.emplace(batch.keys[i],
+                             std::pair{batch.values[i], batch.ttls_ms[i]})
+                   .second);
+      }
+    }
+    ASSERT(snapshot.Next(kBatchSize).keys.empty());
+    return items;
+  };
+
+  std::map<std::string, std::string> expected;
+  for (std::size_t i = 0; i < kNumKeys; i++) {
+    std::string key = "key_" + std::to_string(i);
+    ASSERT(put(key, std::to_string(i)));
+    expected[key] = std::to_string(i);
+  }
+  ASSERT(put("expired", "gone", 1));
+  ASSERT(put("expiring", "later", 60'000));
+  std::this_thread::sleep_for(10ms);
+
+  // Nothing done to the store after the snapshot is taken shows up in it:
+  // overwrites, appends, deletes, new keys, or keys moved between partitions
+  // and dropped
+  auto snapshot = store->TakeSnapshot();
+  ASSERT(put("key_0", "overwritten"));
+  ASSERT(put("key_1", std::string(1000, 'x')));
+  auto append_req = AppendRequest{.key = "key_2", .value = "appended"};
+  auto append_res = AppendResponse{};
+  ASSERT(store->Append(&append_req, &append_res));
+  auto delete_req = DeleteRequest{.key = "key_3"};
+  auto delete_res = DeleteResponse{};
+  ASSERT(store->Delete(&delete_req, &delete_res));
+  ASSERT(put("new_key", "new"));
+  auto mput_req = MultiPutRequest{.keys = {"key_4", "key_5", "key_6"},
+                                  .values = {"a", "b", "c"}};
+  auto mput_res = MultiPutResponse{};
+  ASSERT(store->MultiPut(&mput_req, &mput_res));
+  Shard k{"K", "K"};
+  store->Repartition({k}, to_upper);
+  ASSERT(put("key_7", "after repartition"));
+  store->DropShard(k);
+  ASSERT_EQ(store->AllKeys().size(), 2ul);
+
+  auto items = read_all(*snapshot);
+  ASSERT_EQ(items.size(), kNumKeys + 1);
+  for (auto&& [key, value] : expected) {
+    ASSERT_EQ(items[key].first, value);
+    ASSERT_EQ(items[key].second, 0ul);
+  }
+  ASSERT_EQ(items["expiring"].first, std::string("later"));
+  ASSERT(items["expiring"].second > 0);
+
+  // A snapshot taken now sees the store as it is
+  auto now = store->TakeSnapshot();
+  items = read_all(*now);
+  ASSERT_EQ(items.size(), 2ul);
+  ASSERT_EQ(items["new_key"].first, std::string("new"));
+  ASSERT_EQ(items["expiring"].first, std::string("later"));
+
+  return 0;
+}
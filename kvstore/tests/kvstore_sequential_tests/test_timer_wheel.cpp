@@ -0,0 +1,58 @@
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "kvstore/timer_wheel.hpp"
+#include "test_utils/test_utils.hpp"
+
+using namespace std::chrono_literals;
+
+static constexpr std::size_t kNumTimers = 2000;
+
+int main() {
+  /*
+    Schedules timers over a span of a few thousand 1ms ticks, so that most of
+    them start out in the upper wheels and have to be cascaded down. Every
+    timer must fire exactly once, never before its deadline, and soon after it.
+  */
+  using Clock = TimerWheel::Clock;
+  std::mutex mtx;
+  std::map<std::string, std::pair<Clock::time_point, std::size_t>> fired;
+  TimerWheel wheel(
+      [&](const std::string& key, Clock::time_point deadline) {
+        auto now = Clock::now();
+        std::unique_lock lock(mtx);
+        auto& [at, count] = fired[key];
+        ASSERT(now >= deadline);
+        at = now;
+        count++;
+      },
+      1ms);
+
+  std::mt19937 rng(0);
+  std::map<std::string, Clock::time_point> deadlines;
+  auto start = Clock::now();
+  for (std::size_t i = 0; i < kNumTimers; i++) {
+    std::string key = "key" + std::to_string(i);
+    auto deadline = start + std::chrono::milliseconds(rng() % 3000);
+    deadlines[key] = deadline;
+    wheel.schedule(key, deadline);
+  }
+  // Already due
+  wheel.schedule("late", start - 1s);
+  deadlines["late"] = start - 1s;
+
+  std::this_thread::sleep_for(3200ms);
+
+  std::unique_lock lock(mtx);
+  ASSERT_EQ(fired.size(), deadlines.size());
+  for (auto&& [key, deadline] : deadlines) {
+    auto& [at, count] = fired[key];
+    ASSERT_EQ(count, 1UL);
+    ASSERT(at - std::max(deadline, start) < 100ms);
+  }
+  return 0;
+}
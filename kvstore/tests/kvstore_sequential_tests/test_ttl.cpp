@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "test_utils/test_utils.hpp"
+
+using namespace std::chrono_literals;
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  auto get = [&](const std::string& key) -> std::optional<GetResponse> {
+    auto get_req = GetRequest{.key = key};
+    auto get_res = GetResponse{};
+    if (!store->Get(&get_req, &get_res)) return std::nullopt;
+    return get_res;
+  };
+  auto has_key = [&](const std::string& key) {
+    auto keys = store->AllKeys();
+    return std::find(keys.begin(), keys.end(), key) != keys.end();
+  };
+
+  // Keys with a TTL are served, and report how long they have left, until
+  // they expire
+  auto put_req = PutRequest{.key = "session", .value = "a", .ttl_ms = 200};
+  auto put_res = PutResponse{};
+  ASSERT(store->Put(&put_req, &put_res));
+  put_req = PutRequest{.key = "user", .value = "b"};
+  ASSERT(store->Put(&put_req, &put_res));
+
+  auto session = get("session");
+  ASSERT(session);
+  ASSERT_EQ(session->value, std::string("a"));
+  ASSERT(session->ttl_ms > 0UL && session->ttl_ms <= 200UL);
+  ASSERT_EQ(get("user")->ttl_ms, 0UL);
+  ASSERT(has_key("session"));
+
+  // Appending without a TTL keeps the expiry; so do the atomic operations
+  auto append_req = AppendRequest{.key = "session", .value = "b"};
+  auto append_res = AppendResponse{};
+  ASSERT(store->Append(&append_req, &append_res));
+  auto cas_req = CompareAndSwapRequest{
+      .key = "session", .expected = "ab", .desired = "abc"};
+  auto cas_res = CompareAndSwapResponse{};
+  ASSERT(store->CompareAndSwap(&cas_req, &cas_res));
+  ASSERT(cas_res.swapped);
+  ASSERT(get("session")->ttl_ms > 0UL);
+
+  auto incr_req = IncrementRequest{.key = "hits", .delta = 1};
+  auto incr_res = IncrementResponse{};
+  put_req = PutRequest{.key = "hits", .value = "0", .ttl_ms = 200};
+  ASSERT(store->Put(&put_req, &put_res));
+  ASSERT(store->Increment(&incr_req, &incr_res));
+  ASSERT(get("hits")->ttl_ms > 0UL);
+
+  // A Put without a TTL makes a key persistent again
+  put_req = PutRequest{.key = "kept", .value = "c", .ttl_ms = 200};
+  ASSERT(store->Put(&put_req, &put_res));
+  put_req = PutRequest{.key = "kept", .value = "d"};
+  ASSERT(store->Put(&put_req, &put_res));
+  ASSERT_EQ(get("kept")->ttl_ms, 0UL);
+
+  // MultiPut sets the same TTL on every key, and PutIfAbsent can set one too
+  auto multiput_req = MultiPutRequest{
+      .keys = {"m1", "m2"}, .values = {"x", "y"}, .ttl_ms = 200};
+  auto multiput_res = MultiPutResponse{};
+  ASSERT(store->MultiPut(&multiput_req, &multiput_res));
+  auto pia_req = PutIfAbsentRequest{.key = "lock", .value = "me", .ttl_ms = 200};
+  auto pia_res = PutIfAbsentResponse{};
+  ASSERT(store->PutIfAbsent(&pia_req, &pia_res));
+  ASSERT(pia_res.inserted);
+
+  std::this_thread::sleep_for(300ms);
+
+  // Expired keys are gone from every operation
+  for (auto key : {"session", "hits", "m1", "m2", "lock"}) {
+    ASSERT(!get(key));
+    ASSERT(!has_key(key));
+  }
+  auto multiget_req = MultiGetRequest{.keys = {"user", "m1"}};
+  auto multiget_res = MultiGetResponse{};
+  ASSERT(!store->MultiGet(&multiget_req, &multiget_res));
+  auto delete_req = DeleteRequest{.key = "session"};
+  auto delete_res = DeleteResponse{};
+  ASSERT(!store->Delete(&delete_req, &delete_res));
+  ASSERT_EQ(get("user")->value, std::string("b"));
+  ASSERT_EQ(get("kept")->value, std::string("d"));
+
+  // ...and can be written from scratch
+  ASSERT(store->PutIfAbsent(&pia_req, &pia_res));
+  ASSERT(pia_res.inserted);
+  ASSERT(store->Increment(&incr_req, &incr_res));
+  ASSERT_EQ(incr_res.value, int64_t(1));
+  ASSERT_EQ(get("hits")->ttl_ms, 0UL);
+  append_req = AppendRequest{.key = "session", .value = "new", .ttl_ms = 10000};
+  ASSERT(store->Append(&append_req, &append_res));
+  session = get("session");
+  ASSERT_EQ(session->value, std::string("new"));
+  ASSERT(session->ttl_ms > 200UL);
+}
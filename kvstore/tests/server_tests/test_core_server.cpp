@@ -0,0 +1,90 @@
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client/async_client.hpp"
+#include "client/simple_client.hpp"
+#include "server/core_server.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_CORES = 4;
+constexpr size_t N_THREADS = 4;
+constexpr size_t N_KEYS = 400;
+constexpr size_t N_INCREMENTS = 50;
+
+int main() {
+  string address = get_host_address("10100");
+  auto server = make_shared<CoreServer>(address, N_CORES);
+  ASSERT(server->start() == 0);
+
+  // Every core's keys can be reached through any connection, whichever core
+  // accepted it
+  SimpleClient client(address);
+  for (size_t i = 0; i < N_KEYS; i++) {
+    ASSERT(client.Put("key_" + to_string(i), to_string(i)));
+  }
+  for (size_t i = 0; i < N_KEYS; i++) {
+    ASSERT_EQ(*client.Get("key_" + to_string(i)), to_string(i));
+  }
+  ASSERT(!client.Get("missing"));
+  ASSERT(client.Append("key_0", "s"));
+  ASSERT_EQ(*client.Delete("key_0"), string("0s"));
+  ASSERT(!client.Get("key_0"));
+
+  // Multi-key requests are split over the cores and put back together in
+  // order, failing as a whole if any part does
+  vector<string> keys, values;
+  for (size_t i = 0; i < 20; i++) {
+    keys.push_back("multi_" + to_string(i));
+    values.push_back(to_string(i * i));
+  }
+  ASSERT(client.MultiPut(keys, values));
+  ASSERT_EQ_VECS(*client.MultiGet(keys), values);
+  ASSERT(!client.MultiGet({"multi_0", "missing", "multi_1"}));
+  ASSERT(!client.MultiPut({"a", "b"}, {"only one"}));
+
+  // Conditional writes, from many connections at once
+  ASSERT(client.PutIfAbsent("lock", "a") == true);
+  ASSERT(client.PutIfAbsent("lock", "b") == false);
+  ASSERT(client.CompareAndSwap("lock", "a", "c") == true);
+  ASSERT(client.DeleteIfEquals("lock", "c") == true);
+  vector<thread> threads;
+  for (size_t t = 0; t < N_THREADS; t++) {
+    threads.emplace_back([&] {
+      SimpleClient thread_client(address);
+      for (size_t i = 0; i < N_INCREMENTS; i++) {
+        ASSERT(thread_client.Increment("counter_" + to_string(i % 3)));
+      }
+    });
+  }
+  for (auto&& thread : threads) thread.join();
+  size_t total = 0;
+  for (size_t i = 0; i < 3; i++) {
+    total += stoul(*client.Get("counter_" + to_string(i)));
+  }
+  ASSERT_EQ(total, N_THREADS * N_INCREMENTS);
+
+  // Many requests in flight on one connection, some served by the core that
+  // accepted it and some forwarded, are still answered in order
+  AsyncClient async_client(address, 1);
+  vector<Task<optional<string>>> gets;
+  for (size_t i = 1; i < N_KEYS; i++) {
+    gets.push_back(async_client.Get("key_" + to_string(i)));
+  }
+  vector<optional<string>> got = sync_wait(when_all(std::move(gets)));
+  for (size_t i = 1; i < N_KEYS; i++) {
+    ASSERT(got[i - 1] == to_string(i));
+  }
+
+  // Requests it doesn't serve are answered with an error
+  ASSERT(!client.Stats());
+
+  cout_color(GREEN, "Test passed!");
+
+  server->stop();
+  return 0;
+}
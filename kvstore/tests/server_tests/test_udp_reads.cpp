@@ -0,0 +1,79 @@
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client/simple_client.hpp"
+#include "client/udp_client.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_KEYS = 200;
+constexpr size_t N_THREADS = 4;
+
+int main() {
+  string address = get_host_address("10200");
+  auto server = make_shared<KvServer>(address, N_WORKERS, true);
+  ASSERT(server->start() == 0);
+
+  SimpleClient writer(address);
+  vector<string> keys, values;
+  for (size_t i = 0; i < N_KEYS; i++) {
+    keys.push_back("key_" + to_string(i));
+    values.push_back(to_string(i * i));
+  }
+  ASSERT(writer.MultiPut(keys, values));
+
+  // Small reads are answered over UDP
+  UdpClient client(address);
+  for (size_t i = 0; i < N_KEYS; i++) {
+    ASSERT_EQ(*client.Get(keys[i]), values[i]);
+  }
+  ASSERT(!client.Get("missing"));
+  vector<string> few_keys(keys.begin(), keys.begin() + 10);
+  vector<string> few_values(values.begin(), values.begin() + 10);
+  ASSERT_EQ_VECS(*client.MultiGet(few_keys), few_values);
+  ASSERT(!client.MultiGet({"key_0", "missing"}));
+  ASSERT_EQ(client.n_fallbacks(), 0UL);
+
+  // A response too large for a datagram, and a request too large for one, are
+  // sent over TCP instead
+  string large(4 * MAX_DATAGRAM_SIZE, 'x');
+  ASSERT(writer.Put("large", large));
+  ASSERT_EQ(*client.Get("large"), large);
+  ASSERT_EQ(client.n_fallbacks(), 1UL);
+  ASSERT_EQ_VECS(*client.MultiGet(keys), values);
+  ASSERT_EQ(client.n_fallbacks(), 2UL);
+
+  // Writes read back right away, from many clients at once
+  vector<thread> threads;
+  for (size_t t = 0; t < N_THREADS; t++) {
+    threads.emplace_back([&, t] {
+      SimpleClient thread_writer(address);
+      UdpClient thread_client(address);
+      for (size_t i = t; i < N_KEYS; i += N_THREADS) {
+        ASSERT(thread_writer.Put(keys[i], "new_" + values[i]));
+        ASSERT_EQ(*thread_client.Get(keys[i]), "new_" + values[i]);
+      }
+    });
+  }
+  for (auto&& thread : threads) thread.join();
+
+  // A server without a UDP listener is read from over TCP
+  string tcp_address = get_host_address("10201");
+  auto tcp_server = make_shared<KvServer>(tcp_address, N_WORKERS);
+  ASSERT(tcp_server->start() == 0);
+  ASSERT(SimpleClient(tcp_address).Put("key", "value"));
+  UdpClient tcp_client(tcp_address);
+  ASSERT_EQ(*tcp_client.Get("key"), string("value"));
+  ASSERT_EQ(*tcp_client.Get("key"), string("value"));
+  ASSERT(tcp_client.n_fallbacks() >= 1);
+
+  cout_color(GREEN, "Test passed!");
+
+  tcp_server->stop();
+  server->stop();
+  return 0;
+}
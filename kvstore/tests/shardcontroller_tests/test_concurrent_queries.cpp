@@ -0,0 +1,81 @@
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client/shardkv_client.hpp"
+#include "common/shard.hpp"
+#include "net/network_helpers.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 50;
+constexpr size_t N_CLIENTS = 8;
+
+int main() {
+  string sm_addr = get_host_address("8080");
+
+  shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  vector<string> servers = make_server_addresses(N_SERVERS);
+  map<string, vector<Shard>> correct_config;
+  for (string server : servers) {
+    ASSERT(test_join(sm, server, true));
+    correct_config[server] = vector<Shard>{};
+  }
+
+  // Clients keep querying over the network while the shards move around.
+  // Every config they see must be at least as new as the previous one.
+  atomic<bool> done = false;
+  atomic<size_t> n_failures = 0, n_queries = 0, n_started = 0;
+  vector<thread> clients;
+  for (size_t i = 0; i < N_CLIENTS; i++) {
+    clients.emplace_back([&] {
+      ShardKvClient client(sm_addr);
+      uint64_t last_version = 0;
+      n_started++;
+      while (!done) {
+        optional<ShardControllerConfig> config = client.Query();
+        if (!config || config->version < last_version) {
+          n_failures++;
+          continue;
+        }
+        last_version = config->version;
+        n_queries++;
+      }
+    });
+  }
+
+  // Don't start moving until every client is connected
+  while (n_started < N_CLIENTS) {
+    this_thread::sleep_for(1ms);
+  }
+
+  vector<Shard> shards = split_into(N_SERVERS);
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    ASSERT(test_move(sm, servers[i], {shards[i]}));
+    correct_config[servers[i]] = {shards[i]};
+  }
+
+  done = true;
+  for (thread& client : clients) {
+    client.join();
+  }
+  ASSERT(n_queries > 0UL);
+  ASSERT_EQ(n_failures.load(), 0UL);
+
+  // A fresh client sees the final config
+  optional<ShardControllerConfig> config = ShardKvClient(sm_addr).Query();
+  ASSERT(config);
+  ASSERT_EQ_CONFIGS(config->server_to_shards, correct_config);
+  ASSERT_EQ_CONFIGS(query_config(sm), correct_config);
+
+  cout_color(GREEN, "Test passed!");
+
+  sm->stop();
+
+  return 0;
+}
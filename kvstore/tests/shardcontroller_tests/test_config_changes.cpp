@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "net/network_messages.hpp"
+#include "shardcontroller/static_shardcontroller.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 200;
+
+int main() {
+  string sm_addr = get_host_address("8080");
+  // With backups, so that they change too
+  shared_ptr<Shardcontroller> sm =
+      start_server<StaticShardController, const string&, RebalancePolicy,
+                   ShardingMode, size_t>(sm_addr, {},
+                                         ShardingMode::LEXICOGRAPHIC, 2);
+  vector<string> servers = make_server_addresses(N_SERVERS);
+  vector<Shard> shards = split_into(N_SERVERS);
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    ASSERT(test_join(sm, servers[i]));
+    ASSERT(test_move(sm, servers[i], {shards[i]}));
+  }
+
+  // Brings `known` up to date with the changes since its version, and checks
+  // that it then matches the full config. Returns the changes, and how many
+  // bytes they and the full config take on the wire.
+  CompactConfig known;
+  size_t changes_size = 0, full_size = 0;
+  auto catch_up = [&] {
+    ConfigChangesRequest req{known.version};
+    ConfigChangesResponse res;
+    ASSERT(sm->ConfigChanges(&req, &res));
+    changes_size = serialize_response(res)->sz;
+    ASSERT(known.apply(res.changes));
+
+    QueryRequest query_req;
+    QueryResponse query_res;
+    ASSERT(sm->Query(&query_req, &query_res));
+    full_size = serialize_response(query_res)->sz;
+    ShardControllerConfig expanded = known.expand();
+    ASSERT_EQ(expanded.version, query_res.config.version);
+    ASSERT(expanded.mode == query_res.config.mode);
+    ASSERT(expanded.server_to_shards == query_res.config.server_to_shards);
+    ASSERT(expanded.shards_changed_at == query_res.config.shards_changed_at);
+    ASSERT(expanded.server_to_backups == query_res.config.server_to_backups);
+    ASSERT(expanded.shard_index);
+    return res.changes;
+  };
+
+  // A version the shardcontroller never published gets the whole config,
+  // which still takes less than the full config's encoding, as each address
+  // is only in it once
+  ASSERT(catch_up().full);
+  ASSERT(changes_size < full_size * 3 / 4);
+
+  // Nothing changed
+  ConfigDelta changes = catch_up();
+  ASSERT(!changes.full);
+  ASSERT(changes.added_ranges.empty() && changes.removed_ranges.empty());
+  ASSERT(changes_size < 64);
+
+  // A bucket moves, then a server leaves and another joins: only what
+  // changed is sent, however large the cluster
+  Shard bucket{shards[5].lower, shards[5].lower};
+  ASSERT(test_move(sm, servers[6], {bucket}));
+  changes = catch_up();
+  ASSERT(!changes.full);
+  ASSERT_EQ(changes.added_ranges.size(), 2ul);
+  ASSERT(changes_size < full_size / 20);
+
+  ASSERT(test_leave(sm, servers[10]));
+  string newcomer = get_host_address("10999");
+  ASSERT(test_join(sm, newcomer));
+  ASSERT(test_move(sm, newcomer, {shards[10]}));
+  changes = catch_up();
+  ASSERT(!changes.full);
+  ASSERT_EQ(changes.new_servers.size(), 1ul);
+  ASSERT_EQ(changes.new_servers[0].address, newcomer);
+  ASSERT_EQ_VECS(changes.left, vector<uint32_t>{10});
+  ASSERT(changes_size < full_size / 20);
+
+  // A server that left and comes back keeps its number
+  ASSERT(test_join(sm, servers[10]));
+  changes = catch_up();
+  ASSERT(changes.new_servers.empty());
+  ASSERT_EQ_VECS(changes.joined, vector<uint32_t>{10});
+
+  // Changes from an older version than the one held don't apply
+  CompactConfig stale = known;
+  ASSERT(test_move(sm, servers[7], {bucket}));
+  catch_up();
+  ASSERT(test_move(sm, servers[8], {bucket}));
+  catch_up();
+  ConfigChangesRequest req{stale.version};
+  ConfigChangesResponse res;
+  ASSERT(sm->ConfigChanges(&req, &res));
+  ASSERT(!known.apply(res.changes));
+  ASSERT(stale.apply(res.changes));
+  ASSERT(stale.expand().server_to_shards == known.expand().server_to_shards);
+
+  // Once enough versions were published since, the whole config is sent
+  stale = known;
+  for (size_t i = 0; i < CONFIG_HISTORY; i++) {
+    ASSERT(test_move(sm, servers[i % 2 ? 7 : 8], {bucket}));
+    catch_up();
+  }
+  req.since_version = stale.version;
+  ASSERT(sm->ConfigChanges(&req, &res));
+  ASSERT(res.changes.full);
+  ASSERT(stale.apply(res.changes));
+  ASSERT(stale.expand().server_to_shards == known.expand().server_to_shards);
+
+  // Once no version changes are worked out from refers to a server that
+  // left, its number goes to the next server to join, and isn't sent before
+  uint32_t departed = find(known.servers.begin(), known.servers.end(),
+                           servers[20]) - known.servers.begin();
+  size_t numbered = known.servers.size();
+  ASSERT(test_leave(sm, servers[20]));
+  for (size_t i = 0; i < CONFIG_HISTORY; i++) {
+    ASSERT(test_move(sm, servers[i % 2 ? 7 : 8], {bucket}));
+    catch_up();
+  }
+  req.since_version = 0;
+  ASSERT(sm->ConfigChanges(&req, &res));
+  ASSERT_EQ(res.changes.new_servers.size(), numbered - 1);
+  string latecomer = get_host_address("10998");
+  ASSERT(test_join(sm, latecomer));
+  changes = catch_up();
+  ASSERT(!changes.full);
+  ASSERT_EQ(changes.new_servers.size(), 1ul);
+  ASSERT_EQ(changes.new_servers[0].server, departed);
+  ASSERT_EQ(changes.new_servers[0].address, latecomer);
+  ASSERT_EQ(known.servers.size(), numbered);
+
+  cout_color(GREEN, "Test passed!");
+
+  sm->stop();
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "net/network_helpers.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 10000;
+constexpr size_t N_MOVES = 10000;
+constexpr size_t N_LEAVES = 1000;
+constexpr size_t N_LOOKUPS = 100000;
+
+int main() {
+  /*
+    This benchmark times the shardcontroller's config operations on a large
+    cluster: N_SERVERS joins, a shard moved onto each server, N_MOVES
+    single-bucket moves (as a fine-grained rebalancer would make), and
+    N_LEAVES leaves; then key lookups in the resulting config. Afterwards,
+    every bucket must still belong to exactly one server.
+  */
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+  vector<string> servers = make_server_addresses(N_SERVERS);
+  mt19937 rng(0);
+
+  auto time = [](auto&& f) {
+    auto start = chrono::high_resolution_clock::now();
+    f();
+    auto end = chrono::high_resolution_clock::now();
+    return chrono::duration_cast<chrono::milliseconds>(end - start);
+  };
+
+  auto join_time = time([&] {
+    for (auto&& server : servers) {
+      ASSERT(test_join(sm, server, true));
+    }
+  });
+
+  vector<Shard> shards = split_into(N_SERVERS);
+  auto assign_time = time([&] {
+    for (size_t i = 0; i < N_SERVERS; i++) {
+      ASSERT(test_move(sm, servers[i], {shards[i]}));
+    }
+  });
+
+  size_t granularity = shards.front().granularity();
+  size_t n_buckets = GRANULARITY_OPTS[granularity];
+  auto move_time = time([&] {
+    for (size_t i = 0; i < N_MOVES; i++) {
+      string bucket = bucket_to_str(rng() % n_buckets, granularity);
+      ASSERT(test_move(sm, servers[rng() % N_SERVERS], {{bucket, bucket}}));
+    }
+  });
+
+  auto leave_time = time([&] {
+    for (size_t i = 0; i < N_LEAVES; i++) {
+      ASSERT(test_leave(sm, servers[i * (N_SERVERS / N_LEAVES)], true));
+    }
+  });
+
+  QueryRequest req;
+  QueryResponse res;
+  ASSERT(sm->Query(&req, &res));
+  ShardControllerConfig config = res.config;
+  config.build_index();
+  ASSERT(config.shard_index);
+
+  // Every bucket is covered, and the (disjoint) shards cover nothing else
+  size_t n_covered = 0;
+  for (auto&& [shard, _] : *config.shard_index) {
+    n_covered += str_to_bucket(shard.upper) - str_to_bucket(shard.lower) + 1;
+  }
+  ASSERT_EQ(n_covered, n_buckets);
+
+  vector<string> keys = make_rand_strs(N_LOOKUPS, 6);
+  vector<optional<string>> owners(N_LOOKUPS);
+  auto lookup_time = time([&] {
+    for (size_t i = 0; i < N_LOOKUPS; i++) {
+      owners[i] = config.get_server(keys[i]);
+    }
+  });
+
+  // Lookups agree with scanning every server's shards
+  ShardControllerConfig unindexed = res.config;
+  for (size_t i = 0; i < N_LOOKUPS; i += 100) {
+    ASSERT(owners[i]);
+    ASSERT_EQ(*owners[i], *unindexed.get_server(keys[i]));
+  }
+
+  cout_color(BLUE, N_SERVERS, " joins: ", join_time.count(), "ms");
+  cout_color(BLUE, N_SERVERS, " shard assignments: ", assign_time.count(), "ms");
+  cout_color(BLUE, N_MOVES, " single-bucket moves: ", move_time.count(), "ms");
+  cout_color(BLUE, N_LEAVES, " leaves: ", leave_time.count(), "ms");
+  cout_color(BLUE, N_LOOKUPS, " get_server lookups: ", lookup_time.count(), "ms");
+
+  cout_color(GREEN, "Test passed!");
+
+  sm->stop();
+
+  return 0;
+}
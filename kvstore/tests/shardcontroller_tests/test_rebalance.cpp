@@ -0,0 +1,138 @@
+#include <map>
+#include <string>
+
+#include "common/shard.hpp"
+#include "net/network_helpers.hpp"
+#include "shardcontroller/static_shardcontroller.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+// Reports `n_requests` per second for each of `shards` on behalf of `server`.
+bool report(shared_ptr<StaticShardController> sm, const string& server,
+            const vector<pair<Shard, uint64_t>>& shards) {
+  ReportLoadRequest req{server, 1000, {}};
+  for (auto&& [shard, n_requests] : shards) {
+    req.loads.push_back(ShardLoad{shard, n_requests, 0});
+  }
+  ReportLoadResponse res;
+  return sm->ReportLoad(&req, &res);
+}
+
+int main() {
+  // The background rebalancer never fires on its own here; rounds are driven
+  // by calling Rebalance directly.
+  RebalancePolicy policy;
+  policy.enabled = true;
+  policy.interval = 1h;
+  policy.sustain_rounds = 2;
+  policy.cooldown = 300ms;
+
+  vector<string> servers = make_server_addresses(3);
+
+  // A single hot shard is split, and only part of it moves to the coldest
+  // server, once the overload has been sustained.
+  {
+    auto sm = start_server<StaticShardController, const string&,
+                           RebalancePolicy&>(get_host_address("8080"), policy);
+    vector<Shard> shards = split_into(3);
+    for (size_t i = 0; i < 3; i++) {
+      ASSERT(test_join(sm, servers[i]));
+      ASSERT(test_move(sm, servers[i], {shards[i]}));
+    }
+    // Reports from servers that aren't in the config are rejected
+    ASSERT(!report(sm, "nonexistent:123", {}));
+
+    ASSERT(report(sm, servers[0], {{shards[0], 900}}));
+    ASSERT(report(sm, servers[1], {{shards[1], 50}}));
+    ASSERT(report(sm, servers[2], {{shards[2], 50}}));
+
+    // First overloaded round: not sustained yet
+    ASSERT(!sm->Rebalance());
+    auto before = query_config(sm);
+    ASSERT_EQ_CONFIGS(before, (map<string, vector<Shard>>{
+                                  {servers[0], {shards[0]}},
+                                  {servers[1], {shards[1]}},
+                                  {servers[2], {shards[2]}}}));
+
+    // Second round: the gap is 850 req/s, so about 425 req/s should move. At
+    // 900 req/s spread over the shard's n buckets, that's its top 425 * n / 900
+    // buckets.
+    ASSERT(sm->Rebalance());
+    size_t lower = str_to_bucket(shards[0].lower);
+    size_t upper = str_to_bucket(shards[0].upper);
+    size_t n_move = 425 * (upper - lower + 1) / 900;
+    ASSERT(n_move >= 1);
+    Shard kept{shards[0].lower, bucket_to_str(upper - n_move, 1)};
+    Shard moved{bucket_to_str(upper - n_move + 1, 1), shards[0].upper};
+    ASSERT_EQ_CONFIGS(query_config(sm), (map<string, vector<Shard>>{
+                                            {servers[0], {kept}},
+                                            {servers[1], {moved, shards[1]}},
+                                            {servers[2], {shards[2]}}}));
+
+    // Both servers are cooling down, so an identical report does nothing
+    ASSERT(report(sm, servers[0], {{kept, 900}}));
+    ASSERT(!sm->Rebalance());
+    ASSERT(!sm->Rebalance());
+
+    sm->stop();
+  }
+
+  // A hot shard that's a single bucket gets split after refining the
+  // granularity of the whole configuration.
+  {
+    policy.sustain_rounds = 1;
+    auto sm = start_server<StaticShardController, const string&,
+                           RebalancePolicy&>(get_host_address("8081"), policy);
+    ASSERT(test_join(sm, servers[0]));
+    ASSERT(test_join(sm, servers[1]));
+    ASSERT(test_move(sm, servers[0], {{"0", "Y"}}));
+    ASSERT(test_move(sm, servers[1], {{"Z", "Z"}}));
+
+    // Small imbalances are ignored
+    ASSERT(report(sm, servers[1], {{{"Z", "Z"}, 5}}));
+    ASSERT(!sm->Rebalance());
+
+    // Moving 500 of [Z, Z]'s 1000 req/s means moving 18 of [Z0, ZZ]'s 36
+    // buckets
+    ASSERT(report(sm, servers[1], {{{"Z", "Z"}, 1000}}));
+    ASSERT(sm->Rebalance());
+    ASSERT_EQ_CONFIGS(query_config(sm),
+                      (map<string, vector<Shard>>{
+                          {servers[0], {{"00", "YZ"}, {"ZI", "ZZ"}}},
+                          {servers[1], {{"Z0", "ZH"}}}}));
+
+    // Reports about shards that no longer exist are ignored
+    this_thread::sleep_for(policy.cooldown);
+    ASSERT(report(sm, servers[1], {{{"Z", "Z"}, 1000}}));
+    ASSERT(!sm->Rebalance());
+
+    sm->stop();
+  }
+
+  // A leaving server's shards are spread over the least loaded servers,
+  // hottest first.
+  {
+    auto sm = start_server<StaticShardController, const string&,
+                           RebalancePolicy&>(get_host_address("8082"), policy);
+    for (auto&& server : servers) ASSERT(test_join(sm, server));
+    ASSERT(test_move(sm, servers[0], {{"0", "9"}}));
+    ASSERT(test_move(sm, servers[1], {{"A", "J"}}));
+    ASSERT(test_move(sm, servers[2], {{"K", "Q"}, {"R", "Z"}}));
+
+    ASSERT(report(sm, servers[0], {{{"0", "9"}, 200}}));
+    ASSERT(report(sm, servers[2], {{{"K", "Q"}, 300}, {{"R", "Z"}, 100}}));
+
+    ASSERT(test_leave(sm, servers[2]));
+    ASSERT_EQ_CONFIGS(query_config(sm),
+                      (map<string, vector<Shard>>{
+                          {servers[0], {{"0", "9"}, {"R", "Z"}}},
+                          {servers[1], {{"A", "J"}, {"K", "Q"}}}}));
+
+    sm->stop();
+  }
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include <map>
+#include <string>
+
+#include "common/shard.hpp"
+#include "net/network_helpers.hpp"
+#include "shardcontroller/static_shardcontroller.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+int main() {
+  RebalancePolicy policy;
+  policy.enabled = true;
+  policy.interval = 1h;
+  policy.sustain_rounds = 1;
+  policy.cooldown = 300ms;
+
+  vector<string> servers = make_server_addresses(2);
+
+  // A hot shard is split around the hot keys its server reports, rather than
+  // as if its requests spread evenly over its buckets.
+  {
+    auto sm = start_server<StaticShardController, const string&,
+                           RebalancePolicy&>(get_host_address("8080"), policy);
+    ASSERT(test_join(sm, servers[0]));
+    ASSERT(test_join(sm, servers[1]));
+    ASSERT(test_move(sm, servers[0], {{"0", "Y"}}));
+    ASSERT(test_move(sm, servers[1], {{"Z", "Z"}}));
+
+    // Of [Z, Z]'s 1000 req/s, 450 go to ZZTOP in bucket ZZ, and the other 550
+    // spread over [Z0, ZZ]'s 36 buckets. Moving about 500 req/s means moving
+    // ZZ and only 2 more buckets (ZZ alone plus 3 * 550 / 36 stays under 500),
+    // where evenly spread requests would have moved 18.
+    ReportLoadRequest req{servers[1], 1000, {{{"Z", "Z"}, 1000, 0}}};
+    req.stats = StatsResponse{1000, 1000, {{"ZZTOP", 450}}};
+    ReportLoadResponse res;
+    ASSERT(sm->ReportLoad(&req, &res));
+    ASSERT(sm->Rebalance());
+    ASSERT_EQ_CONFIGS(query_config(sm),
+                      (map<string, vector<Shard>>{
+                          {servers[0], {{"00", "YZ"}, {"ZX", "ZZ"}}},
+                          {servers[1], {{"Z0", "ZW"}}}}));
+
+    sm->stop();
+  }
+
+  // A shard whose requests all go to one key can't be split; the config is
+  // left as it was, so that moves at its granularity still work.
+  {
+    auto sm = start_server<StaticShardController, const string&,
+                           RebalancePolicy&>(get_host_address("8080"), policy);
+    ASSERT(test_join(sm, servers[0]));
+    ASSERT(test_join(sm, servers[1]));
+    ASSERT(test_move(sm, servers[0], {{"0", "Y"}}));
+    ASSERT(test_move(sm, servers[1], {{"Z", "Z"}}));
+
+    ReportLoadRequest req{servers[1], 1000, {{{"Z", "Z"}, 1000, 0}}};
+    req.stats = StatsResponse{1000, 1000, {{"ZZZZZZZZZZ", 1000}}};
+    ReportLoadResponse res;
+    ASSERT(sm->ReportLoad(&req, &res));
+    ASSERT(!sm->Rebalance());
+    ASSERT_EQ_CONFIGS(query_config(sm),
+                      (map<string, vector<Shard>>{{servers[0], {{"0", "Y"}}},
+                                                  {servers[1], {{"Z", "Z"}}}}));
+    ASSERT(test_move(sm, servers[0], {{"Z", "Z"}}));
+
+    sm->stop();
+  }
+  return 0;
+}
@@ -0,0 +1,128 @@
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client/async_client.hpp"
+#include "client/shardkv_client.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 2;
+constexpr size_t N_KEYS = 500;
+constexpr size_t N_COUNTERS = 4;
+constexpr size_t N_INCREMENTS = 50;
+
+// Increments a counter one request at a time, each after the last is done
+static Task<bool> count_up(AsyncClient& client, string counter) {
+  for (size_t i = 0; i < N_INCREMENTS; i++) {
+    if (!co_await client.Increment(counter)) co_return false;
+  }
+  co_return true;
+}
+
+int main() {
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  vector<string> server_addresses = make_server_addresses(N_SERVERS);
+  vector<Shard> shards = split_into(N_SERVERS);
+  vector<shared_ptr<KvServer>> servers;
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    // Enough workers for the async client's connections, and the synchronous
+    // client's besides
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 4));
+    ASSERT(test_move(sm, server_addresses[i], {shards[i]}));
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  ShardKvClient sync_client(sm_addr);
+  auto config = sync_client.Query();
+  ASSERT(config);
+  AsyncClient client(*config);
+
+  ASSERT(sync_wait(client.Put("key", "value")));
+  ASSERT_EQ(*sync_wait(client.Get("key")), string("value"));
+  ASSERT(!sync_wait(client.Get("missing")));
+  ASSERT(sync_wait(client.Append("key", "s")));
+  ASSERT_EQ(*sync_client.Get("key"), string("values"));
+
+  // Many requests in flight at once from this one thread, spread over both
+  // servers, are each matched with their own response
+  vector<Task<bool>> puts;
+  for (size_t i = 0; i < N_KEYS; i++) {
+    puts.push_back(client.Put("key_" + to_string(i), to_string(i)));
+  }
+  for (bool ok : sync_wait(when_all(std::move(puts)))) ASSERT(ok);
+  vector<Task<optional<string>>> gets;
+  for (size_t i = 0; i < N_KEYS; i++) {
+    gets.push_back(client.Get("key_" + to_string(i)));
+  }
+  vector<optional<string>> values = sync_wait(when_all(std::move(gets)));
+  for (size_t i = 0; i < N_KEYS; i++) {
+    ASSERT(values[i] == to_string(i));
+  }
+  ASSERT_EQ(*sync_client.Get("key_7"), string("7"));
+
+  // Coroutines interleave their requests without losing updates
+  vector<Task<bool>> counters;
+  for (size_t i = 0; i < N_COUNTERS; i++) {
+    counters.push_back(count_up(client, "counter_" + to_string(i % 2)));
+  }
+  for (bool ok : sync_wait(when_all(std::move(counters)))) ASSERT(ok);
+  ASSERT_EQ(*sync_client.Get("counter_0"),
+            to_string(N_INCREMENTS * N_COUNTERS / 2));
+  ASSERT_EQ(*sync_client.Get("counter_1"),
+            to_string(N_INCREMENTS * N_COUNTERS / 2));
+
+  // Keys on both servers, in one MultiGet/MultiPut
+  vector<string> keys, expected;
+  for (size_t i = 0; i < 20; i++) {
+    keys.push_back("multi_" + to_string(i));
+    expected.push_back(to_string(i * i));
+  }
+  ASSERT(sync_wait(client.MultiPut(keys, expected)));
+  auto multi = sync_wait(client.MultiGet(keys));
+  ASSERT(multi);
+  ASSERT_EQ_VECS(*multi, expected);
+  ASSERT_EQ_VECS(*sync_client.MultiGet(keys), expected);
+  ASSERT(!sync_wait(client.MultiGet({"multi_0", "missing"})));
+
+  // Conditional writes report whether their condition held
+  ASSERT(sync_wait(client.PutIfAbsent("lock", "a")) == true);
+  ASSERT(sync_wait(client.PutIfAbsent("lock", "b")) == false);
+  ASSERT(sync_wait(client.CompareAndSwap("lock", "b", "c")) == false);
+  ASSERT(sync_wait(client.CompareAndSwap("lock", "a", "c")) == true);
+  ASSERT(sync_wait(client.DeleteIfEquals("lock", "a")) == false);
+  ASSERT(sync_wait(client.DeleteIfEquals("lock", "c")) == true);
+  ASSERT(sync_wait(client.Increment("hits", 10)) == 10);
+  ASSERT(!sync_wait(client.Increment("key")));
+  ASSERT_EQ(*sync_wait(client.Delete("key")), string("values"));
+  ASSERT(!sync_client.Get("key"));
+
+  // A server that goes away fails the requests for its keys, rather than
+  // leaving them waiting
+  string lost_key;
+  for (size_t i = 0; lost_key.empty(); i++) {
+    if (config->get_server("key_" + to_string(i)) == server_addresses[1]) {
+      lost_key = "key_" + to_string(i);
+    }
+  }
+  servers[1]->stop();
+  ASSERT(!sync_wait(client.Get(lost_key)));
+
+  cout_color(GREEN, "Test passed!");
+
+  servers[0]->stop();
+  sm->stop();
+
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client/shardkv_client.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 3;
+constexpr size_t N_CLIENTS = 4;
+constexpr size_t N_ROUNDS = 25;
+constexpr size_t N_COUNTERS = 6;
+
+int main() {
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  vector<string> server_addresses = make_server_addresses(N_SERVERS);
+  vector<Shard> shards = split_into(N_SERVERS);
+  vector<shared_ptr<KvServer>> servers;
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 2));
+    ASSERT(test_move(sm, server_addresses[i], {shards[i]}));
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  ShardKvClient client(sm_addr);
+
+  // Conditional writes report whether their condition held
+  ASSERT(client.PutIfAbsent("lock", "a") == true);
+  ASSERT(client.PutIfAbsent("lock", "b") == false);
+  ASSERT(client.CompareAndSwap("lock", "b", "c") == false);
+  ASSERT(client.CompareAndSwap("lock", "a", "c") == true);
+  ASSERT_EQ(*client.Get("lock"), string("c"));
+  ASSERT(client.DeleteIfEquals("lock", "a") == false);
+  ASSERT(client.DeleteIfEquals("lock", "c") == true);
+  ASSERT(!client.Get("lock"));
+
+  ASSERT(client.Increment("hits", 10) == 10);
+  ASSERT(client.Decrement("hits") == 9);
+  ASSERT(client.Put("name", "value"));
+  ASSERT(!client.Increment("name"));
+
+  // Concurrent clients update counters spread across the servers without
+  // losing any updates
+  vector<string> counters =
+      make_rand_strs(N_COUNTERS, 5, "ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+  vector<thread> clients;
+  atomic<size_t> n_failures = 0;
+  for (size_t i = 0; i < N_CLIENTS; i++) {
+    clients.emplace_back([&] {
+      ShardKvClient client(sm_addr);
+      for (size_t round = 0; round < N_ROUNDS; round++) {
+        for (auto&& counter : counters) {
+          if (!client.Increment(counter, 2)) n_failures++;
+          if (!client.Decrement(counter)) n_failures++;
+        }
+      }
+    });
+  }
+  for (thread& client : clients) {
+    client.join();
+  }
+  ASSERT_EQ(n_failures.load(), 0UL);
+  for (auto&& counter : counters) {
+    ASSERT_EQ(*client.Get(counter), to_string(N_CLIENTS * N_ROUNDS));
+  }
+
+  cout_color(GREEN, "Test passed!");
+
+  for (auto&& server : servers) {
+    server->stop();
+  }
+  sm->stop();
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client/shardkv_client.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 3;
+constexpr size_t N_OTHER_KEYS = 300;
+
+int main() {
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  vector<string> server_addresses = make_server_addresses(N_SERVERS);
+  vector<Shard> shards = split_into(N_SERVERS);
+  vector<shared_ptr<KvServer>> servers;
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 2));
+    ASSERT(test_move(sm, server_addresses[i], {shards[i]}));
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  ShardKvClient client(sm_addr);
+
+  // A slice of gdpr/database.csv, laid out the same way
+  vector<pair<string, string>> data = {
+      {"user_1", "Congressperson Kirby"},
+      {"user_5", "Papa Razzi"},
+      {"user_7", "Tim Boe"},
+      {"user_14", "Kate Hill"},
+      {"user_15", "Frank Blimp"},
+      {"post_1", "Quarantine til July sounds like a bunch of bullshit."},
+      {"post_2", "I get it. I respect it."},
+      {"post_7", "Sarsra Breisand spotted at her cliff-top residence!"},
+      {"post_9", "see u in malibu sarsra!!! lmao"},
+      {"post_16", "@user_15 not shocked that you've missed yet another month"},
+      {"post_17", "Just wanted to address the claims levied by my ex-wife."},
+      {"post_1_replies", "post_2"},
+      {"post_7_replies", "post_9,post_10,post_11"},
+      {"all_users", "user_1,user_5,user_7,user_14,user_15"},
+      {"user_1_posts", "post_1,post_2"},
+      {"user_5_posts", "post_7"},
+      {"user_7_posts", "post_9"},
+      {"user_14_posts", "post_16"},
+      {"user_15_posts", "post_17"},
+  };
+  for (auto&& [key, value] : data) ASSERT(client.Put(key, value));
+  // Plenty of keys that don't mention anyone, which the purge never looks at
+  vector<string> others = make_rand_strs(N_OTHER_KEYS, 8);
+  for (auto&& key : others) ASSERT(client.Put(key, key));
+
+  // The user's records go, and mentions of them elsewhere are redacted
+  ASSERT(client.GDPRDelete("user_15"));
+  ASSERT(!client.Get("user_15"));
+  ASSERT(!client.Get("user_15_posts"));
+  ASSERT(!client.Get("post_17"));
+  ASSERT_EQ(*client.Get("post_16"),
+            string("@[deleted] not shocked that you've missed yet another month"));
+  ASSERT_EQ(*client.Get("all_users"), string("user_1,user_5,user_7,user_14"));
+
+  // Lists of their posts on other keys lose those posts
+  ASSERT(client.GDPRDelete("user_7"));
+  ASSERT(!client.Get("post_9"));
+  ASSERT_EQ(*client.Get("post_7_replies"), string("post_10,post_11"));
+  ASSERT_EQ(*client.Get("all_users"), string("user_1,user_5,user_14"));
+
+  // Replies to the user's posts are deleted with them
+  ASSERT(client.GDPRDelete("user_1"));
+  for (auto&& key : {"user_1", "user_1_posts", "post_1", "post_2",
+                     "post_1_replies"}) {
+    ASSERT(!client.Get(key));
+  }
+  ASSERT_EQ(*client.Get("all_users"), string("user_5,user_14"));
+
+  // Nobody else is touched
+  ASSERT_EQ(*client.Get("user_5"), string("Papa Razzi"));
+  ASSERT_EQ(*client.Get("post_7"),
+            string("Sarsra Breisand spotted at her cliff-top residence!"));
+  ASSERT_EQ(*client.Get("user_14_posts"), string("post_16"));
+  for (auto&& key : others) ASSERT_EQ(*client.Get(key), key);
+
+  // Deleting someone who isn't there (anymore) still succeeds
+  ASSERT(client.GDPRDelete("user_15"));
+  ASSERT(client.GDPRDelete("user_99"));
+
+  return 0;
+}
@@ -0,0 +1,94 @@
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "client/shardkv_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 2;
+static constexpr std::size_t kRandStringLength = 5;
+static constexpr std::size_t kNumKeyValPairs = 100;
+static constexpr std::size_t kNumMoves = 6;
+
+int main() {
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+  shared_ptr<ShardKvClient> client = make_shared<ShardKvClient>(sm_addr);
+
+  vector<string> server_addresses = make_server_addresses(N_SERVERS);
+  vector<Shard> shards = split_into(N_SERVERS);
+  vector<shared_ptr<KvServer>> servers;
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 4));
+    ASSERT(test_move(sm, server_addresses[i], vector<Shard>{shards[i]}));
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  vector<string> keys = make_rand_strs(
+      kNumKeyValPairs, kRandStringLength,
+      "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
+  vector<string> vals = make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  ASSERT(client->MultiPut(keys, vals));
+
+  // Keep reading and writing every key while the first shard moves back and
+  // forth between the servers. No request may fail or see a stale value.
+  atomic<bool> done = false;
+  atomic<size_t> n_failures = 0, n_ops = 0;
+  thread worker([&] {
+    for (size_t round = 0; !done; round++) {
+      for (size_t i = 0; i < kNumKeyValPairs && !done; i++) {
+        optional<string> val = client->Get(keys[i]);
+        if (!val || *val != vals[i]) n_failures++;
+        vals[i] = keys[i] + "_" + to_string(round);
+        if (!client->Put(keys[i], vals[i])) n_failures++;
+        n_ops += 2;
+      }
+    }
+  });
+
+  for (size_t i = 0; i < kNumMoves; i++) {
+    this_thread::sleep_for(300ms);
+    ASSERT(test_move(sm, server_addresses[(i + 1) % N_SERVERS],
+                     vector<Shard>{shards[0]}));
+  }
+  this_thread::sleep_for(300ms);
+  done = true;
+  worker.join();
+
+  ASSERT(n_ops > 0UL);
+  ASSERT_EQ(n_failures.load(), 0UL);
+
+  // Once the moves settle, every key lives only on its owner
+  this_thread::sleep_for(1000ms);
+  optional<ShardControllerConfig> config = client->Query();
+  ASSERT(config);
+  for (size_t i = 0; i < kNumKeyValPairs; i++) {
+    for (size_t j = 0; j < N_SERVERS; j++) {
+      auto pairs = servers[j]->all_kvpairs();
+      if (*config->get_server(keys[i]) == server_addresses[j]) {
+        ASSERT(pairs.contains(keys[i]));
+        ASSERT_EQ(pairs[keys[i]], vals[i]);
+      } else {
+        ASSERT(!pairs.contains(keys[i]));
+      }
+    }
+  }
+
+  for (shared_ptr<KvServer> server : servers) {
+    server->stop();
+  }
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
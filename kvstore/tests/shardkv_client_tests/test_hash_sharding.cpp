@@ -0,0 +1,95 @@
+#include <set>
+#include <string>
+
+#include "client/shardkv_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "shardcontroller/static_shardcontroller.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 4;
+static constexpr std::size_t kNumUsers = 200;
+
+int main() {
+  // Keys that share a prefix, like the ones in gdpr/database.csv
+  vector<string> keys, vals;
+  for (size_t i = 0; i < kNumUsers; i++) {
+    keys.push_back("user_" + to_string(i));
+    vals.push_back("name_" + to_string(i));
+  }
+
+  vector<string> server_addresses = make_server_addresses(N_SERVERS);
+  vector<Shard> shards = split_into(N_SERVERS);
+
+  // With lexicographic sharding, they all land on the same server...
+  ShardControllerConfig config;
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    config.server_to_shards[server_addresses[i]] = {shards[i]};
+  }
+  set<string> owners;
+  for (auto&& key : keys) owners.insert(*config.get_server(key));
+  ASSERT_EQ(owners.size(), 1UL);
+
+  // ... while hash sharding spreads them over every server. Positions are
+  // deterministic and always valid bucket strings.
+  config.mode = ShardingMode::HASH;
+  owners.clear();
+  for (auto&& key : keys) {
+    ASSERT_EQ(config.shard_key(key), config.shard_key(key));
+    ASSERT_EQ(config.shard_key(key).size(), size_t{MAX_GRANULARITY});
+    ASSERT(is_valid(config.shard_key(key)));
+    owners.insert(*config.get_server(key));
+  }
+  ASSERT_EQ(owners.size(), N_SERVERS);
+
+  // End to end: the mode travels with the config to servers and clients
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm =
+      start_server<StaticShardController, const string&, RebalancePolicy,
+                   ShardingMode>(sm_addr, {}, ShardingMode::HASH);
+  shared_ptr<ShardKvClient> client = make_shared<ShardKvClient>(sm_addr);
+
+  vector<shared_ptr<KvServer>> servers;
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 2));
+    ASSERT(test_move(sm, server_addresses[i], vector<Shard>{shards[i]}));
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  ASSERT(client->MultiPut(keys, vals));
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    ASSERT(servers[i]->get_config().mode == ShardingMode::HASH);
+    // Each server gets a fair share of the keys
+    ASSERT(servers[i]->all_kvpairs().size() > kNumUsers / N_SERVERS / 2);
+  }
+
+  // Moving a shard migrates exactly the keys that hash into it
+  ASSERT(test_move(sm, server_addresses[1], vector<Shard>{shards[0]}));
+  this_thread::sleep_for(1000ms);
+  ASSERT(servers[0]->all_kvpairs().empty());
+
+  optional<vector<string>> res = client->MultiGet(keys);
+  ASSERT(res);
+  ASSERT_EQ_VECS(*res, vals);
+  for (size_t i = 0; i < kNumUsers; i++) {
+    optional<string> val = client->Get(keys[i]);
+    ASSERT(val);
+    ASSERT_EQ(*val, vals[i]);
+  }
+
+  for (shared_ptr<KvServer> server : servers) {
+    server->stop();
+  }
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
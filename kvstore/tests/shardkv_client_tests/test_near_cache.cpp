@@ -0,0 +1,76 @@
+#include <string>
+#include <thread>
+
+#include "client/shardkv_client.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+int main() {
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  string server_address = make_server_addresses(1)[0];
+  auto server =
+      start_server<KvServer, const std::string&, const std::string&, uint64_t>(
+          server_address, sm_addr, 2);
+  ASSERT(test_move(sm, server_address, {split_into(1)[0]}));
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  ShardKvClient cached(sm_addr);
+  cached.set_near_cache(100);
+  ShardKvClient writer(sm_addr);
+
+  ASSERT(writer.Put("hot", "v1"));
+  ASSERT(writer.Put("other", "x"));
+
+  // A leased key is served from the cache, even after another client's write
+  ASSERT_EQ(*cached.Get("hot"), string("v1"));
+  ASSERT(writer.Put("hot", "v2"));
+  ASSERT_EQ(*cached.Get("hot"), string("v1"));
+
+  // until the next lease request to its server brings back the revocation
+  ASSERT_EQ(*cached.Get("other"), string("x"));
+  ASSERT_EQ(*cached.Get("hot"), string("v2"));
+
+  // The client's own writes are seen right away
+  ASSERT(cached.Put("hot", "v3"));
+  ASSERT_EQ(*cached.Get("hot"), string("v3"));
+  ASSERT(cached.Delete("other"));
+  ASSERT(!cached.Get("other"));
+
+  // Leases run out on their own
+  ASSERT(writer.Put("hot", "v4"));
+  ASSERT_EQ(*cached.Get("hot"), string("v3"));
+  this_thread::sleep_for(chrono::milliseconds(LEASE_MS + 100));
+  ASSERT_EQ(*cached.Get("hot"), string("v4"));
+
+  // and never outlive the key
+  ASSERT(writer.Put("short", "s", 200ms));
+  ASSERT_EQ(*cached.Get("short"), string("s"));
+  this_thread::sleep_for(300ms);
+  ASSERT(!cached.Get("short"));
+
+  // Only the most recently used keys stay cached
+  cached.set_near_cache(1);
+  ASSERT(writer.Put("a", "a1"));
+  ASSERT(writer.Put("b", "b1"));
+  ASSERT_EQ(*cached.Get("a"), string("a1"));
+  ASSERT_EQ(*cached.Get("b"), string("b1"));
+  ASSERT(writer.Put("a", "a2"));
+  ASSERT_EQ(*cached.Get("a"), string("a2"));
+
+  // Without a near cache, every Get goes to the server
+  cached.set_near_cache(0);
+  ASSERT(writer.Put("a", "a3"));
+  ASSERT_EQ(*cached.Get("a"), string("a3"));
+
+  server->stop();
+  sm->stop();
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include <fstream>
+#include <string>
+
+#include "client/shardkv_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 8;
+static constexpr std::size_t kRandStringLength = 6;
+static constexpr std::size_t kNumKeyValPairs = 400;
+static constexpr std::size_t kNumRounds = 10;
+
+int main() {
+  std::ofstream output_file("performance-runtime.csv", std::ios::app);
+  if (!output_file.is_open()) {
+    std::cerr << "Failed to open output file." << std::endl;
+  }
+
+  /*
+    This benchmark measures how much a MultiGet/MultiPut spanning every server
+    gains from contacting the servers concurrently. The same client runs the
+    same batches twice: once with at most one sub-request in flight (i.e. the
+    servers are contacted one after another), and once with one sub-request
+    per server in flight. Results must be identical either way.
+  */
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  shared_ptr<ShardKvClient> client = make_shared<ShardKvClient>(sm_addr);
+
+  vector<string> server_addresses = make_server_addresses(N_SERVERS);
+  vector<Shard> shards = split_into(N_SERVERS);
+  vector<shared_ptr<KvServer>> servers;
+
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    shared_ptr<KvServer> ptr =
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 2);
+    servers.push_back(ptr);
+    ASSERT(test_move(sm, server_addresses[i], vector<Shard>{shards[i]}));
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  // Keys are drawn from the whole key space, so every batch touches every
+  // server.
+  vector<string> keys = make_rand_strs(
+      kNumKeyValPairs, kRandStringLength,
+      "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
+  vector<string> vals = make_rand_strs(kNumKeyValPairs, kRandStringLength);
+
+  // Returns the {MultiPut, MultiGet} times with at most `max_parallel`
+  // sub-requests in flight.
+  auto run = [&](size_t max_parallel) {
+    client->set_max_parallel_requests(max_parallel);
+
+    auto start = chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < kNumRounds; i++) {
+      ASSERT(client->MultiPut(keys, vals));
+    }
+    auto end = chrono::high_resolution_clock::now();
+    auto put_time = chrono::duration_cast<chrono::milliseconds>(end - start);
+
+    start = chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < kNumRounds; i++) {
+      optional<vector<string>> res = client->MultiGet(keys);
+      ASSERT(res);
+      ASSERT_EQ_VECS(*res, vals);
+    }
+    end = chrono::high_resolution_clock::now();
+    auto get_time = chrono::duration_cast<chrono::milliseconds>(end - start);
+
+    return make_pair(put_time, get_time);
+  };
+
+  auto [seq_put, seq_get] = run(1);
+  auto [par_put, par_get] = run(N_SERVERS);
+
+  // Rows are written in (sequential, parallel) pairs for plot_performance.py
+  auto write_row = [&](const string& title, chrono::milliseconds time) {
+    output_file << title << "," << time.count() << ","
+                << to_throughput(time, kNumRounds, kNumKeyValPairs) << "\n";
+  };
+  write_row("sequential_fanout_multiput", seq_put);
+  write_row("parallel_fanout_multiput", par_put);
+  write_row("sequential_fanout_multiget", seq_get);
+  write_row("parallel_fanout_multiget", par_get);
+
+  for (shared_ptr<KvServer> server : servers) {
+    server->stop();
+  }
+
+  sm->stop();
+  output_file.close();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include <string>
+
+#include "client/shardkv_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "shardcontroller/static_shardcontroller.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 3;
+static constexpr std::size_t kRandStringLength = 5;
+static constexpr std::size_t kNumKeyValPairs = 100;
+
+int main() {
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm =
+      start_server<StaticShardController, const string&, RebalancePolicy,
+                   ShardingMode, size_t>(sm_addr, {},
+                                         ShardingMode::LEXICOGRAPHIC, 1);
+  shared_ptr<ShardKvClient> client = make_shared<ShardKvClient>(sm_addr);
+
+  vector<string> server_addresses = make_server_addresses(N_SERVERS);
+  vector<Shard> shards = split_into(N_SERVERS);
+  map<string, shared_ptr<KvServer>> servers;
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    servers[server_addresses[i]] =
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 2);
+    ASSERT(test_move(sm, server_addresses[i], vector<Shard>{shards[i]}));
+  }
+
+  // Each server is backed up by the next one, wrapping around
+  optional<ShardControllerConfig> config = client->Query();
+  ASSERT(config);
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    ASSERT_EQ_VECS(config->server_to_backups[server_addresses[i]],
+                   vector<string>{server_addresses[(i + 1) % N_SERVERS]});
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  vector<string> keys = make_rand_strs(
+      kNumKeyValPairs, kRandStringLength,
+      "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
+  vector<string> vals = make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  ASSERT(client->MultiPut(keys, vals));
+  ASSERT(client->Delete(keys[0]));
+  ASSERT(client->Append(keys[1], "_appended"));
+  vals[1] += "_appended";
+
+  // Writes reach every replica of the key's shard
+  this_thread::sleep_for(500ms);
+  for (size_t i = 0; i < kNumKeyValPairs; i++) {
+    for (auto&& replica : config->get_replicas(keys[i])) {
+      auto pairs = servers[replica]->all_kvpairs();
+      if (i == 0) {
+        ASSERT(!pairs.contains(keys[i]));
+      } else {
+        ASSERT(pairs.contains(keys[i]));
+        ASSERT_EQ(pairs[keys[i]], vals[i]);
+      }
+    }
+  }
+
+  // A backup only answers reads that allow for staleness
+  string backup = config->get_replicas(keys[1])[1];
+  ASSERT(!SimpleClient{backup}.Get(keys[1]));
+  optional<string> stale = SimpleClient{backup}.Get(keys[1], 1000ms);
+  ASSERT(stale);
+  ASSERT_EQ(*stale, vals[1]);
+
+  // With a read policy, Gets are spread over the replicas
+  client->set_read_policy(1000ms);
+  for (size_t i = 1; i < kNumKeyValPairs; i++) {
+    optional<string> val = client->Get(keys[i]);
+    ASSERT(val);
+    ASSERT_EQ(*val, vals[i]);
+  }
+  client->set_read_policy(0ms);
+
+  // When a server leaves, its backup takes over its shards with the data it
+  // already has
+  string leaving = server_addresses[0];
+  servers[leaving]->stop();
+  servers.erase(leaving);
+  this_thread::sleep_for(1000ms);
+
+  config = client->Query();
+  ASSERT(config);
+  ASSERT(!config->server_to_shards.contains(leaving));
+  ASSERT(config->get_server(keys[1]));
+  for (size_t i = 1; i < kNumKeyValPairs; i++) {
+    optional<string> val = client->Get(keys[i]);
+    ASSERT(val);
+    ASSERT_EQ(*val, vals[i]);
+  }
+
+  for (auto&& [_, server] : servers) {
+    server->stop();
+  }
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "client/shardkv_client.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+int main() {
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  string server_address = make_server_addresses(1)[0];
+  auto server =
+      start_server<KvServer, const std::string&, const std::string&, uint64_t>(
+          server_address, sm_addr, 2);
+  ASSERT(test_move(sm, server_address, {split_into(1)[0]}));
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  ShardKvClient client(sm_addr);
+
+  // A value spanning several chunks, with the last one partly filled
+  string value;
+  for (size_t i = 0; value.size() < 3 * STREAM_CHUNK_SIZE + 1000; i++) {
+    value += to_string(i) + ",";
+  }
+  istringstream in(value);
+  ASSERT(client.PutStream("big", in));
+  ASSERT_EQ(*client.Get("big"), value);
+
+  ostringstream out;
+  ASSERT(client.GetStream("big", out));
+  ASSERT_EQ(out.str(), value);
+
+  // Values of exactly a chunk, and empty ones
+  string chunk(STREAM_CHUNK_SIZE, 'c');
+  istringstream chunk_in(chunk);
+  ASSERT(client.PutStream("chunk", chunk_in));
+  ostringstream chunk_out;
+  ASSERT(client.GetStream("chunk", chunk_out));
+  ASSERT_EQ(chunk_out.str(), chunk);
+
+  istringstream empty_in("");
+  ASSERT(client.PutStream("empty", empty_in));
+  ostringstream empty_out;
+  ASSERT(client.GetStream("empty", empty_out));
+  ASSERT_EQ(empty_out.str(), string(""));
+
+  // Streamed values can be read back whole, and small ones streamed
+  ASSERT(client.Put("small", "value"));
+  ostringstream small_out;
+  ASSERT(client.GetStream("small", small_out));
+  ASSERT_EQ(small_out.str(), string("value"));
+
+  ostringstream missing_out;
+  ASSERT(!client.GetStream("missing", missing_out));
+
+  // The rest goes over a connection of its own, which has one of the server's
+  // workers to itself while it's open; the client's requests could end up
+  // queued behind it
+  auto conn = connect_to_server(server_address);
+  ASSERT(conn);
+
+  // Chunks out of order end the stream, without writing the key
+  ASSERT(conn->send_request(PutStreamRequest{"partial", 0, 0, "abc"}));
+  auto res = conn->recv_response();
+  ASSERT(res && holds_alternative<PutStreamResponse>(*res));
+  uint64_t id = get<PutStreamResponse>(*res).stream_id;
+  ASSERT(conn->send_request(PutStreamRequest{"partial", id, 5, "def", true}));
+  res = conn->recv_response();
+  ASSERT(res && holds_alternative<ErrorResponse>(*res));
+  ASSERT(conn->send_request(PutStreamRequest{"partial", id, 3, "def", true}));
+  res = conn->recv_response();
+  ASSERT(res && holds_alternative<ErrorResponse>(*res));
+  ASSERT(conn->send_request(GetRequest{"partial"}));
+  res = conn->recv_response();
+  ASSERT(res && holds_alternative<ErrorResponse>(*res));
+
+  // A stream claiming more than the server could hold only has room made for
+  // what it sends
+  PutStreamRequest oversized{"oversized", 0, 0, "abc", true};
+  oversized.total_size = uint64_t(1) << 60;
+  ASSERT(conn->send_request(oversized));
+  res = conn->recv_response();
+  ASSERT(res && holds_alternative<PutStreamResponse>(*res));
+  ASSERT(conn->send_request(GetRequest{"oversized"}));
+  res = conn->recv_response();
+  ASSERT(res && holds_alternative<GetResponse>(*res));
+  ASSERT_EQ(get<GetResponse>(*res).value, string("abc"));
+
+  // A key written while it's being read has a new version, so that the reader
+  // knows that the rest of the value belongs to another one
+  ASSERT(conn->send_request(GetStreamRequest{"big", 0, 10}));
+  res = conn->recv_response();
+  ASSERT(res && holds_alternative<GetStreamResponse>(*res));
+  uint64_t version = get<GetStreamResponse>(*res).version;
+  ASSERT(conn->send_request(PutRequest{"big", "new"}));
+  res = conn->recv_response();
+  ASSERT(res && holds_alternative<PutResponse>(*res));
+  ASSERT(conn->send_request(GetStreamRequest{"big", 0, 10}));
+  res = conn->recv_response();
+  ASSERT(res && holds_alternative<GetStreamResponse>(*res));
+  ASSERT(get<GetStreamResponse>(*res).version != version);
+  conn->close();
+
+  server->stop();
+  sm->stop();
+  return 0;
+}
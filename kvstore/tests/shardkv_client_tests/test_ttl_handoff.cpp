@@ -0,0 +1,87 @@
+#include <string>
+#include <thread>
+
+#include "client/shardkv_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "shardcontroller/static_shardcontroller.hpp"
+#include "test_utils/test_utils.hpp"
+
+// for simplicity
+using namespace std;
+
+constexpr size_t N_SERVERS = 2;
+static constexpr std::size_t kRandStringLength = 5;
+static constexpr std::size_t kNumKeyValPairs = 50;
+
+int main() {
+  string sm_addr = get_host_address("8080");
+  shared_ptr<Shardcontroller> sm =
+      start_server<StaticShardController, const string&, RebalancePolicy,
+                   ShardingMode, size_t>(sm_addr, {},
+                                         ShardingMode::LEXICOGRAPHIC, 1);
+  shared_ptr<ShardKvClient> client = make_shared<ShardKvClient>(sm_addr);
+
+  vector<string> server_addresses = make_server_addresses(N_SERVERS);
+  vector<shared_ptr<KvServer>> servers;
+  for (size_t i = 0; i < N_SERVERS; i++) {
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 4));
+  }
+  ASSERT(test_move(sm, server_addresses[0], split_into(1)));
+
+  // Sleep to allow the config to update before issuing requests
+  this_thread::sleep_for(500ms);
+
+  // Half of the keys expire, half don't
+  vector<string> keys = make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  vector<string> vals = make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  vector<string> expiring(keys.begin(), keys.begin() + kNumKeyValPairs / 2);
+  vector<string> persistent(keys.begin() + kNumKeyValPairs / 2, keys.end());
+  ASSERT(client->MultiPut(
+      expiring, vector<string>(vals.begin(), vals.begin() + kNumKeyValPairs / 2),
+      2000ms));
+  ASSERT(client->MultiPut(
+      persistent, vector<string>(vals.begin() + kNumKeyValPairs / 2, vals.end())));
+
+  // The keys keep their times to live when they're handed off to another
+  // server...
+  ASSERT(test_move(sm, server_addresses[1], split_into(1)));
+  this_thread::sleep_for(500ms);
+  for (size_t i = 0; i < kNumKeyValPairs; i++) {
+    optional<string> val = client->Get(keys[i]);
+    ASSERT(val);
+    ASSERT_EQ(*val, vals[i]);
+  }
+
+  // ...and backups (which may serve stale reads) expire them too
+  optional<ShardControllerConfig> config = client->Query();
+  ASSERT(config);
+  ASSERT(config->is_backup(server_addresses[1], server_addresses[0]));
+
+  this_thread::sleep_for(2000ms);
+  client->set_read_policy(10s);
+  for (auto&& key : expiring) {
+    ASSERT(!client->Get(key));
+    ASSERT(!SimpleClient{server_addresses[0]}.Get(key, 10s));
+  }
+  for (size_t i = kNumKeyValPairs / 2; i < kNumKeyValPairs; i++) {
+    optional<string> val = client->Get(keys[i]);
+    ASSERT(val);
+    ASSERT_EQ(*val, vals[i]);
+  }
+  for (auto&& server : servers) {
+    auto pairs = server->all_kvpairs();
+    for (auto&& key : expiring) ASSERT(!pairs.contains(key));
+  }
+
+  for (auto&& server : servers) {
+    server->stop();
+  }
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}